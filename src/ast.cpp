@@ -220,6 +220,14 @@ void Ast::FieldAccess::dump(std::ostream &os) const {
   os << ", " << field << ")";
 }
 
+void Ast::FieldAssignment::dump(std::ostream &os) const {
+  os << "FieldAssignment(";
+  object->dump(os);
+  os << ", " << field << ", ";
+  value->dump(os);
+  os << ")";
+}
+
 void Ast::AddressOf::dump(std::ostream &os) const {
   os << "AddressOf(";
   operand->dump(os);
@@ -453,6 +461,14 @@ void Ast::FieldAccess::to_string(std::ostream &os, int indent) const {
   os << "." << field;
 }
 
+void Ast::FieldAssignment::to_string(std::ostream &os, int indent) const {
+  os << indent_str(indent);
+  object->to_string(os, indent);
+  os << "." << field << " = ";
+  value->to_string(os, indent);
+  os << "\n";
+}
+
 void Ast::AddressOf::to_string(std::ostream &os, int indent) const {
   os << "&";
   operand->to_string(os, indent);
@@ -1,12 +1,15 @@
 #pragma once
 
 #include "derived_cast.h"
+#include "heap.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -43,6 +46,7 @@ struct Ast {
     IndexAssignment,
     StructLiteral,
     FieldAccess,
+    FieldAssignment,
     AddressOf,
     Dereference,
     Negate,
@@ -79,6 +83,7 @@ struct Ast {
   struct IndexAssignment;
   struct StructLiteral;
   struct FieldAccess;
+  struct FieldAssignment;
   struct AddressOf;
   struct Dereference;
   struct Negate;
@@ -442,6 +447,22 @@ struct Ast::FieldAccess final : public Ast {
   void to_string(std::ostream &os, int indent = 0) const override;
 };
 
+struct Ast::FieldAssignment final : public Ast {
+  std::unique_ptr<Ast> object;
+  std::string field;
+  std::unique_ptr<Ast> value;
+
+  FieldAssignment(std::unique_ptr<Ast> object, std::string field,
+                  std::unique_ptr<Ast> value)
+      : Ast(Type::FieldAssignment),
+        object(std::move(object)),
+        field(std::move(field)),
+        value(std::move(value)) {}
+
+  void dump(std::ostream &os) const override;
+  void to_string(std::ostream &os, int indent = 0) const override;
+};
+
 struct Ast::AddressOf final : public Ast {
   std::unique_ptr<Ast> operand;
 
@@ -581,11 +602,13 @@ struct AstInterpreter {
     const auto *function_declaration = it->second;
     assert(function_call.arguments.size() == function_declaration->parameters.size());
 
-    std::vector<Value> argument_values;
-    argument_values.reserve(function_call.arguments.size());
+    const size_t arguments_begin = temporaries.size();
     for (const auto &argument : function_call.arguments) {
-      argument_values.push_back(interpret(*argument));
+      temporaries.push_back(interpret(*argument));
     }
+    std::vector<Value> argument_values(temporaries.begin() + arguments_begin,
+                                       temporaries.end());
+    temporaries.resize(arguments_begin);
 
     const bool caller_return_active = return_active_;
     const Value caller_return_value = return_value_;
@@ -632,11 +655,13 @@ struct AstInterpreter {
   }
 
   Value interpret_equal(const Ast::Equal &equal) {
-    return interpret(*equal.left) == interpret(*equal.right);
+    const auto [left, right] = interpret_rooted_operands(*equal.left, *equal.right);
+    return left == right;
   }
 
   Value interpret_not_equal(const Ast::NotEqual &not_equal) {
-    return interpret(*not_equal.left) != interpret(*not_equal.right);
+    const auto [left, right] = interpret_rooted_operands(*not_equal.left, *not_equal.right);
+    return left != right;
   }
 
   Value interpret_logical_and(const Ast::LogicalAnd &logical_and) {
@@ -674,45 +699,74 @@ struct AstInterpreter {
   }
 
   Value interpret_array_literal(const Ast::ArrayLiteral &array_literal) {
-    const auto handle = next_heap_handle++;
-    auto &array = arrays[handle];
-    array.reserve(array_literal.elements.size());
+    const size_t elements_begin = temporaries.size();
     for (const auto &element : array_literal.elements) {
-      array.push_back(interpret(*element));
+      temporaries.push_back(interpret(*element));
     }
-    return handle;
+    if (heap.should_collect()) {
+      collect_garbage();
+    }
+    std::vector<Value> array(temporaries.begin() + elements_begin, temporaries.end());
+    temporaries.resize(elements_begin);
+    return heap.allocate_array(std::move(array));
   }
 
   Value interpret_index(const Ast::Index &index) {
-    const auto handle = interpret(*index.array);
+    temporaries.push_back(interpret(*index.array));
     const auto idx = interpret(*index.index);
-    const auto it = arrays.find(handle);
-    assert(it != arrays.end());
-    assert(idx < it->second.size());
-    return it->second[idx];
+    const auto handle = temporaries.back();
+    temporaries.pop_back();
+    return heap.load(handle, idx);
   }
 
   Value interpret_index_assignment(const Ast::IndexAssignment &index_assignment) {
-    const auto handle = interpret(*index_assignment.array);
-    const auto idx = interpret(*index_assignment.index);
+    temporaries.push_back(interpret(*index_assignment.array));
+    temporaries.push_back(interpret(*index_assignment.index));
     const auto value = interpret(*index_assignment.value);
-    const auto it = arrays.find(handle);
-    assert(it != arrays.end());
-    assert(idx < it->second.size());
-    it->second[idx] = value;
+    const auto idx = temporaries.back();
+    temporaries.pop_back();
+    const auto handle = temporaries.back();
+    temporaries.pop_back();
+    heap.store(handle, idx, value);
     return value;
   }
 
   Value interpret_struct_literal(const Ast::StructLiteral &struct_literal) {
-    const auto handle = next_heap_handle++;
-    auto &fields = structs[handle];
+    const size_t values_begin = temporaries.size();
     for (const auto &field : struct_literal.fields) {
-      fields[field.first] = interpret(*field.second);
+      temporaries.push_back(interpret(*field.second));
     }
-    return handle;
+    if (heap.should_collect()) {
+      collect_garbage();
+    }
+    const auto &layout = struct_literal_layout(struct_literal);
+    std::vector<Value> fields(heap.layouts().fields(layout.layout).size());
+    for (size_t i = 0; i < struct_literal.fields.size(); ++i) {
+      fields[layout.offsets[i]] = temporaries[values_begin + i];
+    }
+    temporaries.resize(values_begin);
+    return heap.allocate_struct(layout.layout, std::move(fields));
+  }
+
+  const StructLayouts::Interned &struct_literal_layout(const Ast::StructLiteral &struct_literal) {
+    auto it = struct_literal_layouts_.find(&struct_literal);
+    if (it == struct_literal_layouts_.end()) {
+      std::vector<std::string> names;
+      names.reserve(struct_literal.fields.size());
+      for (const auto &field : struct_literal.fields) {
+        names.push_back(field.first);
+      }
+      it = struct_literal_layouts_
+               .emplace(&struct_literal, heap.layouts().intern(names))
+               .first;
+    }
+    return it->second;
   }
 
   Value interpret_address_of(const Ast::AddressOf &address_of) {
+    if (pointers_.size() >= pointer_collection_threshold_) {
+      collect_garbage();
+    }
     if (address_of.operand->type == Ast::Type::Variable) {
       const auto &variable = derived_cast<const Ast::Variable &>(*address_of.operand);
       auto cell = find_variable_cell(variable.name);
@@ -750,11 +804,19 @@ struct AstInterpreter {
 
   Value interpret_field_access(const Ast::FieldAccess &field_access) {
     const auto handle = interpret(*field_access.object);
-    const auto struct_it = structs.find(handle);
-    assert(struct_it != structs.end());
-    const auto field_it = struct_it->second.find(field_access.field);
-    assert(field_it != struct_it->second.end());
-    return field_it->second;
+    const auto offset = heap.layouts().offset(heap.struct_layout(handle), field_access.field);
+    return heap.load_field(handle, offset);
+  }
+
+  Value interpret_field_assignment(const Ast::FieldAssignment &field_assignment) {
+    temporaries.push_back(interpret(*field_assignment.object));
+    const auto value = interpret(*field_assignment.value);
+    const auto handle = temporaries.back();
+    temporaries.pop_back();
+    const auto offset =
+        heap.layouts().offset(heap.struct_layout(handle), field_assignment.field);
+    heap.store_field(handle, offset, value);
+    return value;
   }
 
   Value interpret(const Ast &ast) {
@@ -818,6 +880,8 @@ struct AstInterpreter {
         return interpret_struct_literal(derived_cast<Ast::StructLiteral const &>(ast));
       case Ast::Type::FieldAccess:
         return interpret_field_access(derived_cast<Ast::FieldAccess const &>(ast));
+      case Ast::Type::FieldAssignment:
+        return interpret_field_assignment(derived_cast<Ast::FieldAssignment const &>(ast));
       case Ast::Type::AddressOf:
         return interpret_address_of(derived_cast<Ast::AddressOf const &>(ast));
       case Ast::Type::Dereference:
@@ -855,18 +919,57 @@ struct AstInterpreter {
     return nullptr;
   }
 
-  static constexpr Value k_pointer_tag = Value{1} << 63;
+  // Evaluates `left` then `right`, keeping the left value rooted while the
+  // right side runs, since it may allocate and trigger a collection.
+  std::pair<Value, Value> interpret_rooted_operands(const Ast &left, const Ast &right) {
+    temporaries.push_back(interpret(left));
+    const Value right_value = interpret(right);
+    const Value left_value = temporaries.back();
+    temporaries.pop_back();
+    return {left_value, right_value};
+  }
+
+  // Roots are the variable cells of every live scope plus the temporaries of
+  // expressions still being evaluated. Pointer cells are kept while some
+  // reachable value still holds their handle.
+  void collect_garbage() {
+    for (const auto &scope : scopes) {
+      for (const auto &variable : scope) {
+        heap.mark(*variable.second);
+      }
+    }
+    for (const auto value : temporaries) {
+      heap.mark(value);
+    }
+    std::unordered_set<Value> live_pointers;
+    heap.collect([&](Value handle) {
+      const auto it = pointers_.find(handle);
+      if (it != pointers_.end() && live_pointers.insert(handle).second) {
+        heap.mark(*it->second);
+      }
+    });
+    std::erase_if(pointers_, [&live_pointers](const auto &entry) {
+      return !live_pointers.contains(entry.first);
+    });
+    pointer_collection_threshold_ =
+        std::max(Heap::k_min_collection_threshold, 2 * pointers_.size());
+  }
+
   static Value pointer_handle(Value id) {
-    return k_pointer_tag | id;
+    return Heap::k_pointer_tag | id;
   }
 
   std::vector<std::unordered_map<std::string, std::shared_ptr<Value>>> scopes;
   std::unordered_map<std::string, const Ast::FunctionDeclaration *> functions;
-  std::unordered_map<Value, std::vector<Value>> arrays;
-  std::unordered_map<Value, std::unordered_map<std::string, Value>> structs;
+  Heap heap;
+  // Values held by partially evaluated expressions; collector roots.
+  std::vector<Value> temporaries;
   std::unordered_map<Value, std::shared_ptr<Value>> pointers_;
-  Value next_heap_handle = 1;
+  // Layout and field offsets of each struct literal, interned on first use.
+  std::unordered_map<const Ast::StructLiteral *, StructLayouts::Interned>
+      struct_literal_layouts_;
   Value next_pointer_handle_ = 1;
+  size_t pointer_collection_threshold_ = Heap::k_min_collection_threshold;
   bool return_active_ = false;
   Value return_value_ = 0;
 };
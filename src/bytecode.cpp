@@ -1,388 +1,178 @@
 #include "bytecode.h"
+#include "bytecode_operands.h"
+#include "jit.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cinttypes>
 #include <cstdio>
+#include <iomanip>
+#include <limits>
 #include <optional>
+#include <ostream>
+
+// The interpreter dispatches through a switch. Build with
+// -DKAI_THREADED_DISPATCH=1 to use direct threading instead, which needs the
+// labels-as-values extension. It is off by default because it has not
+// measured reliably faster: at -O2 GCC merges most of the handlers' indirect
+// jumps back into one shared jump, and 'make bench' times both loops.
+#ifndef KAI_THREADED_DISPATCH
+#define KAI_THREADED_DISPATCH 0
+#endif
+#if KAI_THREADED_DISPATCH && !defined(__GNUC__) && !defined(__clang__)
+#error "KAI_THREADED_DISPATCH needs the labels-as-values extension"
+#endif
 
 namespace kai {
 
 
 namespace {
-constexpr Bytecode::Value k_pointer_tag = Bytecode::Value{1} << 63;
+constexpr Bytecode::Value k_pointer_tag = Heap::k_pointer_tag;
+// Marks a pointer cell whose id is on the free list, and one holding its
+// pointee's value after the frame went away.
+constexpr size_t k_free_pointer = static_cast<size_t>(-1);
+constexpr size_t k_closed_pointer = static_cast<size_t>(-2);
 
 Bytecode::Value pointer_handle(Bytecode::Value id) {
   return k_pointer_tag | id;
 }
 
-void initialize_frame_slots(
-    std::vector<std::shared_ptr<Bytecode::Value>> &register_stack,
-    size_t frame_base,
-    size_t register_count) {
+Bytecode::Value pointer_id(Bytecode::Value handle) {
+  return handle & ~k_pointer_tag;
+}
+
+u32 to_operand(u64 value) {
+  assert(value <= std::numeric_limits<u32>::max());
+  return static_cast<u32>(value);
+}
+
+void initialize_frame_slots(std::vector<Bytecode::Value> &register_stack,
+                            size_t frame_base,
+                            size_t register_count) {
   const size_t needed = frame_base + register_count;
   if (needed > register_stack.size()) {
     register_stack.resize(needed);
   }
-  for (size_t i = 0; i < register_count; ++i) {
-    register_stack[frame_base + i] = std::make_shared<Bytecode::Value>(0);
-  }
+  std::fill_n(register_stack.begin() + static_cast<std::ptrdiff_t>(frame_base),
+              register_count, Bytecode::Value{0});
 }
 
 bool has_terminator(const Bytecode::BasicBlock &block) {
-  if (block.instructions.empty()) {
-    return false;
-  }
-  const auto last_type = block.instructions.back()->type();
-  return last_type == Bytecode::Instruction::Type::Jump ||
-         last_type == Bytecode::Instruction::Type::JumpConditional ||
-         last_type == Bytecode::Instruction::Type::JumpEqualImmediate ||
-         last_type == Bytecode::Instruction::Type::JumpGreaterThanImmediate ||
-         last_type == Bytecode::Instruction::Type::JumpLessThanOrEqual ||
-         last_type == Bytecode::Instruction::Type::TailCall ||
-         last_type == Bytecode::Instruction::Type::Return;
-}
-
-size_t register_count(const std::vector<Bytecode::BasicBlock> &blocks) {
-  size_t count = 0;
-  const auto track = [&count](Bytecode::Register reg) {
-    const size_t needed = static_cast<size_t>(reg) + 1;
-    if (needed > count) {
-      count = needed;
+  return !block.instructions.empty() &&
+         has_opcode_flag(block.instructions.back()->type(), k_terminator);
+}
+
+// Invokes `track` on every register `instr` reads or writes in the frame it
+// executes in. A call's parameter registers live in the callee's frame and are
+// not reported; a tail call's are, because the callee reuses the caller's frame.
+template <typename Track>
+void for_each_frame_register(const Bytecode::Instruction &instr, Track &&track) {
+  struct Visitor : OperandVisitor {
+    Track &track;
+    void use(const Bytecode::Register &reg) { track(reg); }
+    void def(const Bytecode::Register &reg) { track(reg); }
+    void parameters(const std::vector<Bytecode::Register> &registers, bool in_own_frame) {
+      if (in_own_frame) {
+        for (const auto reg : registers) {
+          track(reg);
+        }
+      }
     }
   };
+  visit_operands(instr, Visitor{{}, track});
+}
 
-  for (const auto &block : blocks) {
-    for (const auto &instr : block.instructions) {
-      switch (instr->type()) {
-        case Bytecode::Instruction::Type::Move: {
-          const auto &move =
-              derived_cast<const Bytecode::Instruction::Move &>(*instr);
-          track(move.dst);
-          track(move.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::Load: {
-          const auto &load =
-              derived_cast<const Bytecode::Instruction::Load &>(*instr);
-          track(load.dst);
-          break;
-        }
-        case Bytecode::Instruction::Type::LessThan: {
-          const auto &less_than =
-              derived_cast<const Bytecode::Instruction::LessThan &>(*instr);
-          track(less_than.dst);
-          track(less_than.lhs);
-          track(less_than.rhs);
-          break;
-        }
-        case Bytecode::Instruction::Type::LessThanImmediate: {
-          const auto &less_than_imm =
-              derived_cast<const Bytecode::Instruction::LessThanImmediate &>(*instr);
-          track(less_than_imm.dst);
-          track(less_than_imm.lhs);
-          break;
-        }
-        case Bytecode::Instruction::Type::GreaterThan: {
-          const auto &greater_than =
-              derived_cast<const Bytecode::Instruction::GreaterThan &>(*instr);
-          track(greater_than.dst);
-          track(greater_than.lhs);
-          track(greater_than.rhs);
-          break;
-        }
-        case Bytecode::Instruction::Type::GreaterThanImmediate: {
-          const auto &greater_than_imm =
-              derived_cast<const Bytecode::Instruction::GreaterThanImmediate &>(*instr);
-          track(greater_than_imm.dst);
-          track(greater_than_imm.lhs);
-          break;
-        }
-        case Bytecode::Instruction::Type::LessThanOrEqual: {
-          const auto &less_than_or_equal =
-              derived_cast<const Bytecode::Instruction::LessThanOrEqual &>(*instr);
-          track(less_than_or_equal.dst);
-          track(less_than_or_equal.lhs);
-          track(less_than_or_equal.rhs);
-          break;
-        }
-        case Bytecode::Instruction::Type::LessThanOrEqualImmediate: {
-          const auto &less_than_or_equal_imm =
-              derived_cast<const Bytecode::Instruction::LessThanOrEqualImmediate &>(*instr);
-          track(less_than_or_equal_imm.dst);
-          track(less_than_or_equal_imm.lhs);
-          break;
-        }
-        case Bytecode::Instruction::Type::GreaterThanOrEqual: {
-          const auto &greater_than_or_equal = derived_cast<
-              const Bytecode::Instruction::GreaterThanOrEqual &>(*instr);
-          track(greater_than_or_equal.dst);
-          track(greater_than_or_equal.lhs);
-          track(greater_than_or_equal.rhs);
-          break;
-        }
-        case Bytecode::Instruction::Type::GreaterThanOrEqualImmediate: {
-          const auto &greater_than_or_equal_imm =
-              derived_cast<const Bytecode::Instruction::GreaterThanOrEqualImmediate &>(
-                  *instr);
-          track(greater_than_or_equal_imm.dst);
-          track(greater_than_or_equal_imm.lhs);
-          break;
-        }
-        case Bytecode::Instruction::Type::Jump:
-          break;
-        case Bytecode::Instruction::Type::JumpConditional: {
-          const auto &jump_cond =
-              derived_cast<const Bytecode::Instruction::JumpConditional &>(*instr);
-          track(jump_cond.cond);
-          break;
-        }
-        case Bytecode::Instruction::Type::JumpEqualImmediate: {
-          const auto &jump_equal_imm =
-              derived_cast<const Bytecode::Instruction::JumpEqualImmediate &>(*instr);
-          track(jump_equal_imm.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::JumpGreaterThanImmediate: {
-          const auto &jump_greater_than_imm =
-              derived_cast<const Bytecode::Instruction::JumpGreaterThanImmediate &>(*instr);
-          track(jump_greater_than_imm.lhs);
-          break;
-        }
-        case Bytecode::Instruction::Type::JumpLessThanOrEqual: {
-          const auto &jump_less_than_or_equal =
-              derived_cast<const Bytecode::Instruction::JumpLessThanOrEqual &>(*instr);
-          track(jump_less_than_or_equal.lhs);
-          track(jump_less_than_or_equal.rhs);
-          break;
-        }
-        case Bytecode::Instruction::Type::Call: {
-          const auto &call =
-              derived_cast<const Bytecode::Instruction::Call &>(*instr);
-          track(call.dst);
-          for (const auto reg : call.arg_registers) {
-            track(reg);
-          }
-          for (const auto reg : call.param_registers) {
-            track(reg);
-          }
-          break;
-        }
-        case Bytecode::Instruction::Type::TailCall: {
-          const auto &tail_call =
-              derived_cast<const Bytecode::Instruction::TailCall &>(*instr);
-          for (const auto reg : tail_call.arg_registers) {
-            track(reg);
-          }
-          for (const auto reg : tail_call.param_registers) {
-            track(reg);
-          }
-          break;
-        }
-        case Bytecode::Instruction::Type::Return: {
-          const auto &ret =
-              derived_cast<const Bytecode::Instruction::Return &>(*instr);
-          track(ret.reg);
-          break;
-        }
-        case Bytecode::Instruction::Type::Equal: {
-          const auto &equal =
-              derived_cast<const Bytecode::Instruction::Equal &>(*instr);
-          track(equal.dst);
-          track(equal.src1);
-          track(equal.src2);
-          break;
-        }
-        case Bytecode::Instruction::Type::EqualImmediate: {
-          const auto &equal_imm =
-              derived_cast<const Bytecode::Instruction::EqualImmediate &>(*instr);
-          track(equal_imm.dst);
-          track(equal_imm.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::NotEqual: {
-          const auto &not_equal =
-              derived_cast<const Bytecode::Instruction::NotEqual &>(*instr);
-          track(not_equal.dst);
-          track(not_equal.src1);
-          track(not_equal.src2);
-          break;
-        }
-        case Bytecode::Instruction::Type::NotEqualImmediate: {
-          const auto &not_equal_imm =
-              derived_cast<const Bytecode::Instruction::NotEqualImmediate &>(*instr);
-          track(not_equal_imm.dst);
-          track(not_equal_imm.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::Add: {
-          const auto &add =
-              derived_cast<const Bytecode::Instruction::Add &>(*instr);
-          track(add.dst);
-          track(add.src1);
-          track(add.src2);
-          break;
-        }
-        case Bytecode::Instruction::Type::AddImmediate: {
-          const auto &add_imm =
-              derived_cast<const Bytecode::Instruction::AddImmediate &>(*instr);
-          track(add_imm.dst);
-          track(add_imm.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::Subtract: {
-          const auto &subtract =
-              derived_cast<const Bytecode::Instruction::Subtract &>(*instr);
-          track(subtract.dst);
-          track(subtract.src1);
-          track(subtract.src2);
-          break;
-        }
-        case Bytecode::Instruction::Type::SubtractImmediate: {
-          const auto &subtract_imm =
-              derived_cast<const Bytecode::Instruction::SubtractImmediate &>(*instr);
-          track(subtract_imm.dst);
-          track(subtract_imm.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::Multiply: {
-          const auto &multiply =
-              derived_cast<const Bytecode::Instruction::Multiply &>(*instr);
-          track(multiply.dst);
-          track(multiply.src1);
-          track(multiply.src2);
-          break;
-        }
-        case Bytecode::Instruction::Type::MultiplyImmediate: {
-          const auto &multiply_imm =
-              derived_cast<const Bytecode::Instruction::MultiplyImmediate &>(*instr);
-          track(multiply_imm.dst);
-          track(multiply_imm.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::Divide: {
-          const auto &divide =
-              derived_cast<const Bytecode::Instruction::Divide &>(*instr);
-          track(divide.dst);
-          track(divide.src1);
-          track(divide.src2);
-          break;
-        }
-        case Bytecode::Instruction::Type::DivideImmediate: {
-          const auto &divide_imm =
-              derived_cast<const Bytecode::Instruction::DivideImmediate &>(*instr);
-          track(divide_imm.dst);
-          track(divide_imm.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::Modulo: {
-          const auto &modulo =
-              derived_cast<const Bytecode::Instruction::Modulo &>(*instr);
-          track(modulo.dst);
-          track(modulo.src1);
-          track(modulo.src2);
-          break;
-        }
-        case Bytecode::Instruction::Type::ModuloImmediate: {
-          const auto &modulo_imm =
-              derived_cast<const Bytecode::Instruction::ModuloImmediate &>(*instr);
-          track(modulo_imm.dst);
-          track(modulo_imm.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::ArrayCreate: {
-          const auto &array_create =
-              derived_cast<const Bytecode::Instruction::ArrayCreate &>(*instr);
-          track(array_create.dst);
-          for (const auto reg : array_create.elements) {
-            track(reg);
-          }
-          break;
-        }
-        case Bytecode::Instruction::Type::ArrayLiteralCreate: {
-          const auto &array_literal_create =
-              derived_cast<const Bytecode::Instruction::ArrayLiteralCreate &>(*instr);
-          track(array_literal_create.dst);
-          break;
-        }
-        case Bytecode::Instruction::Type::ArrayLoad: {
-          const auto &array_load =
-              derived_cast<const Bytecode::Instruction::ArrayLoad &>(*instr);
-          track(array_load.dst);
-          track(array_load.array);
-          track(array_load.index);
-          break;
-        }
-        case Bytecode::Instruction::Type::ArrayLoadImmediate: {
-          const auto &array_load_immediate =
-              derived_cast<const Bytecode::Instruction::ArrayLoadImmediate &>(*instr);
-          track(array_load_immediate.dst);
-          track(array_load_immediate.array);
-          break;
-        }
-        case Bytecode::Instruction::Type::ArrayStore: {
-          const auto &array_store =
-              derived_cast<const Bytecode::Instruction::ArrayStore &>(*instr);
-          track(array_store.array);
-          track(array_store.index);
-          track(array_store.value);
-          break;
-        }
-        case Bytecode::Instruction::Type::StructCreate: {
-          const auto &struct_create =
-              derived_cast<const Bytecode::Instruction::StructCreate &>(*instr);
-          track(struct_create.dst);
-          for (const auto &field : struct_create.fields) {
-            track(field.second);
-          }
-          break;
-        }
-        case Bytecode::Instruction::Type::StructLiteralCreate: {
-          const auto &struct_literal_create =
-              derived_cast<const Bytecode::Instruction::StructLiteralCreate &>(*instr);
-          track(struct_literal_create.dst);
-          break;
-        }
-        case Bytecode::Instruction::Type::StructLoad: {
-          const auto &struct_load =
-              derived_cast<const Bytecode::Instruction::StructLoad &>(*instr);
-          track(struct_load.dst);
-          track(struct_load.object);
-          break;
-        }
-        case Bytecode::Instruction::Type::AddressOf: {
-          const auto &address_of =
-              derived_cast<const Bytecode::Instruction::AddressOf &>(*instr);
-          track(address_of.dst);
-          track(address_of.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::LoadIndirect: {
-          const auto &load_indirect =
-              derived_cast<const Bytecode::Instruction::LoadIndirect &>(*instr);
-          track(load_indirect.dst);
-          track(load_indirect.pointer);
-          break;
-        }
-        case Bytecode::Instruction::Type::Negate: {
-          const auto &negate =
-              derived_cast<const Bytecode::Instruction::Negate &>(*instr);
-          track(negate.dst);
-          track(negate.src);
-          break;
-        }
-        case Bytecode::Instruction::Type::LogicalNot: {
-          const auto &logical_not =
-              derived_cast<const Bytecode::Instruction::LogicalNot &>(*instr);
-          track(logical_not.dst);
-          track(logical_not.src);
-          break;
+template <typename Visit>
+void for_each_successor(const Bytecode::Instruction &instr, Visit &&visit) {
+  struct Visitor : OperandVisitor {
+    Visit &visit;
+    void jump(const Bytecode::Label &label) { visit(label); }
+  };
+  visit_operands(instr, Visitor{{}, visit});
+}
+
+struct CallEdge {
+  size_t callee;
+  bool pushes_frame;
+};
+
+// Longest chain of pushed frames below each function of the call graph.
+// Strongly connected components are collapsed first: a component linked by a
+// pushing call recurses without bound, while one linked only by tail calls
+// runs in a single frame.
+std::vector<size_t> max_call_depths(const std::vector<std::vector<CallEdge>> &callees) {
+  constexpr size_t k_unvisited = static_cast<size_t>(-1);
+  constexpr size_t k_unbounded = Bytecode::Function::k_unbounded_call_depth;
+  const size_t count = callees.size();
+  std::vector<size_t> index(count, k_unvisited);
+  std::vector<size_t> lowlink(count, 0);
+  std::vector<size_t> component(count, k_unvisited);
+  std::vector<bool> on_stack(count, false);
+  std::vector<size_t> stack;
+  std::vector<size_t> component_depth;
+  size_t next_index = 0;
+
+  // Tarjan emits components callees-first, so every edge leaving a component
+  // points at one whose depth is already known.
+  const auto finish_component = [&](size_t root) {
+    const size_t id = component_depth.size();
+    std::vector<size_t> members;
+    size_t member = 0;
+    do {
+      member = stack.back();
+      stack.pop_back();
+      on_stack[member] = false;
+      component[member] = id;
+      members.push_back(member);
+    } while (member != root);
+
+    size_t depth = 0;
+    for (const auto function : members) {
+      for (const auto &edge : callees[function]) {
+        size_t through_edge = 0;
+        if (component[edge.callee] == id) {
+          through_edge = edge.pushes_frame ? k_unbounded : 0;
+        } else if (component_depth[component[edge.callee]] == k_unbounded) {
+          through_edge = k_unbounded;
+        } else {
+          through_edge = component_depth[component[edge.callee]] + edge.pushes_frame;
         }
-        default:
-          assert(false);
-          break;
+        depth = std::max(depth, through_edge);
+      }
+    }
+    component_depth.push_back(depth);
+  };
+
+  const auto connect = [&](auto &self, size_t function) -> void {
+    index[function] = next_index;
+    lowlink[function] = next_index;
+    ++next_index;
+    stack.push_back(function);
+    on_stack[function] = true;
+    for (const auto &edge : callees[function]) {
+      if (index[edge.callee] == k_unvisited) {
+        self(self, edge.callee);
+        lowlink[function] = std::min(lowlink[function], lowlink[edge.callee]);
+      } else if (on_stack[edge.callee]) {
+        lowlink[function] = std::min(lowlink[function], index[edge.callee]);
       }
     }
+    if (lowlink[function] == index[function]) {
+      finish_component(function);
+    }
+  };
+
+  for (size_t function = 0; function < count; ++function) {
+    if (index[function] == k_unvisited) {
+      connect(connect, function);
+    }
+  }
+
+  std::vector<size_t> depths(count, 0);
+  for (size_t function = 0; function < count; ++function) {
+    depths[function] = component_depth[component[function]];
   }
-  return count;
+  return depths;
 }
 
 std::optional<Bytecode::Value> literal_value(const Ast &ast) {
@@ -391,8 +181,97 @@ std::optional<Bytecode::Value> literal_value(const Ast &ast) {
   }
   return derived_cast<const Ast::Literal &>(ast).value;
 }
+
 }  // namespace
 
+std::vector<Bytecode::Function> build_function_table(
+    const std::vector<Bytecode::BasicBlock> &blocks) {
+  std::vector<Bytecode::Function> functions;
+  std::vector<bool> is_entry(blocks.size(), false);
+  const auto add_function = [&](Bytecode::Label entry,
+                                const std::vector<Bytecode::Register> &parameters) {
+    assert(entry < blocks.size());
+    if (is_entry[entry]) {
+      return;
+    }
+    is_entry[entry] = true;
+    functions.push_back({entry, parameters.size(), parameters, 0, {}, 0});
+  };
+
+  if (blocks.empty()) {
+    return functions;
+  }
+  add_function(0, {});
+  for (const auto &block : blocks) {
+    for (const auto &instr : block.instructions) {
+      if (instr->type() == Bytecode::Instruction::Type::Call) {
+        const auto &call = derived_cast<const Bytecode::Instruction::Call &>(*instr);
+        add_function(call.label, call.param_registers);
+      } else if (instr->type() == Bytecode::Instruction::Type::TailCall) {
+        const auto &tail_call =
+            derived_cast<const Bytecode::Instruction::TailCall &>(*instr);
+        add_function(tail_call.label, tail_call.param_registers);
+      }
+    }
+  }
+  std::sort(functions.begin(), functions.end(),
+            [](const auto &a, const auto &b) { return a.entry < b.entry; });
+
+  std::unordered_map<Bytecode::Label, size_t> function_index;
+  for (size_t i = 0; i < functions.size(); ++i) {
+    function_index[functions[i].entry] = i;
+  }
+
+  std::vector<std::vector<CallEdge>> callees(functions.size());
+  std::vector<bool> visited(blocks.size());
+  std::vector<Bytecode::Label> worklist;
+  for (size_t i = 0; i < functions.size(); ++i) {
+    auto &function = functions[i];
+    size_t frame_size = 0;
+    const auto track = [&frame_size](Bytecode::Register reg) {
+      frame_size = std::max(frame_size, static_cast<size_t>(reg) + 1);
+    };
+    for (const auto reg : function.parameter_registers) {
+      track(reg);
+    }
+
+    std::fill(visited.begin(), visited.end(), false);
+    visited[function.entry] = true;
+    worklist.assign(1, function.entry);
+    while (!worklist.empty()) {
+      const auto label = worklist.back();
+      worklist.pop_back();
+      function.blocks.push_back(label);
+      for (const auto &instr : blocks[label].instructions) {
+        for_each_frame_register(*instr, track);
+        for_each_successor(*instr, [&](Bytecode::Label successor) {
+          assert(successor < blocks.size());
+          if (!visited[successor]) {
+            visited[successor] = true;
+            worklist.push_back(successor);
+          }
+        });
+        if (instr->type() == Bytecode::Instruction::Type::Call) {
+          const auto &call = derived_cast<const Bytecode::Instruction::Call &>(*instr);
+          callees[i].push_back({function_index.at(call.label), true});
+        } else if (instr->type() == Bytecode::Instruction::Type::TailCall) {
+          const auto &tail_call =
+              derived_cast<const Bytecode::Instruction::TailCall &>(*instr);
+          callees[i].push_back({function_index.at(tail_call.label), false});
+        }
+      }
+    }
+    function.frame_size = frame_size;
+    std::sort(function.blocks.begin(), function.blocks.end());
+  }
+
+  const auto depths = max_call_depths(callees);
+  for (size_t i = 0; i < functions.size(); ++i) {
+    functions[i].max_call_depth = depths[i];
+  }
+  return functions;
+}
+
 Bytecode::Instruction::Instruction(Type type) : type_(type) {}
 
 Bytecode::Instruction::Type Bytecode::Instruction::type() const { return type_; }
@@ -401,21 +280,21 @@ Bytecode::Instruction::Move::Move(Register dst, Register src)
     : Bytecode::Instruction(Type::Move), dst(dst), src(src) {}
 
 void Bytecode::Instruction::Move::dump() const {
-  std::printf("Move r%llu, r%llu", dst, src);
+  std::printf("Move r%" PRIu64 ", r%" PRIu64, dst, src);
 }
 
 Bytecode::Instruction::Load::Load(Register dst, Value value)
     : Bytecode::Instruction(Type::Load), dst(dst), value(value) {}
 
 void Bytecode::Instruction::Load::dump() const {
-  std::printf("Load r%llu, %llu", dst, value);
+  std::printf("Load r%" PRIu64 ", %" PRIu64, dst, value);
 }
 
 Bytecode::Instruction::LessThan::LessThan(Register dst, Register lhs, Register rhs)
     : Bytecode::Instruction(Type::LessThan), dst(dst), lhs(lhs), rhs(rhs) {}
 
 void Bytecode::Instruction::LessThan::dump() const {
-  std::printf("LessThan r%llu, r%llu, r%llu", dst, lhs, rhs);
+  std::printf("LessThan r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, lhs, rhs);
 }
 
 Bytecode::Instruction::LessThanImmediate::LessThanImmediate(Register dst, Register lhs,
@@ -423,7 +302,7 @@ Bytecode::Instruction::LessThanImmediate::LessThanImmediate(Register dst, Regist
     : Bytecode::Instruction(Type::LessThanImmediate), dst(dst), lhs(lhs), value(value) {}
 
 void Bytecode::Instruction::LessThanImmediate::dump() const {
-  std::printf("LessThanImmediate r%llu, r%llu, %llu", dst, lhs, value);
+  std::printf("LessThanImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, lhs, value);
 }
 
 Bytecode::Instruction::GreaterThan::GreaterThan(Register dst, Register lhs,
@@ -431,7 +310,7 @@ Bytecode::Instruction::GreaterThan::GreaterThan(Register dst, Register lhs,
     : Bytecode::Instruction(Type::GreaterThan), dst(dst), lhs(lhs), rhs(rhs) {}
 
 void Bytecode::Instruction::GreaterThan::dump() const {
-  std::printf("GreaterThan r%llu, r%llu, r%llu", dst, lhs, rhs);
+  std::printf("GreaterThan r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, lhs, rhs);
 }
 
 Bytecode::Instruction::GreaterThanImmediate::GreaterThanImmediate(Register dst, Register lhs,
@@ -439,7 +318,7 @@ Bytecode::Instruction::GreaterThanImmediate::GreaterThanImmediate(Register dst,
     : Bytecode::Instruction(Type::GreaterThanImmediate), dst(dst), lhs(lhs), value(value) {}
 
 void Bytecode::Instruction::GreaterThanImmediate::dump() const {
-  std::printf("GreaterThanImmediate r%llu, r%llu, %llu", dst, lhs, value);
+  std::printf("GreaterThanImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, lhs, value);
 }
 
 Bytecode::Instruction::LessThanOrEqual::LessThanOrEqual(Register dst, Register lhs,
@@ -447,7 +326,7 @@ Bytecode::Instruction::LessThanOrEqual::LessThanOrEqual(Register dst, Register l
     : Bytecode::Instruction(Type::LessThanOrEqual), dst(dst), lhs(lhs), rhs(rhs) {}
 
 void Bytecode::Instruction::LessThanOrEqual::dump() const {
-  std::printf("LessThanOrEqual r%llu, r%llu, r%llu", dst, lhs, rhs);
+  std::printf("LessThanOrEqual r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, lhs, rhs);
 }
 
 Bytecode::Instruction::LessThanOrEqualImmediate::LessThanOrEqualImmediate(Register dst,
@@ -459,7 +338,7 @@ Bytecode::Instruction::LessThanOrEqualImmediate::LessThanOrEqualImmediate(Regist
       value(value) {}
 
 void Bytecode::Instruction::LessThanOrEqualImmediate::dump() const {
-  std::printf("LessThanOrEqualImmediate r%llu, r%llu, %llu", dst, lhs, value);
+  std::printf("LessThanOrEqualImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, lhs, value);
 }
 
 Bytecode::Instruction::GreaterThanOrEqual::GreaterThanOrEqual(Register dst,
@@ -468,7 +347,7 @@ Bytecode::Instruction::GreaterThanOrEqual::GreaterThanOrEqual(Register dst,
     : Bytecode::Instruction(Type::GreaterThanOrEqual), dst(dst), lhs(lhs), rhs(rhs) {}
 
 void Bytecode::Instruction::GreaterThanOrEqual::dump() const {
-  std::printf("GreaterThanOrEqual r%llu, r%llu, r%llu", dst, lhs, rhs);
+  std::printf("GreaterThanOrEqual r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, lhs, rhs);
 }
 
 Bytecode::Instruction::GreaterThanOrEqualImmediate::GreaterThanOrEqualImmediate(Register dst,
@@ -480,13 +359,13 @@ Bytecode::Instruction::GreaterThanOrEqualImmediate::GreaterThanOrEqualImmediate(
       value(value) {}
 
 void Bytecode::Instruction::GreaterThanOrEqualImmediate::dump() const {
-  std::printf("GreaterThanOrEqualImmediate r%llu, r%llu, %llu", dst, lhs, value);
+  std::printf("GreaterThanOrEqualImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, lhs, value);
 }
 
 Bytecode::Instruction::Jump::Jump(Label label)
     : Bytecode::Instruction(Type::Jump), label(label) {}
 
-void Bytecode::Instruction::Jump::dump() const { std::printf("Jump @%llu", label); }
+void Bytecode::Instruction::Jump::dump() const { std::printf("Jump @%" PRIu64, label); }
 
 Bytecode::Instruction::JumpConditional::JumpConditional(Register cond, Label label1,
                                                         Label label2)
@@ -496,7 +375,7 @@ Bytecode::Instruction::JumpConditional::JumpConditional(Register cond, Label lab
       label2(label2) {}
 
 void Bytecode::Instruction::JumpConditional::dump() const {
-  std::printf("JumpConditional r%llu, @%llu, @%llu", cond, label1, label2);
+  std::printf("JumpConditional r%" PRIu64 ", @%" PRIu64 ", @%" PRIu64, cond, label1, label2);
 }
 
 Bytecode::Instruction::JumpEqualImmediate::JumpEqualImmediate(Register src, Value value,
@@ -508,7 +387,8 @@ Bytecode::Instruction::JumpEqualImmediate::JumpEqualImmediate(Register src, Valu
       label2(label2) {}
 
 void Bytecode::Instruction::JumpEqualImmediate::dump() const {
-  std::printf("JumpEqualImmediate r%llu, %llu, @%llu, @%llu", src, value, label1, label2);
+  std::printf("JumpEqualImmediate r%" PRIu64 ", %" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              src, value, label1, label2);
 }
 
 Bytecode::Instruction::JumpGreaterThanImmediate::JumpGreaterThanImmediate(Register lhs,
@@ -522,7 +402,8 @@ Bytecode::Instruction::JumpGreaterThanImmediate::JumpGreaterThanImmediate(Regist
       label2(label2) {}
 
 void Bytecode::Instruction::JumpGreaterThanImmediate::dump() const {
-  std::printf("JumpGreaterThanImmediate r%llu, %llu, @%llu, @%llu", lhs, value, label1, label2);
+  std::printf("JumpGreaterThanImmediate r%" PRIu64 ", %" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              lhs, value, label1, label2);
 }
 
 Bytecode::Instruction::JumpLessThanOrEqual::JumpLessThanOrEqual(Register lhs, Register rhs,
@@ -534,72 +415,194 @@ Bytecode::Instruction::JumpLessThanOrEqual::JumpLessThanOrEqual(Register lhs, Re
       label2(label2) {}
 
 void Bytecode::Instruction::JumpLessThanOrEqual::dump() const {
-  std::printf("JumpLessThanOrEqual r%llu, r%llu, @%llu, @%llu", lhs, rhs, label1, label2);
+  std::printf("JumpLessThanOrEqual r%" PRIu64 ", r%" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              lhs, rhs, label1, label2);
 }
 
-Bytecode::Instruction::Call::Call(Register dst, Label label,
-                                  std::vector<Register> arg_registers,
-                                  std::vector<Register> param_registers)
-    : Bytecode::Instruction(Type::Call),
-      dst(dst),
-      label(label),
-      arg_registers(std::move(arg_registers)),
-      param_registers(std::move(param_registers)) {}
+Bytecode::Instruction::JumpLessThan::JumpLessThan(Register lhs, Register rhs, Label label1,
+                                                  Label label2)
+    : Bytecode::Instruction(Type::JumpLessThan),
+      lhs(lhs),
+      rhs(rhs),
+      label1(label1),
+      label2(label2) {}
 
-void Bytecode::Instruction::Call::dump() const {
-  std::printf("Call r%llu, @%llu, [", dst, label);
-  for (size_t i = 0; i < arg_registers.size(); ++i) {
-    if (i != 0) {
-      std::printf(", ");
-    }
-    std::printf("r%llu", arg_registers[i]);
-  }
-  std::printf("]");
+void Bytecode::Instruction::JumpLessThan::dump() const {
+  std::printf("JumpLessThan r%" PRIu64 ", r%" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              lhs, rhs, label1, label2);
 }
 
-Bytecode::Instruction::TailCall::TailCall(Label label,
-                                          std::vector<Register> arg_registers,
-                                          std::vector<Register> param_registers)
-    : Bytecode::Instruction(Type::TailCall),
-      label(label),
-      arg_registers(std::move(arg_registers)),
-      param_registers(std::move(param_registers)) {}
+Bytecode::Instruction::JumpLessThanImmediate::JumpLessThanImmediate(Register lhs, Value value,
+                                                                    Label label1, Label label2)
+    : Bytecode::Instruction(Type::JumpLessThanImmediate),
+      lhs(lhs),
+      value(value),
+      label1(label1),
+      label2(label2) {}
 
-void Bytecode::Instruction::TailCall::dump() const {
-  std::printf("TailCall @%llu, [", label);
-  for (size_t i = 0; i < arg_registers.size(); ++i) {
-    if (i != 0) {
-      std::printf(", ");
-    }
-    std::printf("r%llu", arg_registers[i]);
-  }
-  std::printf("]");
+void Bytecode::Instruction::JumpLessThanImmediate::dump() const {
+  std::printf("JumpLessThanImmediate r%" PRIu64 ", %" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              lhs, value, label1, label2);
 }
 
-Bytecode::Instruction::Return::Return(Register reg)
-    : Bytecode::Instruction(Type::Return), reg(reg) {}
+Bytecode::Instruction::JumpGreaterThan::JumpGreaterThan(Register lhs, Register rhs,
+                                                        Label label1, Label label2)
+    : Bytecode::Instruction(Type::JumpGreaterThan),
+      lhs(lhs),
+      rhs(rhs),
+      label1(label1),
+      label2(label2) {}
 
-void Bytecode::Instruction::Return::dump() const { std::printf("Return r%llu", reg); }
+void Bytecode::Instruction::JumpGreaterThan::dump() const {
+  std::printf("JumpGreaterThan r%" PRIu64 ", r%" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              lhs, rhs, label1, label2);
+}
+
+Bytecode::Instruction::JumpLessThanOrEqualImmediate::JumpLessThanOrEqualImmediate(Register lhs,
+                                                                                  Value value,
+                                                                                  Label label1,
+                                                                                  Label label2)
+    : Bytecode::Instruction(Type::JumpLessThanOrEqualImmediate),
+      lhs(lhs),
+      value(value),
+      label1(label1),
+      label2(label2) {}
+
+void Bytecode::Instruction::JumpLessThanOrEqualImmediate::dump() const {
+  std::printf("JumpLessThanOrEqualImmediate r%" PRIu64 ", %" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              lhs, value, label1, label2);
+}
+
+Bytecode::Instruction::JumpGreaterThanOrEqual::JumpGreaterThanOrEqual(Register lhs, Register rhs,
+                                                                      Label label1, Label label2)
+    : Bytecode::Instruction(Type::JumpGreaterThanOrEqual),
+      lhs(lhs),
+      rhs(rhs),
+      label1(label1),
+      label2(label2) {}
+
+void Bytecode::Instruction::JumpGreaterThanOrEqual::dump() const {
+  std::printf("JumpGreaterThanOrEqual r%" PRIu64 ", r%" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              lhs, rhs, label1, label2);
+}
+
+Bytecode::Instruction::JumpGreaterThanOrEqualImmediate::JumpGreaterThanOrEqualImmediate(Register lhs,
+                                                                                        Value value,
+                                                                                        Label label1,
+                                                                                        Label label2)
+    : Bytecode::Instruction(Type::JumpGreaterThanOrEqualImmediate),
+      lhs(lhs),
+      value(value),
+      label1(label1),
+      label2(label2) {}
+
+void Bytecode::Instruction::JumpGreaterThanOrEqualImmediate::dump() const {
+  std::printf("JumpGreaterThanOrEqualImmediate r%" PRIu64 ", %" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              lhs, value, label1, label2);
+}
+
+Bytecode::Instruction::JumpEqual::JumpEqual(Register lhs, Register rhs, Label label1,
+                                            Label label2)
+    : Bytecode::Instruction(Type::JumpEqual),
+      lhs(lhs),
+      rhs(rhs),
+      label1(label1),
+      label2(label2) {}
+
+void Bytecode::Instruction::JumpEqual::dump() const {
+  std::printf("JumpEqual r%" PRIu64 ", r%" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              lhs, rhs, label1, label2);
+}
+
+Bytecode::Instruction::JumpNotEqual::JumpNotEqual(Register lhs, Register rhs, Label label1,
+                                                  Label label2)
+    : Bytecode::Instruction(Type::JumpNotEqual),
+      lhs(lhs),
+      rhs(rhs),
+      label1(label1),
+      label2(label2) {}
+
+void Bytecode::Instruction::JumpNotEqual::dump() const {
+  std::printf("JumpNotEqual r%" PRIu64 ", r%" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              lhs, rhs, label1, label2);
+}
+
+Bytecode::Instruction::JumpNotEqualImmediate::JumpNotEqualImmediate(Register src, Value value,
+                                                                    Label label1, Label label2)
+    : Bytecode::Instruction(Type::JumpNotEqualImmediate),
+      src(src),
+      value(value),
+      label1(label1),
+      label2(label2) {}
+
+void Bytecode::Instruction::JumpNotEqualImmediate::dump() const {
+  std::printf("JumpNotEqualImmediate r%" PRIu64 ", %" PRIu64 ", @%" PRIu64 ", @%" PRIu64,
+              src, value, label1, label2);
+}
+
+Bytecode::Instruction::Call::Call(Register dst, Label label,
+                                  std::vector<Register> arg_registers,
+                                  std::vector<Register> param_registers)
+    : Bytecode::Instruction(Type::Call),
+      dst(dst),
+      label(label),
+      arg_registers(std::move(arg_registers)),
+      param_registers(std::move(param_registers)) {}
+
+void Bytecode::Instruction::Call::dump() const {
+  std::printf("Call r%" PRIu64 ", @%" PRIu64 ", [", dst, label);
+  for (size_t i = 0; i < arg_registers.size(); ++i) {
+    if (i != 0) {
+      std::printf(", ");
+    }
+    std::printf("r%" PRIu64, arg_registers[i]);
+  }
+  std::printf("]");
+}
+
+Bytecode::Instruction::TailCall::TailCall(Label label,
+                                          std::vector<Register> arg_registers,
+                                          std::vector<Register> param_registers)
+    : Bytecode::Instruction(Type::TailCall),
+      label(label),
+      arg_registers(std::move(arg_registers)),
+      param_registers(std::move(param_registers)) {}
+
+void Bytecode::Instruction::TailCall::dump() const {
+  std::printf("TailCall @%" PRIu64 ", [", label);
+  for (size_t i = 0; i < arg_registers.size(); ++i) {
+    if (i != 0) {
+      std::printf(", ");
+    }
+    std::printf("r%" PRIu64, arg_registers[i]);
+  }
+  std::printf("]");
+}
+
+Bytecode::Instruction::Return::Return(Register reg)
+    : Bytecode::Instruction(Type::Return), reg(reg) {}
+
+void Bytecode::Instruction::Return::dump() const { std::printf("Return r%" PRIu64, reg); }
 
 Bytecode::Instruction::Equal::Equal(Register dst, Register src1, Register src2)
     : Bytecode::Instruction(Type::Equal), dst(dst), src1(src1), src2(src2) {}
 
 void Bytecode::Instruction::Equal::dump() const {
-  std::printf("Equal r%llu, r%llu, r%llu", dst, src1, src2);
+  std::printf("Equal r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, src1, src2);
 }
 
 Bytecode::Instruction::EqualImmediate::EqualImmediate(Register dst, Register src, Value value)
     : Bytecode::Instruction(Type::EqualImmediate), dst(dst), src(src), value(value) {}
 
 void Bytecode::Instruction::EqualImmediate::dump() const {
-  std::printf("EqualImmediate r%llu, r%llu, %llu", dst, src, value);
+  std::printf("EqualImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, src, value);
 }
 
 Bytecode::Instruction::NotEqual::NotEqual(Register dst, Register src1, Register src2)
     : Bytecode::Instruction(Type::NotEqual), dst(dst), src1(src1), src2(src2) {}
 
 void Bytecode::Instruction::NotEqual::dump() const {
-  std::printf("NotEqual r%llu, r%llu, r%llu", dst, src1, src2);
+  std::printf("NotEqual r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, src1, src2);
 }
 
 Bytecode::Instruction::NotEqualImmediate::NotEqualImmediate(Register dst, Register src,
@@ -607,28 +610,28 @@ Bytecode::Instruction::NotEqualImmediate::NotEqualImmediate(Register dst, Regist
     : Bytecode::Instruction(Type::NotEqualImmediate), dst(dst), src(src), value(value) {}
 
 void Bytecode::Instruction::NotEqualImmediate::dump() const {
-  std::printf("NotEqualImmediate r%llu, r%llu, %llu", dst, src, value);
+  std::printf("NotEqualImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, src, value);
 }
 
 Bytecode::Instruction::Add::Add(Register dst, Register src1, Register src2)
     : Bytecode::Instruction(Type::Add), dst(dst), src1(src1), src2(src2) {}
 
 void Bytecode::Instruction::Add::dump() const {
-  std::printf("Add r%llu, r%llu, r%llu", dst, src1, src2);
+  std::printf("Add r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, src1, src2);
 }
 
 Bytecode::Instruction::AddImmediate::AddImmediate(Register dst, Register src, Value value)
     : Bytecode::Instruction(Type::AddImmediate), dst(dst), src(src), value(value) {}
 
 void Bytecode::Instruction::AddImmediate::dump() const {
-  std::printf("AddImmediate r%llu, r%llu, %llu", dst, src, value);
+  std::printf("AddImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, src, value);
 }
 
 Bytecode::Instruction::Subtract::Subtract(Register dst, Register src1, Register src2)
     : Bytecode::Instruction(Type::Subtract), dst(dst), src1(src1), src2(src2) {}
 
 void Bytecode::Instruction::Subtract::dump() const {
-  std::printf("Subtract r%llu, r%llu, r%llu", dst, src1, src2);
+  std::printf("Subtract r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, src1, src2);
 }
 
 Bytecode::Instruction::SubtractImmediate::SubtractImmediate(Register dst, Register src,
@@ -636,14 +639,14 @@ Bytecode::Instruction::SubtractImmediate::SubtractImmediate(Register dst, Regist
     : Bytecode::Instruction(Type::SubtractImmediate), dst(dst), src(src), value(value) {}
 
 void Bytecode::Instruction::SubtractImmediate::dump() const {
-  std::printf("SubtractImmediate r%llu, r%llu, %llu", dst, src, value);
+  std::printf("SubtractImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, src, value);
 }
 
 Bytecode::Instruction::Multiply::Multiply(Register dst, Register src1, Register src2)
     : Bytecode::Instruction(Type::Multiply), dst(dst), src1(src1), src2(src2) {}
 
 void Bytecode::Instruction::Multiply::dump() const {
-  std::printf("Multiply r%llu, r%llu, r%llu", dst, src1, src2);
+  std::printf("Multiply r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, src1, src2);
 }
 
 Bytecode::Instruction::MultiplyImmediate::MultiplyImmediate(Register dst, Register src,
@@ -651,35 +654,35 @@ Bytecode::Instruction::MultiplyImmediate::MultiplyImmediate(Register dst, Regist
     : Bytecode::Instruction(Type::MultiplyImmediate), dst(dst), src(src), value(value) {}
 
 void Bytecode::Instruction::MultiplyImmediate::dump() const {
-  std::printf("MultiplyImmediate r%llu, r%llu, %llu", dst, src, value);
+  std::printf("MultiplyImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, src, value);
 }
 
 Bytecode::Instruction::Divide::Divide(Register dst, Register src1, Register src2)
     : Bytecode::Instruction(Type::Divide), dst(dst), src1(src1), src2(src2) {}
 
 void Bytecode::Instruction::Divide::dump() const {
-  std::printf("Divide r%llu, r%llu, r%llu", dst, src1, src2);
+  std::printf("Divide r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, src1, src2);
 }
 
 Bytecode::Instruction::DivideImmediate::DivideImmediate(Register dst, Register src, Value value)
     : Bytecode::Instruction(Type::DivideImmediate), dst(dst), src(src), value(value) {}
 
 void Bytecode::Instruction::DivideImmediate::dump() const {
-  std::printf("DivideImmediate r%llu, r%llu, %llu", dst, src, value);
+  std::printf("DivideImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, src, value);
 }
 
 Bytecode::Instruction::Modulo::Modulo(Register dst, Register src1, Register src2)
     : Bytecode::Instruction(Type::Modulo), dst(dst), src1(src1), src2(src2) {}
 
 void Bytecode::Instruction::Modulo::dump() const {
-  std::printf("Modulo r%llu, r%llu, r%llu", dst, src1, src2);
+  std::printf("Modulo r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, src1, src2);
 }
 
 Bytecode::Instruction::ModuloImmediate::ModuloImmediate(Register dst, Register src, Value value)
     : Bytecode::Instruction(Type::ModuloImmediate), dst(dst), src(src), value(value) {}
 
 void Bytecode::Instruction::ModuloImmediate::dump() const {
-  std::printf("ModuloImmediate r%llu, r%llu, %llu", dst, src, value);
+  std::printf("ModuloImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, src, value);
 }
 
 Bytecode::Instruction::ArrayCreate::ArrayCreate(Register dst,
@@ -687,12 +690,12 @@ Bytecode::Instruction::ArrayCreate::ArrayCreate(Register dst,
     : Bytecode::Instruction(Type::ArrayCreate), dst(dst), elements(std::move(elements)) {}
 
 void Bytecode::Instruction::ArrayCreate::dump() const {
-  std::printf("ArrayCreate r%llu, [", dst);
+  std::printf("ArrayCreate r%" PRIu64 ", [", dst);
   for (size_t i = 0; i < elements.size(); ++i) {
     if (i != 0) {
       std::printf(", ");
     }
-    std::printf("r%llu", elements[i]);
+    std::printf("r%" PRIu64, elements[i]);
   }
   std::printf("]");
 }
@@ -702,12 +705,12 @@ Bytecode::Instruction::ArrayLiteralCreate::ArrayLiteralCreate(
     : Bytecode::Instruction(Type::ArrayLiteralCreate), dst(dst), elements(std::move(elements)) {}
 
 void Bytecode::Instruction::ArrayLiteralCreate::dump() const {
-  std::printf("ArrayLiteralCreate r%llu, [", dst);
+  std::printf("ArrayLiteralCreate r%" PRIu64 ", [", dst);
   for (size_t i = 0; i < elements.size(); ++i) {
     if (i != 0) {
       std::printf(", ");
     }
-    std::printf("%llu", elements[i]);
+    std::printf("%" PRIu64, elements[i]);
   }
   std::printf("]");
 }
@@ -716,7 +719,7 @@ Bytecode::Instruction::ArrayLoad::ArrayLoad(Register dst, Register array, Regist
     : Bytecode::Instruction(Type::ArrayLoad), dst(dst), array(array), index(index) {}
 
 void Bytecode::Instruction::ArrayLoad::dump() const {
-  std::printf("ArrayLoad r%llu, r%llu, r%llu", dst, array, index);
+  std::printf("ArrayLoad r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, array, index);
 }
 
 Bytecode::Instruction::ArrayLoadImmediate::ArrayLoadImmediate(Register dst, Register array,
@@ -727,7 +730,7 @@ Bytecode::Instruction::ArrayLoadImmediate::ArrayLoadImmediate(Register dst, Regi
       index(index) {}
 
 void Bytecode::Instruction::ArrayLoadImmediate::dump() const {
-  std::printf("ArrayLoadImmediate r%llu, r%llu, %llu", dst, array, index);
+  std::printf("ArrayLoadImmediate r%" PRIu64 ", r%" PRIu64 ", %" PRIu64, dst, array, index);
 }
 
 Bytecode::Instruction::ArrayStore::ArrayStore(Register array, Register index, Register value)
@@ -737,7 +740,29 @@ Bytecode::Instruction::ArrayStore::ArrayStore(Register array, Register index, Re
       value(value) {}
 
 void Bytecode::Instruction::ArrayStore::dump() const {
-  std::printf("ArrayStore r%llu, r%llu, r%llu", array, index, value);
+  std::printf("ArrayStore r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, array, index, value);
+}
+
+Bytecode::Instruction::ArrayLoadUnchecked::ArrayLoadUnchecked(Register dst, Register array,
+                                                              Register index)
+    : Bytecode::Instruction(Type::ArrayLoadUnchecked),
+      dst(dst),
+      array(array),
+      index(index) {}
+
+void Bytecode::Instruction::ArrayLoadUnchecked::dump() const {
+  std::printf("ArrayLoadUnchecked r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, dst, array, index);
+}
+
+Bytecode::Instruction::ArrayStoreUnchecked::ArrayStoreUnchecked(Register array, Register index,
+                                                                Register value)
+    : Bytecode::Instruction(Type::ArrayStoreUnchecked),
+      array(array),
+      index(index),
+      value(value) {}
+
+void Bytecode::Instruction::ArrayStoreUnchecked::dump() const {
+  std::printf("ArrayStoreUnchecked r%" PRIu64 ", r%" PRIu64 ", r%" PRIu64, array, index, value);
 }
 
 Bytecode::Instruction::StructCreate::StructCreate(
@@ -745,12 +770,12 @@ Bytecode::Instruction::StructCreate::StructCreate(
     : Bytecode::Instruction(Type::StructCreate), dst(dst), fields(std::move(fields)) {}
 
 void Bytecode::Instruction::StructCreate::dump() const {
-  std::printf("StructCreate r%llu, {", dst);
+  std::printf("StructCreate r%" PRIu64 ", {", dst);
   for (size_t i = 0; i < fields.size(); ++i) {
     if (i != 0) {
       std::printf(", ");
     }
-    std::printf("%s: r%llu", fields[i].first.c_str(), fields[i].second);
+    std::printf("%s: r%" PRIu64, fields[i].first.c_str(), fields[i].second);
   }
   std::printf("}");
 }
@@ -760,12 +785,12 @@ Bytecode::Instruction::StructLiteralCreate::StructLiteralCreate(
     : Bytecode::Instruction(Type::StructLiteralCreate), dst(dst), fields(std::move(fields)) {}
 
 void Bytecode::Instruction::StructLiteralCreate::dump() const {
-  std::printf("StructLiteralCreate r%llu, {", dst);
+  std::printf("StructLiteralCreate r%" PRIu64 ", {", dst);
   for (size_t i = 0; i < fields.size(); ++i) {
     if (i != 0) {
       std::printf(", ");
     }
-    std::printf("%s: %llu", fields[i].first.c_str(), fields[i].second);
+    std::printf("%s: %" PRIu64, fields[i].first.c_str(), fields[i].second);
   }
   std::printf("}");
 }
@@ -778,35 +803,79 @@ Bytecode::Instruction::StructLoad::StructLoad(Register dst, Register object,
       field(std::move(field)) {}
 
 void Bytecode::Instruction::StructLoad::dump() const {
-  std::printf("StructLoad r%llu, r%llu, %s", dst, object, field.c_str());
+  std::printf("StructLoad r%" PRIu64 ", r%" PRIu64 ", %s", dst, object, field.c_str());
+}
+
+Bytecode::Instruction::StructStore::StructStore(Register object, std::string field,
+                                                Register value)
+    : Bytecode::Instruction(Type::StructStore),
+      object(object),
+      field(std::move(field)),
+      value(value) {}
+
+void Bytecode::Instruction::StructStore::dump() const {
+  std::printf("StructStore r%" PRIu64 ", %s, r%" PRIu64, object, field.c_str(), value);
 }
 
 Bytecode::Instruction::AddressOf::AddressOf(Register dst, Register src)
     : Bytecode::Instruction(Type::AddressOf), dst(dst), src(src) {}
 
 void Bytecode::Instruction::AddressOf::dump() const {
-  std::printf("AddressOf r%llu, r%llu", dst, src);
+  std::printf("AddressOf r%" PRIu64 ", r%" PRIu64, dst, src);
 }
 
 Bytecode::Instruction::LoadIndirect::LoadIndirect(Register dst, Register pointer)
     : Bytecode::Instruction(Type::LoadIndirect), dst(dst), pointer(pointer) {}
 
 void Bytecode::Instruction::LoadIndirect::dump() const {
-  std::printf("LoadIndirect r%llu, r%llu", dst, pointer);
+  std::printf("LoadIndirect r%" PRIu64 ", r%" PRIu64, dst, pointer);
 }
 
 Bytecode::Instruction::Negate::Negate(Register dst, Register src)
     : Bytecode::Instruction(Type::Negate), dst(dst), src(src) {}
 
 void Bytecode::Instruction::Negate::dump() const {
-  std::printf("Negate r%llu, r%llu", dst, src);
+  std::printf("Negate r%" PRIu64 ", r%" PRIu64, dst, src);
 }
 
 Bytecode::Instruction::LogicalNot::LogicalNot(Register dst, Register src)
     : Bytecode::Instruction(Type::LogicalNot), dst(dst), src(src) {}
 
 void Bytecode::Instruction::LogicalNot::dump() const {
-  std::printf("LogicalNot r%llu, r%llu", dst, src);
+  std::printf("LogicalNot r%" PRIu64 ", r%" PRIu64, dst, src);
+}
+
+Bytecode::Instruction::MoveJump::MoveJump(Register dst, Register src, Label label)
+    : Bytecode::Instruction(Type::MoveJump), dst(dst), src(src), label(label) {}
+
+void Bytecode::Instruction::MoveJump::dump() const {
+  std::printf("MoveJump r%" PRIu64 ", r%" PRIu64 ", @%" PRIu64, dst, src, label);
+}
+
+Bytecode::Instruction::LoadJump::LoadJump(Register dst, Value value, Label label)
+    : Bytecode::Instruction(Type::LoadJump), dst(dst), value(value), label(label) {}
+
+void Bytecode::Instruction::LoadJump::dump() const {
+  std::printf("LoadJump r%" PRIu64 ", %" PRIu64 ", @%" PRIu64, dst, value, label);
+}
+
+Bytecode::Instruction::AddImmediateJump::AddImmediateJump(Register dst, Register src,
+                                                          Value value, Label label)
+    : Bytecode::Instruction(Type::AddImmediateJump),
+      dst(dst),
+      src(src),
+      value(value),
+      label(label) {}
+
+void Bytecode::Instruction::AddImmediateJump::dump() const {
+  std::printf("AddImmediateJump r%" PRIu64 ", r%" PRIu64 ", %" PRIu64 ", @%" PRIu64, dst, src, value, label);
+}
+
+Bytecode::Instruction::AddReturn::AddReturn(Register src1, Register src2)
+    : Bytecode::Instruction(Type::AddReturn), src1(src1), src2(src2) {}
+
+void Bytecode::Instruction::AddReturn::dump() const {
+  std::printf("AddReturn r%" PRIu64 ", r%" PRIu64, src1, src2);
 }
 
 void Bytecode::BasicBlock::dump() const {
@@ -909,6 +978,9 @@ void BytecodeGenerator::visit(const Ast &ast) {
     case Ast::Type::FieldAccess:
       visit_field_access(derived_cast<Ast::FieldAccess const &>(ast));
       break;
+    case Ast::Type::FieldAssignment:
+      visit_field_assignment(derived_cast<Ast::FieldAssignment const &>(ast));
+      break;
     case Ast::Type::Assignment:
       visit_assignment(derived_cast<Ast::Assignment const &>(ast));
       break;
@@ -934,7 +1006,11 @@ void BytecodeGenerator::visit(const Ast &ast) {
 
 void BytecodeGenerator::visit_function_declaration(
     const Ast::FunctionDeclaration &func_decl) {
-  auto outer_vars = vars_;
+  // Each function numbers its registers from 0 in its own frame. The
+  // typechecker rejects reads of enclosing variables, so only the parameters
+  // are in scope.
+  auto outer_vars = std::exchange(vars_, {});
+  auto outer_reg_alloc = std::exchange(reg_alloc_, {});
   auto &jump_to_after_decl = current_block().append<Bytecode::Instruction::Jump>(-1);
   auto function_label = static_cast<Bytecode::Label>(blocks_.size());
   functions_[func_decl.name] = function_label;
@@ -967,6 +1043,7 @@ void BytecodeGenerator::visit_function_declaration(
   blocks_.emplace_back();
   jump_to_after_decl.label = after_decl_label;
   vars_ = std::move(outer_vars);
+  reg_alloc_ = outer_reg_alloc;
 }
 
 void BytecodeGenerator::visit_block(const Ast::Block &block) {
@@ -993,7 +1070,14 @@ void BytecodeGenerator::finalize() {
 }
 
 void BytecodeGenerator::dump() const {
+  const auto functions = build_function_table(blocks_);
+  auto function_it = functions.begin();
   for (size_t i = 0; i < blocks_.size(); ++i) {
+    if (function_it != functions.end() && function_it->entry == i) {
+      std::printf("; function arity=%zu frame=%zu\n", function_it->arity,
+                  function_it->frame_size);
+      ++function_it;
+    }
     std::printf("%zu:\n", i);
     blocks_[i].dump();
   }
@@ -1466,6 +1550,16 @@ void BytecodeGenerator::visit_field_access(const Ast::FieldAccess &field_access)
       dst_reg, object_reg, field_access.field);
 }
 
+void BytecodeGenerator::visit_field_assignment(
+    const Ast::FieldAssignment &field_assignment) {
+  visit(*field_assignment.object);
+  const auto object_reg = reg_alloc_.current();
+  visit(*field_assignment.value);
+  const auto value_reg = reg_alloc_.current();
+  current_block().append<Bytecode::Instruction::StructStore>(
+      object_reg, field_assignment.field, value_reg);
+}
+
 void BytecodeGenerator::visit_assignment(const Ast::Assignment &assignment) {
   visit(*assignment.value);
   // TODO(pointer): emit pointer stores for `*p = v` once dereference-assignment
@@ -1510,548 +1604,1434 @@ void BytecodeGenerator::visit_logical_not(const Ast::LogicalNot &logical_not) {
   current_block().append<Bytecode::Instruction::LogicalNot>(reg_alloc_.allocate(), src_reg);
 }
 
-Bytecode::Value BytecodeInterpreter::interpret(
-    const std::vector<Bytecode::BasicBlock> &blocks) {
-  assert(!blocks.empty());
-  block_index = 0;
-  instr_index_ = 0;
-  call_stack_.clear();
-  register_count_ = register_count(blocks);
-  frame_base_ = 0;
-  initialize_frame_slots(register_stack_, frame_base_, register_count_);
-  arrays_.clear();
-  structs_.clear();
-  pointers_.clear();
-  next_heap_id_ = 1;
-  next_pointer_id_ = 1;
-
-  for (;;) {
-    assert(block_index < blocks.size());
-    const auto &block = blocks[block_index];
-    assert(instr_index_ < block.instructions.size());
-    const auto &instr = block.instructions[instr_index_];
-    switch (instr->type()) {
-      case Bytecode::Instruction::Type::Move:
-        interpret_move(derived_cast<Bytecode::Instruction::Move const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::Load:
-        interpret_load(derived_cast<Bytecode::Instruction::Load const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::LessThan:
-        interpret_less_than(derived_cast<Bytecode::Instruction::LessThan const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::LessThanImmediate:
-        interpret_less_than_immediate(
-            derived_cast<Bytecode::Instruction::LessThanImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::GreaterThan:
-        interpret_greater_than(
-            derived_cast<Bytecode::Instruction::GreaterThan const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::GreaterThanImmediate:
-        interpret_greater_than_immediate(
-            derived_cast<Bytecode::Instruction::GreaterThanImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::LessThanOrEqual:
-        interpret_less_than_or_equal(
-            derived_cast<Bytecode::Instruction::LessThanOrEqual const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::LessThanOrEqualImmediate:
-        interpret_less_than_or_equal_immediate(
-            derived_cast<Bytecode::Instruction::LessThanOrEqualImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::GreaterThanOrEqual:
-        interpret_greater_than_or_equal(
-            derived_cast<Bytecode::Instruction::GreaterThanOrEqual const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::GreaterThanOrEqualImmediate:
-        interpret_greater_than_or_equal_immediate(derived_cast<
-            Bytecode::Instruction::GreaterThanOrEqualImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::Jump:
-        interpret_jump(derived_cast<Bytecode::Instruction::Jump const &>(*instr));
-        break;
-      case Bytecode::Instruction::Type::JumpConditional:
-        interpret_jump_conditional(
-            derived_cast<Bytecode::Instruction::JumpConditional const &>(*instr));
-        break;
-      case Bytecode::Instruction::Type::JumpEqualImmediate:
-        interpret_jump_equal_immediate(
-            derived_cast<Bytecode::Instruction::JumpEqualImmediate const &>(*instr));
-        break;
-      case Bytecode::Instruction::Type::JumpGreaterThanImmediate:
-        interpret_jump_greater_than_immediate(
-            derived_cast<Bytecode::Instruction::JumpGreaterThanImmediate const &>(*instr));
-        break;
-      case Bytecode::Instruction::Type::JumpLessThanOrEqual:
-        interpret_jump_less_than_or_equal(
-            derived_cast<Bytecode::Instruction::JumpLessThanOrEqual const &>(*instr));
-        break;
-      case Bytecode::Instruction::Type::Call:
-        interpret_call(derived_cast<Bytecode::Instruction::Call const &>(*instr),
-                       instr_index_ + 1);
-        break;
-      case Bytecode::Instruction::Type::TailCall:
-        interpret_tail_call(
-            derived_cast<Bytecode::Instruction::TailCall const &>(*instr));
-        break;
-      case Bytecode::Instruction::Type::Return: {
-        const auto ret_reg = derived_cast<Bytecode::Instruction::Return const &>(*instr).reg;
-        const auto value = reg(ret_reg);
-        if (call_stack_.empty()) {
-          return value;
-        }
-        auto frame = std::move(call_stack_.back());
-        call_stack_.pop_back();
-        frame_base_ = frame.frame_base;
-        reg(frame.dst_register) = value;
-        block_index = frame.return_block_index;
-        instr_index_ = frame.return_instr_index;
-        break;
+std::vector<std::pair<Bytecode::Register, Bytecode::Register>> schedule_parallel_move(
+    const std::vector<Bytecode::Register> &args,
+    const std::vector<Bytecode::Register> &params, Bytecode::Register temporary) {
+  assert(args.size() == params.size());
+  std::vector<std::pair<Bytecode::Register, Bytecode::Register>> pending;
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i] != params[i]) {
+      pending.emplace_back(params[i], args[i]);
+    }
+  }
+
+  std::vector<std::pair<Bytecode::Register, Bytecode::Register>> moves;
+  const auto is_read = [&](Bytecode::Register reg) {
+    return std::any_of(pending.begin(), pending.end(),
+                       [&](const auto &move) { return move.second == reg; });
+  };
+  while (!pending.empty()) {
+    const auto ready = std::find_if(pending.begin(), pending.end(),
+                                    [&](const auto &move) { return !is_read(move.first); });
+    if (ready != pending.end()) {
+      moves.push_back(*ready);
+      pending.erase(ready);
+      continue;
+    }
+    const auto saved = pending.front().first;
+    moves.emplace_back(temporary, saved);
+    for (auto &move : pending) {
+      if (move.second == saved) {
+        move.second = temporary;
       }
-      case Bytecode::Instruction::Type::Equal:
-        interpret_equal(derived_cast<Bytecode::Instruction::Equal const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::EqualImmediate:
-        interpret_equal_immediate(
-            derived_cast<Bytecode::Instruction::EqualImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::NotEqual:
-        interpret_not_equal(
-            derived_cast<Bytecode::Instruction::NotEqual const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::NotEqualImmediate:
-        interpret_not_equal_immediate(
-            derived_cast<Bytecode::Instruction::NotEqualImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::Add:
-        interpret_add(derived_cast<Bytecode::Instruction::Add const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::AddImmediate:
-        interpret_add_immediate(
-            derived_cast<Bytecode::Instruction::AddImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::Subtract:
-        interpret_subtract(derived_cast<Bytecode::Instruction::Subtract const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::SubtractImmediate:
-        interpret_subtract_immediate(
-            derived_cast<Bytecode::Instruction::SubtractImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::Multiply:
-        interpret_multiply(derived_cast<Bytecode::Instruction::Multiply const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::MultiplyImmediate:
-        interpret_multiply_immediate(
-            derived_cast<Bytecode::Instruction::MultiplyImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::Divide:
-        interpret_divide(derived_cast<Bytecode::Instruction::Divide const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::DivideImmediate:
-        interpret_divide_immediate(
-            derived_cast<Bytecode::Instruction::DivideImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::Modulo:
-        interpret_modulo(derived_cast<Bytecode::Instruction::Modulo const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::ModuloImmediate:
-        interpret_modulo_immediate(
-            derived_cast<Bytecode::Instruction::ModuloImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::ArrayCreate:
-        interpret_array_create(
-            derived_cast<Bytecode::Instruction::ArrayCreate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::ArrayLiteralCreate:
-        interpret_array_literal_create(
-            derived_cast<Bytecode::Instruction::ArrayLiteralCreate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::ArrayLoad:
-        interpret_array_load(derived_cast<Bytecode::Instruction::ArrayLoad const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::ArrayLoadImmediate:
-        interpret_array_load_immediate(
-            derived_cast<Bytecode::Instruction::ArrayLoadImmediate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::ArrayStore:
-        interpret_array_store(
-            derived_cast<Bytecode::Instruction::ArrayStore const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::StructCreate:
-        interpret_struct_create(
-            derived_cast<Bytecode::Instruction::StructCreate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::StructLiteralCreate:
-        interpret_struct_literal_create(
-            derived_cast<Bytecode::Instruction::StructLiteralCreate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::StructLoad:
-        interpret_struct_load(
-            derived_cast<Bytecode::Instruction::StructLoad const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::AddressOf:
-        interpret_address_of(
-            derived_cast<Bytecode::Instruction::AddressOf const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::LoadIndirect:
-        interpret_load_indirect(
-            derived_cast<Bytecode::Instruction::LoadIndirect const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::Negate:
-        interpret_negate(derived_cast<Bytecode::Instruction::Negate const &>(*instr));
-        ++instr_index_;
-        break;
-      case Bytecode::Instruction::Type::LogicalNot:
-        interpret_logical_not(
-            derived_cast<Bytecode::Instruction::LogicalNot const &>(*instr));
-        ++instr_index_;
-        break;
-      default:
-        assert(false);
-        break;
     }
   }
-  assert(false);
-  return Bytecode::Value(-1);
+  return moves;
 }
+Bytecode::Executable lower_to_executable(const std::vector<Bytecode::BasicBlock> &blocks) {
+  using Type = Bytecode::Instruction::Type;
+  using Packed = Bytecode::Executable::Instruction;
 
-void BytecodeInterpreter::interpret_move(const Bytecode::Instruction::Move &move) {
-  reg(move.dst) = reg(move.src);
-}
+  Bytecode::Executable executable;
+  if (blocks.empty()) {
+    return executable;
+  }
 
-void BytecodeInterpreter::interpret_load(const Bytecode::Instruction::Load &load) {
-  reg(load.dst) = load.value;
-}
+  size_t instruction_count = 0;
+  executable.block_offsets.reserve(blocks.size());
+  for (const auto &block : blocks) {
+    assert(has_terminator(block));
+    executable.block_offsets.push_back(to_operand(instruction_count));
+    instruction_count += block.instructions.size();
+  }
+  executable.code.reserve(instruction_count);
+
+  std::vector<size_t> frame_sizes(blocks.size(), 0);
+  for (const auto &function : build_function_table(blocks)) {
+    frame_sizes[function.entry] = function.frame_size;
+    auto &lowered = executable.functions.emplace_back();
+    lowered.entry = executable.block_offsets[function.entry];
+    lowered.frame_size = to_operand(function.frame_size);
+    for (const auto label : function.blocks) {
+      lowered.blocks.push_back(to_operand(label));
+    }
+  }
+  executable.entry_frame_size = frame_sizes[0];
+
+  std::unordered_map<std::string, u32> string_ids;
+  const auto intern = [&](const std::string &string) {
+    const auto [it, inserted] =
+        string_ids.try_emplace(string, to_operand(executable.strings.size()));
+    if (inserted) {
+      executable.strings.push_back(string);
+    }
+    return it->second;
+  };
+  const auto target = [&](Bytecode::Label label) {
+    assert(label < blocks.size());
+    return executable.block_offsets[label];
+  };
+  const auto push_registers = [&](const std::vector<Bytecode::Register> &registers) {
+    const auto offset = to_operand(executable.operands.size());
+    for (const auto reg : registers) {
+      executable.operands.push_back(to_operand(reg));
+    }
+    return offset;
+  };
 
-void BytecodeInterpreter::interpret_less_than(
-    const Bytecode::Instruction::LessThan &less_than) {
-  reg(less_than.dst) = reg(less_than.lhs) < reg(less_than.rhs);
+  for (const auto &block : blocks) {
+    for (const auto &instr : block.instructions) {
+      Packed packed{instr->type()};
+      switch (instr->type()) {
+        case Type::Move: {
+          const auto &move = derived_cast<const Bytecode::Instruction::Move &>(*instr);
+          packed.a = to_operand(move.dst);
+          packed.b = to_operand(move.src);
+          break;
+        }
+        case Type::Load: {
+          const auto &load = derived_cast<const Bytecode::Instruction::Load &>(*instr);
+          packed.a = to_operand(load.dst);
+          packed.value = load.value;
+          break;
+        }
+        case Type::LessThan: {
+          const auto &less_than =
+              derived_cast<const Bytecode::Instruction::LessThan &>(*instr);
+          packed.a = to_operand(less_than.dst);
+          packed.b = to_operand(less_than.lhs);
+          packed.c = to_operand(less_than.rhs);
+          break;
+        }
+        case Type::LessThanImmediate: {
+          const auto &less_than_imm =
+              derived_cast<const Bytecode::Instruction::LessThanImmediate &>(*instr);
+          packed.a = to_operand(less_than_imm.dst);
+          packed.b = to_operand(less_than_imm.lhs);
+          packed.value = less_than_imm.value;
+          break;
+        }
+        case Type::GreaterThan: {
+          const auto &greater_than =
+              derived_cast<const Bytecode::Instruction::GreaterThan &>(*instr);
+          packed.a = to_operand(greater_than.dst);
+          packed.b = to_operand(greater_than.lhs);
+          packed.c = to_operand(greater_than.rhs);
+          break;
+        }
+        case Type::GreaterThanImmediate: {
+          const auto &greater_than_imm =
+              derived_cast<const Bytecode::Instruction::GreaterThanImmediate &>(*instr);
+          packed.a = to_operand(greater_than_imm.dst);
+          packed.b = to_operand(greater_than_imm.lhs);
+          packed.value = greater_than_imm.value;
+          break;
+        }
+        case Type::LessThanOrEqual: {
+          const auto &less_than_or_equal =
+              derived_cast<const Bytecode::Instruction::LessThanOrEqual &>(*instr);
+          packed.a = to_operand(less_than_or_equal.dst);
+          packed.b = to_operand(less_than_or_equal.lhs);
+          packed.c = to_operand(less_than_or_equal.rhs);
+          break;
+        }
+        case Type::LessThanOrEqualImmediate: {
+          const auto &less_than_or_equal_imm =
+              derived_cast<const Bytecode::Instruction::LessThanOrEqualImmediate &>(*instr);
+          packed.a = to_operand(less_than_or_equal_imm.dst);
+          packed.b = to_operand(less_than_or_equal_imm.lhs);
+          packed.value = less_than_or_equal_imm.value;
+          break;
+        }
+        case Type::GreaterThanOrEqual: {
+          const auto &greater_than_or_equal =
+              derived_cast<const Bytecode::Instruction::GreaterThanOrEqual &>(*instr);
+          packed.a = to_operand(greater_than_or_equal.dst);
+          packed.b = to_operand(greater_than_or_equal.lhs);
+          packed.c = to_operand(greater_than_or_equal.rhs);
+          break;
+        }
+        case Type::GreaterThanOrEqualImmediate: {
+          const auto &greater_than_or_equal_imm =
+              derived_cast<const Bytecode::Instruction::GreaterThanOrEqualImmediate &>(
+                  *instr);
+          packed.a = to_operand(greater_than_or_equal_imm.dst);
+          packed.b = to_operand(greater_than_or_equal_imm.lhs);
+          packed.value = greater_than_or_equal_imm.value;
+          break;
+        }
+        case Type::Jump: {
+          const auto &jump = derived_cast<const Bytecode::Instruction::Jump &>(*instr);
+          packed.b = target(jump.label);
+          break;
+        }
+        case Type::JumpConditional: {
+          const auto &jump_cond =
+              derived_cast<const Bytecode::Instruction::JumpConditional &>(*instr);
+          packed.a = to_operand(jump_cond.cond);
+          packed.b = target(jump_cond.label1);
+          packed.c = target(jump_cond.label2);
+          break;
+        }
+        case Type::JumpEqualImmediate: {
+          const auto &jump_equal_imm =
+              derived_cast<const Bytecode::Instruction::JumpEqualImmediate &>(*instr);
+          packed.a = to_operand(jump_equal_imm.src);
+          packed.b = target(jump_equal_imm.label1);
+          packed.c = target(jump_equal_imm.label2);
+          packed.value = jump_equal_imm.value;
+          break;
+        }
+        case Type::JumpGreaterThanImmediate: {
+          const auto &jump_greater_than_imm =
+              derived_cast<const Bytecode::Instruction::JumpGreaterThanImmediate &>(*instr);
+          packed.a = to_operand(jump_greater_than_imm.lhs);
+          packed.b = target(jump_greater_than_imm.label1);
+          packed.c = target(jump_greater_than_imm.label2);
+          packed.value = jump_greater_than_imm.value;
+          break;
+        }
+        case Type::JumpLessThanOrEqual: {
+          const auto &jump_less_than_or_equal =
+              derived_cast<const Bytecode::Instruction::JumpLessThanOrEqual &>(*instr);
+          packed.a = to_operand(jump_less_than_or_equal.lhs);
+          packed.d = to_operand(jump_less_than_or_equal.rhs);
+          packed.b = target(jump_less_than_or_equal.label1);
+          packed.c = target(jump_less_than_or_equal.label2);
+          break;
+        }
+        case Type::JumpLessThan: {
+          const auto &jump_less_than =
+              derived_cast<const Bytecode::Instruction::JumpLessThan &>(*instr);
+          packed.a = to_operand(jump_less_than.lhs);
+          packed.d = to_operand(jump_less_than.rhs);
+          packed.b = target(jump_less_than.label1);
+          packed.c = target(jump_less_than.label2);
+          break;
+        }
+        case Type::JumpLessThanImmediate: {
+          const auto &jump_less_than_imm =
+              derived_cast<const Bytecode::Instruction::JumpLessThanImmediate &>(*instr);
+          packed.a = to_operand(jump_less_than_imm.lhs);
+          packed.b = target(jump_less_than_imm.label1);
+          packed.c = target(jump_less_than_imm.label2);
+          packed.value = jump_less_than_imm.value;
+          break;
+        }
+        case Type::JumpGreaterThan: {
+          const auto &jump_greater_than =
+              derived_cast<const Bytecode::Instruction::JumpGreaterThan &>(*instr);
+          packed.a = to_operand(jump_greater_than.lhs);
+          packed.d = to_operand(jump_greater_than.rhs);
+          packed.b = target(jump_greater_than.label1);
+          packed.c = target(jump_greater_than.label2);
+          break;
+        }
+        case Type::JumpLessThanOrEqualImmediate: {
+          const auto &jump_lte_imm =
+              derived_cast<const Bytecode::Instruction::JumpLessThanOrEqualImmediate &>(*instr);
+          packed.a = to_operand(jump_lte_imm.lhs);
+          packed.b = target(jump_lte_imm.label1);
+          packed.c = target(jump_lte_imm.label2);
+          packed.value = jump_lte_imm.value;
+          break;
+        }
+        case Type::JumpGreaterThanOrEqual: {
+          const auto &jump_gte =
+              derived_cast<const Bytecode::Instruction::JumpGreaterThanOrEqual &>(*instr);
+          packed.a = to_operand(jump_gte.lhs);
+          packed.d = to_operand(jump_gte.rhs);
+          packed.b = target(jump_gte.label1);
+          packed.c = target(jump_gte.label2);
+          break;
+        }
+        case Type::JumpGreaterThanOrEqualImmediate: {
+          const auto &jump_gte_imm =
+              derived_cast<const Bytecode::Instruction::JumpGreaterThanOrEqualImmediate &>(
+                  *instr);
+          packed.a = to_operand(jump_gte_imm.lhs);
+          packed.b = target(jump_gte_imm.label1);
+          packed.c = target(jump_gte_imm.label2);
+          packed.value = jump_gte_imm.value;
+          break;
+        }
+        case Type::JumpEqual: {
+          const auto &jump_equal =
+              derived_cast<const Bytecode::Instruction::JumpEqual &>(*instr);
+          packed.a = to_operand(jump_equal.lhs);
+          packed.d = to_operand(jump_equal.rhs);
+          packed.b = target(jump_equal.label1);
+          packed.c = target(jump_equal.label2);
+          break;
+        }
+        case Type::JumpNotEqual: {
+          const auto &jump_not_equal =
+              derived_cast<const Bytecode::Instruction::JumpNotEqual &>(*instr);
+          packed.a = to_operand(jump_not_equal.lhs);
+          packed.d = to_operand(jump_not_equal.rhs);
+          packed.b = target(jump_not_equal.label1);
+          packed.c = target(jump_not_equal.label2);
+          break;
+        }
+        case Type::JumpNotEqualImmediate: {
+          const auto &jump_not_equal_imm =
+              derived_cast<const Bytecode::Instruction::JumpNotEqualImmediate &>(*instr);
+          packed.a = to_operand(jump_not_equal_imm.src);
+          packed.b = target(jump_not_equal_imm.label1);
+          packed.c = target(jump_not_equal_imm.label2);
+          packed.value = jump_not_equal_imm.value;
+          break;
+        }
+        case Type::Call: {
+          const auto &call = derived_cast<const Bytecode::Instruction::Call &>(*instr);
+          assert(call.arg_registers.size() == call.param_registers.size());
+          packed.a = to_operand(call.dst);
+          packed.b = target(call.label);
+          packed.c = push_registers(call.arg_registers);
+          push_registers(call.param_registers);
+          packed.d = to_operand(call.arg_registers.size());
+          packed.value = frame_sizes[call.label];
+          break;
+        }
+        case Type::TailCall: {
+          const auto &tail_call =
+              derived_cast<const Bytecode::Instruction::TailCall &>(*instr);
+          assert(tail_call.arg_registers.size() == tail_call.param_registers.size());
+          packed.b = target(tail_call.label);
+          packed.c = push_registers(tail_call.arg_registers);
+          push_registers(tail_call.param_registers);
+          packed.d = to_operand(tail_call.arg_registers.size());
+          packed.value = frame_sizes[tail_call.label];
+          const auto moves =
+              schedule_parallel_move(tail_call.arg_registers, tail_call.param_registers,
+                                     Bytecode::Executable::k_move_temporary);
+          for (const auto &[dst, src] : moves) {
+            executable.operands.push_back(to_operand(dst));
+            executable.operands.push_back(to_operand(src));
+          }
+          packed.a = to_operand(moves.size());
+          break;
+        }
+        case Type::Return: {
+          const auto &ret = derived_cast<const Bytecode::Instruction::Return &>(*instr);
+          packed.a = to_operand(ret.reg);
+          break;
+        }
+        case Type::Equal: {
+          const auto &equal = derived_cast<const Bytecode::Instruction::Equal &>(*instr);
+          packed.a = to_operand(equal.dst);
+          packed.b = to_operand(equal.src1);
+          packed.c = to_operand(equal.src2);
+          break;
+        }
+        case Type::EqualImmediate: {
+          const auto &equal_imm =
+              derived_cast<const Bytecode::Instruction::EqualImmediate &>(*instr);
+          packed.a = to_operand(equal_imm.dst);
+          packed.b = to_operand(equal_imm.src);
+          packed.value = equal_imm.value;
+          break;
+        }
+        case Type::NotEqual: {
+          const auto &not_equal =
+              derived_cast<const Bytecode::Instruction::NotEqual &>(*instr);
+          packed.a = to_operand(not_equal.dst);
+          packed.b = to_operand(not_equal.src1);
+          packed.c = to_operand(not_equal.src2);
+          break;
+        }
+        case Type::NotEqualImmediate: {
+          const auto &not_equal_imm =
+              derived_cast<const Bytecode::Instruction::NotEqualImmediate &>(*instr);
+          packed.a = to_operand(not_equal_imm.dst);
+          packed.b = to_operand(not_equal_imm.src);
+          packed.value = not_equal_imm.value;
+          break;
+        }
+        case Type::Add: {
+          const auto &add = derived_cast<const Bytecode::Instruction::Add &>(*instr);
+          packed.a = to_operand(add.dst);
+          packed.b = to_operand(add.src1);
+          packed.c = to_operand(add.src2);
+          break;
+        }
+        case Type::AddImmediate: {
+          const auto &add_imm =
+              derived_cast<const Bytecode::Instruction::AddImmediate &>(*instr);
+          packed.a = to_operand(add_imm.dst);
+          packed.b = to_operand(add_imm.src);
+          packed.value = add_imm.value;
+          break;
+        }
+        case Type::Subtract: {
+          const auto &subtract =
+              derived_cast<const Bytecode::Instruction::Subtract &>(*instr);
+          packed.a = to_operand(subtract.dst);
+          packed.b = to_operand(subtract.src1);
+          packed.c = to_operand(subtract.src2);
+          break;
+        }
+        case Type::SubtractImmediate: {
+          const auto &subtract_imm =
+              derived_cast<const Bytecode::Instruction::SubtractImmediate &>(*instr);
+          packed.a = to_operand(subtract_imm.dst);
+          packed.b = to_operand(subtract_imm.src);
+          packed.value = subtract_imm.value;
+          break;
+        }
+        case Type::Multiply: {
+          const auto &multiply =
+              derived_cast<const Bytecode::Instruction::Multiply &>(*instr);
+          packed.a = to_operand(multiply.dst);
+          packed.b = to_operand(multiply.src1);
+          packed.c = to_operand(multiply.src2);
+          break;
+        }
+        case Type::MultiplyImmediate: {
+          const auto &multiply_imm =
+              derived_cast<const Bytecode::Instruction::MultiplyImmediate &>(*instr);
+          packed.a = to_operand(multiply_imm.dst);
+          packed.b = to_operand(multiply_imm.src);
+          packed.value = multiply_imm.value;
+          break;
+        }
+        case Type::Divide: {
+          const auto &divide = derived_cast<const Bytecode::Instruction::Divide &>(*instr);
+          packed.a = to_operand(divide.dst);
+          packed.b = to_operand(divide.src1);
+          packed.c = to_operand(divide.src2);
+          break;
+        }
+        case Type::DivideImmediate: {
+          const auto &divide_imm =
+              derived_cast<const Bytecode::Instruction::DivideImmediate &>(*instr);
+          packed.a = to_operand(divide_imm.dst);
+          packed.b = to_operand(divide_imm.src);
+          packed.value = divide_imm.value;
+          break;
+        }
+        case Type::Modulo: {
+          const auto &modulo = derived_cast<const Bytecode::Instruction::Modulo &>(*instr);
+          packed.a = to_operand(modulo.dst);
+          packed.b = to_operand(modulo.src1);
+          packed.c = to_operand(modulo.src2);
+          break;
+        }
+        case Type::ModuloImmediate: {
+          const auto &modulo_imm =
+              derived_cast<const Bytecode::Instruction::ModuloImmediate &>(*instr);
+          packed.a = to_operand(modulo_imm.dst);
+          packed.b = to_operand(modulo_imm.src);
+          packed.value = modulo_imm.value;
+          break;
+        }
+        case Type::ArrayCreate: {
+          const auto &array_create =
+              derived_cast<const Bytecode::Instruction::ArrayCreate &>(*instr);
+          packed.a = to_operand(array_create.dst);
+          packed.c = push_registers(array_create.elements);
+          packed.d = to_operand(array_create.elements.size());
+          break;
+        }
+        case Type::ArrayLiteralCreate: {
+          const auto &array_literal_create =
+              derived_cast<const Bytecode::Instruction::ArrayLiteralCreate &>(*instr);
+          packed.a = to_operand(array_literal_create.dst);
+          packed.c = to_operand(executable.values.size());
+          packed.d = to_operand(array_literal_create.elements.size());
+          executable.values.insert(executable.values.end(),
+                                   array_literal_create.elements.begin(),
+                                   array_literal_create.elements.end());
+          break;
+        }
+        case Type::ArrayLoad: {
+          const auto &array_load =
+              derived_cast<const Bytecode::Instruction::ArrayLoad &>(*instr);
+          packed.a = to_operand(array_load.dst);
+          packed.b = to_operand(array_load.array);
+          packed.c = to_operand(array_load.index);
+          break;
+        }
+        case Type::ArrayLoadImmediate: {
+          const auto &array_load_immediate =
+              derived_cast<const Bytecode::Instruction::ArrayLoadImmediate &>(*instr);
+          packed.a = to_operand(array_load_immediate.dst);
+          packed.b = to_operand(array_load_immediate.array);
+          packed.value = array_load_immediate.index;
+          break;
+        }
+        case Type::ArrayStore: {
+          const auto &array_store =
+              derived_cast<const Bytecode::Instruction::ArrayStore &>(*instr);
+          packed.a = to_operand(array_store.array);
+          packed.b = to_operand(array_store.index);
+          packed.c = to_operand(array_store.value);
+          break;
+        }
+        case Type::ArrayLoadUnchecked: {
+          const auto &array_load =
+              derived_cast<const Bytecode::Instruction::ArrayLoadUnchecked &>(*instr);
+          packed.a = to_operand(array_load.dst);
+          packed.b = to_operand(array_load.array);
+          packed.c = to_operand(array_load.index);
+          break;
+        }
+        case Type::ArrayStoreUnchecked: {
+          const auto &array_store =
+              derived_cast<const Bytecode::Instruction::ArrayStoreUnchecked &>(*instr);
+          packed.a = to_operand(array_store.array);
+          packed.b = to_operand(array_store.index);
+          packed.c = to_operand(array_store.value);
+          break;
+        }
+        case Type::StructCreate: {
+          const auto &struct_create =
+              derived_cast<const Bytecode::Instruction::StructCreate &>(*instr);
+          std::vector<std::string> names;
+          for (const auto &field : struct_create.fields) {
+            names.push_back(field.first);
+          }
+          const auto layout = executable.layouts.intern(names);
+          packed.a = to_operand(struct_create.dst);
+          packed.b = layout.layout;
+          packed.c = to_operand(executable.operands.size());
+          packed.d = to_operand(executable.layouts.fields(layout.layout).size());
+          executable.operands.resize(executable.operands.size() + packed.d);
+          for (size_t i = 0; i < struct_create.fields.size(); ++i) {
+            executable.operands[packed.c + layout.offsets[i]] =
+                to_operand(struct_create.fields[i].second);
+          }
+          break;
+        }
+        case Type::StructLiteralCreate: {
+          const auto &struct_literal_create =
+              derived_cast<const Bytecode::Instruction::StructLiteralCreate &>(*instr);
+          std::vector<std::string> names;
+          for (const auto &field : struct_literal_create.fields) {
+            names.push_back(field.first);
+          }
+          const auto layout = executable.layouts.intern(names);
+          packed.a = to_operand(struct_literal_create.dst);
+          packed.b = layout.layout;
+          packed.c = to_operand(executable.values.size());
+          packed.d = to_operand(executable.layouts.fields(layout.layout).size());
+          executable.values.resize(executable.values.size() + packed.d);
+          for (size_t i = 0; i < struct_literal_create.fields.size(); ++i) {
+            executable.values[packed.c + layout.offsets[i]] =
+                struct_literal_create.fields[i].second;
+          }
+          break;
+        }
+        case Type::StructLoad: {
+          const auto &struct_load =
+              derived_cast<const Bytecode::Instruction::StructLoad &>(*instr);
+          packed.a = to_operand(struct_load.dst);
+          packed.b = to_operand(struct_load.object);
+          packed.c = intern(struct_load.field);
+          packed.d = to_operand(executable.inline_cache_count++);
+          break;
+        }
+        case Type::StructStore: {
+          const auto &struct_store =
+              derived_cast<const Bytecode::Instruction::StructStore &>(*instr);
+          packed.a = to_operand(struct_store.object);
+          packed.b = to_operand(struct_store.value);
+          packed.c = intern(struct_store.field);
+          packed.d = to_operand(executable.inline_cache_count++);
+          break;
+        }
+        case Type::AddressOf: {
+          const auto &address_of =
+              derived_cast<const Bytecode::Instruction::AddressOf &>(*instr);
+          packed.a = to_operand(address_of.dst);
+          packed.b = to_operand(address_of.src);
+          break;
+        }
+        case Type::LoadIndirect: {
+          const auto &load_indirect =
+              derived_cast<const Bytecode::Instruction::LoadIndirect &>(*instr);
+          packed.a = to_operand(load_indirect.dst);
+          packed.b = to_operand(load_indirect.pointer);
+          break;
+        }
+        case Type::Negate: {
+          const auto &negate = derived_cast<const Bytecode::Instruction::Negate &>(*instr);
+          packed.a = to_operand(negate.dst);
+          packed.b = to_operand(negate.src);
+          break;
+        }
+        case Type::LogicalNot: {
+          const auto &logical_not =
+              derived_cast<const Bytecode::Instruction::LogicalNot &>(*instr);
+          packed.a = to_operand(logical_not.dst);
+          packed.b = to_operand(logical_not.src);
+          break;
+        }
+        case Type::MoveJump: {
+          const auto &move_jump =
+              derived_cast<const Bytecode::Instruction::MoveJump &>(*instr);
+          packed.a = to_operand(move_jump.dst);
+          packed.b = to_operand(move_jump.src);
+          packed.c = target(move_jump.label);
+          break;
+        }
+        case Type::LoadJump: {
+          const auto &load_jump =
+              derived_cast<const Bytecode::Instruction::LoadJump &>(*instr);
+          packed.a = to_operand(load_jump.dst);
+          packed.c = target(load_jump.label);
+          packed.value = load_jump.value;
+          break;
+        }
+        case Type::AddImmediateJump: {
+          const auto &add_imm_jump =
+              derived_cast<const Bytecode::Instruction::AddImmediateJump &>(*instr);
+          packed.a = to_operand(add_imm_jump.dst);
+          packed.b = to_operand(add_imm_jump.src);
+          packed.c = target(add_imm_jump.label);
+          packed.value = add_imm_jump.value;
+          break;
+        }
+        case Type::AddReturn: {
+          const auto &add_return =
+              derived_cast<const Bytecode::Instruction::AddReturn &>(*instr);
+          packed.b = to_operand(add_return.src1);
+          packed.c = to_operand(add_return.src2);
+          break;
+        }
+        default:
+          assert(false);
+          break;
+      }
+      executable.code.push_back(packed);
+    }
+  }
+  return executable;
 }
 
-void BytecodeInterpreter::interpret_less_than_immediate(
-    const Bytecode::Instruction::LessThanImmediate &less_than_imm) {
-  reg(less_than_imm.dst) = reg(less_than_imm.lhs) < less_than_imm.value;
+void OpcodeProfile::dump(std::ostream &out, size_t top) const {
+  const auto flags = out.flags();
+  const auto precision = out.precision();
+  out << "dispatches " << dispatches << ", operations " << operations;
+  if (dispatches != 0) {
+    out << std::fixed << std::setprecision(3) << " ("
+        << static_cast<double>(operations) / static_cast<double>(dispatches)
+        << " per dispatch)";
+  }
+  out << "\n";
+
+  const auto dump_hottest = [&](const char *title, const std::vector<u64> &counts,
+                                size_t length) {
+    std::vector<size_t> order;
+    for (size_t i = 0; i < counts.size(); ++i) {
+      if (counts[i] != 0) {
+        order.push_back(i);
+      }
+    }
+    const auto shown = std::min(top, order.size());
+    std::partial_sort(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(shown),
+                      order.end(), [&counts](size_t lhs, size_t rhs) {
+                        return counts[lhs] != counts[rhs] ? counts[lhs] > counts[rhs]
+                                                          : lhs < rhs;
+                      });
+    out << title << "\n";
+    for (size_t i = 0; i < shown; ++i) {
+      const auto index = order[i];
+      out << std::right << std::setw(14) << counts[index] << std::setw(8) << std::fixed
+          << std::setprecision(2)
+          << 100.0 * static_cast<double>(counts[index]) / static_cast<double>(dispatches)
+          << "%  ";
+      // The first opcode is the most significant digit of the index.
+      std::vector<size_t> opcodes(length);
+      auto rest = index;
+      for (size_t j = length; j-- > 0;) {
+        opcodes[j] = rest % k_opcode_count;
+        rest /= k_opcode_count;
+      }
+      for (size_t j = 0; j < length; ++j) {
+        out << (j == 0 ? "" : " ") << k_opcode_names[opcodes[j]];
+      }
+      out << "\n";
+    }
+  };
+  dump_hottest("hottest pairs:", pairs, 2);
+  dump_hottest("hottest triples:", triples, 3);
+  out.flags(flags);
+  out.precision(precision);
 }
 
-void BytecodeInterpreter::interpret_greater_than(
-    const Bytecode::Instruction::GreaterThan &greater_than) {
-  reg(greater_than.dst) = reg(greater_than.lhs) > reg(greater_than.rhs);
-}
+BytecodeInterpreter::BytecodeInterpreter() = default;
+BytecodeInterpreter::~BytecodeInterpreter() = default;
 
-void BytecodeInterpreter::interpret_greater_than_immediate(
-    const Bytecode::Instruction::GreaterThanImmediate &greater_than_imm) {
-  reg(greater_than_imm.dst) = reg(greater_than_imm.lhs) > greater_than_imm.value;
+void BytecodeInterpreter::set_jit_enabled(bool enabled) {
+  if (!enabled) {
+    jit_.reset();
+  } else if (!jit_ && Jit::is_supported()) {
+    jit_ = std::make_unique<Jit>();
+  }
 }
 
-void BytecodeInterpreter::interpret_less_than_or_equal(
-    const Bytecode::Instruction::LessThanOrEqual &less_than_or_equal) {
-  reg(less_than_or_equal.dst) =
-      reg(less_than_or_equal.lhs) <= reg(less_than_or_equal.rhs);
+void BytecodeInterpreter::set_jit_thresholds(u32 call_threshold, u32 back_edge_threshold) {
+  assert(call_threshold > 0 && back_edge_threshold > 0);
+  call_threshold_ = call_threshold;
+  back_edge_threshold_ = back_edge_threshold;
 }
 
-void BytecodeInterpreter::interpret_less_than_or_equal_immediate(
-    const Bytecode::Instruction::LessThanOrEqualImmediate &less_than_or_equal_imm) {
-  reg(less_than_or_equal_imm.dst) =
-      reg(less_than_or_equal_imm.lhs) <= less_than_or_equal_imm.value;
+void BytecodeInterpreter::set_opcode_profiling(bool enabled) {
+  opcode_profiling_ = enabled;
 }
 
-void BytecodeInterpreter::interpret_greater_than_or_equal(
-    const Bytecode::Instruction::GreaterThanOrEqual &greater_than_or_equal) {
-  reg(greater_than_or_equal.dst) =
-      reg(greater_than_or_equal.lhs) >= reg(greater_than_or_equal.rhs);
+size_t BytecodeInterpreter::jit_compiled_function_count() const {
+  return jit_ ? jit_->compiled_function_count() : 0;
 }
 
-void BytecodeInterpreter::interpret_greater_than_or_equal_immediate(
-    const Bytecode::Instruction::GreaterThanOrEqualImmediate &greater_than_or_equal_imm) {
-  reg(greater_than_or_equal_imm.dst) =
-      reg(greater_than_or_equal_imm.lhs) >= greater_than_or_equal_imm.value;
+Bytecode::Value BytecodeInterpreter::interpret(
+    const std::vector<Bytecode::BasicBlock> &blocks) {
+  assert(!blocks.empty());
+  return interpret(lower_to_executable(blocks));
 }
 
-void BytecodeInterpreter::interpret_jump(const Bytecode::Instruction::Jump &jump) {
-  block_index = jump.label;
-  instr_index_ = 0;
-}
+Bytecode::Value BytecodeInterpreter::interpret(const Bytecode::Executable &executable) {
+  using Type = Bytecode::Instruction::Type;
 
-void BytecodeInterpreter::interpret_jump_conditional(
-    const Bytecode::Instruction::JumpConditional &jump_cond) {
-  if (reg(jump_cond.cond)) {
-    block_index = jump_cond.label1;
-  } else {
-    block_index = jump_cond.label2;
+  assert(!executable.code.empty());
+  call_stack_.clear();
+  frame_base_ = 0;
+  frame_size_ = executable.entry_frame_size;
+  initialize_frame_slots(register_stack_, frame_base_, frame_size_);
+  heap_.clear();
+  heap_.layouts() = executable.layouts;
+  inline_caches_.assign(executable.inline_cache_count, {});
+  pointers_.clear();
+  free_pointer_ids_.clear();
+  open_pointers_.clear();
+  pointer_collection_threshold_ = Heap::k_min_collection_threshold;
+
+  native_functions_ = nullptr;
+  osr_transfer_count_ = 0;
+  if (jit_) {
+    jit_->load(executable);
+    native_functions_ = jit_->functions().data();
+    call_counts_.assign(executable.code.size(), 0);
+    back_edge_counts_.assign(executable.code.size(), 0);
   }
-  instr_index_ = 0;
-}
 
-void BytecodeInterpreter::interpret_jump_equal_immediate(
-    const Bytecode::Instruction::JumpEqualImmediate &jump_equal_imm) {
-  if (reg(jump_equal_imm.src) == jump_equal_imm.value) {
-    block_index = jump_equal_imm.label1;
-  } else {
-    block_index = jump_equal_imm.label2;
+  // Opcodes of the last two instructions dispatched, when they were adjacent
+  // in the code.
+  const Instruction *previous = nullptr;
+  size_t previous_pair = k_opcode_count * k_opcode_count;
+  if (opcode_profiling_) {
+    opcode_profile_ = {};
+    opcode_profile_.pairs.assign(k_opcode_count * k_opcode_count, 0);
+    opcode_profile_.triples.assign(k_opcode_count * k_opcode_count * k_opcode_count, 0);
   }
-  instr_index_ = 0;
-}
+  const auto profile_dispatch = [&](const Instruction *at) {
+    const auto opcode = static_cast<size_t>(at->type);
+    ++opcode_profile_.dispatches;
+    opcode_profile_.operations += has_opcode_flag(at->type, k_fused) ? 2 : 1;
+    size_t pair = k_opcode_count * k_opcode_count;
+    if (previous != nullptr && at == previous + 1) {
+      pair = static_cast<size_t>(previous->type) * k_opcode_count + opcode;
+      ++opcode_profile_.pairs[pair];
+      if (previous_pair < k_opcode_count * k_opcode_count) {
+        ++opcode_profile_.triples[previous_pair * k_opcode_count + opcode];
+      }
+    }
+    previous = at;
+    previous_pair = pair;
+  };
 
-void BytecodeInterpreter::interpret_jump_greater_than_immediate(
-    const Bytecode::Instruction::JumpGreaterThanImmediate &jump_greater_than_imm) {
-  if (reg(jump_greater_than_imm.lhs) > jump_greater_than_imm.value) {
-    block_index = jump_greater_than_imm.label1;
-  } else {
-    block_index = jump_greater_than_imm.label2;
+  const auto *code = executable.code.data();
+  const auto *operands = executable.operands.data();
+  const auto *values = executable.values.data();
+  const auto &strings = executable.strings;
+  const Instruction *ip = code;
+  // Base of the current frame. Refreshed whenever the frame changes or the
+  // register stack may have been reallocated.
+  Bytecode::Value *regs = register_stack_.data();
+  const auto sync_frame = [&] { regs = register_stack_.data() + frame_base_; };
+  Bytecode::Value return_value = 0;
+
+#if KAI_THREADED_DISPATCH
+  // Direct threading: translate every opcode into its handler address once, so
+  // each handler ends with a single indirect jump to the next one.
+  const void *opcode_handlers[k_opcode_count] = {};
+  opcode_handlers[static_cast<size_t>(Type::Move)] = &&op_move;
+  opcode_handlers[static_cast<size_t>(Type::Load)] = &&op_load;
+  opcode_handlers[static_cast<size_t>(Type::LessThan)] = &&op_less_than;
+  opcode_handlers[static_cast<size_t>(Type::LessThanImmediate)] = &&op_less_than_immediate;
+  opcode_handlers[static_cast<size_t>(Type::GreaterThan)] = &&op_greater_than;
+  opcode_handlers[static_cast<size_t>(Type::GreaterThanImmediate)] =
+      &&op_greater_than_immediate;
+  opcode_handlers[static_cast<size_t>(Type::LessThanOrEqual)] = &&op_less_than_or_equal;
+  opcode_handlers[static_cast<size_t>(Type::LessThanOrEqualImmediate)] =
+      &&op_less_than_or_equal_immediate;
+  opcode_handlers[static_cast<size_t>(Type::GreaterThanOrEqual)] =
+      &&op_greater_than_or_equal;
+  opcode_handlers[static_cast<size_t>(Type::GreaterThanOrEqualImmediate)] =
+      &&op_greater_than_or_equal_immediate;
+  opcode_handlers[static_cast<size_t>(Type::Jump)] = &&op_jump;
+  opcode_handlers[static_cast<size_t>(Type::JumpConditional)] = &&op_jump_conditional;
+  opcode_handlers[static_cast<size_t>(Type::JumpEqualImmediate)] =
+      &&op_jump_equal_immediate;
+  opcode_handlers[static_cast<size_t>(Type::JumpGreaterThanImmediate)] =
+      &&op_jump_greater_than_immediate;
+  opcode_handlers[static_cast<size_t>(Type::JumpLessThanOrEqual)] =
+      &&op_jump_less_than_or_equal;
+  opcode_handlers[static_cast<size_t>(Type::JumpLessThan)] = &&op_jump_less_than;
+  opcode_handlers[static_cast<size_t>(Type::JumpLessThanImmediate)] =
+      &&op_jump_less_than_immediate;
+  opcode_handlers[static_cast<size_t>(Type::JumpGreaterThan)] = &&op_jump_greater_than;
+  opcode_handlers[static_cast<size_t>(Type::JumpLessThanOrEqualImmediate)] =
+      &&op_jump_less_than_or_equal_immediate;
+  opcode_handlers[static_cast<size_t>(Type::JumpGreaterThanOrEqual)] =
+      &&op_jump_greater_than_or_equal;
+  opcode_handlers[static_cast<size_t>(Type::JumpGreaterThanOrEqualImmediate)] =
+      &&op_jump_greater_than_or_equal_immediate;
+  opcode_handlers[static_cast<size_t>(Type::JumpEqual)] = &&op_jump_equal;
+  opcode_handlers[static_cast<size_t>(Type::JumpNotEqual)] = &&op_jump_not_equal;
+  opcode_handlers[static_cast<size_t>(Type::JumpNotEqualImmediate)] =
+      &&op_jump_not_equal_immediate;
+  opcode_handlers[static_cast<size_t>(Type::Call)] = &&op_call;
+  opcode_handlers[static_cast<size_t>(Type::TailCall)] = &&op_tail_call;
+  opcode_handlers[static_cast<size_t>(Type::Return)] = &&op_return;
+  opcode_handlers[static_cast<size_t>(Type::Equal)] = &&op_equal;
+  opcode_handlers[static_cast<size_t>(Type::EqualImmediate)] = &&op_equal_immediate;
+  opcode_handlers[static_cast<size_t>(Type::NotEqual)] = &&op_not_equal;
+  opcode_handlers[static_cast<size_t>(Type::NotEqualImmediate)] = &&op_not_equal_immediate;
+  opcode_handlers[static_cast<size_t>(Type::Add)] = &&op_add;
+  opcode_handlers[static_cast<size_t>(Type::AddImmediate)] = &&op_add_immediate;
+  opcode_handlers[static_cast<size_t>(Type::Subtract)] = &&op_subtract;
+  opcode_handlers[static_cast<size_t>(Type::SubtractImmediate)] = &&op_subtract_immediate;
+  opcode_handlers[static_cast<size_t>(Type::Multiply)] = &&op_multiply;
+  opcode_handlers[static_cast<size_t>(Type::MultiplyImmediate)] = &&op_multiply_immediate;
+  opcode_handlers[static_cast<size_t>(Type::Divide)] = &&op_divide;
+  opcode_handlers[static_cast<size_t>(Type::DivideImmediate)] = &&op_divide_immediate;
+  opcode_handlers[static_cast<size_t>(Type::Modulo)] = &&op_modulo;
+  opcode_handlers[static_cast<size_t>(Type::ModuloImmediate)] = &&op_modulo_immediate;
+  opcode_handlers[static_cast<size_t>(Type::ArrayCreate)] = &&op_array_create;
+  opcode_handlers[static_cast<size_t>(Type::ArrayLiteralCreate)] =
+      &&op_array_literal_create;
+  opcode_handlers[static_cast<size_t>(Type::ArrayLoad)] = &&op_array_load;
+  opcode_handlers[static_cast<size_t>(Type::ArrayLoadImmediate)] =
+      &&op_array_load_immediate;
+  opcode_handlers[static_cast<size_t>(Type::ArrayStore)] = &&op_array_store;
+  opcode_handlers[static_cast<size_t>(Type::ArrayLoadUnchecked)] = &&op_array_load_unchecked;
+  opcode_handlers[static_cast<size_t>(Type::ArrayStoreUnchecked)] =
+      &&op_array_store_unchecked;
+  opcode_handlers[static_cast<size_t>(Type::StructCreate)] = &&op_struct_create;
+  opcode_handlers[static_cast<size_t>(Type::StructLiteralCreate)] =
+      &&op_struct_literal_create;
+  opcode_handlers[static_cast<size_t>(Type::StructLoad)] = &&op_struct_load;
+  opcode_handlers[static_cast<size_t>(Type::StructStore)] = &&op_struct_store;
+  opcode_handlers[static_cast<size_t>(Type::AddressOf)] = &&op_address_of;
+  opcode_handlers[static_cast<size_t>(Type::LoadIndirect)] = &&op_load_indirect;
+  opcode_handlers[static_cast<size_t>(Type::Negate)] = &&op_negate;
+  opcode_handlers[static_cast<size_t>(Type::LogicalNot)] = &&op_logical_not;
+  opcode_handlers[static_cast<size_t>(Type::MoveJump)] = &&op_move_jump;
+  opcode_handlers[static_cast<size_t>(Type::LoadJump)] = &&op_load_jump;
+  opcode_handlers[static_cast<size_t>(Type::AddImmediateJump)] = &&op_add_immediate_jump;
+  opcode_handlers[static_cast<size_t>(Type::AddReturn)] = &&op_add_return;
+
+  // While profiling, every instruction goes through op_profile first.
+  std::vector<const void *> threaded_code(executable.code.size());
+  for (size_t i = 0; i < executable.code.size(); ++i) {
+    threaded_code[i] = opcode_profiling_ ? &&op_profile
+                                         : opcode_handlers[static_cast<size_t>(code[i].type)];
+    assert(opcode_handlers[static_cast<size_t>(code[i].type)] != nullptr);
   }
-  instr_index_ = 0;
-}
-
-void BytecodeInterpreter::interpret_jump_less_than_or_equal(
-    const Bytecode::Instruction::JumpLessThanOrEqual &jump_less_than_or_equal) {
-  if (reg(jump_less_than_or_equal.lhs) <= reg(jump_less_than_or_equal.rhs)) {
-    block_index = jump_less_than_or_equal.label1;
-  } else {
-    block_index = jump_less_than_or_equal.label2;
+  const void *const *handlers = threaded_code.data();
+#define KAI_DISPATCH() goto *handlers[ip - code]
+#else
+#define KAI_DISPATCH() goto dispatch
+#endif
+#define KAI_NEXT() \
+  do {             \
+    ++ip;          \
+    KAI_DISPATCH(); \
+  } while (0)
+#define KAI_JUMP(target) \
+  do {                   \
+    ip = code + (target); \
+    KAI_DISPATCH();      \
+  } while (0)
+// A jump that may close a loop. With the JIT enabled, a back edge that makes
+// its loop hot moves the current activation into native code, which runs it
+// to completion, or runs out of stack and leaves it to the interpreter.
+#define KAI_BRANCH(target)                                                     \
+  do {                                                                         \
+    const u32 branch_target = (target);                                        \
+    if (native_functions_ != nullptr && branch_target <= ip - code &&          \
+        ++back_edge_counts_[branch_target] == back_edge_threshold_) {          \
+      if (const auto osr = back_edge_osr_entry(branch_target)) {               \
+        auto *frame = jit_->stack();                                           \
+        std::copy_n(regs, frame_size_, frame);                                 \
+        if (const auto result = jit_->run(osr, frame)) {                       \
+          ++osr_transfer_count_;                                               \
+          return_value = *result;                                              \
+          goto return_to_caller;                                               \
+        }                                                                      \
+        native_functions_ = nullptr;                                           \
+      }                                                                        \
+    }                                                                          \
+    KAI_JUMP(branch_target);                                                   \
+  } while (0)
+
+  KAI_DISPATCH();
+
+#if KAI_THREADED_DISPATCH
+op_profile:
+  profile_dispatch(ip);
+  goto *opcode_handlers[static_cast<size_t>(ip->type)];
+#else
+dispatch:
+  assert(ip >= code && ip < code + executable.code.size());
+  if (opcode_profiling_) {
+    profile_dispatch(ip);
   }
-  instr_index_ = 0;
-}
+  switch (ip->type) {
+    case Type::Move: goto op_move;
+    case Type::Load: goto op_load;
+    case Type::LessThan: goto op_less_than;
+    case Type::LessThanImmediate: goto op_less_than_immediate;
+    case Type::GreaterThan: goto op_greater_than;
+    case Type::GreaterThanImmediate: goto op_greater_than_immediate;
+    case Type::LessThanOrEqual: goto op_less_than_or_equal;
+    case Type::LessThanOrEqualImmediate: goto op_less_than_or_equal_immediate;
+    case Type::GreaterThanOrEqual: goto op_greater_than_or_equal;
+    case Type::GreaterThanOrEqualImmediate: goto op_greater_than_or_equal_immediate;
+    case Type::Jump: goto op_jump;
+    case Type::JumpConditional: goto op_jump_conditional;
+    case Type::JumpEqualImmediate: goto op_jump_equal_immediate;
+    case Type::JumpGreaterThanImmediate: goto op_jump_greater_than_immediate;
+    case Type::JumpLessThanOrEqual: goto op_jump_less_than_or_equal;
+    case Type::JumpLessThan: goto op_jump_less_than;
+    case Type::JumpLessThanImmediate: goto op_jump_less_than_immediate;
+    case Type::JumpGreaterThan: goto op_jump_greater_than;
+    case Type::JumpLessThanOrEqualImmediate: goto op_jump_less_than_or_equal_immediate;
+    case Type::JumpGreaterThanOrEqual: goto op_jump_greater_than_or_equal;
+    case Type::JumpGreaterThanOrEqualImmediate: goto op_jump_greater_than_or_equal_immediate;
+    case Type::JumpEqual: goto op_jump_equal;
+    case Type::JumpNotEqual: goto op_jump_not_equal;
+    case Type::JumpNotEqualImmediate: goto op_jump_not_equal_immediate;
+    case Type::Call: goto op_call;
+    case Type::TailCall: goto op_tail_call;
+    case Type::Return: goto op_return;
+    case Type::Equal: goto op_equal;
+    case Type::EqualImmediate: goto op_equal_immediate;
+    case Type::NotEqual: goto op_not_equal;
+    case Type::NotEqualImmediate: goto op_not_equal_immediate;
+    case Type::Add: goto op_add;
+    case Type::AddImmediate: goto op_add_immediate;
+    case Type::Subtract: goto op_subtract;
+    case Type::SubtractImmediate: goto op_subtract_immediate;
+    case Type::Multiply: goto op_multiply;
+    case Type::MultiplyImmediate: goto op_multiply_immediate;
+    case Type::Divide: goto op_divide;
+    case Type::DivideImmediate: goto op_divide_immediate;
+    case Type::Modulo: goto op_modulo;
+    case Type::ModuloImmediate: goto op_modulo_immediate;
+    case Type::ArrayCreate: goto op_array_create;
+    case Type::ArrayLiteralCreate: goto op_array_literal_create;
+    case Type::ArrayLoad: goto op_array_load;
+    case Type::ArrayLoadImmediate: goto op_array_load_immediate;
+    case Type::ArrayStore: goto op_array_store;
+    case Type::ArrayLoadUnchecked: goto op_array_load_unchecked;
+    case Type::ArrayStoreUnchecked: goto op_array_store_unchecked;
+    case Type::StructCreate: goto op_struct_create;
+    case Type::StructLiteralCreate: goto op_struct_literal_create;
+    case Type::StructLoad: goto op_struct_load;
+    case Type::StructStore: goto op_struct_store;
+    case Type::AddressOf: goto op_address_of;
+    case Type::LoadIndirect: goto op_load_indirect;
+    case Type::Negate: goto op_negate;
+    case Type::LogicalNot: goto op_logical_not;
+    case Type::MoveJump: goto op_move_jump;
+    case Type::LoadJump: goto op_load_jump;
+    case Type::AddImmediateJump: goto op_add_immediate_jump;
+    case Type::AddReturn: goto op_add_return;
+  }
+  assert(false);
+#endif
 
-void BytecodeInterpreter::interpret_call(const Bytecode::Instruction::Call &call,
-                                         size_t next_instr_index) {
-  assert(call.arg_registers.size() == call.param_registers.size());
+op_move:
+  regs[ip->a] = regs[ip->b];
+  KAI_NEXT();
 
-  const size_t new_frame_base = frame_base_ + register_count_;
-  initialize_frame_slots(register_stack_, new_frame_base, register_count_);
-  for (size_t i = 0; i < call.param_registers.size(); ++i) {
-    *register_stack_[new_frame_base + call.param_registers[i]] =
-        reg(call.arg_registers[i]);
-  }
-  call_stack_.push_back({block_index, next_instr_index, call.dst, frame_base_});
-  frame_base_ = new_frame_base;
-  block_index = call.label;
-  instr_index_ = 0;
-}
+op_load:
+  regs[ip->a] = ip->value;
+  KAI_NEXT();
 
-void BytecodeInterpreter::interpret_tail_call(
-    const Bytecode::Instruction::TailCall &tail_call) {
-  assert(tail_call.arg_registers.size() == tail_call.param_registers.size());
+op_less_than:
+  regs[ip->a] = regs[ip->b] < regs[ip->c];
+  KAI_NEXT();
 
-  // Copy argument values first to avoid clobbering when args and params overlap.
-  std::vector<Bytecode::Value> args;
-  args.reserve(tail_call.arg_registers.size());
-  for (const auto arg : tail_call.arg_registers) {
-    args.push_back(reg(arg));
-  }
-  for (size_t i = 0; i < tail_call.param_registers.size(); ++i) {
-    reg(tail_call.param_registers[i]) = args[i];
-  }
+op_less_than_immediate:
+  regs[ip->a] = regs[ip->b] < ip->value;
+  KAI_NEXT();
 
-  block_index = tail_call.label;
-  instr_index_ = 0;
-}
+op_greater_than:
+  regs[ip->a] = regs[ip->b] > regs[ip->c];
+  KAI_NEXT();
 
-void BytecodeInterpreter::interpret_equal(const Bytecode::Instruction::Equal &equal) {
-  reg(equal.dst) = reg(equal.src1) == reg(equal.src2);
-}
+op_greater_than_immediate:
+  regs[ip->a] = regs[ip->b] > ip->value;
+  KAI_NEXT();
 
-void BytecodeInterpreter::interpret_equal_immediate(
-    const Bytecode::Instruction::EqualImmediate &equal_imm) {
-  reg(equal_imm.dst) = reg(equal_imm.src) == equal_imm.value;
-}
+op_less_than_or_equal:
+  regs[ip->a] = regs[ip->b] <= regs[ip->c];
+  KAI_NEXT();
 
-void BytecodeInterpreter::interpret_not_equal(
-    const Bytecode::Instruction::NotEqual &not_equal) {
-  reg(not_equal.dst) = reg(not_equal.src1) != reg(not_equal.src2);
-}
+op_less_than_or_equal_immediate:
+  regs[ip->a] = regs[ip->b] <= ip->value;
+  KAI_NEXT();
 
-void BytecodeInterpreter::interpret_not_equal_immediate(
-    const Bytecode::Instruction::NotEqualImmediate &not_equal_imm) {
-  reg(not_equal_imm.dst) = reg(not_equal_imm.src) != not_equal_imm.value;
-}
+op_greater_than_or_equal:
+  regs[ip->a] = regs[ip->b] >= regs[ip->c];
+  KAI_NEXT();
 
-void BytecodeInterpreter::interpret_add(const Bytecode::Instruction::Add &add) {
-  reg(add.dst) = reg(add.src1) + reg(add.src2);
-}
+op_greater_than_or_equal_immediate:
+  regs[ip->a] = regs[ip->b] >= ip->value;
+  KAI_NEXT();
 
-void BytecodeInterpreter::interpret_add_immediate(
-    const Bytecode::Instruction::AddImmediate &add_imm) {
-  reg(add_imm.dst) = reg(add_imm.src) + add_imm.value;
-}
+op_jump:
+  KAI_BRANCH(ip->b);
 
-void BytecodeInterpreter::interpret_subtract(
-    const Bytecode::Instruction::Subtract &subtract) {
-  reg(subtract.dst) = reg(subtract.src1) - reg(subtract.src2);
-}
+op_jump_conditional:
+  KAI_BRANCH(regs[ip->a] ? ip->b : ip->c);
 
-void BytecodeInterpreter::interpret_subtract_immediate(
-    const Bytecode::Instruction::SubtractImmediate &subtract_imm) {
-  reg(subtract_imm.dst) = reg(subtract_imm.src) - subtract_imm.value;
-}
+op_jump_equal_immediate:
+  KAI_BRANCH(regs[ip->a] == ip->value ? ip->b : ip->c);
 
-void BytecodeInterpreter::interpret_multiply(
-    const Bytecode::Instruction::Multiply &multiply) {
-  reg(multiply.dst) = reg(multiply.src1) * reg(multiply.src2);
-}
+op_jump_greater_than_immediate:
+  KAI_BRANCH(regs[ip->a] > ip->value ? ip->b : ip->c);
 
-void BytecodeInterpreter::interpret_multiply_immediate(
-    const Bytecode::Instruction::MultiplyImmediate &multiply_imm) {
-  reg(multiply_imm.dst) = reg(multiply_imm.src) * multiply_imm.value;
-}
+op_jump_less_than_or_equal:
+  KAI_BRANCH(regs[ip->a] <= regs[ip->d] ? ip->b : ip->c);
 
-void BytecodeInterpreter::interpret_divide(const Bytecode::Instruction::Divide &divide) {
-  reg(divide.dst) = reg(divide.src1) / reg(divide.src2);
-}
+op_jump_less_than:
+  KAI_BRANCH(regs[ip->a] < regs[ip->d] ? ip->b : ip->c);
 
-void BytecodeInterpreter::interpret_divide_immediate(
-    const Bytecode::Instruction::DivideImmediate &divide_imm) {
-  reg(divide_imm.dst) = reg(divide_imm.src) / divide_imm.value;
-}
+op_jump_less_than_immediate:
+  KAI_BRANCH(regs[ip->a] < ip->value ? ip->b : ip->c);
 
-void BytecodeInterpreter::interpret_modulo(const Bytecode::Instruction::Modulo &modulo) {
-  reg(modulo.dst) = reg(modulo.src1) % reg(modulo.src2);
-}
+op_jump_greater_than:
+  KAI_BRANCH(regs[ip->a] > regs[ip->d] ? ip->b : ip->c);
 
-void BytecodeInterpreter::interpret_modulo_immediate(
-    const Bytecode::Instruction::ModuloImmediate &modulo_imm) {
-  reg(modulo_imm.dst) = reg(modulo_imm.src) % modulo_imm.value;
-}
+op_jump_less_than_or_equal_immediate:
+  KAI_BRANCH(regs[ip->a] <= ip->value ? ip->b : ip->c);
+
+op_jump_greater_than_or_equal:
+  KAI_BRANCH(regs[ip->a] >= regs[ip->d] ? ip->b : ip->c);
+
+op_jump_greater_than_or_equal_immediate:
+  KAI_BRANCH(regs[ip->a] >= ip->value ? ip->b : ip->c);
+
+op_jump_equal:
+  KAI_BRANCH(regs[ip->a] == regs[ip->d] ? ip->b : ip->c);
+
+op_jump_not_equal:
+  KAI_BRANCH(regs[ip->a] != regs[ip->d] ? ip->b : ip->c);
 
-void BytecodeInterpreter::interpret_array_create(
-    const Bytecode::Instruction::ArrayCreate &array_create) {
-  auto array_id = next_heap_id_++;
-  auto &array = arrays_[array_id];
-  array.reserve(array_create.elements.size());
-  for (auto element_reg : array_create.elements) {
-    array.push_back(reg(element_reg));
+op_jump_not_equal_immediate:
+  KAI_BRANCH(regs[ip->a] != ip->value ? ip->b : ip->c);
+
+op_call: {
+  if (native_functions_ != nullptr) {
+    if (native_functions_[ip->b] == nullptr && ++call_counts_[ip->b] == call_threshold_) {
+      jit_->compile_function(ip->b);
+    }
+    if (const auto native = native_functions_[ip->b]) {
+      if (const auto result = call_native(native, *ip, regs, operands)) {
+        regs[ip->a] = *result;
+        KAI_NEXT();
+      }
+    }
   }
-  reg(array_create.dst) = array_id;
+  const auto *args = operands + ip->c;
+  const auto *params = args + ip->d;
+  const size_t new_frame_base = frame_base_ + frame_size_;
+  const size_t new_frame_size = ip->value;
+  initialize_frame_slots(register_stack_, new_frame_base, new_frame_size);
+  sync_frame();
+  auto *callee_regs = register_stack_.data() + new_frame_base;
+  for (u32 i = 0; i < ip->d; ++i) {
+    assert(params[i] < new_frame_size);
+    callee_regs[params[i]] = regs[args[i]];
+  }
+  call_stack_.push_back(
+      {static_cast<size_t>(ip - code) + 1, ip->a, frame_base_, frame_size_});
+  frame_base_ = new_frame_base;
+  frame_size_ = new_frame_size;
+  regs = callee_regs;
+  KAI_JUMP(ip->b);
 }
 
-void BytecodeInterpreter::interpret_array_literal_create(
-    const Bytecode::Instruction::ArrayLiteralCreate &array_literal_create) {
-  auto array_id = next_heap_id_++;
-  auto &array = arrays_[array_id];
-  array = array_literal_create.elements;
-  reg(array_literal_create.dst) = array_id;
+op_tail_call: {
+  if (native_functions_ != nullptr) {
+    if (native_functions_[ip->b] == nullptr && ++call_counts_[ip->b] == call_threshold_) {
+      jit_->compile_function(ip->b);
+    }
+    if (const auto native = native_functions_[ip->b]) {
+      if (const auto result = call_native(native, *ip, regs, operands)) {
+        return_value = *result;
+        goto return_to_caller;
+      }
+    }
+  }
+  // The callee takes over this frame; widen it if the callee needs more slots.
+  // Arguments all live below the old frame size, so widening keeps them.
+  close_pointers(frame_base_);
+  const size_t new_frame_size = ip->value;
+  if (new_frame_size > frame_size_) {
+    initialize_frame_slots(register_stack_, frame_base_ + frame_size_,
+                           new_frame_size - frame_size_);
+    sync_frame();
+  }
+  frame_size_ = new_frame_size;
+  // Arguments reach the parameters through the move schedule from lowering.
+  const auto *moves = operands + ip->c + 2 * ip->d;
+  Bytecode::Value temporary = 0;
+  for (u32 i = 0; i < ip->a; ++i) {
+    const u32 dst = moves[2 * i];
+    const u32 src = moves[2 * i + 1];
+    const auto value =
+        src == Bytecode::Executable::k_move_temporary ? temporary : regs[src];
+    if (dst == Bytecode::Executable::k_move_temporary) {
+      temporary = value;
+    } else {
+      regs[dst] = value;
+    }
+  }
+  KAI_JUMP(ip->b);
 }
 
-void BytecodeInterpreter::interpret_array_load(
-    const Bytecode::Instruction::ArrayLoad &array_load) {
-  auto array_id = reg(array_load.array);
-  auto index = reg(array_load.index);
-  const auto it = arrays_.find(array_id);
-  assert(it != arrays_.end());
-  assert(index < it->second.size());
-  reg(array_load.dst) = it->second[index];
+op_return:
+  return_value = regs[ip->a];
+return_to_caller: {
+  if (call_stack_.empty()) {
+    return return_value;
+  }
+  close_pointers(frame_base_);
+  const auto frame = call_stack_.back();
+  call_stack_.pop_back();
+  frame_base_ = frame.frame_base;
+  frame_size_ = frame.frame_size;
+  sync_frame();
+  regs[frame.dst_register] = return_value;
+  KAI_JUMP(frame.return_pc);
+}
+
+op_equal:
+  regs[ip->a] = regs[ip->b] == regs[ip->c];
+  KAI_NEXT();
+
+op_equal_immediate:
+  regs[ip->a] = regs[ip->b] == ip->value;
+  KAI_NEXT();
+
+op_not_equal:
+  regs[ip->a] = regs[ip->b] != regs[ip->c];
+  KAI_NEXT();
+
+op_not_equal_immediate:
+  regs[ip->a] = regs[ip->b] != ip->value;
+  KAI_NEXT();
+
+op_add:
+  regs[ip->a] = regs[ip->b] + regs[ip->c];
+  KAI_NEXT();
+
+op_add_immediate:
+  regs[ip->a] = regs[ip->b] + ip->value;
+  KAI_NEXT();
+
+op_subtract:
+  regs[ip->a] = regs[ip->b] - regs[ip->c];
+  KAI_NEXT();
+
+op_subtract_immediate:
+  regs[ip->a] = regs[ip->b] - ip->value;
+  KAI_NEXT();
+
+op_multiply:
+  regs[ip->a] = regs[ip->b] * regs[ip->c];
+  KAI_NEXT();
+
+op_multiply_immediate:
+  regs[ip->a] = regs[ip->b] * ip->value;
+  KAI_NEXT();
+
+op_divide:
+  regs[ip->a] = regs[ip->b] / regs[ip->c];
+  KAI_NEXT();
+
+op_divide_immediate:
+  regs[ip->a] = regs[ip->b] / ip->value;
+  KAI_NEXT();
+
+op_modulo:
+  regs[ip->a] = regs[ip->b] % regs[ip->c];
+  KAI_NEXT();
+
+op_modulo_immediate:
+  regs[ip->a] = regs[ip->b] % ip->value;
+  KAI_NEXT();
+
+op_array_create: {
+  if (heap_.should_collect()) {
+    collect_garbage();
+  }
+  const auto *elements = operands + ip->c;
+  std::vector<Bytecode::Value> array;
+  array.reserve(ip->d);
+  for (u32 i = 0; i < ip->d; ++i) {
+    array.push_back(regs[elements[i]]);
+  }
+  regs[ip->a] = heap_.allocate_array(std::move(array));
+  KAI_NEXT();
 }
 
-void BytecodeInterpreter::interpret_array_load_immediate(
-    const Bytecode::Instruction::ArrayLoadImmediate &array_load_immediate) {
-  const auto array_id = reg(array_load_immediate.array);
-  const auto index = array_load_immediate.index;
-  const auto it = arrays_.find(array_id);
-  assert(it != arrays_.end());
-  assert(index < it->second.size());
-  reg(array_load_immediate.dst) = it->second[index];
+op_array_literal_create: {
+  if (heap_.should_collect()) {
+    collect_garbage();
+  }
+  const auto *elements = values + ip->c;
+  regs[ip->a] =
+      heap_.allocate_array(std::vector<Bytecode::Value>(elements, elements + ip->d));
+  KAI_NEXT();
 }
 
-void BytecodeInterpreter::interpret_array_store(
-    const Bytecode::Instruction::ArrayStore &array_store) {
-  const auto array_id = reg(array_store.array);
-  const auto index = reg(array_store.index);
-  const auto value = reg(array_store.value);
-  const auto it = arrays_.find(array_id);
-  assert(it != arrays_.end());
-  assert(index < it->second.size());
-  it->second[index] = value;
-}
+op_array_load:
+  regs[ip->a] = heap_.load(regs[ip->b], regs[ip->c]);
+  KAI_NEXT();
+
+op_array_load_immediate:
+  regs[ip->a] = heap_.load(regs[ip->b], ip->value);
+  KAI_NEXT();
+
+op_array_store:
+  heap_.store(regs[ip->a], regs[ip->b], regs[ip->c]);
+  KAI_NEXT();
+
+op_array_load_unchecked:
+  regs[ip->a] = heap_.load_unchecked(regs[ip->b], regs[ip->c]);
+  KAI_NEXT();
 
-void BytecodeInterpreter::interpret_struct_create(
-    const Bytecode::Instruction::StructCreate &struct_create) {
-  auto struct_id = next_heap_id_++;
-  auto &fields = structs_[struct_id];
-  for (const auto &field : struct_create.fields) {
-    fields[field.first] = reg(field.second);
+op_array_store_unchecked:
+  heap_.store_unchecked(regs[ip->a], regs[ip->b], regs[ip->c]);
+  KAI_NEXT();
+
+op_struct_create: {
+  if (heap_.should_collect()) {
+    collect_garbage();
+  }
+  const auto *field_registers = operands + ip->c;
+  std::vector<Bytecode::Value> fields;
+  fields.reserve(ip->d);
+  for (u32 i = 0; i < ip->d; ++i) {
+    fields.push_back(regs[field_registers[i]]);
   }
-  reg(struct_create.dst) = struct_id;
+  regs[ip->a] = heap_.allocate_struct(ip->b, std::move(fields));
+  KAI_NEXT();
 }
 
-void BytecodeInterpreter::interpret_struct_literal_create(
-    const Bytecode::Instruction::StructLiteralCreate &struct_literal_create) {
-  auto struct_id = next_heap_id_++;
-  auto &fields = structs_[struct_id];
-  for (const auto &field : struct_literal_create.fields) {
-    fields[field.first] = field.second;
+op_struct_literal_create: {
+  if (heap_.should_collect()) {
+    collect_garbage();
+  }
+  const auto *field_values = values + ip->c;
+  regs[ip->a] = heap_.allocate_struct(
+      ip->b, std::vector<Bytecode::Value>(field_values, field_values + ip->d));
+  KAI_NEXT();
+}
+
+op_struct_load: {
+  const auto handle = regs[ip->b];
+  const auto layout = heap_.struct_layout(handle);
+  const auto &cache = inline_caches_[ip->d];
+  const auto offset = cache.layouts[0] == layout
+                          ? cache.offsets[0]
+                          : field_offset_miss(ip->d, layout, strings[ip->c]);
+  regs[ip->a] = heap_.load_field(handle, offset);
+  KAI_NEXT();
+}
+
+op_struct_store: {
+  const auto handle = regs[ip->a];
+  const auto layout = heap_.struct_layout(handle);
+  const auto &cache = inline_caches_[ip->d];
+  const auto offset = cache.layouts[0] == layout
+                          ? cache.offsets[0]
+                          : field_offset_miss(ip->d, layout, strings[ip->c]);
+  heap_.store_field(handle, offset, regs[ip->b]);
+  KAI_NEXT();
+}
+
+op_address_of: {
+  const auto absolute_register_index = frame_base_ + ip->b;
+  assert(absolute_register_index < register_stack_.size());
+  if (free_pointer_ids_.empty() && pointers_.size() >= pointer_collection_threshold_) {
+    collect_garbage();
+  }
+  size_t id = pointers_.size();
+  if (free_pointer_ids_.empty()) {
+    pointers_.push_back({absolute_register_index, 0});
+  } else {
+    id = free_pointer_ids_.back();
+    free_pointer_ids_.pop_back();
+    pointers_[id] = {absolute_register_index, 0};
+  }
+  open_pointers_.push_back(id);
+  regs[ip->a] = pointer_handle(id);
+  KAI_NEXT();
+}
+
+op_load_indirect: {
+  const auto id = pointer_id(regs[ip->b]);
+  assert(id < pointers_.size());
+  const auto &cell = pointers_[id];
+  assert(cell.slot != k_free_pointer);
+  if (cell.slot == k_closed_pointer) {
+    regs[ip->a] = cell.value;
+  } else {
+    assert(cell.slot < register_stack_.size());
+    regs[ip->a] = register_stack_[cell.slot];
   }
-  reg(struct_literal_create.dst) = struct_id;
+  KAI_NEXT();
 }
 
-void BytecodeInterpreter::interpret_struct_load(
-    const Bytecode::Instruction::StructLoad &struct_load) {
-  const auto struct_id = reg(struct_load.object);
-  const auto struct_it = structs_.find(struct_id);
-  assert(struct_it != structs_.end());
-  const auto field_it = struct_it->second.find(struct_load.field);
-  assert(field_it != struct_it->second.end());
-  reg(struct_load.dst) = field_it->second;
-}
+op_negate:
+  regs[ip->a] = static_cast<Bytecode::Value>(-static_cast<int64_t>(regs[ip->b]));
+  KAI_NEXT();
 
-void BytecodeInterpreter::interpret_address_of(
-    const Bytecode::Instruction::AddressOf &address_of) {
-  const auto absolute_register_index = frame_base_ + address_of.src;
-  assert(absolute_register_index < register_stack_.size());
-  const auto handle = pointer_handle(next_pointer_id_++);
-  pointers_[handle] = register_stack_[absolute_register_index];
-  reg(address_of.dst) = handle;
+op_logical_not:
+  regs[ip->a] = regs[ip->b] == 0 ? 1 : 0;
+  KAI_NEXT();
+
+op_move_jump:
+  regs[ip->a] = regs[ip->b];
+  KAI_BRANCH(ip->c);
+
+op_load_jump:
+  regs[ip->a] = ip->value;
+  KAI_BRANCH(ip->c);
+
+op_add_immediate_jump:
+  regs[ip->a] = regs[ip->b] + ip->value;
+  KAI_BRANCH(ip->c);
+
+op_add_return:
+  return_value = regs[ip->b] + regs[ip->c];
+  goto return_to_caller;
+
+#undef KAI_BRANCH
+#undef KAI_JUMP
+#undef KAI_NEXT
+#undef KAI_DISPATCH
 }
 
-void BytecodeInterpreter::interpret_load_indirect(
-    const Bytecode::Instruction::LoadIndirect &load_indirect) {
-  const auto pointer_value = reg(load_indirect.pointer);
-  const auto it = pointers_.find(pointer_value);
-  assert(it != pointers_.end());
-  assert(it->second);
-  reg(load_indirect.dst) = *it->second;
+void BytecodeInterpreter::collect_garbage() {
+  // Every slot of every live frame is a root. Open pointers name stack slots,
+  // so their pointees are covered by the same scan; a closed pointer keeps
+  // its own value alive.
+  const size_t stack_top = frame_base_ + frame_size_;
+  for (size_t i = 0; i < stack_top; ++i) {
+    heap_.mark(register_stack_[i]);
+  }
+  std::vector<bool> live_pointers(pointers_.size(), false);
+  heap_.collect([&](Bytecode::Value handle) {
+    const auto id = pointer_id(handle);
+    if (id < live_pointers.size() && !live_pointers[id]) {
+      live_pointers[id] = true;
+      if (pointers_[id].slot == k_closed_pointer) {
+        heap_.mark(pointers_[id].value);
+      }
+    }
+  });
+
+  size_t live_pointer_count = 0;
+  for (size_t id = 0; id < pointers_.size(); ++id) {
+    if (live_pointers[id]) {
+      ++live_pointer_count;
+    } else if (pointers_[id].slot != k_free_pointer) {
+      pointers_[id].slot = k_free_pointer;
+      free_pointer_ids_.push_back(id);
+    }
+  }
+  std::erase_if(open_pointers_,
+                [this](size_t id) { return pointers_[id].slot == k_free_pointer; });
+  pointer_collection_threshold_ =
+      std::max(Heap::k_min_collection_threshold, 2 * live_pointer_count);
+}
+
+void BytecodeInterpreter::close_pointers(size_t frame_base) {
+  // Frames end in the reverse order they start, so the cells into this frame
+  // are the last ones opened.
+  while (!open_pointers_.empty() && pointers_[open_pointers_.back()].slot >= frame_base) {
+    auto &cell = pointers_[open_pointers_.back()];
+    cell.value = register_stack_[cell.slot];
+    cell.slot = k_closed_pointer;
+    open_pointers_.pop_back();
+  }
 }
 
-void BytecodeInterpreter::interpret_negate(const Bytecode::Instruction::Negate &negate) {
-  reg(negate.dst) = static_cast<Bytecode::Value>(-static_cast<int64_t>(reg(negate.src)));
+u32 BytecodeInterpreter::field_offset_miss(u32 cache_index, Heap::LayoutId layout,
+                                            const std::string &field) {
+  auto &cache = inline_caches_[cache_index];
+  for (u32 i = 1; i < cache.size; ++i) {
+    if (cache.layouts[i] == layout) {
+      return cache.offsets[i];
+    }
+  }
+  const auto offset = heap_.layouts().offset(layout, field);
+  if (cache.size < InlineCache::k_entries) {
+    cache.layouts[cache.size] = layout;
+    cache.offsets[cache.size] = offset;
+    ++cache.size;
+  }
+  return offset;
+}
+
+std::optional<Bytecode::Value> BytecodeInterpreter::call_native(NativeFunction function,
+                                                                const Instruction &call,
+                                                                const Bytecode::Value *regs,
+                                                                const u32 *operands) {
+  // Native code never re-enters the interpreter, so every native call made
+  // from here starts at the base of the JIT's register stack.
+  auto *frame = jit_->stack();
+  std::fill_n(frame, call.value, Bytecode::Value{0});
+  const auto *args = operands + call.c;
+  const auto *params = args + call.d;
+  for (u32 i = 0; i < call.d; ++i) {
+    frame[params[i]] = regs[args[i]];
+  }
+  const auto result = jit_->run(function, frame);
+  if (!result) {
+    native_functions_ = nullptr;
+  }
+  return result;
 }
 
-void BytecodeInterpreter::interpret_logical_not(
-    const Bytecode::Instruction::LogicalNot &logical_not) {
-  reg(logical_not.dst) = reg(logical_not.src) == 0 ? 1 : 0;
+Jit::NativeFunction BytecodeInterpreter::back_edge_osr_entry(u32 header) {
+  // Compiling may fail for an ineligible function, which then stays
+  // interpreted; the counter has passed the threshold, so this is not retried.
+  if (!jit_->compile_function(jit_->function_entry(header))) {
+    return nullptr;
+  }
+  return jit_->osr_entry(header);
 }
 
+const Heap::Stats &BytecodeInterpreter::heap_stats() const { return heap_.stats(); }
+
 }  // namespace kai
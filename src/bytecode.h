@@ -1,16 +1,22 @@
 #pragma once
 
 #include <cstdint>
+#include <iosfwd>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "ast.h"
+#include "heap.h"
 
 namespace kai {
 
+class Jit;
+
+using u32 = uint32_t;
 using u64 = uint64_t;
 
 struct Bytecode {
@@ -22,102 +28,123 @@ struct Bytecode {
 
   struct BasicBlock;
   struct RegisterAllocator;
+  struct Function;
+  struct Executable;
+};
+
+// What an opcode does besides computing its destination register from its
+// operands. Listed for every opcode in KAI_BYTECODE_OPCODES.
+enum OpcodeFlags : unsigned {
+  k_no_flags = 0,
+  // Reads nothing but its operands and has no effect but its result.
+  k_pure = 1u << 0,
+  // Gives the same result with its two source registers swapped.
+  k_commutative = 1u << 1,
+  // Undefined when its divisor is zero.
+  k_may_fault = 1u << 2,
+  k_reads_heap = 1u << 3,
+  k_writes_heap = 1u << 4,
+  // Gives a new object each time it runs.
+  k_allocates = 1u << 5,
+  // Lets later instructions read its source register through a pointer.
+  k_takes_address = 1u << 6,
+  k_calls = 1u << 7,
+  // Ends its block.
+  k_terminator = 1u << 8,
+  // A superinstruction: performs two source operations in one dispatch.
+  k_fused = 1u << 9,
 };
 
+// Every opcode with its flags and its operands, in Type order. The operands
+// name fields of the opcode's struct:
+//   USE(f)         a register read in the instruction's frame
+//   USES(f)        a vector of registers read
+//   FIELD_USES(f)  a vector of (name, register) pairs whose registers are read
+//   DEF(f)         the register written
+//   IMM(f)         an immediate value
+//   JUMP(f)        a branch target
+//   CALL(f)        a call target
+//   PARAMS(f, own) the callee's parameter registers, which are in the
+//                  caller's frame when `own` is true
+// Registers read come first, in field order, then the one written.
+// visit_operands in bytecode_operands.h gives the operands meaning.
+#define KAI_BYTECODE_OPCODES(X)                                                              \
+  X(Move, k_pure, USE(src) DEF(dst))                                                         \
+  X(Load, k_pure, DEF(dst) IMM(value))                                                       \
+  X(LessThan, k_pure, USE(lhs) USE(rhs) DEF(dst))                                            \
+  X(LessThanImmediate, k_pure, USE(lhs) DEF(dst) IMM(value))                                 \
+  X(GreaterThan, k_pure, USE(lhs) USE(rhs) DEF(dst))                                         \
+  X(GreaterThanImmediate, k_pure, USE(lhs) DEF(dst) IMM(value))                              \
+  X(LessThanOrEqual, k_pure, USE(lhs) USE(rhs) DEF(dst))                                     \
+  X(LessThanOrEqualImmediate, k_pure, USE(lhs) DEF(dst) IMM(value))                          \
+  X(GreaterThanOrEqual, k_pure, USE(lhs) USE(rhs) DEF(dst))                                  \
+  X(GreaterThanOrEqualImmediate, k_pure, USE(lhs) DEF(dst) IMM(value))                       \
+  X(Jump, k_terminator, JUMP(label))                                                         \
+  X(JumpConditional, k_terminator, USE(cond) JUMP(label1) JUMP(label2))                      \
+  X(JumpEqualImmediate, k_terminator, USE(src) IMM(value) JUMP(label1) JUMP(label2))         \
+  X(JumpGreaterThanImmediate, k_terminator, USE(lhs) IMM(value) JUMP(label1) JUMP(label2))   \
+  X(JumpLessThanOrEqual, k_terminator, USE(lhs) USE(rhs) JUMP(label1) JUMP(label2))          \
+  X(JumpLessThan, k_terminator, USE(lhs) USE(rhs) JUMP(label1) JUMP(label2))                 \
+  X(JumpLessThanImmediate, k_terminator, USE(lhs) IMM(value) JUMP(label1) JUMP(label2))      \
+  X(JumpGreaterThan, k_terminator, USE(lhs) USE(rhs) JUMP(label1) JUMP(label2))              \
+  X(JumpLessThanOrEqualImmediate, k_terminator,                                              \
+    USE(lhs) IMM(value) JUMP(label1) JUMP(label2))                                           \
+  X(JumpGreaterThanOrEqual, k_terminator, USE(lhs) USE(rhs) JUMP(label1) JUMP(label2))       \
+  X(JumpGreaterThanOrEqualImmediate, k_terminator,                                           \
+    USE(lhs) IMM(value) JUMP(label1) JUMP(label2))                                           \
+  X(JumpEqual, k_terminator, USE(lhs) USE(rhs) JUMP(label1) JUMP(label2))                    \
+  X(JumpNotEqual, k_terminator, USE(lhs) USE(rhs) JUMP(label1) JUMP(label2))                 \
+  X(JumpNotEqualImmediate, k_terminator, USE(src) IMM(value) JUMP(label1) JUMP(label2))      \
+  X(Call, k_calls, USES(arg_registers) DEF(dst) CALL(label) PARAMS(param_registers, false))  \
+  X(TailCall, k_calls | k_terminator,                                                        \
+    USES(arg_registers) CALL(label) PARAMS(param_registers, true))                           \
+  X(Return, k_terminator, USE(reg))                                                          \
+  X(Equal, k_pure | k_commutative, USE(src1) USE(src2) DEF(dst))                            \
+  X(EqualImmediate, k_pure, USE(src) DEF(dst) IMM(value))                                    \
+  X(NotEqual, k_pure | k_commutative, USE(src1) USE(src2) DEF(dst))                         \
+  X(NotEqualImmediate, k_pure, USE(src) DEF(dst) IMM(value))                                 \
+  X(Add, k_pure | k_commutative, USE(src1) USE(src2) DEF(dst))                              \
+  X(AddImmediate, k_pure, USE(src) DEF(dst) IMM(value))                                      \
+  X(Subtract, k_pure, USE(src1) USE(src2) DEF(dst))                                          \
+  X(SubtractImmediate, k_pure, USE(src) DEF(dst) IMM(value))                                 \
+  X(Multiply, k_pure | k_commutative, USE(src1) USE(src2) DEF(dst))                         \
+  X(MultiplyImmediate, k_pure, USE(src) DEF(dst) IMM(value))                                 \
+  X(Divide, k_pure | k_may_fault, USE(src1) USE(src2) DEF(dst))                              \
+  X(DivideImmediate, k_pure | k_may_fault, USE(src) DEF(dst) IMM(value))                     \
+  X(Modulo, k_pure | k_may_fault, USE(src1) USE(src2) DEF(dst))                              \
+  X(ModuloImmediate, k_pure | k_may_fault, USE(src) DEF(dst) IMM(value))                     \
+  X(ArrayCreate, k_allocates, USES(elements) DEF(dst))                                       \
+  X(ArrayLiteralCreate, k_allocates, DEF(dst))                                               \
+  X(ArrayLoad, k_reads_heap, USE(array) USE(index) DEF(dst))                                 \
+  X(ArrayLoadImmediate, k_reads_heap, USE(array) DEF(dst) IMM(index))                        \
+  X(ArrayStore, k_writes_heap, USE(array) USE(index) USE(value))                             \
+  X(ArrayLoadUnchecked, k_reads_heap, USE(array) USE(index) DEF(dst))                        \
+  X(ArrayStoreUnchecked, k_writes_heap, USE(array) USE(index) USE(value))                    \
+  X(StructCreate, k_allocates, FIELD_USES(fields) DEF(dst))                                  \
+  X(StructLiteralCreate, k_allocates, DEF(dst))                                              \
+  X(StructLoad, k_reads_heap, USE(object) DEF(dst))                                          \
+  X(StructStore, k_writes_heap, USE(object) USE(value))                                      \
+  X(AddressOf, k_takes_address, USE(src) DEF(dst))                                           \
+  X(LoadIndirect, k_no_flags, USE(pointer) DEF(dst))                                         \
+  X(Negate, k_pure, USE(src) DEF(dst))                                                       \
+  X(LogicalNot, k_pure, USE(src) DEF(dst))                                                  \
+  X(MoveJump, k_fused | k_terminator, USE(src) DEF(dst) JUMP(label))                         \
+  X(LoadJump, k_fused | k_terminator, DEF(dst) IMM(value) JUMP(label))                       \
+  X(AddImmediateJump, k_fused | k_terminator, USE(src) DEF(dst) IMM(value) JUMP(label))      \
+  X(AddReturn, k_fused | k_terminator, USE(src1) USE(src2))
+
 struct Bytecode::Instruction {
   enum class Type {
-    Move,
-    Load,
-    LessThan,
-    LessThanImmediate,
-    GreaterThan,
-    GreaterThanImmediate,
-    LessThanOrEqual,
-    LessThanOrEqualImmediate,
-    GreaterThanOrEqual,
-    GreaterThanOrEqualImmediate,
-    Jump,
-    JumpConditional,
-    JumpEqualImmediate,
-    JumpGreaterThanImmediate,
-    JumpLessThanOrEqual,
-    Call,
-    TailCall,
-    Return,
-    Equal,
-    EqualImmediate,
-    NotEqual,
-    NotEqualImmediate,
-    Add,
-    AddImmediate,
-    Subtract,
-    SubtractImmediate,
-    Multiply,
-    MultiplyImmediate,
-    Divide,
-    DivideImmediate,
-    Modulo,
-    ModuloImmediate,
-    ArrayCreate,
-    ArrayLiteralCreate,
-    ArrayLoad,
-    ArrayLoadImmediate,
-    ArrayStore,
-    StructCreate,
-    StructLiteralCreate,
-    StructLoad,
-    AddressOf,
-    LoadIndirect,
-    Negate,
-    LogicalNot,
+#define KAI_OPCODE_TYPE(name, flags, operands) name,
+    KAI_BYTECODE_OPCODES(KAI_OPCODE_TYPE)
+#undef KAI_OPCODE_TYPE
   };
 
   Type type_;
 
-  struct Move;
-  struct Load;
-  struct LessThan;
-  struct LessThanImmediate;
-  struct GreaterThan;
-  struct GreaterThanImmediate;
-  struct LessThanOrEqual;
-  struct LessThanOrEqualImmediate;
-  struct GreaterThanOrEqual;
-  struct GreaterThanOrEqualImmediate;
-  struct Jump;
-  struct JumpConditional;
-  struct JumpEqualImmediate;
-  struct JumpGreaterThanImmediate;
-  struct JumpLessThanOrEqual;
-  struct Call;
-  struct TailCall;
-  struct Return;
-  struct Equal;
-  struct EqualImmediate;
-  struct NotEqual;
-  struct NotEqualImmediate;
-  struct Add;
-  struct AddImmediate;
-  struct Subtract;
-  struct SubtractImmediate;
-  struct Multiply;
-  struct MultiplyImmediate;
-  struct Divide;
-  struct DivideImmediate;
-  struct Modulo;
-  struct ModuloImmediate;
-  struct ArrayCreate;
-  struct ArrayLiteralCreate;
-  struct ArrayLoad;
-  struct ArrayLoadImmediate;
-  struct ArrayStore;
-  struct StructCreate;
-  struct StructLiteralCreate;
-  struct StructLoad;
-  struct AddressOf;
-  struct LoadIndirect;
-  struct Negate;
-  struct LogicalNot;
+#define KAI_OPCODE_STRUCT(name, flags, operands) struct name;
+  KAI_BYTECODE_OPCODES(KAI_OPCODE_STRUCT)
+#undef KAI_OPCODE_STRUCT
 
   virtual ~Instruction() = default;
 
@@ -128,6 +155,25 @@ struct Bytecode::Instruction {
   explicit Instruction(Type type);
 };
 
+inline constexpr unsigned k_opcode_flags[] = {
+#define KAI_OPCODE_FLAGS(name, flags, operands) static_cast<unsigned>(flags),
+    KAI_BYTECODE_OPCODES(KAI_OPCODE_FLAGS)
+#undef KAI_OPCODE_FLAGS
+};
+
+// Whether `type` has any of the OpcodeFlags in `flags`.
+constexpr bool has_opcode_flag(Bytecode::Instruction::Type type, unsigned flags) {
+  return (k_opcode_flags[static_cast<size_t>(type)] & flags) != 0;
+}
+
+inline constexpr size_t k_opcode_count = sizeof(k_opcode_flags) / sizeof(k_opcode_flags[0]);
+
+inline constexpr const char *k_opcode_names[] = {
+#define KAI_OPCODE_NAME(name, flags, operands) #name,
+    KAI_BYTECODE_OPCODES(KAI_OPCODE_NAME)
+#undef KAI_OPCODE_NAME
+};
+
 struct Bytecode::Instruction::Move final : Bytecode::Instruction {
   Move(Register dst, Register src);
   void dump() const override;
@@ -262,6 +308,96 @@ struct Bytecode::Instruction::JumpLessThanOrEqual final : Bytecode::Instruction
   Label label2;
 };
 
+struct Bytecode::Instruction::JumpLessThan final : Bytecode::Instruction {
+  JumpLessThan(Register lhs, Register rhs, Label label1, Label label2);
+  void dump() const override;
+
+  Register lhs;
+  Register rhs;
+  Label label1;
+  Label label2;
+};
+
+struct Bytecode::Instruction::JumpLessThanImmediate final : Bytecode::Instruction {
+  JumpLessThanImmediate(Register lhs, Value value, Label label1, Label label2);
+  void dump() const override;
+
+  Register lhs;
+  Value value;
+  Label label1;
+  Label label2;
+};
+
+struct Bytecode::Instruction::JumpGreaterThan final : Bytecode::Instruction {
+  JumpGreaterThan(Register lhs, Register rhs, Label label1, Label label2);
+  void dump() const override;
+
+  Register lhs;
+  Register rhs;
+  Label label1;
+  Label label2;
+};
+
+struct Bytecode::Instruction::JumpLessThanOrEqualImmediate final : Bytecode::Instruction {
+  JumpLessThanOrEqualImmediate(Register lhs, Value value, Label label1, Label label2);
+  void dump() const override;
+
+  Register lhs;
+  Value value;
+  Label label1;
+  Label label2;
+};
+
+struct Bytecode::Instruction::JumpGreaterThanOrEqual final : Bytecode::Instruction {
+  JumpGreaterThanOrEqual(Register lhs, Register rhs, Label label1, Label label2);
+  void dump() const override;
+
+  Register lhs;
+  Register rhs;
+  Label label1;
+  Label label2;
+};
+
+struct Bytecode::Instruction::JumpGreaterThanOrEqualImmediate final : Bytecode::Instruction {
+  JumpGreaterThanOrEqualImmediate(Register lhs, Value value, Label label1, Label label2);
+  void dump() const override;
+
+  Register lhs;
+  Value value;
+  Label label1;
+  Label label2;
+};
+
+struct Bytecode::Instruction::JumpEqual final : Bytecode::Instruction {
+  JumpEqual(Register lhs, Register rhs, Label label1, Label label2);
+  void dump() const override;
+
+  Register lhs;
+  Register rhs;
+  Label label1;
+  Label label2;
+};
+
+struct Bytecode::Instruction::JumpNotEqual final : Bytecode::Instruction {
+  JumpNotEqual(Register lhs, Register rhs, Label label1, Label label2);
+  void dump() const override;
+
+  Register lhs;
+  Register rhs;
+  Label label1;
+  Label label2;
+};
+
+struct Bytecode::Instruction::JumpNotEqualImmediate final : Bytecode::Instruction {
+  JumpNotEqualImmediate(Register src, Value value, Label label1, Label label2);
+  void dump() const override;
+
+  Register src;
+  Value value;
+  Label label1;
+  Label label2;
+};
+
 struct Bytecode::Instruction::Call final : Bytecode::Instruction {
   Call(Register dst, Label label, std::vector<Register> arg_registers = {},
        std::vector<Register> param_registers = {});
@@ -459,6 +595,26 @@ struct Bytecode::Instruction::ArrayStore final : Bytecode::Instruction {
   Register value;
 };
 
+// An ArrayLoad whose index the optimizer proved is inside the array.
+struct Bytecode::Instruction::ArrayLoadUnchecked final : Bytecode::Instruction {
+  ArrayLoadUnchecked(Register dst, Register array, Register index);
+  void dump() const override;
+
+  Register dst;
+  Register array;
+  Register index;
+};
+
+// An ArrayStore whose index the optimizer proved is inside the array.
+struct Bytecode::Instruction::ArrayStoreUnchecked final : Bytecode::Instruction {
+  ArrayStoreUnchecked(Register array, Register index, Register value);
+  void dump() const override;
+
+  Register array;
+  Register index;
+  Register value;
+};
+
 struct Bytecode::Instruction::StructCreate final : Bytecode::Instruction {
   StructCreate(Register dst, std::vector<std::pair<std::string, Register>> fields);
   void dump() const override;
@@ -484,6 +640,15 @@ struct Bytecode::Instruction::StructLoad final : Bytecode::Instruction {
   std::string field;
 };
 
+struct Bytecode::Instruction::StructStore final : Bytecode::Instruction {
+  StructStore(Register object, std::string field, Register value);
+  void dump() const override;
+
+  Register object;
+  std::string field;
+  Register value;
+};
+
 struct Bytecode::Instruction::AddressOf final : Bytecode::Instruction {
   AddressOf(Register dst, Register src);
   void dump() const override;
@@ -516,6 +681,52 @@ struct Bytecode::Instruction::LogicalNot final : Bytecode::Instruction {
   Register src;
 };
 
+// Superinstructions, formed from a block's last two instructions by
+// BytecodeOptimizer::form_superinstructions once nothing else will rewrite
+// the code.
+
+// Move, then Jump.
+struct Bytecode::Instruction::MoveJump final : Bytecode::Instruction {
+  MoveJump(Register dst, Register src, Label label);
+  void dump() const override;
+
+  Register dst;
+  Register src;
+  Label label;
+};
+
+// Load, then Jump.
+struct Bytecode::Instruction::LoadJump final : Bytecode::Instruction {
+  LoadJump(Register dst, Value value, Label label);
+  void dump() const override;
+
+  Register dst;
+  Value value;
+  Label label;
+};
+
+// AddImmediate, then Jump. Also stands for SubtractImmediate, by adding the
+// negated value.
+struct Bytecode::Instruction::AddImmediateJump final : Bytecode::Instruction {
+  AddImmediateJump(Register dst, Register src, Value value, Label label);
+  void dump() const override;
+
+  Register dst;
+  Register src;
+  Value value;
+  Label label;
+};
+
+// Add, then Return of the sum. The frame goes away with the return, so the
+// sum is never stored in it.
+struct Bytecode::Instruction::AddReturn final : Bytecode::Instruction {
+  AddReturn(Register src1, Register src2);
+  void dump() const override;
+
+  Register src1;
+  Register src2;
+};
+
 struct Bytecode::BasicBlock {
   std::vector<std::unique_ptr<Instruction>> instructions;
 
@@ -536,6 +747,112 @@ struct Bytecode::RegisterAllocator {
   Register current();
 };
 
+// Calling-convention metadata for one function. Registers are numbered per
+// function from 0, so a frame only holds the registers its own blocks touch.
+struct Bytecode::Function {
+  static constexpr size_t k_unbounded_call_depth = static_cast<size_t>(-1);
+
+  Label entry;
+  size_t arity;
+  std::vector<Register> parameter_registers;
+  size_t frame_size;
+  // Blocks reachable from `entry` through jumps, in ascending label order.
+  std::vector<Label> blocks;
+  // Deepest chain of frames pushed below this one; tail calls reuse the frame
+  // and do not count. Recursive functions report k_unbounded_call_depth.
+  size_t max_call_depth;
+};
+
+// Recovers the function table from a block list: label 0 is the program
+// entry and every Call/TailCall target is a function entry. A function owns
+// the blocks reachable from its entry through jumps. Sorted by entry label.
+std::vector<Bytecode::Function> build_function_table(
+    const std::vector<Bytecode::BasicBlock> &blocks);
+
+// Orders the simultaneous assignments params[i] = args[i] into sequential
+// (dst, src) moves that never overwrite a value before it is read. A move
+// runs once no other pending move reads its destination; when only cycles
+// remain, one destination is saved in `temporary` and its readers switched
+// to it. `temporary` must not be an argument or parameter.
+std::vector<std::pair<Bytecode::Register, Bytecode::Register>> schedule_parallel_move(
+    const std::vector<Bytecode::Register> &args,
+    const std::vector<Bytecode::Register> &params, Bytecode::Register temporary);
+
+// Lowered form of a block list that the interpreter executes. Blocks are laid
+// out back to back in one contiguous array of fixed-width instructions; jump
+// and call targets are absolute offsets into `code`, and variable-length
+// operands live in the side pools.
+//
+// Operand layout per opcode (unlisted operands are 0):
+//   Move, AddressOf, LoadIndirect, Negate, LogicalNot   a=dst b=src
+//   Load                                                a=dst value
+//   register/register compare and arithmetic            a=dst b=lhs c=rhs
+//   register/immediate compare and arithmetic           a=dst b=lhs value
+//   Jump                                                b=target
+//   JumpConditional                                     a=cond b=then c=else
+//   register/immediate compare-and-branch               a=lhs b=then c=else value
+//   register/register compare-and-branch                a=lhs d=rhs b=then c=else
+//   Call       a=dst b=target c=operands offset d=argc value=callee frame size
+//   TailCall   a=move count b=target c=operands offset d=argc
+//              value=callee frame size
+//              operands[c, c+d) are arguments, operands[c+d, c+2d) parameters,
+//              then `a` (dst, src) pairs: the arguments-to-parameters
+//              assignment as sequential moves, where k_move_temporary names
+//              a scratch value outside the frame
+//   Return                                              a=src
+//   ArrayCreate            a=dst c=operands offset d=count
+//   ArrayLiteralCreate     a=dst c=values offset d=count
+//   ArrayLoad, ArrayLoadUnchecked     a=dst b=array c=index
+//   ArrayLoadImmediate                a=dst b=array value=index
+//   ArrayStore, ArrayStoreUnchecked   a=array b=index c=src
+//   StructCreate           a=dst b=layout c=operands offset d=field count
+//   StructLiteralCreate    a=dst b=layout c=values offset d=field count
+//   StructLoad             a=dst b=object c=string d=inline cache
+//   StructStore            a=object b=src c=string d=inline cache
+//   MoveJump               a=dst b=src c=target
+//   LoadJump               a=dst c=target value
+//   AddImmediateJump       a=dst b=src c=target value
+//   AddReturn              b=lhs c=rhs
+//
+// Struct fields are stored at the offsets of their layout, so the create
+// operands are ordered by layout offset rather than source order. Every
+// StructLoad owns one inline cache that maps the layouts it has seen to the
+// field's offset; StructStore sites share the same cache layout.
+struct Bytecode::Executable {
+  static constexpr u32 k_move_temporary = static_cast<u32>(-1);
+
+  struct Instruction {
+    Bytecode::Instruction::Type type;
+    u32 a = 0;
+    u32 b = 0;
+    u32 c = 0;
+    u32 d = 0;
+    Value value = 0;
+  };
+
+  // A function from build_function_table(), with its entry as a code offset.
+  struct Function {
+    u32 entry = 0;
+    u32 frame_size = 0;
+    // Source blocks of the function; block_offsets maps them into `code`.
+    std::vector<u32> blocks;
+  };
+
+  std::vector<Instruction> code;
+  std::vector<u32> operands;
+  std::vector<Value> values;
+  std::vector<std::string> strings;
+  // Offset of the first instruction of each source block.
+  std::vector<u32> block_offsets;
+  size_t entry_frame_size = 0;
+  std::vector<Function> functions;
+  StructLayouts layouts;
+  size_t inline_cache_count = 0;
+};
+
+// Packs `blocks` into an Executable. Every block must end in a terminator.
+Bytecode::Executable lower_to_executable(const std::vector<Bytecode::BasicBlock> &blocks);
+
 class BytecodeGenerator {
  public:
   void visit(const Ast &ast);
@@ -577,6 +894,7 @@ class BytecodeGenerator {
   void visit_index_assignment(const Ast::IndexAssignment &index_assignment);
   void visit_struct_literal(const Ast::StructLiteral &struct_literal);
   void visit_field_access(const Ast::FieldAccess &field_access);
+  void visit_field_assignment(const Ast::FieldAssignment &field_assignment);
   void visit_assignment(const Ast::Assignment &assignment);
   void visit_address_of(const Ast::AddressOf &address_of);
   void visit_dereference(const Ast::Dereference &dereference);
@@ -593,90 +911,126 @@ class BytecodeGenerator {
   Bytecode::RegisterAllocator reg_alloc_;
 };
 
+// Dispatch counts of the interpreter, gathered while opcode profiling is on.
+// Code the JIT runs natively is not counted.
+struct OpcodeProfile {
+  // Instructions dispatched.
+  u64 dispatches = 0;
+  // Source operations they performed: a superinstruction performs two.
+  u64 operations = 0;
+  // Runs of two and three instructions, adjacent in the code, that executed
+  // one right after the other, indexed by their opcodes:
+  // pairs[first * k_opcode_count + second], and triples likewise.
+  std::vector<u64> pairs;
+  std::vector<u64> triples;
+
+  // Prints the totals and the `top` hottest pairs and triples.
+  void dump(std::ostream &out, size_t top = 10) const;
+};
+
 class BytecodeInterpreter {
  public:
+  BytecodeInterpreter();
+  ~BytecodeInterpreter();
+
   Bytecode::Value interpret(const std::vector<Bytecode::BasicBlock> &blocks);
+  Bytecode::Value interpret(const Bytecode::Executable &executable);
+  const Heap::Stats &heap_stats() const;
+
+  static constexpr u32 k_default_call_threshold = 1000;
+  static constexpr u32 k_default_back_edge_threshold = 1000;
+
+  // Tiers hot code up to native code while running. A function is compiled
+  // once it has been called `call_threshold` times; a loop that takes
+  // `back_edge_threshold` back edges in one function compiles that function
+  // and its running activation continues natively from the loop header. Has
+  // no effect where Jit::is_supported() is false.
+  void set_jit_enabled(bool enabled);
+  void set_jit_thresholds(u32 call_threshold, u32 back_edge_threshold);
+  // Functions compiled by the last interpret() call.
+  size_t jit_compiled_function_count() const;
+  // Interpreted activations moved into native code mid-loop by the last
+  // interpret() call.
+  size_t jit_osr_transfer_count() const { return osr_transfer_count_; }
+
+  // Counts the opcode sequences interpret() dispatches, for choosing
+  // superinstructions. Costs a counter update per dispatch while enabled.
+  void set_opcode_profiling(bool enabled);
+  // Counts of the last interpret() call with profiling enabled.
+  const OpcodeProfile &opcode_profile() const { return opcode_profile_; }
 
  private:
-  void interpret_move(const Bytecode::Instruction::Move &move);
-  void interpret_load(const Bytecode::Instruction::Load &load);
-  void interpret_less_than(const Bytecode::Instruction::LessThan &less_than);
-  void interpret_less_than_immediate(
-      const Bytecode::Instruction::LessThanImmediate &less_than_imm);
-  void interpret_greater_than(const Bytecode::Instruction::GreaterThan &greater_than);
-  void interpret_greater_than_immediate(
-      const Bytecode::Instruction::GreaterThanImmediate &greater_than_imm);
-  void interpret_less_than_or_equal(
-      const Bytecode::Instruction::LessThanOrEqual &less_than_or_equal);
-  void interpret_less_than_or_equal_immediate(
-      const Bytecode::Instruction::LessThanOrEqualImmediate &less_than_or_equal_imm);
-  void interpret_greater_than_or_equal(
-      const Bytecode::Instruction::GreaterThanOrEqual &greater_than_or_equal);
-  void interpret_greater_than_or_equal_immediate(
-      const Bytecode::Instruction::GreaterThanOrEqualImmediate &greater_than_or_equal_imm);
-  void interpret_jump(const Bytecode::Instruction::Jump &jump);
-  void interpret_jump_conditional(const Bytecode::Instruction::JumpConditional &jump_cond);
-  void interpret_jump_equal_immediate(
-      const Bytecode::Instruction::JumpEqualImmediate &jump_equal_imm);
-  void interpret_jump_greater_than_immediate(
-      const Bytecode::Instruction::JumpGreaterThanImmediate &jump_greater_than_imm);
-  void interpret_jump_less_than_or_equal(
-      const Bytecode::Instruction::JumpLessThanOrEqual &jump_less_than_or_equal);
-  void interpret_call(const Bytecode::Instruction::Call &call, size_t next_instr_index);
-  void interpret_tail_call(const Bytecode::Instruction::TailCall &tail_call);
-  void interpret_equal(const Bytecode::Instruction::Equal &equal);
-  void interpret_equal_immediate(const Bytecode::Instruction::EqualImmediate &equal_imm);
-  void interpret_not_equal(const Bytecode::Instruction::NotEqual &not_equal);
-  void interpret_not_equal_immediate(
-      const Bytecode::Instruction::NotEqualImmediate &not_equal_imm);
-  void interpret_add(const Bytecode::Instruction::Add &add);
-  void interpret_subtract(const Bytecode::Instruction::Subtract &subtract);
-  void interpret_add_immediate(const Bytecode::Instruction::AddImmediate &add_imm);
-  void interpret_subtract_immediate(
-      const Bytecode::Instruction::SubtractImmediate &subtract_imm);
-  void interpret_multiply(const Bytecode::Instruction::Multiply &multiply);
-  void interpret_multiply_immediate(
-      const Bytecode::Instruction::MultiplyImmediate &multiply_imm);
-  void interpret_divide(const Bytecode::Instruction::Divide &divide);
-  void interpret_divide_immediate(const Bytecode::Instruction::DivideImmediate &divide_imm);
-  void interpret_modulo(const Bytecode::Instruction::Modulo &modulo);
-  void interpret_modulo_immediate(const Bytecode::Instruction::ModuloImmediate &modulo_imm);
-  void interpret_array_create(const Bytecode::Instruction::ArrayCreate &array_create);
-  void interpret_array_literal_create(
-      const Bytecode::Instruction::ArrayLiteralCreate &array_literal_create);
-  void interpret_array_load(const Bytecode::Instruction::ArrayLoad &array_load);
-  void interpret_array_load_immediate(
-      const Bytecode::Instruction::ArrayLoadImmediate &array_load_immediate);
-  void interpret_array_store(const Bytecode::Instruction::ArrayStore &array_store);
-  void interpret_struct_create(const Bytecode::Instruction::StructCreate &struct_create);
-  void interpret_struct_literal_create(
-      const Bytecode::Instruction::StructLiteralCreate &struct_literal_create);
-  void interpret_struct_load(const Bytecode::Instruction::StructLoad &struct_load);
-  void interpret_address_of(const Bytecode::Instruction::AddressOf &address_of);
-  void interpret_load_indirect(const Bytecode::Instruction::LoadIndirect &load_indirect);
-  void interpret_negate(const Bytecode::Instruction::Negate &negate);
-  void interpret_logical_not(const Bytecode::Instruction::LogicalNot &logical_not);
-
-  Bytecode::Value& reg(Bytecode::Register r) { return *register_stack_[frame_base_ + r]; }
-
-  u64 block_index = 0;
-  size_t instr_index_ = 0;
+  using Instruction = Bytecode::Executable::Instruction;
+  using NativeFunction = Bytecode::Value (*)(Bytecode::Value *frame);
+
+  void collect_garbage();
+  // Runs a call in native code; nullopt when native code ran out of stack,
+  // after which the JIT stays off for the rest of the run.
+  std::optional<Bytecode::Value> call_native(NativeFunction function, const Instruction &call,
+                                             const Bytecode::Value *regs,
+                                             const u32 *operands);
+  NativeFunction back_edge_osr_entry(u32 header);
+  u32 field_offset_miss(u32 cache_index, Heap::LayoutId layout, const std::string &field);
+
   struct CallFrame {
-    u64 return_block_index;
-    size_t return_instr_index;
-    Bytecode::Register dst_register;
+    size_t return_pc;
+    u32 dst_register;
     size_t frame_base;
+    size_t frame_size;
   };
   std::vector<CallFrame> call_stack_;
-  std::vector<std::shared_ptr<Bytecode::Value>> register_stack_;
+  // Registers of every live frame, stored by value in one contiguous stack.
+  // Frames are windows of `frame_size_` slots starting at `frame_base_`, sized
+  // per function from the function table.
+  std::vector<Bytecode::Value> register_stack_;
   size_t frame_base_ = 0;
-  size_t register_count_ = 0;
-  std::unordered_map<Bytecode::Value, std::vector<Bytecode::Value>> arrays_;
-  std::unordered_map<Bytecode::Value, std::unordered_map<std::string, Bytecode::Value>>
-      structs_;
-  std::unordered_map<Bytecode::Value, std::shared_ptr<Bytecode::Value>> pointers_;
-  Bytecode::Value next_heap_id_ = 1;
-  Bytecode::Value next_pointer_id_ = 1;
+  size_t frame_size_ = 0;
+  Heap heap_;
+  // Only registers whose address is taken are ever referenced indirectly. A
+  // pointer handle's payload indexes this table of cells. While the pointee's
+  // frame is live the cell is open and names its absolute stack slot; when
+  // the frame returns or is taken over by a tail call, the cell closes over
+  // the slot's last value, so a pointer that escaped its frame keeps reading
+  // it. Unreachable cells are recycled by the collector.
+  struct PointerCell {
+    size_t slot;
+    Bytecode::Value value;
+  };
+  void close_pointers(size_t frame_base);
+  std::vector<PointerCell> pointers_;
+  std::vector<size_t> free_pointer_ids_;
+  // Ids of the open cells, outermost frame first. A frame only takes the
+  // address of its own registers, so its cells are always the last ones.
+  std::vector<size_t> open_pointers_;
+  size_t pointer_collection_threshold_ = Heap::k_min_collection_threshold;
+  // Polymorphic inline cache of a StructLoad or StructStore site. Entries fill in order;
+  // once all are taken the site is megamorphic and misses look the offset
+  // up in the layout every time.
+  struct InlineCache {
+    static constexpr size_t k_entries = 4;
+    Heap::LayoutId layouts[k_entries] = {StructLayouts::k_no_layout,
+                                         StructLayouts::k_no_layout,
+                                         StructLayouts::k_no_layout,
+                                         StructLayouts::k_no_layout};
+    u32 offsets[k_entries] = {};
+    u32 size = 0;
+  };
+  std::vector<InlineCache> inline_caches_;
+  std::unique_ptr<Jit> jit_;
+  // Native entry per code offset while the JIT is enabled, otherwise null.
+  // Native code that runs out of stack turns the JIT off, so that every
+  // deeper call is not tried natively and given up again.
+  const NativeFunction *native_functions_ = nullptr;
+  // Hotness counters, indexed by the code offset of a function entry or a
+  // loop header. Only maintained while the JIT is enabled; code tiers up when
+  // its counter reaches the threshold, exactly once.
+  std::vector<u32> call_counts_;
+  std::vector<u32> back_edge_counts_;
+  u32 call_threshold_ = k_default_call_threshold;
+  u32 back_edge_threshold_ = k_default_back_edge_threshold;
+  size_t osr_transfer_count_ = 0;
+  bool opcode_profiling_ = false;
+  OpcodeProfile opcode_profile_;
 };
 
 }  // namespace kai
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <type_traits>
+
+#include "bytecode.h"
+#include "derived_cast.h"
+
+namespace kai {
+
+// Base for visit_operands() visitors that ignores every operand. A visitor
+// hides the members for the operands it cares about; the others cost
+// nothing.
+struct OperandVisitor {
+  template <typename Register>
+  void use(Register &) {}
+  template <typename Register>
+  void def(Register &) {}
+  template <typename Value>
+  void immediate(Value &) {}
+  template <typename Label>
+  void jump(Label &) {}
+  template <typename Label>
+  void call(Label &) {}
+  // The callee's parameter registers, in the caller's frame when
+  // `in_own_frame`, as they are for a tail call.
+  template <typename Registers>
+  void parameters(Registers &, bool /*in_own_frame*/) {}
+};
+
+// Hands each operand of `instr` to `visitor`, in the order
+// KAI_BYTECODE_OPCODES lists them. `Instruction` may be const, and then so
+// are the operands.
+template <typename Instruction, typename Visitor>
+  requires std::is_same_v<std::remove_const_t<Instruction>, Bytecode::Instruction>
+void visit_operands(Instruction &instr, Visitor &&visitor) {
+#define USE(field) visitor.use(op.field);
+#define USES(field)              \
+  for (auto &reg : op.field) {   \
+    visitor.use(reg);            \
+  }
+#define FIELD_USES(field)        \
+  for (auto &entry : op.field) { \
+    visitor.use(entry.second);   \
+  }
+#define DEF(field) visitor.def(op.field);
+#define IMM(field) visitor.immediate(op.field);
+#define JUMP(field) visitor.jump(op.field);
+#define CALL(field) visitor.call(op.field);
+#define PARAMS(field, in_own_frame) visitor.parameters(op.field, in_own_frame);
+#define KAI_VISIT_OPCODE(name, flags, operands)                                        \
+  case Bytecode::Instruction::Type::name: {                                           \
+    using Op = Bytecode::Instruction::name;                                           \
+    auto &op = derived_cast<std::conditional_t<std::is_const_v<Instruction>, const Op, \
+                                               Op> &>(instr);                         \
+    operands break;                                                                   \
+  }
+
+  switch (instr.type()) { KAI_BYTECODE_OPCODES(KAI_VISIT_OPCODE) }
+
+#undef KAI_VISIT_OPCODE
+#undef PARAMS
+#undef CALL
+#undef JUMP
+#undef IMM
+#undef DEF
+#undef FIELD_USES
+#undef USES
+#undef USE
+}
+
+}  // namespace kai
@@ -23,6 +23,19 @@ enum class Backend {
   Bytecode,
 };
 
+struct OptimizerOptions {
+  bool enabled = false;
+  size_t inline_threshold = kai::BytecodeOptimizer::k_default_inline_threshold;
+  size_t unroll_factor = kai::BytecodeOptimizer::k_default_unroll_factor;
+  bool fixed_point = false;
+  bool print_stats = false;
+};
+
+struct InterpreterOptions {
+  bool jit = false;
+  bool profile_opcodes = false;
+};
+
 std::string trim(std::string_view input) {
   size_t begin = 0;
   while (begin < input.size() &&
@@ -70,8 +83,24 @@ void print_errors(const std::string &source, const kai::ErrorReporter &reporter)
   }
 }
 
+void optimize_blocks(std::vector<kai::Bytecode::BasicBlock> &blocks,
+                     const OptimizerOptions &options) {
+  if (!options.enabled) {
+    return;
+  }
+  kai::BytecodeOptimizer optimizer;
+  optimizer.set_inline_threshold(options.inline_threshold);
+  optimizer.set_unroll_factor(options.unroll_factor);
+  optimizer.set_iterate_to_fixed_point(options.fixed_point);
+  optimizer.optimize(blocks);
+  if (options.print_stats) {
+    optimizer.dump_stats(std::cerr);
+  }
+}
+
 std::optional<kai::Value> run_source(const std::string &source, Backend backend,
-                                     bool optimize_bytecode) {
+                                     const OptimizerOptions &optimizer_options,
+                                     const InterpreterOptions &interpreter_options) {
   kai::ErrorReporter reporter;
   kai::Parser parser(source, reporter);
   auto program = parser.parse_program();
@@ -89,26 +118,36 @@ std::optional<kai::Value> run_source(const std::string &source, Backend backend,
     return std::nullopt;
   }
 
-  if (backend == Backend::Ast) {
-    kai::AstInterpreter interpreter;
-    return interpreter.interpret(*program);
-  }
+  // An array index out of bounds ends the program, but not the REPL.
+  try {
+    if (backend == Backend::Ast) {
+      kai::AstInterpreter interpreter;
+      return interpreter.interpret(*program);
+    }
 
-  ensure_bytecode_program_returns_value(*program);
-  kai::BytecodeGenerator generator;
-  generator.visit_block(*program);
-  generator.finalize();
+    ensure_bytecode_program_returns_value(*program);
+    kai::BytecodeGenerator generator;
+    generator.visit_block(*program);
+    generator.finalize();
 
-  if (optimize_bytecode) {
-    kai::BytecodeOptimizer optimizer;
-    optimizer.optimize(generator.blocks());
-  }
+    optimize_blocks(generator.blocks(), optimizer_options);
 
-  kai::BytecodeInterpreter interpreter;
-  return interpreter.interpret(generator.blocks());
+    kai::BytecodeInterpreter interpreter;
+    interpreter.set_jit_enabled(interpreter_options.jit);
+    interpreter.set_opcode_profiling(interpreter_options.profile_opcodes);
+    const auto value = interpreter.interpret(generator.blocks());
+    if (interpreter_options.profile_opcodes) {
+      interpreter.opcode_profile().dump(std::cerr);
+    }
+    return value;
+  } catch (const std::out_of_range &ex) {
+    std::cerr << "error: " << ex.what() << "\n";
+    return std::nullopt;
+  }
 }
 
-bool dump_source(const std::string &source, Backend backend, bool optimize_bytecode) {
+bool dump_source(const std::string &source, Backend backend,
+                 const OptimizerOptions &optimizer_options) {
   kai::ErrorReporter reporter;
   kai::Parser parser(source, reporter);
   auto program = parser.parse_program();
@@ -136,10 +175,7 @@ bool dump_source(const std::string &source, Backend backend, bool optimize_bytec
   generator.visit_block(*program);
   generator.finalize();
 
-  if (optimize_bytecode) {
-    kai::BytecodeOptimizer optimizer;
-    optimizer.optimize(generator.blocks());
-  }
+  optimize_blocks(generator.blocks(), optimizer_options);
   generator.dump();
   return true;
 }
@@ -157,7 +193,8 @@ std::string normalize_repl_input(std::string_view line) {
   return normalized;
 }
 
-void repl(Backend backend, bool optimize_bytecode) {
+void repl(Backend backend, const OptimizerOptions &optimizer_options,
+          const InterpreterOptions &interpreter_options) {
   std::string source;
   std::string line;
   int brace_depth = 0;
@@ -199,7 +236,7 @@ void repl(Backend backend, bool optimize_bytecode) {
       continue;
     }
 
-    const auto value = run_source(source, backend, optimize_bytecode);
+    const auto value = run_source(source, backend, optimizer_options, interpreter_options);
     if (!value.has_value()) {
       source = previous_source;
       brace_depth = previous_brace_depth;
@@ -220,6 +257,16 @@ int main(int argc, char **argv) {
         ("ast", "Use the AST interpreter backend")
         ("bytecode", "Use the bytecode interpreter backend (default)")
         ("opt", "Enable bytecode optimizations")
+        ("inline-threshold", "Largest function, in instructions, that --opt inlines (0 disables)",
+         cxxopts::value<size_t>()->default_value(
+             std::to_string(kai::BytecodeOptimizer::k_default_inline_threshold)))
+        ("unroll-factor", "Most copies of a loop body that --opt unrolls (0 and 1 disable)",
+         cxxopts::value<size_t>()->default_value(
+             std::to_string(kai::BytecodeOptimizer::k_default_unroll_factor)))
+        ("opt-fixed-point", "Repeat the --opt passes until they stop changing the code")
+        ("opt-stats", "Print the time and changes of each --opt pass to stderr")
+        ("jit", "Compile hot bytecode functions and loops to native code")
+        ("profile-opcodes", "Print the hottest interpreted opcode pairs and triples to stderr")
         ("dump", "Dump the representation for the active backend and exit")
         ("h,help", "Show help")
         ("file", "Input source file", cxxopts::value<std::vector<std::string>>());
@@ -240,7 +287,25 @@ int main(int argc, char **argv) {
     }
 
     const Backend backend = use_ast ? Backend::Ast : Backend::Bytecode;
-    const bool optimize_bytecode = result.count("opt") != 0;
+    OptimizerOptions optimizer_options;
+    optimizer_options.fixed_point = result.count("opt-fixed-point") != 0;
+    optimizer_options.print_stats = result.count("opt-stats") != 0;
+    optimizer_options.enabled =
+        result.count("opt") != 0 || optimizer_options.fixed_point || optimizer_options.print_stats;
+    optimizer_options.inline_threshold = result["inline-threshold"].as<size_t>();
+    optimizer_options.unroll_factor = result["unroll-factor"].as<size_t>();
+    InterpreterOptions interpreter_options;
+    interpreter_options.jit = result.count("jit") != 0;
+    interpreter_options.profile_opcodes = result.count("profile-opcodes") != 0;
+
+    if (use_ast && interpreter_options.jit) {
+      std::cerr << "error: --jit requires the bytecode backend\n";
+      return 1;
+    }
+    if (use_ast && interpreter_options.profile_opcodes) {
+      std::cerr << "error: --profile-opcodes requires the bytecode backend\n";
+      return 1;
+    }
     const bool do_dump = result.count("dump") != 0;
 
     std::vector<std::string> files;
@@ -256,10 +321,10 @@ int main(int argc, char **argv) {
     if (files.size() == 1) {
       const std::string source = read_file(files[0]);
       if (do_dump) {
-        return dump_source(source, backend, optimize_bytecode) ? 0 : 1;
+        return dump_source(source, backend, optimizer_options) ? 0 : 1;
       }
 
-      const auto value = run_source(source, backend, optimize_bytecode);
+      const auto value = run_source(source, backend, optimizer_options, interpreter_options);
       if (!value.has_value()) {
         return 1;
       }
@@ -272,7 +337,7 @@ int main(int argc, char **argv) {
       return 1;
     }
 
-    repl(backend, optimize_bytecode);
+    repl(backend, optimizer_options, interpreter_options);
     return 0;
   } catch (const cxxopts::exceptions::exception &ex) {
     std::cerr << "error: " << ex.what() << "\n";
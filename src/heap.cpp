@@ -0,0 +1,123 @@
+#include "heap.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace kai {
+
+StructLayouts::Interned StructLayouts::intern(const std::vector<std::string> &names) {
+  std::vector<std::string> fields = names;
+  std::sort(fields.begin(), fields.end());
+  fields.erase(std::unique(fields.begin(), fields.end()), fields.end());
+
+  auto it = ids_.find(fields);
+  if (it == ids_.end()) {
+    const auto layout = static_cast<LayoutId>(layouts_.size());
+    layouts_.push_back(fields);
+    it = ids_.emplace(std::move(fields), layout).first;
+  }
+
+  Interned interned{it->second, {}};
+  interned.offsets.reserve(names.size());
+  for (const auto &name : names) {
+    interned.offsets.push_back(offset(interned.layout, name));
+  }
+  return interned;
+}
+
+uint32_t StructLayouts::offset(LayoutId layout, std::string_view name) const {
+  const auto &layout_fields = fields(layout);
+  const auto it = std::lower_bound(layout_fields.begin(), layout_fields.end(), name);
+  assert(it != layout_fields.end() && *it == name);
+  return static_cast<uint32_t>(it - layout_fields.begin());
+}
+
+void Heap::index_out_of_bounds(Value index, size_t size) {
+  throw std::out_of_range("array index " + std::to_string(index) +
+                          " is out of bounds for length " + std::to_string(size));
+}
+
+void Heap::invalid_handle(Value handle) {
+  throw std::out_of_range("heap handle " + std::to_string(handle) +
+                          " does not refer to a live object");
+}
+
+void Heap::wrong_kind(Value handle, Kind expected) {
+  throw std::runtime_error("heap handle " + std::to_string(handle) + " is not " +
+                           (expected == Kind::Array ? "an array" : "a struct"));
+}
+
+Heap::Object &Heap::allocate(Kind kind) {
+  ++allocations_since_collection_;
+  ++stats_.allocated_objects;
+  ++stats_.live_objects;
+  if (!free_list_.empty()) {
+    const auto handle = free_list_.back();
+    free_list_.pop_back();
+    auto &object = objects_[handle - 1];
+    assert(object.kind == Kind::Free);
+    object.kind = kind;
+    object.layout = StructLayouts::k_no_layout;
+    return object;
+  }
+  objects_.push_back({kind, false, StructLayouts::k_no_layout, {}});
+  stats_.slots = objects_.size();
+  return objects_.back();
+}
+
+Heap::Value Heap::allocate_array(std::vector<Value> elements) {
+  auto &object = allocate(Kind::Array);
+  object.elements = std::move(elements);
+  return static_cast<Value>(&object - objects_.data()) + 1;
+}
+
+Heap::Value Heap::allocate_struct(LayoutId layout, std::vector<Value> fields) {
+  assert(fields.size() == layouts_.fields(layout).size());
+  auto &object = allocate(Kind::Struct);
+  object.layout = layout;
+  object.elements = std::move(fields);
+  return static_cast<Value>(&object - objects_.data()) + 1;
+}
+
+void Heap::trace(Value handle) {
+  const auto &object = object_at(handle);
+  for (const auto value : object.elements) {
+    mark(value);
+  }
+}
+
+void Heap::sweep() {
+  for (size_t i = 0; i < objects_.size(); ++i) {
+    auto &object = objects_[i];
+    if (object.kind == Kind::Free) {
+      continue;
+    }
+    if (object.marked) {
+      object.marked = false;
+      continue;
+    }
+    object.kind = Kind::Free;
+    object.elements = {};
+    free_list_.push_back(static_cast<Value>(i) + 1);
+    ++stats_.freed_objects;
+    --stats_.live_objects;
+  }
+  ++stats_.collections;
+  allocations_since_collection_ = 0;
+  collection_threshold_ = std::max(k_min_collection_threshold, stats_.live_objects);
+}
+
+void Heap::clear() {
+  objects_.clear();
+  layouts_ = {};
+  free_list_.clear();
+  gray_.clear();
+  pending_pointers_.clear();
+  allocations_since_collection_ = 0;
+  collection_threshold_ = k_min_collection_threshold;
+  stats_ = {};
+}
+
+}  // namespace kai
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kai {
+
+// Registry of struct layouts (hidden classes). A layout is the sorted set of
+// field names of a struct literal, the same identity the typechecker gives a
+// Shape::Struct_Literal, so every struct with the same fields shares one
+// layout and stores its fields at the same offsets.
+class StructLayouts {
+ public:
+  using LayoutId = uint32_t;
+
+  static constexpr LayoutId k_no_layout = UINT32_MAX;
+
+  struct Interned {
+    LayoutId layout;
+    // Offset of each field name passed to intern(), in the order given.
+    // Repeated names share an offset, so the last value written wins.
+    std::vector<uint32_t> offsets;
+  };
+
+  Interned intern(const std::vector<std::string> &names);
+
+  const std::vector<std::string> &fields(LayoutId layout) const {
+    assert(layout < layouts_.size());
+    return layouts_[layout];
+  }
+
+  uint32_t offset(LayoutId layout, std::string_view name) const;
+  size_t size() const { return layouts_.size(); }
+
+ private:
+  std::vector<std::vector<std::string>> layouts_;
+  std::map<std::vector<std::string>, LayoutId, std::less<>> ids_;
+};
+
+// Object heap shared by the AST and bytecode interpreters. A handle is the
+// 1-based index of its object in a dense slot table, so reaching an array
+// element is one range check on the handle and one on the index; 0 is never a
+// valid handle.
+//
+// Memory is reclaimed by a mark-sweep collector. Values carry no type tag, so
+// marking is conservative: any root or field value that equals the handle of
+// a live object keeps that object alive. Values with k_pointer_tag set are
+// pointer handles owned by the interpreters; the collector hands those back
+// to the caller so it can mark its own pointer cells. Freed slots are reused
+// through a free list, and a collection is due once the number of
+// allocations since the last one reaches the live object count (at least
+// k_min_collection_threshold).
+class Heap {
+ public:
+  using Value = uint64_t;
+
+  static constexpr Value k_pointer_tag = Value{1} << 63;
+  static constexpr size_t k_min_collection_threshold = 1024;
+
+  using LayoutId = StructLayouts::LayoutId;
+
+  enum class Kind : uint8_t {
+    Free,
+    Array,
+    Struct,
+  };
+
+  struct Stats {
+    size_t collections = 0;
+    size_t allocated_objects = 0;
+    size_t freed_objects = 0;
+    size_t live_objects = 0;
+    // Size of the slot table, which bounds the heap's footprint.
+    size_t slots = 0;
+  };
+
+  Value allocate_array(std::vector<Value> elements);
+  // `fields` holds one value per field of `layout`, in layout order.
+  Value allocate_struct(LayoutId layout, std::vector<Value> fields);
+
+  // Like load and store, every accessor checks its handle in every build:
+  // one that names no live object throws std::out_of_range, and one that
+  // names an object of the wrong kind throws std::runtime_error.
+  std::vector<Value> &array(Value handle) {
+    return object_of_kind(handle, Kind::Array).elements;
+  }
+
+  // Element access checks the index in every build and throws
+  // std::out_of_range when it is past the end, so kai code cannot reach
+  // memory outside its arrays.
+  Value load(Value handle, Value index) {
+    const auto &elements = array(handle);
+    if (index >= elements.size()) [[unlikely]] {
+      index_out_of_bounds(index, elements.size());
+    }
+    return elements[index];
+  }
+
+  void store(Value handle, Value index, Value value) {
+    auto &elements = array(handle);
+    if (index >= elements.size()) [[unlikely]] {
+      index_out_of_bounds(index, elements.size());
+    }
+    elements[index] = value;
+  }
+
+  // For indices already known to be in bounds, as the optimizer proves for
+  // ArrayLoadUnchecked and ArrayStoreUnchecked; only debug builds check the
+  // index, but the handle is still checked like everywhere else.
+  Value load_unchecked(Value handle, Value index) {
+    const auto &elements = array(handle);
+    assert(index < elements.size());
+    return elements[index];
+  }
+
+  void store_unchecked(Value handle, Value index, Value value) {
+    auto &elements = array(handle);
+    assert(index < elements.size());
+    elements[index] = value;
+  }
+
+  LayoutId struct_layout(Value handle) {
+    return object_of_kind(handle, Kind::Struct).layout;
+  }
+
+  Value load_field(Value handle, uint32_t offset) {
+    const auto &object = object_of_kind(handle, Kind::Struct);
+    assert(offset < object.elements.size());
+    return object.elements[offset];
+  }
+
+  void store_field(Value handle, uint32_t offset, Value value) {
+    auto &object = object_of_kind(handle, Kind::Struct);
+    assert(offset < object.elements.size());
+    object.elements[offset] = value;
+  }
+
+  StructLayouts &layouts() { return layouts_; }
+  const StructLayouts &layouts() const { return layouts_; }
+
+  bool should_collect() const {
+    return allocations_since_collection_ >= collection_threshold_;
+  }
+
+  // Marks the object `value` may refer to. Call for every root, then
+  // collect(); pointer visitors may call mark() again while collecting.
+  void mark(Value value) {
+    if (value & k_pointer_tag) {
+      pending_pointers_.push_back(value);
+      return;
+    }
+    if (value == 0 || value > objects_.size()) {
+      return;
+    }
+    auto &object = objects_[value - 1];
+    if (object.kind == Kind::Free || object.marked) {
+      return;
+    }
+    object.marked = true;
+    gray_.push_back(value);
+  }
+
+  // Traces everything reachable from the marked roots, then frees the rest.
+  // `visit_pointer` is called for each pointer handle found along the way,
+  // possibly more than once for the same handle.
+  template <typename VisitPointer>
+  void collect(VisitPointer &&visit_pointer) {
+    while (!gray_.empty() || !pending_pointers_.empty()) {
+      if (!pending_pointers_.empty()) {
+        const auto pointer = pending_pointers_.back();
+        pending_pointers_.pop_back();
+        visit_pointer(pointer);
+        continue;
+      }
+      const auto handle = gray_.back();
+      gray_.pop_back();
+      trace(handle);
+    }
+    sweep();
+  }
+
+  // Number of slots in the table, free or not.
+  size_t size() const { return objects_.size(); }
+  const Stats &stats() const { return stats_; }
+  // Frees every object and forgets every layout.
+  void clear();
+
+ private:
+  // Array elements, or struct fields at their layout offsets.
+  struct Object {
+    Kind kind;
+    bool marked = false;
+    LayoutId layout = StructLayouts::k_no_layout;
+    std::vector<Value> elements;
+  };
+
+  Object &object_at(Value handle) {
+    if (handle == 0 || handle > objects_.size() ||
+        objects_[handle - 1].kind == Kind::Free) [[unlikely]] {
+      invalid_handle(handle);
+    }
+    return objects_[handle - 1];
+  }
+
+  Object &object_of_kind(Value handle, Kind kind) {
+    auto &object = object_at(handle);
+    if (object.kind != kind) [[unlikely]] {
+      wrong_kind(handle, kind);
+    }
+    return object;
+  }
+
+  [[noreturn]] static void index_out_of_bounds(Value index, size_t size);
+  [[noreturn]] static void invalid_handle(Value handle);
+  [[noreturn]] static void wrong_kind(Value handle, Kind expected);
+  Object &allocate(Kind kind);
+  void trace(Value handle);
+  void sweep();
+
+  std::vector<Object> objects_;
+  StructLayouts layouts_;
+  std::vector<Value> free_list_;
+  std::vector<Value> gray_;
+  std::vector<Value> pending_pointers_;
+  size_t allocations_since_collection_ = 0;
+  size_t collection_threshold_ = k_min_collection_threshold;
+  Stats stats_;
+};
+
+}  // namespace kai
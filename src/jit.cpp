@@ -0,0 +1,1003 @@
+#include "jit.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define KAI_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define KAI_JIT_X86_64 0
+#endif
+
+namespace kai {
+
+using Type = Bytecode::Instruction::Type;
+
+bool Jit::supports(Type type) {
+  switch (type) {
+    case Type::Move:
+    case Type::Load:
+    case Type::LessThan:
+    case Type::LessThanImmediate:
+    case Type::GreaterThan:
+    case Type::GreaterThanImmediate:
+    case Type::LessThanOrEqual:
+    case Type::LessThanOrEqualImmediate:
+    case Type::GreaterThanOrEqual:
+    case Type::GreaterThanOrEqualImmediate:
+    case Type::Jump:
+    case Type::JumpConditional:
+    case Type::JumpEqualImmediate:
+    case Type::JumpGreaterThanImmediate:
+    case Type::JumpLessThanOrEqual:
+    case Type::JumpLessThan:
+    case Type::JumpLessThanImmediate:
+    case Type::JumpGreaterThan:
+    case Type::JumpLessThanOrEqualImmediate:
+    case Type::JumpGreaterThanOrEqual:
+    case Type::JumpGreaterThanOrEqualImmediate:
+    case Type::JumpEqual:
+    case Type::JumpNotEqual:
+    case Type::JumpNotEqualImmediate:
+    case Type::Call:
+    case Type::TailCall:
+    case Type::Return:
+    case Type::Equal:
+    case Type::EqualImmediate:
+    case Type::NotEqual:
+    case Type::NotEqualImmediate:
+    case Type::Add:
+    case Type::AddImmediate:
+    case Type::Subtract:
+    case Type::SubtractImmediate:
+    case Type::Multiply:
+    case Type::MultiplyImmediate:
+    case Type::Divide:
+    case Type::DivideImmediate:
+    case Type::Modulo:
+    case Type::ModuloImmediate:
+    case Type::Negate:
+    case Type::LogicalNot:
+    case Type::MoveJump:
+    case Type::LoadJump:
+    case Type::AddImmediateJump:
+    case Type::AddReturn:
+      return true;
+    case Type::ArrayCreate:
+    case Type::ArrayLiteralCreate:
+    case Type::ArrayLoad:
+    case Type::ArrayLoadImmediate:
+    case Type::ArrayStore:
+    case Type::ArrayLoadUnchecked:
+    case Type::ArrayStoreUnchecked:
+    case Type::StructCreate:
+    case Type::StructLiteralCreate:
+    case Type::StructLoad:
+    case Type::StructStore:
+    case Type::AddressOf:
+    case Type::LoadIndirect:
+      return false;
+  }
+  return false;
+}
+
+Jit::NativeFunction Jit::function(u32 entry) const {
+  return entry < functions_.size() ? functions_[entry] : nullptr;
+}
+
+Jit::NativeFunction Jit::osr_entry(u32 offset) const {
+  return offset < osr_entries_.size() ? osr_entries_[offset] : nullptr;
+}
+
+#if KAI_JIT_X86_64
+
+namespace {
+
+// Scratch registers. rbx holds the frame base for the whole function.
+enum Reg : uint8_t {
+  rax = 0,
+  rcx = 1,
+  rdx = 2,
+  rbx = 3,
+};
+
+// Condition codes for the unsigned comparisons the interpreter performs.
+enum Condition : uint8_t {
+  below = 0x2,
+  above_or_equal = 0x3,
+  equal = 0x4,
+  not_equal = 0x5,
+  below_or_equal = 0x6,
+  above = 0x7,
+};
+
+bool fits_int32(Bytecode::Value value) {
+  const auto signed_value = static_cast<int64_t>(value);
+  return signed_value >= std::numeric_limits<int32_t>::min() &&
+         signed_value <= std::numeric_limits<int32_t>::max();
+}
+
+// Every native call takes two words of the native stack, its return address
+// and the saved rbx, and at least one register slot, so a native stack twice
+// the size of the register stack does not run out first. The reserve below
+// the limit is never touched.
+constexpr size_t k_native_stack_reserve = size_t{4} << 10;
+constexpr size_t k_native_stack_bytes =
+    2 * Jit::k_stack_slots * sizeof(Bytecode::Value) + k_native_stack_reserve;
+
+// NativeResult trampoline(Value *frame, NativeFunction function, void *stack_top)
+// calls `function` with `frame` on the stack ending at `stack_top`. Native
+// code leaves a stack that is about to overflow by jumping to
+// k_trampoline_abandon, which drops every native frame at once; rbp is never
+// used by native code, so it still holds the trampoline's stack pointer.
+constexpr uint8_t k_trampoline[] = {
+    0x55,                          // push rbp
+    0x53,                          // push rbx
+    0x48, 0x89, 0xe5,              // mov rbp, rsp
+    0x48, 0x89, 0xd4,              // mov rsp, rdx
+    0xff, 0xd6,                    // call rsi
+    0xba, 0x01, 0x00, 0x00, 0x00,  // mov edx, 1
+    0xeb, 0x02,                    // jmp leave
+    0x31, 0xd2,                    // abandon: xor edx, edx
+    0x48, 0x89, 0xec,              // leave: mov rsp, rbp
+    0x5b,                          // pop rbx
+    0x5d,                          // pop rbp
+    0xc3,                          // ret
+};
+constexpr size_t k_trampoline_abandon = 17;
+
+struct NativeResult {
+  Bytecode::Value value;
+  uint64_t completed;
+};
+using Trampoline = NativeResult (*)(Bytecode::Value *frame, Jit::NativeFunction function,
+                                    void *stack_top);
+
+// Maps `bytes` as executable code.
+void *map_code(const uint8_t *bytes, size_t count, size_t &size) {
+  const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size = (count + page_size - 1) / page_size * page_size;
+  void *code =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) {
+    std::perror("mmap");
+    std::abort();
+  }
+  std::memcpy(code, bytes, count);
+  if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+    std::perror("mprotect");
+    std::abort();
+  }
+  return code;
+}
+
+class Assembler {
+ public:
+  size_t size() const { return bytes_.size(); }
+  const std::vector<uint8_t> &bytes() const { return bytes_; }
+
+  void emit(std::initializer_list<uint8_t> bytes) {
+    bytes_.insert(bytes_.end(), bytes.begin(), bytes.end());
+  }
+
+  void emit32(uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      bytes_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  void emit64(uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+      bytes_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  void patch32(size_t at, int32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      bytes_[at + i] = static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8 * i));
+    }
+  }
+
+  // [rbx + 8 * slot] operand with `reg` in the ModRM reg field.
+  void frame_operand(uint8_t reg, u32 slot) {
+    assert(slot < (1u << 28));
+    emit({static_cast<uint8_t>(0x80 | (reg << 3) | rbx)});
+    emit32(slot * 8);
+  }
+
+  void load(Reg reg, u32 slot) {
+    emit({0x48, 0x8b});
+    frame_operand(reg, slot);
+  }
+
+  void store(u32 slot, Reg reg) {
+    emit({0x48, 0x89});
+    frame_operand(reg, slot);
+  }
+
+  void store_immediate(u32 slot, Bytecode::Value value) {
+    if (fits_int32(value)) {
+      emit({0x48, 0xc7});
+      frame_operand(0, slot);
+      emit32(static_cast<uint32_t>(value));
+      return;
+    }
+    move_immediate(rax, value);
+    store(slot, rax);
+  }
+
+  void move_immediate(Reg reg, uint64_t value) {
+    emit({0x48, static_cast<uint8_t>(0xb8 | reg)});
+    emit64(value);
+  }
+
+  // rax op= [rbx + 8 * slot] for add (0x03), sub (0x2b) and cmp (0x3b).
+  void arithmetic(uint8_t opcode, u32 slot) {
+    emit({0x48, opcode});
+    frame_operand(rax, slot);
+  }
+
+  // rax op= value for add (0x05/0x01), sub (0x2d/0x29) and cmp (0x3d/0x39).
+  void arithmetic_immediate(uint8_t imm32_opcode, uint8_t register_opcode,
+                            Bytecode::Value value) {
+    if (fits_int32(value)) {
+      emit({0x48, imm32_opcode});
+      emit32(static_cast<uint32_t>(value));
+      return;
+    }
+    move_immediate(rcx, value);
+    emit({0x48, register_opcode, 0xc8});
+  }
+
+  void add(u32 slot) { arithmetic(0x03, slot); }
+  void subtract(u32 slot) { arithmetic(0x2b, slot); }
+  void compare(u32 slot) { arithmetic(0x3b, slot); }
+  void add_immediate(Bytecode::Value value) { arithmetic_immediate(0x05, 0x01, value); }
+  void subtract_immediate(Bytecode::Value value) {
+    arithmetic_immediate(0x2d, 0x29, value);
+  }
+  void compare_immediate(Bytecode::Value value) {
+    arithmetic_immediate(0x3d, 0x39, value);
+  }
+
+  void multiply(u32 slot) {
+    emit({0x48, 0x0f, 0xaf});
+    frame_operand(rax, slot);
+  }
+
+  void multiply_immediate(Bytecode::Value value) {
+    if (fits_int32(value)) {
+      emit({0x48, 0x69, 0xc0});
+      emit32(static_cast<uint32_t>(value));
+      return;
+    }
+    move_immediate(rcx, value);
+    emit({0x48, 0x0f, 0xaf, 0xc1});
+  }
+
+  // rdx:rax = rax divmod rcx, unsigned.
+  void divide_by_rcx() { emit({0x31, 0xd2, 0x48, 0xf7, 0xf1}); }
+
+  // rax = (flags satisfy `condition`) ? 1 : 0.
+  void set_condition(Condition condition) {
+    emit({0x0f, static_cast<uint8_t>(0x90 | condition), 0xc0, 0x0f, 0xb6, 0xc0});
+  }
+
+  void negate() { emit({0x48, 0xf7, 0xd8}); }
+  void test_rax() { emit({0x48, 0x85, 0xc0}); }
+
+  void compare_slot_with_zero(u32 slot) {
+    emit({0x48, 0x83});
+    frame_operand(7, slot);
+    emit({0x00});
+  }
+
+  void load_address(Reg reg, u32 slot) {
+    emit({0x48, 0x8d});
+    frame_operand(reg, slot);
+  }
+
+  void load_address_rdi(u32 slot) {
+    emit({0x48, 0x8d});
+    frame_operand(7, slot);
+  }
+
+  // Zeroes `count` slots starting at `slot`. Frames of a few dozen slots,
+  // common once small callees are inlined, are cheaper to clear with plain
+  // stores than with rep stos and its fixed startup cost.
+  void zero_slots(u32 slot, u32 count) {
+    if (count == 0) {
+      return;
+    }
+    emit({0x31, 0xc0});
+    if (count <= 32) {
+      for (u32 i = 0; i < count; ++i) {
+        store(slot + i, rax);
+      }
+      return;
+    }
+    load_address_rdi(slot);
+    emit({0xb9});
+    emit32(count);
+    emit({0xf3, 0x48, 0xab});
+  }
+
+  // Emits a rel32 branch and returns the position of its displacement.
+  size_t jump() {
+    emit({0xe9});
+    return placeholder();
+  }
+
+  size_t jump_if(Condition condition) {
+    emit({0x0f, static_cast<uint8_t>(0x80 | condition)});
+    return placeholder();
+  }
+
+  size_t call() {
+    emit({0xe8});
+    return placeholder();
+  }
+
+  void call_rax() { emit({0xff, 0xd0}); }
+  void jump_rax() { emit({0xff, 0xe0}); }
+
+  void prologue() { emit({0x53, 0x48, 0x89, 0xfb}); }
+  void epilogue() { emit({0x5b, 0xc3}); }
+
+ private:
+  size_t placeholder() {
+    const size_t position = bytes_.size();
+    emit32(0);
+    return position;
+  }
+
+  std::vector<uint8_t> bytes_;
+};
+
+u32 block_end(const Bytecode::Executable &executable, u32 block) {
+  return block + 1 < executable.block_offsets.size()
+             ? executable.block_offsets[block + 1]
+             : static_cast<u32>(executable.code.size());
+}
+
+// Native code for a chunk of functions of one Executable. Branches and calls
+// within the chunk are rel32, so the code can be copied anywhere; calls to
+// functions compiled into earlier chunks go through their absolute addresses.
+class Compiler {
+ public:
+  Compiler(const Bytecode::Executable &executable, const std::vector<size_t> &functions,
+           const std::vector<Jit::NativeFunction> &compiled_entries,
+           const std::vector<const void *> &compiled_bodies,
+           const Bytecode::Value *stack_limit, const void *native_stack_limit,
+           const void *abandon)
+      : executable_(executable),
+        functions_(functions),
+        compiled_entries_(compiled_entries),
+        compiled_bodies_(compiled_bodies),
+        stack_limit_(stack_limit),
+        native_stack_limit_(native_stack_limit),
+        abandon_(abandon),
+        in_chunk_(executable.code.size(), false),
+        instruction_labels_(executable.code.size(), k_unbound),
+        entry_labels_(executable.code.size(), k_unbound),
+        osr_labels_(executable.code.size(), k_unbound) {
+    for (const auto function : functions_) {
+      in_chunk_[executable_.functions[function].entry] = true;
+    }
+  }
+
+  Assembler compile() {
+    // Shared slow path for call sites that would overflow the register stack
+    // and entries that would overflow the native stack: native code gives up
+    // and the interpreter runs the call instead.
+    overflow_label_ = assembler_.size();
+    assembler_.move_immediate(rax, reinterpret_cast<uint64_t>(abandon_));
+    assembler_.jump_rax();
+
+    for (const auto function : functions_) {
+      compile_function(executable_.functions[function]);
+    }
+    for (const auto &fixup : fixups_) {
+      const auto &labels = fixup.entry ? entry_labels_ : instruction_labels_;
+      const size_t target =
+          fixup.target == k_overflow ? overflow_label_ : labels[fixup.target];
+      assert(target != k_unbound);
+      const auto displacement =
+          static_cast<int64_t>(target) - static_cast<int64_t>(fixup.position + 4);
+      assembler_.patch32(fixup.position, static_cast<int32_t>(displacement));
+    }
+    return std::move(assembler_);
+  }
+
+  size_t entry_label(u32 entry) const { return entry_labels_[entry]; }
+  size_t instruction_label(u32 offset) const { return instruction_labels_[offset]; }
+  // Offsets of the loop headers that got an OSR entry, and their labels.
+  const std::vector<u32> &loop_headers() const { return loop_headers_; }
+  size_t osr_label(u32 offset) const { return osr_labels_[offset]; }
+
+ private:
+  static constexpr size_t k_unbound = static_cast<size_t>(-1);
+  static constexpr u32 k_overflow = static_cast<u32>(-1);
+
+  struct Fixup {
+    size_t position;
+    u32 target;
+    bool entry;
+  };
+
+  void branch_to(size_t position, u32 target, bool entry = false) {
+    fixups_.push_back({position, target, entry});
+  }
+
+  // Jumps to `target` unless it is the next instruction emitted.
+  void jump_to(u32 target, u32 next) {
+    if (target != next) {
+      branch_to(assembler_.jump(), target);
+    }
+  }
+
+  void check_stack(u32 frame_end) {
+    assembler_.load_address(rax, frame_end);
+    assembler_.move_immediate(rcx, reinterpret_cast<uint64_t>(stack_limit_));
+    assembler_.emit({0x48, 0x39, 0xc8});
+    branch_to(assembler_.jump_if(above), k_overflow);
+  }
+
+  // Saves rbx, points it at the frame and checks the native stack.
+  void enter_function() {
+    assembler_.prologue();
+    assembler_.move_immediate(rcx, reinterpret_cast<uint64_t>(native_stack_limit_));
+    assembler_.emit({0x48, 0x39, 0xcc});
+    branch_to(assembler_.jump_if(below), k_overflow);
+  }
+
+  void compile_function(const Bytecode::Executable::Function &function) {
+    std::vector<u32> order;
+    std::vector<u32> blocks = function.blocks;
+    std::sort(blocks.begin(), blocks.end());
+    for (const auto block : blocks) {
+      const u32 end = block_end(executable_, block);
+      for (u32 offset = executable_.block_offsets[block]; offset < end; ++offset) {
+        order.push_back(offset);
+      }
+    }
+
+    entry_labels_[function.entry] = assembler_.size();
+    enter_function();
+    for (size_t i = 0; i < order.size(); ++i) {
+      const u32 next = i + 1 < order.size() ? order[i + 1] : k_overflow;
+      instruction_labels_[order[i]] = assembler_.size();
+      compile_instruction(executable_.code[order[i]], function.frame_size, next);
+    }
+
+    // An OSR entry sets up the frame like the prologue and jumps straight to
+    // its loop header.
+    for (const auto offset : order) {
+      const auto &ip = executable_.code[offset];
+      for (const auto target : jump_targets(ip)) {
+        if (target <= offset && osr_labels_[target] == k_unbound) {
+          osr_labels_[target] = assembler_.size();
+          loop_headers_.push_back(target);
+          enter_function();
+          branch_to(assembler_.jump(), target);
+        }
+      }
+    }
+  }
+
+  static std::vector<u32> jump_targets(const Bytecode::Executable::Instruction &ip) {
+    switch (ip.type) {
+      case Type::Jump:
+        return {ip.b};
+      case Type::MoveJump:
+      case Type::LoadJump:
+      case Type::AddImmediateJump:
+        return {ip.c};
+      case Type::JumpConditional:
+      case Type::JumpEqualImmediate:
+      case Type::JumpGreaterThanImmediate:
+      case Type::JumpLessThanOrEqual:
+      case Type::JumpLessThan:
+      case Type::JumpLessThanImmediate:
+      case Type::JumpGreaterThan:
+      case Type::JumpLessThanOrEqualImmediate:
+      case Type::JumpGreaterThanOrEqual:
+      case Type::JumpGreaterThanOrEqualImmediate:
+      case Type::JumpEqual:
+      case Type::JumpNotEqual:
+      case Type::JumpNotEqualImmediate:
+        return {ip.b, ip.c};
+      default:
+        return {};
+    }
+  }
+
+  void compile_compare(const Bytecode::Executable::Instruction &ip, Condition condition) {
+    assembler_.load(rax, ip.b);
+    assembler_.compare(ip.c);
+    assembler_.set_condition(condition);
+    assembler_.store(ip.a, rax);
+  }
+
+  void compile_compare_immediate(const Bytecode::Executable::Instruction &ip,
+                                 Condition condition) {
+    assembler_.load(rax, ip.b);
+    assembler_.compare_immediate(ip.value);
+    assembler_.set_condition(condition);
+    assembler_.store(ip.a, rax);
+  }
+
+  void compile_divide(const Bytecode::Executable::Instruction &ip, bool immediate,
+                      Reg result) {
+    assembler_.load(rax, ip.b);
+    if (immediate) {
+      assembler_.move_immediate(rcx, ip.value);
+    } else {
+      assembler_.load(rcx, ip.c);
+    }
+    assembler_.divide_by_rcx();
+    assembler_.store(ip.a, result);
+  }
+
+  void compile_conditional_jump(Condition condition, u32 then_target, u32 else_target,
+                                u32 next) {
+    branch_to(assembler_.jump_if(condition), then_target);
+    jump_to(else_target, next);
+  }
+
+  void compile_compare_jump(const Bytecode::Executable::Instruction &ip, Condition condition,
+                            u32 next) {
+    assembler_.load(rax, ip.a);
+    assembler_.compare(ip.d);
+    compile_conditional_jump(condition, ip.b, ip.c, next);
+  }
+
+  void compile_compare_immediate_jump(const Bytecode::Executable::Instruction &ip,
+                                      Condition condition, u32 next) {
+    assembler_.load(rax, ip.a);
+    assembler_.compare_immediate(ip.value);
+    compile_conditional_jump(condition, ip.b, ip.c, next);
+  }
+
+  void compile_instruction(const Bytecode::Executable::Instruction &ip, u32 frame_size,
+                           u32 next) {
+    const auto *operands = executable_.operands.data();
+    switch (ip.type) {
+      case Type::Move:
+        assembler_.load(rax, ip.b);
+        assembler_.store(ip.a, rax);
+        break;
+      case Type::Load:
+        assembler_.store_immediate(ip.a, ip.value);
+        break;
+      case Type::LessThan:
+        compile_compare(ip, below);
+        break;
+      case Type::LessThanImmediate:
+        compile_compare_immediate(ip, below);
+        break;
+      case Type::GreaterThan:
+        compile_compare(ip, above);
+        break;
+      case Type::GreaterThanImmediate:
+        compile_compare_immediate(ip, above);
+        break;
+      case Type::LessThanOrEqual:
+        compile_compare(ip, below_or_equal);
+        break;
+      case Type::LessThanOrEqualImmediate:
+        compile_compare_immediate(ip, below_or_equal);
+        break;
+      case Type::GreaterThanOrEqual:
+        compile_compare(ip, above_or_equal);
+        break;
+      case Type::GreaterThanOrEqualImmediate:
+        compile_compare_immediate(ip, above_or_equal);
+        break;
+      case Type::Equal:
+        compile_compare(ip, equal);
+        break;
+      case Type::EqualImmediate:
+        compile_compare_immediate(ip, equal);
+        break;
+      case Type::NotEqual:
+        compile_compare(ip, not_equal);
+        break;
+      case Type::NotEqualImmediate:
+        compile_compare_immediate(ip, not_equal);
+        break;
+      case Type::Jump:
+        jump_to(ip.b, next);
+        break;
+      case Type::JumpConditional:
+        assembler_.compare_slot_with_zero(ip.a);
+        compile_conditional_jump(not_equal, ip.b, ip.c, next);
+        break;
+      case Type::JumpEqualImmediate:
+        compile_compare_immediate_jump(ip, equal, next);
+        break;
+      case Type::JumpGreaterThanImmediate:
+        compile_compare_immediate_jump(ip, above, next);
+        break;
+      case Type::JumpLessThanOrEqual:
+        compile_compare_jump(ip, below_or_equal, next);
+        break;
+      case Type::JumpLessThan:
+        compile_compare_jump(ip, below, next);
+        break;
+      case Type::JumpLessThanImmediate:
+        compile_compare_immediate_jump(ip, below, next);
+        break;
+      case Type::JumpGreaterThan:
+        compile_compare_jump(ip, above, next);
+        break;
+      case Type::JumpLessThanOrEqualImmediate:
+        compile_compare_immediate_jump(ip, below_or_equal, next);
+        break;
+      case Type::JumpGreaterThanOrEqual:
+        compile_compare_jump(ip, above_or_equal, next);
+        break;
+      case Type::JumpGreaterThanOrEqualImmediate:
+        compile_compare_immediate_jump(ip, above_or_equal, next);
+        break;
+      case Type::JumpEqual:
+        compile_compare_jump(ip, equal, next);
+        break;
+      case Type::JumpNotEqual:
+        compile_compare_jump(ip, not_equal, next);
+        break;
+      case Type::JumpNotEqualImmediate:
+        compile_compare_immediate_jump(ip, not_equal, next);
+        break;
+      case Type::Call: {
+        // The callee frame starts right after this one, as in the interpreter.
+        const auto *args = operands + ip.c;
+        const auto *params = args + ip.d;
+        const auto callee_frame_size = static_cast<u32>(ip.value);
+        check_stack(frame_size + callee_frame_size);
+        assembler_.zero_slots(frame_size, callee_frame_size);
+        for (u32 i = 0; i < ip.d; ++i) {
+          assembler_.load(rax, args[i]);
+          assembler_.store(frame_size + params[i], rax);
+        }
+        assembler_.load_address_rdi(frame_size);
+        if (in_chunk_[ip.b]) {
+          branch_to(assembler_.call(), ip.b, true);
+        } else {
+          assert(compiled_entries_[ip.b] != nullptr);
+          assembler_.move_immediate(rax,
+                                    reinterpret_cast<uint64_t>(compiled_entries_[ip.b]));
+          assembler_.call_rax();
+        }
+        assembler_.store(ip.a, rax);
+        break;
+      }
+      case Type::TailCall: {
+        // The callee reuses this frame, widened and zeroed past the current
+        // size if it needs more slots. Arguments then reach the parameters
+        // through the lowered move schedule, with rdx as its temporary.
+        const auto *moves = operands + ip.c + 2 * ip.d;
+        const auto callee_frame_size = static_cast<u32>(ip.value);
+        if (callee_frame_size > frame_size) {
+          check_stack(callee_frame_size);
+          assembler_.zero_slots(frame_size, callee_frame_size - frame_size);
+        }
+        for (u32 i = 0; i < ip.a; ++i) {
+          const u32 dst = moves[2 * i];
+          const u32 src = moves[2 * i + 1];
+          if (dst == Bytecode::Executable::k_move_temporary) {
+            assembler_.load(rdx, src);
+          } else if (src == Bytecode::Executable::k_move_temporary) {
+            assembler_.store(dst, rdx);
+          } else {
+            assembler_.load(rax, src);
+            assembler_.store(dst, rax);
+          }
+        }
+        if (in_chunk_[ip.b]) {
+          jump_to(ip.b, next);
+        } else {
+          assert(compiled_bodies_[ip.b] != nullptr);
+          assembler_.move_immediate(rax, reinterpret_cast<uint64_t>(compiled_bodies_[ip.b]));
+          assembler_.jump_rax();
+        }
+        break;
+      }
+      case Type::Return:
+        assembler_.load(rax, ip.a);
+        assembler_.epilogue();
+        break;
+      case Type::Add:
+        assembler_.load(rax, ip.b);
+        assembler_.add(ip.c);
+        assembler_.store(ip.a, rax);
+        break;
+      case Type::AddImmediate:
+        assembler_.load(rax, ip.b);
+        assembler_.add_immediate(ip.value);
+        assembler_.store(ip.a, rax);
+        break;
+      case Type::Subtract:
+        assembler_.load(rax, ip.b);
+        assembler_.subtract(ip.c);
+        assembler_.store(ip.a, rax);
+        break;
+      case Type::SubtractImmediate:
+        assembler_.load(rax, ip.b);
+        assembler_.subtract_immediate(ip.value);
+        assembler_.store(ip.a, rax);
+        break;
+      case Type::Multiply:
+        assembler_.load(rax, ip.b);
+        assembler_.multiply(ip.c);
+        assembler_.store(ip.a, rax);
+        break;
+      case Type::MultiplyImmediate:
+        assembler_.load(rax, ip.b);
+        assembler_.multiply_immediate(ip.value);
+        assembler_.store(ip.a, rax);
+        break;
+      case Type::Divide:
+        compile_divide(ip, false, rax);
+        break;
+      case Type::DivideImmediate:
+        compile_divide(ip, true, rax);
+        break;
+      case Type::Modulo:
+        compile_divide(ip, false, rdx);
+        break;
+      case Type::ModuloImmediate:
+        compile_divide(ip, true, rdx);
+        break;
+      case Type::Negate:
+        assembler_.load(rax, ip.b);
+        assembler_.negate();
+        assembler_.store(ip.a, rax);
+        break;
+      case Type::LogicalNot:
+        assembler_.load(rax, ip.b);
+        assembler_.test_rax();
+        assembler_.set_condition(equal);
+        assembler_.store(ip.a, rax);
+        break;
+      case Type::MoveJump:
+        assembler_.load(rax, ip.b);
+        assembler_.store(ip.a, rax);
+        jump_to(ip.c, next);
+        break;
+      case Type::LoadJump:
+        assembler_.store_immediate(ip.a, ip.value);
+        jump_to(ip.c, next);
+        break;
+      case Type::AddImmediateJump:
+        assembler_.load(rax, ip.b);
+        assembler_.add_immediate(ip.value);
+        assembler_.store(ip.a, rax);
+        jump_to(ip.c, next);
+        break;
+      case Type::AddReturn:
+        assembler_.load(rax, ip.b);
+        assembler_.add(ip.c);
+        assembler_.epilogue();
+        break;
+      default:
+        assert(false);
+        break;
+    }
+  }
+
+  const Bytecode::Executable &executable_;
+  const std::vector<size_t> &functions_;
+  const std::vector<Jit::NativeFunction> &compiled_entries_;
+  const std::vector<const void *> &compiled_bodies_;
+  const Bytecode::Value *stack_limit_;
+  const void *native_stack_limit_;
+  const void *abandon_;
+  Assembler assembler_;
+  // Indexed by code offset.
+  std::vector<bool> in_chunk_;
+  std::vector<size_t> instruction_labels_;
+  std::vector<size_t> entry_labels_;
+  std::vector<size_t> osr_labels_;
+  std::vector<u32> loop_headers_;
+  std::vector<Fixup> fixups_;
+  size_t overflow_label_ = 0;
+};
+
+// Functions whose instructions are all supported and whose calls only reach
+// other such functions. Fills in the functions each one calls.
+std::vector<bool> compilable_functions(const Bytecode::Executable &executable,
+                                       const std::vector<u32> &function_index,
+                                       std::vector<std::vector<u32>> &callees) {
+  const auto &functions = executable.functions;
+  std::vector<bool> compilable(functions.size(), true);
+  callees.assign(functions.size(), {});
+  for (size_t i = 0; i < functions.size(); ++i) {
+    for (const auto block : functions[i].blocks) {
+      const u32 end = block_end(executable, block);
+      for (u32 offset = executable.block_offsets[block]; offset < end; ++offset) {
+        const auto &ip = executable.code[offset];
+        if (!Jit::supports(ip.type)) {
+          compilable[i] = false;
+        } else if (ip.type == Type::Call || ip.type == Type::TailCall) {
+          assert(executable.functions[function_index[ip.b]].entry == ip.b);
+          callees[i].push_back(function_index[ip.b]);
+        }
+      }
+    }
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i < functions.size(); ++i) {
+      if (!compilable[i]) {
+        continue;
+      }
+      for (const auto callee : callees[i]) {
+        if (!compilable[callee]) {
+          compilable[i] = false;
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+  return compilable;
+}
+
+}  // namespace
+
+bool Jit::is_supported() { return true; }
+
+Jit::Jit() {
+  void *stack = mmap(nullptr, k_stack_slots * sizeof(Bytecode::Value),
+                     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                     -1, 0);
+  if (stack == MAP_FAILED) {
+    std::perror("mmap");
+    std::abort();
+  }
+  stack_ = static_cast<Bytecode::Value *>(stack);
+
+  native_stack_ = mmap(nullptr, k_native_stack_bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (native_stack_ == MAP_FAILED) {
+    std::perror("mmap");
+    std::abort();
+  }
+  trampoline_.code = map_code(k_trampoline, sizeof(k_trampoline), trampoline_.size);
+}
+
+Jit::~Jit() {
+  release_code();
+  munmap(trampoline_.code, trampoline_.size);
+  munmap(native_stack_, k_native_stack_bytes);
+  munmap(stack_, k_stack_slots * sizeof(Bytecode::Value));
+}
+
+std::optional<Bytecode::Value> Jit::run(NativeFunction function, Bytecode::Value *frame) const {
+  const auto trampoline = reinterpret_cast<Trampoline>(trampoline_.code);
+  const auto result =
+      trampoline(frame, function, static_cast<uint8_t *>(native_stack_) + k_native_stack_bytes);
+  if (!result.completed) {
+    return std::nullopt;
+  }
+  return result.value;
+}
+
+void Jit::release_code() {
+  for (const auto &chunk : chunks_) {
+    munmap(chunk.code, chunk.size);
+  }
+  chunks_.clear();
+  compiled_function_count_ = 0;
+}
+
+bool Jit::compile_function(u32 entry) {
+  assert(executable_ != nullptr);
+  const auto &executable = *executable_;
+  const auto index = function_index_[entry];
+  assert(executable.functions[index].entry == entry);
+  if (!compilable_[index]) {
+    return false;
+  }
+  if (compiled_[index]) {
+    return true;
+  }
+
+  // The function and every callee without native code yet go in one chunk.
+  std::vector<size_t> pending = {index};
+  std::vector<bool> queued(executable.functions.size(), false);
+  queued[index] = true;
+  for (size_t i = 0; i < pending.size(); ++i) {
+    for (const auto callee : callees_[pending[i]]) {
+      if (!compiled_[callee] && !queued[callee]) {
+        queued[callee] = true;
+        pending.push_back(callee);
+      }
+    }
+  }
+
+  Compiler compiler(executable, pending, functions_, bodies_, stack_ + k_stack_slots,
+                    static_cast<uint8_t *>(native_stack_) + k_native_stack_reserve,
+                    static_cast<uint8_t *>(trampoline_.code) + k_trampoline_abandon);
+  const auto assembler = compiler.compile();
+
+  size_t size = 0;
+  void *code = map_code(assembler.bytes().data(), assembler.size(), size);
+  chunks_.push_back({code, size});
+
+  auto *base = static_cast<uint8_t *>(code);
+  for (const auto function : pending) {
+    const auto function_entry = executable.functions[function].entry;
+    functions_[function_entry] =
+        reinterpret_cast<NativeFunction>(base + compiler.entry_label(function_entry));
+    bodies_[function_entry] = base + compiler.instruction_label(function_entry);
+    compiled_[function] = true;
+    ++compiled_function_count_;
+  }
+  for (const auto header : compiler.loop_headers()) {
+    osr_entries_[header] =
+        reinterpret_cast<NativeFunction>(base + compiler.osr_label(header));
+  }
+  return true;
+}
+
+#else
+
+bool Jit::is_supported() { return false; }
+
+Jit::Jit() = default;
+Jit::~Jit() = default;
+
+void Jit::release_code() { compiled_function_count_ = 0; }
+
+std::optional<Bytecode::Value> Jit::run(NativeFunction function, Bytecode::Value *frame) const {
+  return function(frame);
+}
+
+bool Jit::compile_function(u32) { return false; }
+
+#endif
+
+void Jit::load(const Bytecode::Executable &executable) {
+  release_code();
+  executable_ = &executable;
+
+  const auto &functions = executable.functions;
+  function_index_.assign(executable.code.size(), static_cast<u32>(functions.size()));
+  for (size_t i = 0; i < functions.size(); ++i) {
+    for (const auto block : functions[i].blocks) {
+      const u32 end = block + 1 < executable.block_offsets.size()
+                          ? executable.block_offsets[block + 1]
+                          : static_cast<u32>(executable.code.size());
+      for (u32 offset = executable.block_offsets[block]; offset < end; ++offset) {
+        function_index_[offset] = static_cast<u32>(i);
+      }
+    }
+  }
+#if KAI_JIT_X86_64
+  compilable_ = compilable_functions(executable, function_index_, callees_);
+#else
+  compilable_.assign(functions.size(), false);
+  callees_.assign(functions.size(), {});
+#endif
+  compiled_.assign(functions.size(), false);
+  functions_.assign(executable.code.size(), nullptr);
+  bodies_.assign(executable.code.size(), nullptr);
+  osr_entries_.assign(executable.code.size(), nullptr);
+}
+
+u32 Jit::function_entry(u32 offset) const {
+  return executable_->functions[function_index_[offset]].entry;
+}
+
+}  // namespace kai
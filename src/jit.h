@@ -0,0 +1,116 @@
+#pragma once
+
+#include "bytecode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace kai {
+
+// Baseline template JIT for x86-64. Each supported opcode of a packed
+// Executable is translated into a fixed machine-code sequence that operates on
+// the function's registers in memory, so native code keeps exactly the
+// interpreter's frame layout and semantics.
+//
+// A function is compiled only when every instruction in it and every function
+// it calls or tail-calls is supported; native code therefore never calls back
+// into the interpreter. Everything else (arrays, structs, pointers) stays
+// interpreted, and the interpreter enters native code at call sites.
+//
+// Compilation is lazy: the interpreter decides which functions are hot and
+// asks for them one at a time. Each request produces a separate chunk of code
+// holding the function and any of its callees not compiled yet.
+//
+// Native frames live on a separate register stack owned by the Jit. A native
+// function takes a pointer to its frame, with the frame zeroed and the
+// parameters stored, and returns the function's result. An on-stack
+// replacement (OSR) entry has the same signature but takes a frame holding
+// the live registers of an interpreted activation, and resumes it at a loop
+// header.
+//
+// Native calls nest on a machine stack of the Jit's own, entered through
+// run(). Native code only writes its register stack, so when either stack
+// would overflow it drops every native frame and the interpreter runs the
+// call again, as deep as its own frames can grow.
+class Jit {
+ public:
+  using NativeFunction = Bytecode::Value (*)(Bytecode::Value *frame);
+
+  static constexpr size_t k_stack_slots = size_t{1} << 24;
+
+  // Whether this build can generate and run native code.
+  static bool is_supported();
+
+  Jit();
+  ~Jit();
+  Jit(const Jit &) = delete;
+  Jit &operator=(const Jit &) = delete;
+
+  // Prepares to compile functions of `executable` on demand, dropping code
+  // for any previous executable. `executable` must outlive the compiled code.
+  void load(const Bytecode::Executable &executable);
+
+  // Compiles the function whose entry is the code offset `entry`, along with
+  // its callees. Returns whether it has native code, which is false when it
+  // is not eligible.
+  bool compile_function(u32 entry);
+
+  // Entry of the function containing the code offset `offset`.
+  u32 function_entry(u32 offset) const;
+
+  // Native code of the function whose entry is the code offset `entry`, or
+  // null when that function was not compiled.
+  NativeFunction function(u32 entry) const;
+
+  // OSR entry resuming at the loop header at code offset `offset`, or null
+  // when its function was not compiled. Loop headers are the targets of
+  // jumps to the same or an earlier offset.
+  NativeFunction osr_entry(u32 offset) const;
+
+  // Calls native code of this Jit, a function or OSR entry, with `frame` on
+  // the register stack. Returns nullopt when it ran out of stack and gave
+  // up. Native code is only ever entered through here.
+  std::optional<Bytecode::Value> run(NativeFunction function, Bytecode::Value *frame) const;
+
+  // Native entries indexed by code offset; null where no function starts or
+  // the function was not compiled. Stable from load() to the next load().
+  const std::vector<NativeFunction> &functions() const { return functions_; }
+  size_t compiled_function_count() const { return compiled_function_count_; }
+
+  // Base of the native register stack, where the outermost native frame
+  // starts.
+  Bytecode::Value *stack() const { return stack_; }
+
+  // Supported opcodes, exposed for tests.
+  static bool supports(Bytecode::Instruction::Type type);
+
+ private:
+  struct Chunk {
+    void *code;
+    size_t size;
+  };
+
+  void release_code();
+
+  const Bytecode::Executable *executable_ = nullptr;
+  // Per function of the executable, in function table order.
+  std::vector<bool> compilable_;
+  std::vector<bool> compiled_;
+  std::vector<std::vector<u32>> callees_;
+  // Per code offset.
+  std::vector<u32> function_index_;
+  std::vector<NativeFunction> functions_;
+  // First instruction of each compiled function, where tail calls land.
+  std::vector<const void *> bodies_;
+  std::vector<NativeFunction> osr_entries_;
+  size_t compiled_function_count_ = 0;
+  std::vector<Chunk> chunks_;
+  Bytecode::Value *stack_ = nullptr;
+  // Machine stack native code runs on, and the code switching to it.
+  void *native_stack_ = nullptr;
+  Chunk trampoline_ = {nullptr, 0};
+};
+
+}  // namespace kai
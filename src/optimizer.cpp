@@ -1,39 +1,160 @@
 #include "optimizer.h"
+#include "optimizer/optimizer_analyses.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
 
 namespace kai {
 
+BytecodeOptimizer::BytecodeOptimizer() = default;
+BytecodeOptimizer::~BytecodeOptimizer() = default;
+
+void BytecodeOptimizer::set_iterate_to_fixed_point(bool iterate) {
+  iterate_to_fixed_point_ = iterate;
+}
+
+AnalysisCache &BytecodeOptimizer::analyses(const std::vector<Bytecode::BasicBlock> &blocks) {
+  if (!keep_analyses_ || !analyses_ || &analyses_->blocks() != &blocks) {
+    analyses_ = std::make_unique<AnalysisCache>(blocks);
+  }
+  return *analyses_;
+}
+
+PassResult BytecodeOptimizer::run_pass(const char *name, Pass pass,
+                                       std::vector<Bytecode::BasicBlock> &blocks) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto result = (this->*pass)(blocks);
+  const auto time = std::chrono::steady_clock::now() - start;
+
+  auto it = std::find_if(stats_.begin(), stats_.end(),
+                         [name](const auto &stats) { return stats.name == name; });
+  if (it == stats_.end()) {
+    it = stats_.insert(it, PassStats{name});
+  }
+  ++it->runs;
+  it->changes += result.changes;
+  it->time += std::chrono::duration_cast<std::chrono::nanoseconds>(time);
+
+  if (analyses_) {
+    analyses_->invalidate(result);
+  }
+  return result;
+}
+
 void BytecodeOptimizer::optimize(std::vector<Bytecode::BasicBlock> &blocks) {
-  // Pass -1: constant-condition simplification.
-  simplify_constant_conditions(blocks);
+  stats_.clear();
+  rounds_ = 0;
+  analyses_.reset();
+  keep_analyses_ = true;
+
+  // Pass -2: function inlining. Propagating the argument copies into the
+  // inlined bodies lets the next pass resolve branches on constant arguments.
+  if (run_pass("inline_functions", &BytecodeOptimizer::inline_functions, blocks)) {
+    run_pass("copy_propagation", &BytecodeOptimizer::copy_propagation, blocks);
+  }
+
+  // One round may leave work for the passes before the one that exposed it:
+  // a branch folded late makes a loop invariant, a copy removed late leaves
+  // a compare only the branch reads.
+  const size_t max_rounds = iterate_to_fixed_point_ ? k_max_rounds : 1;
+  bool changed = true;
+  while (changed && rounds_ < max_rounds) {
+    ++rounds_;
+    changed = false;
+    const auto run = [&](const char *name, Pass pass) {
+      changed = run_pass(name, pass, blocks) || changed;
+    };
+
+    // Pass -1: constant-condition simplification.
+    run("simplify_constant_conditions", &BytecodeOptimizer::simplify_constant_conditions);
 
-  // Pass 0: loop-invariant code motion.
-  loop_invariant_code_motion(blocks);
+    // Pass -0.5: turn self tail-recursion into loops before the loop passes.
+    run("tail_recursion_elimination", &BytecodeOptimizer::tail_recursion_elimination);
 
-  // Pass 1: global copy + constant propagation.
-  // Runs before branch fusion and DCE so rewritten operands and simplified
-  // branches expose more dead aliases and cleaner control flow.
-  copy_propagation(blocks);
+    // Pass -0.25: fold constants across blocks and prune the branches they
+    // decide.
+    run("sparse_conditional_constant_propagation",
+        &BytecodeOptimizer::sparse_conditional_constant_propagation);
 
-  // Pass 1.25: fuse compare + branch pairs.
-  fuse_compare_branches(blocks);
+    // Pass -0.2: reuse computations repeated across blocks.
+    run("global_value_numbering", &BytecodeOptimizer::global_value_numbering);
 
-  // Pass 1.5: aggregate literal folding.
-  fold_aggregate_literals(blocks);
+    // Pass 0: loop-invariant code motion.
+    run("loop_invariant_code_motion", &BytecodeOptimizer::loop_invariant_code_motion);
 
-  // Pass 2: global dead instruction elimination.
-  dead_code_elimination(blocks);
+    // Pass 1: global copy + constant propagation.
+    // Runs before branch fusion and DCE so rewritten operands and simplified
+    // branches expose more dead aliases and cleaner control flow.
+    run("copy_propagation", &BytecodeOptimizer::copy_propagation);
 
-  // Pass 3: tail-call optimization.
-  tail_call_optimization(blocks);
+    // Pass 1.25: fuse compare + branch pairs.
+    run("fuse_compare_branches", &BytecodeOptimizer::fuse_compare_branches);
 
-  // Pass 3.5: CFG cleanup.
-  cfg_cleanup(blocks);
+    // Pass 1.5: aggregate literal folding.
+    run("fold_aggregate_literals", &BytecodeOptimizer::fold_aggregate_literals);
+
+    // Pass 1.6: keep arrays and structs that never leave their function in
+    // registers.
+    run("scalar_replacement", &BytecodeOptimizer::scalar_replacement);
+
+    // Pass 1.75: drop the bounds checks of array accesses proven in range.
+    run("eliminate_bounds_checks", &BytecodeOptimizer::eliminate_bounds_checks);
+
+    // Pass 2: global dead instruction elimination.
+    run("dead_code_elimination", &BytecodeOptimizer::dead_code_elimination);
+
+    // Pass 2.25: turn multiplications by induction variables into additions.
+    run("strength_reduction", &BytecodeOptimizer::strength_reduction);
+
+    // Pass 2.5: unroll loops with known trip counts.
+    run("unroll_loops", &BytecodeOptimizer::unroll_loops);
+
+    // Pass 3: tail-call optimization.
+    run("tail_call_optimization", &BytecodeOptimizer::tail_call_optimization);
+
+    // Pass 3.5: CFG cleanup.
+    run("cfg_cleanup", &BytecodeOptimizer::cfg_cleanup);
+
+    // Pass 4: peephole optimization.
+    run("peephole", &BytecodeOptimizer::peephole);
+  }
+
+  // Pass 5: register allocation. Packs registers whose live ranges do not
+  // overlap into shared frame slots.
+  run_pass("allocate_registers", &BytecodeOptimizer::allocate_registers, blocks);
+
+  // Pass 6: superinstruction formation, on the final registers.
+  run_pass("form_superinstructions", &BytecodeOptimizer::form_superinstructions, blocks);
+
+  keep_analyses_ = false;
+  analyses_.reset();
+}
 
-  // Pass 4: peephole optimization.
-  peephole(blocks);
+void BytecodeOptimizer::dump_stats(std::ostream &out) const {
+  const auto flags = out.flags();
+  const auto precision = out.precision();
+  const auto milliseconds = [](std::chrono::nanoseconds time) {
+    return std::chrono::duration<double, std::milli>(time).count();
+  };
 
-  // Pass 5: register compaction.
-  compact_registers(blocks);
+  out << std::left << std::setw(40) << "pass" << std::right << std::setw(6) << "runs"
+      << std::setw(10) << "changes" << std::setw(12) << "time (ms)" << "\n";
+  PassStats total{"total (" + std::to_string(rounds_) +
+                  (rounds_ == 1 ? " round)" : " rounds)")};
+  out << std::fixed << std::setprecision(3);
+  for (const auto &stats : stats_) {
+    out << std::left << std::setw(40) << stats.name << std::right << std::setw(6)
+        << stats.runs << std::setw(10) << stats.changes << std::setw(12)
+        << milliseconds(stats.time) << "\n";
+    total.runs += stats.runs;
+    total.changes += stats.changes;
+    total.time += stats.time;
+  }
+  out << std::left << std::setw(40) << total.name << std::right << std::setw(6) << total.runs
+      << std::setw(10) << total.changes << std::setw(12) << milliseconds(total.time) << "\n";
+  out.flags(flags);
+  out.precision(precision);
 }
 
 }  // namespace kai
@@ -1,13 +1,85 @@
 #pragma once
 #include "bytecode.h"
+#include <chrono>
+#include <iosfwd>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace kai {
 
+class AnalysisCache;
+
+// What one run of a pass changed, so the pass manager keeps the analyses it
+// left intact.
+struct PassResult {
+  // Instructions and operands the pass rewrote, moved or removed.
+  size_t changes = 0;
+  // Whether a branch target or the set of blocks changed. Control-flow
+  // graphs survive a pass that only rewrote code between branches.
+  bool control_flow_changed = false;
+
+  explicit operator bool() const { return changes != 0; }
+
+  PassResult &operator+=(const PassResult &other) {
+    changes += other.changes;
+    control_flow_changed = control_flow_changed || other.control_flow_changed;
+    return *this;
+  }
+};
+
+// Time spent in one pass over an optimize() run, and what it changed.
+struct PassStats {
+  std::string name;
+  size_t runs = 0;
+  size_t changes = 0;
+  std::chrono::nanoseconds time{0};
+};
+
 class BytecodeOptimizer {
  public:
+  static constexpr size_t k_default_inline_threshold = 24;
+  static constexpr size_t k_max_inline_depth = 3;
+  static constexpr size_t k_max_rounds = 8;
+  static constexpr size_t k_default_unroll_factor = 4;
+  // Largest loop, in instructions over all its copies, unroll_loops makes.
+  static constexpr size_t k_max_unrolled_instructions = 64;
+
+  BytecodeOptimizer();
+  ~BytecodeOptimizer();
+
+  // Runs the passes below in order. Analyses the passes share (function
+  // tables, control-flow graphs, use counts and liveness) are computed once
+  // and kept until a pass reports a change that makes them stale.
   void optimize(std::vector<Bytecode::BasicBlock> &blocks);
 
+  // Largest callee, in instructions, that inline_functions copies into its
+  // callers. Zero disables inlining.
+  void set_inline_threshold(size_t threshold);
+
+  // Most copies of a loop body unroll_loops lays out. Zero and one disable
+  // unrolling.
+  void set_unroll_factor(size_t factor);
+
+  // Repeats the passes between inlining and register allocation until a
+  // round changes nothing, for at most k_max_rounds rounds.
+  void set_iterate_to_fixed_point(bool iterate);
+
+  // Per-pass totals of the last optimize() run, in the order the passes
+  // first ran, and how many rounds it took.
+  const std::vector<PassStats> &stats() const { return stats_; }
+  size_t rounds() const { return rounds_; }
+  void dump_stats(std::ostream &out) const;
+
+  // Pass -2: function inlining.
+  // Replaces a Call to a function of at most the inline threshold's size
+  // with a copy of its blocks in a fresh region of the caller's frame:
+  //   Move p', arg ...; Jump @copy   ...copy...   Move r_dst, r'; Jump @rest
+  // Callees containing TailCall or AddressOf are kept as calls. Inlined code
+  // is scanned again up to k_max_inline_depth times, which bounds how far a
+  // recursive function unrolls into itself. Counts the calls inlined.
+  PassResult inline_functions(std::vector<Bytecode::BasicBlock> &blocks);
+
   // Pass -1: constant-condition simplification.
   // Tracks block-local register constants and rewrites:
   //   JumpConditional rC, @T, @F
@@ -16,37 +88,131 @@ class BytecodeOptimizer {
   //   Jump @F  when rC is provably zero
   // Constants are inferred from Load and optionally through Move when the
   // source register is known constant.
-  void simplify_constant_conditions(std::vector<Bytecode::BasicBlock> &blocks);
+  PassResult simplify_constant_conditions(std::vector<Bytecode::BasicBlock> &blocks);
+
+  // Pass -0.5: tail-recursion elimination.
+  // Rewrites a function's tail calls to itself, either
+  //   Call r_tmp, @f, args + Return r_tmp   or   TailCall @f, args
+  // into parameter Moves (ordered as a parallel move) and a back-edge Jump
+  // to the function's first block. A new entry block that jumps to it
+  // becomes the loop pre-header, so later loop passes see ordinary loops.
+  // Functions that take the address of one of their registers are skipped.
+  PassResult tail_recursion_elimination(std::vector<Bytecode::BasicBlock> &blocks);
+
+  // Pass -0.25: sparse conditional constant propagation.
+  // Evaluates every function in SSA form on a constant lattice, following
+  // only the branch edges that can execute (Wegman-Zadeck). Then:
+  //   <pure op> r, ...  -> Load r, K          when r is always K
+  //   phi r, ...        -> Load r, K          when every reached input is K
+  //   <branch> on K     -> Jump @taken
+  // and blocks that are never reached are left as a Jump to themselves for
+  // cfg_cleanup to remove. Division by a constant zero is left in place.
+  // Functions where nothing folds are not touched.
+  PassResult sparse_conditional_constant_propagation(std::vector<Bytecode::BasicBlock> &blocks);
+
+  // Pass -0.2: global value numbering.
+  // Walks each function's dominator tree in SSA form and removes pure
+  // computations already made on every path to them:
+  //   r1 = a * b ... r2 = b * a   -> uses of r2 read r1
+  // Arithmetic, compares (a > b matching b < a), ArrayLoad,
+  // ArrayLoadImmediate and StructLoad are numbered. Heap loads only match
+  // while no ArrayStore, StructStore or Call can run between them.
+  PassResult global_value_numbering(std::vector<Bytecode::BasicBlock> &blocks);
 
   // Pass 0: loop-invariant code motion.
-  // Detects natural loops via back edges, then hoists pure instructions
-  // whose operands are not modified anywhere in the loop to a pre-header
-  // block that executes once.
-  void loop_invariant_code_motion(std::vector<Bytecode::BasicBlock> &blocks);
+  // Finds each function's natural loops on its dominator tree, gives every
+  // loop a pre-header (appending one when the header is entered from several
+  // blocks), and moves pure instructions whose operands the loop never writes
+  // into it, inner loops first. A result the code after the loop reads, when
+  // the loop may end without computing it, is computed into a fresh register
+  // that the loop copies. Divisions are only hoisted when they run on every
+  // way out of the loop.
+  PassResult loop_invariant_code_motion(std::vector<Bytecode::BasicBlock> &blocks);
 
   // Pass 1: global copy + constant propagation.
   // Forward dataflow over CFG blocks with intersection at joins. Rewrites
   // source registers through copy chains, propagates Load constants through
   // Moves, and simplifies constant-resolved branch conditions.
-  void copy_propagation(std::vector<Bytecode::BasicBlock> &blocks);
+  PassResult copy_propagation(std::vector<Bytecode::BasicBlock> &blocks);
 
   // Pass 1.25: compare+branch fusion.
   // Rewrites:
   //   <compare> r_tmp, ...
   //   JumpConditional r_tmp, @T, @F
-  // into fused branch opcodes when r_tmp is only used by the branch.
-  void fuse_compare_branches(std::vector<Bytecode::BasicBlock> &blocks);
+  // into the compare-and-branch opcode of the compare, such as
+  //   JumpLessThan lhs, rhs, @T, @F   or   JumpNotEqualImmediate src, K, @T, @F
+  // when r_tmp is only used by the branch. Every compare, register/register
+  // and register/immediate, has one.
+  PassResult fuse_compare_branches(std::vector<Bytecode::BasicBlock> &blocks);
+
+  // Pass 1.75: bounds-check elimination.
+  // Bounds every register of each function by an unsigned range on entry to
+  // each block, and tracks the shortest length of the arrays it may hold.
+  // Ranges come from constants, arithmetic and the compare-and-branch
+  // opcodes, which narrow their operands on each edge; bounds that keep
+  // moving around a loop widen at its header, so a counter tested by
+  //   JumpLessThanImmediate i, 10, @body, @exit
+  // is known to be below 10 in @body. Then:
+  //   ArrayLoad r, a, i   -> ArrayLoadUnchecked r, a, i     when i < len(a)
+  //   ArrayStore a, i, v  -> ArrayStoreUnchecked a, i, v
+  // Lengths come from ArrayCreate and ArrayLiteralCreate. Runs after
+  // compare+branch fusion, whose branches it reads.
+  PassResult eliminate_bounds_checks(std::vector<Bytecode::BasicBlock> &blocks);
 
   // Pass 2: global dead instruction elimination.
   // Removes instructions whose dst register is never read anywhere in
   // any block (pure computation with no observable effect).
-  void dead_code_elimination(std::vector<Bytecode::BasicBlock> &blocks);
+  PassResult dead_code_elimination(std::vector<Bytecode::BasicBlock> &blocks);
 
   // Pass 1.5: aggregate literal folding.
   // Rewrites ArrayCreate/StructCreate with register operands into
   // ArrayLiteralCreate/StructLiteralCreate when every operand register is
   // proven to come from a constant Load at that point in the block.
-  void fold_aggregate_literals(std::vector<Bytecode::BasicBlock> &blocks);
+  PassResult fold_aggregate_literals(std::vector<Bytecode::BasicBlock> &blocks);
+
+  // Pass 1.6: scalar replacement of aggregates.
+  // An array or struct whose handle does not escape its function lives in
+  // registers instead of the heap. The handle escapes unless its register is
+  // written once, by the ArrayCreate, ArrayLiteralCreate, StructCreate or
+  // StructLiteralCreate, ahead of every read, and every read is an
+  // ArrayLoadImmediate in range, a StructLoad or a StructStore of a field it
+  // has. Then:
+  //   StructCreate s, {x: a, y: b}      ->   Move s.x, a; Move s.y, b
+  //   StructLoad r, s, "y"              ->   Move r, s.y
+  //   StructStore s, "x", v             ->   Move s.x, v
+  // with s.x and s.y fresh registers, and the same for array elements.
+  // Literal elements are loaded. Functions taking an address are skipped.
+  PassResult scalar_replacement(std::vector<Bytecode::BasicBlock> &blocks);
+
+  // Pass 2.25: induction-variable strength reduction.
+  // Finds the basic induction variables of each loop, registers whose only
+  // write in it adds a constant (see optimizer_induction_variables.h), and
+  // replaces a product of one with a factor the loop does not change by an
+  // addition at each step:
+  //   preheader: ...                     preheader: Load p, i0 * K
+  //   body:      Multiply p, i, k   ->   body:      ...
+  //              AddImmediate i, i, c               AddImmediate i, i, c
+  //                                                 AddImmediate p, p, c * K
+  // when every read of p follows the multiplication before i steps. Then,
+  // when the loop's test is the last reader of i, tests p instead (linear
+  // function test replacement) and drops i's step:
+  //   JumpLessThanImmediate i, N, ...   ->   JumpLessThanImmediate p, N * K, ...
+  // provided the products of i's values cannot wrap. Products of two
+  // induction variables are left alone: two additions cost the interpreter
+  // more than one multiplication.
+  PassResult strength_reduction(std::vector<Bytecode::BasicBlock> &blocks);
+
+  // Pass 2.5: loop unrolling.
+  // Innermost loops whose header tests an induction variable against an
+  // immediate run a known number of times, at most (other exits may leave
+  // sooner). A loop running at most the unroll factor's times is unrolled
+  // completely; a longer one is laid out as the most copies, up to the
+  // factor and k_max_unrolled_instructions, that divide its trip count:
+  //   H: X; test @B, @exit   B: ...; Jump @H
+  //   -> H: X; test @B, @exit   B: ...; Jump @B1   B1: X; ...; Jump @H
+  // so only every factor-th iteration tests and branches back. The copies
+  // of the header keep what runs before the test.
+  PassResult unroll_loops(std::vector<Bytecode::BasicBlock> &blocks);
 
   // Pass 3: tail-call optimization.
   // Rewrites:
@@ -54,26 +220,60 @@ class BytecodeOptimizer {
   //   Return r_tmp
   // into:
   //   TailCall @f, args
-  // so the interpreter can reuse the current frame.
-  void tail_call_optimization(std::vector<Bytecode::BasicBlock> &blocks);
+  // so the interpreter can reuse the current frame. Functions that take the
+  // address of one of their registers keep their calls.
+  PassResult tail_call_optimization(std::vector<Bytecode::BasicBlock> &blocks);
 
   // Pass 3.5: CFG cleanup.
   // - trims instructions after the first block terminator
   // - rewrites branch targets through jump-only trampoline chains
   // - removes unreachable blocks (from entry @0 via Jump/JumpConditional/Call/TailCall)
-  void cfg_cleanup(std::vector<Bytecode::BasicBlock> &blocks);
+  PassResult cfg_cleanup(std::vector<Bytecode::BasicBlock> &blocks);
 
   // Pass 4: peephole optimization.
   // Collapses two-instruction sequences where a pure producer writes to a
   // temporary register that is used only by an immediately-following Move:
   //   <immediate-op> r_tmp, r_src, K + Move r_var, r_tmp -> <immediate-op> r_var, r_src, K
   //   Load r_tmp, K                  + Move r_var, r_tmp -> Load r_var, K
-  void peephole(std::vector<Bytecode::BasicBlock> &blocks);
+  PassResult peephole(std::vector<Bytecode::BasicBlock> &blocks);
+
+  // Pass 5: register allocation.
+  // Computes liveness in each function and packs its registers into the
+  // fewest frame slots, greedily in the order they are written: registers
+  // whose live ranges do not overlap share a slot, and a Move whose source
+  // and destination end up in one slot is removed. A register whose address
+  // is taken or that is read before it is written keeps a slot of its own.
+  // Call and TailCall parameter registers follow the callee's assignment.
+  // If functions share blocks, registers are only renumbered densely.
+  PassResult allocate_registers(std::vector<Bytecode::BasicBlock> &blocks);
+
+  // Pass 6: superinstruction formation.
+  // Merges a block's terminator with the instruction before it, for the
+  // pairs the opcode profile of our workloads finds hottest:
+  //   Move/Load/AddImmediate/SubtractImmediate + Jump -> MoveJump/LoadJump/AddImmediateJump
+  //   Add r, a, b + Return r                          -> AddReturn a, b
+  // so the interpreter dispatches once for both. Runs last: the other
+  // passes do not know the fused opcodes.
+  PassResult form_superinstructions(std::vector<Bytecode::BasicBlock> &blocks);
+
+ private:
+  using Pass = PassResult (BytecodeOptimizer::*)(std::vector<Bytecode::BasicBlock> &);
+
+  // Runs `pass`, adds its time and changes to the stats and drops the
+  // analyses it made stale.
+  PassResult run_pass(const char *name, Pass pass, std::vector<Bytecode::BasicBlock> &blocks);
+
+  // Analyses of `blocks` for the running pass: those optimize() keeps
+  // between passes, or fresh ones when a pass is called on its own.
+  AnalysisCache &analyses(const std::vector<Bytecode::BasicBlock> &blocks);
 
-  // Pass 5: register compaction.
-  // Renumbers all referenced registers to a dense 0..N-1 range to eliminate
-  // gaps left by earlier optimizations.
-  void compact_registers(std::vector<Bytecode::BasicBlock> &blocks);
+  size_t inline_threshold_ = k_default_inline_threshold;
+  size_t unroll_factor_ = k_default_unroll_factor;
+  bool iterate_to_fixed_point_ = false;
+  bool keep_analyses_ = false;
+  std::unique_ptr<AnalysisCache> analyses_;
+  std::vector<PassStats> stats_;
+  size_t rounds_ = 0;
 };
 
 }  // namespace kai
@@ -0,0 +1,100 @@
+#include "optimizer_analyses.h"
+#include "optimizer_internal.h"
+
+#include <algorithm>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+
+const std::vector<Bytecode::Function> &AnalysisCache::functions() {
+  if (!functions_) {
+    functions_ = build_function_table(blocks_);
+  }
+  return *functions_;
+}
+
+const BlockGraph &AnalysisCache::block_graph() {
+  if (block_graph_) {
+    return *block_graph_;
+  }
+  auto &graph = block_graph_.emplace();
+  graph.successors.resize(blocks_.size());
+  graph.predecessors.resize(blocks_.size());
+  for (Label label = 0; label < blocks_.size(); ++label) {
+    auto &successors = graph.successors[label];
+    const auto &instrs = blocks_[label].instructions;
+    const auto terminator = std::find_if(instrs.begin(), instrs.end(),
+                                         [](const auto &instr) { return is_terminator(*instr); });
+    if (terminator == instrs.end()) {
+      if (label + 1 < blocks_.size()) {
+        successors.push_back(label + 1);
+      }
+      continue;
+    }
+    for (const auto target : get_jump_targets(**terminator)) {
+      if (target < blocks_.size() &&
+          std::find(successors.begin(), successors.end(), target) == successors.end()) {
+        successors.push_back(target);
+      }
+    }
+  }
+  for (Label label = 0; label < blocks_.size(); ++label) {
+    for (const auto successor : graph.successors[label]) {
+      graph.predecessors[successor].push_back(label);
+    }
+  }
+  return graph;
+}
+
+const ControlFlowGraph &AnalysisCache::cfg(Label entry) {
+  auto it = cfgs_.find(entry);
+  if (it == cfgs_.end()) {
+    it = cfgs_.emplace(entry, build_control_flow_graph(blocks_, entry)).first;
+  }
+  return it->second;
+}
+
+const std::vector<RegisterSet> &AnalysisCache::live_in(const Bytecode::Function &function) {
+  auto it = live_in_.find(function.entry);
+  if (it == live_in_.end()) {
+    const std::vector<std::vector<Phi>> no_phis(blocks_.size());
+    it = live_in_
+             .emplace(function.entry,
+                      live_in_sets(blocks_, cfg(function.entry), no_phis, function.frame_size))
+             .first;
+  }
+  return it->second;
+}
+
+size_t AnalysisCache::use_count(Bytecode::Register reg) {
+  if (!use_counts_) {
+    auto &counts = use_counts_.emplace();
+    for (const auto &block : blocks_) {
+      for (const auto &instr_ptr : block.instructions) {
+        for_each_src_reg(*instr_ptr, [&counts](Register src) {
+          if (src >= counts.size()) {
+            counts.resize(src + 1, 0);
+          }
+          ++counts[src];
+        });
+      }
+    }
+  }
+  return reg < use_counts_->size() ? (*use_counts_)[reg] : 0;
+}
+
+void AnalysisCache::invalidate(const PassResult &result) {
+  if (!result) {
+    return;
+  }
+  functions_.reset();
+  live_in_.clear();
+  use_counts_.reset();
+  if (result.control_flow_changed) {
+    block_graph_.reset();
+    cfgs_.clear();
+  }
+}
+
+}  // namespace kai
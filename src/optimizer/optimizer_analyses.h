@@ -0,0 +1,51 @@
+#pragma once
+
+#include "optimizer_cfg.h"
+#include "optimizer_liveness.h"
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace kai {
+
+// Branch edges between every block of the program, following each block's
+// first terminator, or falling through to the next block when it has none.
+// Calls are not edges.
+struct BlockGraph {
+  std::vector<std::vector<Bytecode::Label>> successors;
+  std::vector<std::vector<Bytecode::Label>> predecessors;
+};
+
+// Analyses several passes read, computed on first use and kept until a pass
+// reports a change that makes them stale. The references returned stay valid
+// until the next invalidate().
+class AnalysisCache {
+ public:
+  explicit AnalysisCache(const std::vector<Bytecode::BasicBlock> &blocks) : blocks_(blocks) {}
+
+  const std::vector<Bytecode::BasicBlock> &blocks() const { return blocks_; }
+
+  const std::vector<Bytecode::Function> &functions();
+  const BlockGraph &block_graph();
+  // Graph of the function starting at `entry`.
+  const ControlFlowGraph &cfg(Bytecode::Label entry);
+  // Live registers on entry to each block of `function`, over its frame.
+  const std::vector<RegisterSet> &live_in(const Bytecode::Function &function);
+  // Number of operands reading `reg`, in any frame.
+  size_t use_count(Bytecode::Register reg);
+
+  // Drops what `result` makes stale: everything derived from instructions
+  // when it changed any, and the graphs too when it changed control flow.
+  void invalidate(const PassResult &result);
+
+ private:
+  const std::vector<Bytecode::BasicBlock> &blocks_;
+  std::optional<std::vector<Bytecode::Function>> functions_;
+  std::optional<BlockGraph> block_graph_;
+  std::unordered_map<Bytecode::Label, ControlFlowGraph> cfgs_;
+  std::unordered_map<Bytecode::Label, std::vector<RegisterSet>> live_in_;
+  std::optional<std::vector<size_t>> use_counts_;
+};
+
+}  // namespace kai
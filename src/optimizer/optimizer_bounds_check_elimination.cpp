@@ -0,0 +1,504 @@
+#include "../optimizer.h"
+#include "optimizer_analyses.h"
+#include "optimizer_internal.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+using Register = Bytecode::Register;
+using Type = Bytecode::Instruction::Type;
+using Value = Bytecode::Value;
+
+namespace {
+
+constexpr Value k_max_value = std::numeric_limits<Value>::max();
+
+// Inclusive unsigned bounds of a register's value. Compares and array
+// indices are unsigned, so an index is in bounds exactly when `hi` is below
+// the array's length.
+struct Range {
+  Value lo = 0;
+  Value hi = k_max_value;
+
+  static Range constant(Value value) { return {value, value}; }
+  bool operator==(const Range &) const = default;
+};
+
+// What the analysis knows of one register: the range of its value and, when
+// it holds an array, the shortest length that array may have (0 when
+// unknown). Arrays never change length, so the length follows the handle.
+struct Fact {
+  Range range;
+  size_t length = 0;
+  bool operator==(const Fact &) const = default;
+};
+
+// A fact per register of the function's frame.
+using State = std::vector<Fact>;
+
+// `range` plus `addend`, wrapping. The sums are a range again when either
+// every value in `range` wraps or none does.
+Range shift(Range range, Value addend) {
+  const Range sum{range.lo + addend, range.hi + addend};
+  return (sum.lo < range.lo) == (sum.hi < range.hi) ? sum : Range{};
+}
+
+Range add(Range lhs, Range rhs) {
+  if (lhs.hi > k_max_value - rhs.hi) {
+    return {};
+  }
+  return {lhs.lo + rhs.lo, lhs.hi + rhs.hi};
+}
+
+Range subtract(Range lhs, Range rhs) {
+  if (lhs.lo < rhs.hi) {
+    return {};
+  }
+  return {lhs.lo - rhs.hi, lhs.hi - rhs.lo};
+}
+
+Range multiply(Range lhs, Range rhs) {
+  if (rhs.hi != 0 && lhs.hi > k_max_value / rhs.hi) {
+    return {};
+  }
+  return {lhs.lo * rhs.lo, lhs.hi * rhs.hi};
+}
+
+// Division and modulo by a divisor that may be zero are undefined, so they
+// tell nothing.
+Range divide(Range lhs, Range rhs) {
+  if (rhs.lo == 0) {
+    return {};
+  }
+  return {lhs.lo / rhs.hi, lhs.hi / rhs.lo};
+}
+
+Range modulo(Range lhs, Range rhs) {
+  if (rhs.lo == 0) {
+    return {};
+  }
+  return {0, std::min(lhs.hi, rhs.hi - 1)};
+}
+
+// The length of the array `instr` creates, if it creates one.
+std::optional<size_t> created_length(const Bytecode::Instruction &instr) {
+  switch (instr.type()) {
+    case Type::ArrayCreate:
+      return derived_cast<const Bytecode::Instruction::ArrayCreate &>(instr).elements.size();
+    case Type::ArrayLiteralCreate:
+      return derived_cast<const Bytecode::Instruction::ArrayLiteralCreate &>(instr)
+          .elements.size();
+    default:
+      return std::nullopt;
+  }
+}
+
+// Updates `state` for `instr` having run.
+void transfer(const Bytecode::Instruction &instr, State &state) {
+  const auto dst = get_dst_reg(instr);
+  if (!dst) {
+    return;
+  }
+  const auto srcs = get_src_regs(instr);
+  const auto immediate = get_immediate(instr);
+  // The i-th operand: a source register, or the immediate after them.
+  const auto operand = [&](size_t i) {
+    return i < srcs.size() ? state[srcs[i]].range : Range::constant(*immediate);
+  };
+
+  Fact fact;
+  switch (instr.type()) {
+    case Type::Load:
+      fact.range = Range::constant(*immediate);
+      break;
+    case Type::Move:
+      fact = state[srcs[0]];
+      break;
+    case Type::AddImmediate:
+      fact.range = shift(operand(0), *immediate);
+      break;
+    case Type::SubtractImmediate:
+      fact.range = shift(operand(0), Value{0} - *immediate);
+      break;
+    case Type::Add:
+      fact.range = add(operand(0), operand(1));
+      break;
+    case Type::Subtract:
+      fact.range = subtract(operand(0), operand(1));
+      break;
+    case Type::Multiply:
+    case Type::MultiplyImmediate:
+      fact.range = multiply(operand(0), operand(1));
+      break;
+    case Type::Divide:
+    case Type::DivideImmediate:
+      fact.range = divide(operand(0), operand(1));
+      break;
+    case Type::Modulo:
+    case Type::ModuloImmediate:
+      fact.range = modulo(operand(0), operand(1));
+      break;
+    case Type::LessThan:
+    case Type::LessThanImmediate:
+    case Type::GreaterThan:
+    case Type::GreaterThanImmediate:
+    case Type::LessThanOrEqual:
+    case Type::LessThanOrEqualImmediate:
+    case Type::GreaterThanOrEqual:
+    case Type::GreaterThanOrEqualImmediate:
+    case Type::Equal:
+    case Type::EqualImmediate:
+    case Type::NotEqual:
+    case Type::NotEqualImmediate:
+    case Type::LogicalNot:
+      fact.range = {0, 1};
+      break;
+    case Type::ArrayCreate:
+    case Type::ArrayLiteralCreate:
+      fact.length = *created_length(instr);
+      break;
+    default:
+      break;
+  }
+  state[*dst] = fact;
+}
+
+enum class Relation {
+  Less,
+  LessOrEqual,
+  Greater,
+  GreaterOrEqual,
+  Equal,
+  NotEqual,
+};
+
+Relation relation_of(Type compare) {
+  switch (compare) {
+    case Type::LessThan:
+    case Type::LessThanImmediate:
+      return Relation::Less;
+    case Type::LessThanOrEqual:
+    case Type::LessThanOrEqualImmediate:
+      return Relation::LessOrEqual;
+    case Type::GreaterThan:
+    case Type::GreaterThanImmediate:
+      return Relation::Greater;
+    case Type::GreaterThanOrEqual:
+    case Type::GreaterThanOrEqualImmediate:
+      return Relation::GreaterOrEqual;
+    case Type::Equal:
+    case Type::EqualImmediate:
+      return Relation::Equal;
+    default:
+      return Relation::NotEqual;
+  }
+}
+
+// The relation that holds when `relation` does not.
+Relation negate(Relation relation) {
+  switch (relation) {
+    case Relation::Less:
+      return Relation::GreaterOrEqual;
+    case Relation::LessOrEqual:
+      return Relation::Greater;
+    case Relation::Greater:
+      return Relation::LessOrEqual;
+    case Relation::GreaterOrEqual:
+      return Relation::Less;
+    case Relation::Equal:
+      return Relation::NotEqual;
+    case Relation::NotEqual:
+      return Relation::Equal;
+  }
+  return relation;
+}
+
+// The relation of b to a when `relation` is that of a to b.
+Relation reverse(Relation relation) {
+  switch (relation) {
+    case Relation::Less:
+      return Relation::Greater;
+    case Relation::LessOrEqual:
+      return Relation::GreaterOrEqual;
+    case Relation::Greater:
+      return Relation::Less;
+    case Relation::GreaterOrEqual:
+      return Relation::LessOrEqual;
+    default:
+      return relation;
+  }
+}
+
+// Narrows `range` to the values in `relation` to some value of `other`.
+// When none is, the edge never runs and `range` is left as it is.
+void narrow(Range &range, Relation relation, Range other) {
+  Range narrowed = range;
+  switch (relation) {
+    case Relation::Less:
+      if (other.hi == 0) {
+        return;
+      }
+      narrowed.hi = std::min(range.hi, other.hi - 1);
+      break;
+    case Relation::LessOrEqual:
+      narrowed.hi = std::min(range.hi, other.hi);
+      break;
+    case Relation::Greater:
+      if (other.lo == k_max_value) {
+        return;
+      }
+      narrowed.lo = std::max(range.lo, other.lo + 1);
+      break;
+    case Relation::GreaterOrEqual:
+      narrowed.lo = std::max(range.lo, other.lo);
+      break;
+    case Relation::Equal:
+      narrowed = {std::max(range.lo, other.lo), std::min(range.hi, other.hi)};
+      break;
+    case Relation::NotEqual:
+      return;
+  }
+  if (narrowed.lo <= narrowed.hi) {
+    range = narrowed;
+  }
+}
+
+const Bytecode::Instruction *first_terminator(const Bytecode::BasicBlock &block) {
+  const auto it = std::find_if(block.instructions.begin(), block.instructions.end(),
+                               [](const auto &instr) { return is_terminator(*instr); });
+  return it == block.instructions.end() ? nullptr : it->get();
+}
+
+// `state` at the end of `block`, narrowed by what its compare-and-branch
+// decides on the edge to `target`.
+State edge_state(const Bytecode::BasicBlock &block, State state, Label target) {
+  const auto *terminator = first_terminator(block);
+  const auto compare = terminator ? branch_compare_type(terminator->type()) : std::nullopt;
+  if (!compare) {
+    return state;
+  }
+  const auto targets = get_jump_targets(*terminator);
+  if (targets[0] == targets[1]) {
+    return state;
+  }
+  auto relation = relation_of(*compare);
+  if (target != targets[0]) {
+    relation = negate(relation);
+  }
+
+  const auto srcs = get_src_regs(*terminator);
+  const auto lhs_range = state[srcs[0]].range;
+  if (srcs.size() == 1) {
+    narrow(state[srcs[0]].range, relation, Range::constant(*get_immediate(*terminator)));
+  } else if (srcs[0] != srcs[1]) {
+    narrow(state[srcs[0]].range, relation, state[srcs[1]].range);
+    narrow(state[srcs[1]].range, reverse(relation), lhs_range);
+  }
+  return state;
+}
+
+void join(State &into, const State &other) {
+  for (size_t reg = 0; reg < into.size(); ++reg) {
+    auto &fact = into[reg];
+    fact.range = {std::min(fact.range.lo, other[reg].range.lo),
+                  std::max(fact.range.hi, other[reg].range.hi)};
+    fact.length = std::min(fact.length, other[reg].length);
+  }
+}
+
+// Joins `other` into `into`, which starts out as `other` when empty.
+void merge(std::optional<State> &into, const State &other) {
+  if (into) {
+    join(*into, other);
+  } else {
+    into = other;
+  }
+}
+
+// Moves each bound that grew past both `previous` and `entering`, the state
+// the edges into the loop bring, out to the next of the sorted `thresholds`
+// or to its extreme, so loops settle after a few rounds. Growth that comes
+// in from outside is left alone: a counter copied from an outer one keeps
+// the bound it enters the inner loop with. A counter's own loop bound is
+// lost at the header but comes back on the edge into the body, from the
+// compare that ends the loop; thresholds keep it for values only assigned
+// from the counter, like the index of the smallest element seen.
+void widen(State &state, const State &previous, const State &entering,
+           const std::vector<Value> &thresholds) {
+  for (size_t reg = 0; reg < state.size(); ++reg) {
+    auto &fact = state[reg];
+    if (fact.range.lo < std::min(previous[reg].range.lo, entering[reg].range.lo)) {
+      fact.range.lo = 0;
+    }
+    if (fact.range.hi > std::max(previous[reg].range.hi, entering[reg].range.hi)) {
+      const auto threshold =
+          std::lower_bound(thresholds.begin(), thresholds.end(), fact.range.hi);
+      fact.range.hi = threshold == thresholds.end() ? k_max_value : *threshold;
+    }
+    if (fact.length < std::min(previous[reg].length, entering[reg].length)) {
+      fact.length = 0;
+    }
+  }
+}
+
+// Ranges of every register on entry to each block of one function, then the
+// rewrite of the accesses they prove in bounds.
+class RangeAnalysis {
+ public:
+  static constexpr size_t k_max_header_updates = 8;
+
+  RangeAnalysis(std::vector<Bytecode::BasicBlock> &blocks, const ControlFlowGraph &cfg,
+                size_t frame_size)
+      : blocks_(blocks), cfg_(cfg), frame_size_(frame_size), in_(blocks.size()) {}
+
+  void run() {
+    std::vector<size_t> rpo_index(blocks_.size(), 0);
+    for (size_t i = 0; i < cfg_.order.size(); ++i) {
+      rpo_index[cfg_.order[i]] = i;
+    }
+    // Bounds widen where a back edge comes in: at loop headers, and where
+    // irreducible control flow enters a cycle. They stop at the immediates
+    // of the function and the lengths of its arrays, and one below each.
+    // A header that keeps changing anyway widens every bound that moves.
+    std::vector<Value> thresholds;
+    for (const auto label : cfg_.order) {
+      for (const auto &instr_ptr : blocks_[label].instructions) {
+        auto limit = get_immediate(*instr_ptr);
+        if (const auto length = created_length(*instr_ptr)) {
+          limit = *length;
+        }
+        if (limit) {
+          thresholds.push_back(*limit);
+          thresholds.push_back(*limit - (*limit != 0));
+        }
+      }
+    }
+    std::sort(thresholds.begin(), thresholds.end());
+    std::vector<size_t> updates(blocks_.size(), 0);
+    std::vector<std::optional<State>> out(blocks_.size());
+    in_[cfg_.entry] = State(frame_size_);
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (const auto label : cfg_.order) {
+        std::optional<State> state;
+        std::optional<State> entering;
+        bool has_back_edge = false;
+        if (label == cfg_.entry) {
+          state = in_[label];
+          entering = in_[label];
+        }
+        for (const auto predecessor : cfg_.predecessors[label]) {
+          const bool back_edge = rpo_index[predecessor] >= rpo_index[label];
+          has_back_edge = has_back_edge || back_edge;
+          if (!out[predecessor]) {
+            continue;
+          }
+          const auto edge = edge_state(blocks_[predecessor], *out[predecessor], label);
+          merge(state, edge);
+          if (!back_edge) {
+            merge(entering, edge);
+          }
+        }
+        if (!state) {
+          continue;
+        }
+        if (in_[label]) {
+          join(*state, *in_[label]);
+          if (has_back_edge) {
+            const bool settled = ++updates[label] <= k_max_header_updates && entering;
+            widen(*state, *in_[label], settled ? *entering : *in_[label],
+                  settled ? thresholds : std::vector<Value>{});
+          }
+          if (*state == *in_[label] && out[label]) {
+            continue;
+          }
+        }
+        in_[label] = *state;
+        for (const auto &instr_ptr : blocks_[label].instructions) {
+          if (is_terminator(*instr_ptr)) {
+            break;
+          }
+          transfer(*instr_ptr, *state);
+        }
+        out[label] = std::move(state);
+        changed = true;
+      }
+    }
+  }
+
+  // Returns how many accesses became unchecked.
+  size_t remove_checks() {
+    size_t removed = 0;
+    for (const auto label : cfg_.order) {
+      if (!in_[label]) {
+        continue;
+      }
+      auto state = *in_[label];
+      const auto in_bounds = [&state](Register array, Register index) {
+        return state[index].range.hi < state[array].length;
+      };
+      for (auto &instr_ptr : blocks_[label].instructions) {
+        if (is_terminator(*instr_ptr)) {
+          break;
+        }
+        if (instr_ptr->type() == Type::ArrayLoad) {
+          const auto &load = derived_cast<const Bytecode::Instruction::ArrayLoad &>(*instr_ptr);
+          if (in_bounds(load.array, load.index)) {
+            instr_ptr = std::make_unique<Bytecode::Instruction::ArrayLoadUnchecked>(
+                load.dst, load.array, load.index);
+            ++removed;
+          }
+        } else if (instr_ptr->type() == Type::ArrayStore) {
+          const auto &store = derived_cast<const Bytecode::Instruction::ArrayStore &>(*instr_ptr);
+          if (in_bounds(store.array, store.index)) {
+            instr_ptr = std::make_unique<Bytecode::Instruction::ArrayStoreUnchecked>(
+                store.array, store.index, store.value);
+            ++removed;
+          }
+        }
+        transfer(*instr_ptr, state);
+      }
+    }
+    return removed;
+  }
+
+ private:
+  std::vector<Bytecode::BasicBlock> &blocks_;
+  const ControlFlowGraph &cfg_;
+  size_t frame_size_;
+  std::vector<std::optional<State>> in_;
+};
+
+}  // namespace
+
+PassResult BytecodeOptimizer::eliminate_bounds_checks(std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
+  auto &analyses = this->analyses(blocks);
+  const auto functions = analyses.functions();
+  for (const auto &function : functions) {
+    const bool accesses_arrays =
+        std::any_of(function.blocks.begin(), function.blocks.end(), [&blocks](Label label) {
+          return std::any_of(blocks[label].instructions.begin(),
+                             blocks[label].instructions.end(), [](const auto &instr) {
+                               return instr->type() == Type::ArrayLoad ||
+                                      instr->type() == Type::ArrayStore;
+                             });
+        });
+    if (!accesses_arrays || shares_blocks(functions, function)) {
+      continue;
+    }
+    RangeAnalysis analysis(blocks, analyses.cfg(function.entry), function.frame_size);
+    analysis.run();
+    result.changes += analysis.remove_checks();
+  }
+  return result;
+}
+
+}  // namespace kai
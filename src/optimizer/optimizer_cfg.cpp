@@ -0,0 +1,315 @@
+#include "optimizer_cfg.h"
+#include "optimizer_internal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+
+namespace {
+
+std::vector<Label> terminator_targets(const Bytecode::BasicBlock &block) {
+  for (const auto &instr_ptr : block.instructions) {
+    if (is_terminator(*instr_ptr)) {
+      auto targets = get_jump_targets(*instr_ptr);
+      std::sort(targets.begin(), targets.end());
+      targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+      return targets;
+    }
+  }
+  return {};
+}
+
+}  // namespace
+
+bool ControlFlowGraph::is_reachable(Label label) const {
+  return label == entry || idom[label] != k_no_label;
+}
+
+bool ControlFlowGraph::dominates(Label dominator, Label label) const {
+  if (!is_reachable(dominator) || !is_reachable(label)) {
+    return false;
+  }
+  return preorder[dominator] <= preorder[label] && postorder[label] <= postorder[dominator];
+}
+
+std::vector<std::vector<Label>> ControlFlowGraph::dominance_frontiers() const {
+  // Cytron et al., in the formulation of Cooper, Harvey and Kennedy: walk up
+  // from each predecessor of a join until reaching the join's dominator.
+  std::vector<std::vector<Label>> frontiers(successors.size());
+  for (const auto label : order) {
+    if (predecessors[label].size() < 2) {
+      continue;
+    }
+    for (const auto predecessor : predecessors[label]) {
+      auto runner = predecessor;
+      while (runner != idom[label]) {
+        auto &frontier = frontiers[runner];
+        if (frontier.empty() || frontier.back() != label) {
+          frontier.push_back(label);
+        }
+        if (runner == entry) {
+          break;
+        }
+        runner = idom[runner];
+      }
+    }
+  }
+  return frontiers;
+}
+
+ControlFlowGraph build_control_flow_graph(const std::vector<Bytecode::BasicBlock> &blocks,
+                                          Label entry) {
+  assert(entry < blocks.size());
+  ControlFlowGraph cfg;
+  cfg.entry = entry;
+  cfg.successors.resize(blocks.size());
+  cfg.predecessors.resize(blocks.size());
+  cfg.idom.assign(blocks.size(), ControlFlowGraph::k_no_label);
+  cfg.dominator_children.resize(blocks.size());
+  cfg.preorder.assign(blocks.size(), 0);
+  cfg.postorder.assign(blocks.size(), 0);
+
+  // Depth-first search for the postorder, iteratively so that long chains of
+  // blocks cannot overflow the native stack.
+  std::vector<bool> visited(blocks.size(), false);
+  std::vector<std::pair<Label, size_t>> stack = {{entry, 0}};
+  visited[entry] = true;
+  cfg.successors[entry] = terminator_targets(blocks[entry]);
+  while (!stack.empty()) {
+    auto &[label, next] = stack.back();
+    if (next < cfg.successors[label].size()) {
+      const auto successor = cfg.successors[label][next++];
+      assert(successor < blocks.size());
+      if (!visited[successor]) {
+        visited[successor] = true;
+        cfg.successors[successor] = terminator_targets(blocks[successor]);
+        stack.push_back({successor, 0});
+      }
+      continue;
+    }
+    cfg.order.push_back(label);
+    stack.pop_back();
+  }
+  std::reverse(cfg.order.begin(), cfg.order.end());
+
+  std::vector<size_t> rpo_index(blocks.size(), 0);
+  for (size_t i = 0; i < cfg.order.size(); ++i) {
+    rpo_index[cfg.order[i]] = i;
+  }
+  for (const auto label : cfg.order) {
+    for (const auto successor : cfg.successors[label]) {
+      cfg.predecessors[successor].push_back(label);
+    }
+  }
+
+  // Cooper, Harvey and Kennedy's iterative algorithm. The entry is its own
+  // dominator while iterating.
+  const auto intersect = [&](Label a, Label b) {
+    while (a != b) {
+      while (rpo_index[a] > rpo_index[b]) {
+        a = cfg.idom[a];
+      }
+      while (rpo_index[b] > rpo_index[a]) {
+        b = cfg.idom[b];
+      }
+    }
+    return a;
+  };
+  cfg.idom[entry] = entry;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 1; i < cfg.order.size(); ++i) {
+      const auto label = cfg.order[i];
+      auto new_idom = ControlFlowGraph::k_no_label;
+      for (const auto predecessor : cfg.predecessors[label]) {
+        if (cfg.idom[predecessor] == ControlFlowGraph::k_no_label) {
+          continue;
+        }
+        new_idom = new_idom == ControlFlowGraph::k_no_label
+                       ? predecessor
+                       : intersect(predecessor, new_idom);
+      }
+      if (cfg.idom[label] != new_idom) {
+        cfg.idom[label] = new_idom;
+        changed = true;
+      }
+    }
+  }
+  cfg.idom[entry] = ControlFlowGraph::k_no_label;
+
+  for (const auto label : cfg.order) {
+    if (label != entry) {
+      cfg.dominator_children[cfg.idom[label]].push_back(label);
+    }
+  }
+
+  size_t pre = 0;
+  size_t post = 0;
+  std::vector<std::pair<Label, size_t>> walk = {{entry, 0}};
+  cfg.preorder[entry] = pre++;
+  while (!walk.empty()) {
+    auto &[label, next] = walk.back();
+    if (next < cfg.dominator_children[label].size()) {
+      const auto child = cfg.dominator_children[label][next++];
+      cfg.preorder[child] = pre++;
+      walk.push_back({child, 0});
+      continue;
+    }
+    cfg.postorder[label] = post++;
+    walk.pop_back();
+  }
+  return cfg;
+}
+
+bool LoopForest::contains(size_t loop, Label label) const {
+  for (auto current = innermost[label]; current != k_no_loop; current = loops[current].parent) {
+    if (current == loop) {
+      return true;
+    }
+  }
+  return false;
+}
+
+LoopForest find_loops(const ControlFlowGraph &cfg) {
+  LoopForest forest;
+  forest.innermost.assign(cfg.successors.size(), LoopForest::k_no_loop);
+
+  std::vector<std::vector<bool>> members;
+  for (const auto header : cfg.order) {
+    Loop loop;
+    loop.header = header;
+    for (const auto predecessor : cfg.predecessors[header]) {
+      if (cfg.dominates(header, predecessor)) {
+        loop.latches.push_back(predecessor);
+      }
+    }
+    if (loop.latches.empty()) {
+      continue;
+    }
+
+    // Walk back from the latches; the header stops the walk.
+    std::vector<bool> in_loop(cfg.successors.size(), false);
+    in_loop[header] = true;
+    std::vector<Label> worklist = loop.latches;
+    while (!worklist.empty()) {
+      const auto label = worklist.back();
+      worklist.pop_back();
+      if (in_loop[label]) {
+        continue;
+      }
+      in_loop[label] = true;
+      for (const auto predecessor : cfg.predecessors[label]) {
+        worklist.push_back(predecessor);
+      }
+    }
+    for (const auto label : cfg.order) {
+      if (!in_loop[label]) {
+        continue;
+      }
+      loop.blocks.push_back(label);
+      for (const auto successor : cfg.successors[label]) {
+        if (!in_loop[successor]) {
+          loop.exits.push_back({label, successor});
+        }
+      }
+    }
+
+    std::vector<Label> outside;
+    for (const auto predecessor : cfg.predecessors[header]) {
+      if (!in_loop[predecessor]) {
+        outside.push_back(predecessor);
+      }
+    }
+    if (outside.size() == 1 && cfg.successors[outside[0]].size() == 1) {
+      loop.preheader = outside[0];
+    }
+    forest.loops.push_back(std::move(loop));
+    members.push_back(std::move(in_loop));
+  }
+
+  // A loop nested in another is strictly smaller, so ordering by size puts
+  // inner loops first and makes the first later loop holding a header its
+  // parent.
+  std::vector<size_t> by_size(forest.loops.size());
+  for (size_t i = 0; i < by_size.size(); ++i) {
+    by_size[i] = i;
+  }
+  std::stable_sort(by_size.begin(), by_size.end(), [&](size_t a, size_t b) {
+    return forest.loops[a].blocks.size() < forest.loops[b].blocks.size();
+  });
+  std::vector<Loop> loops;
+  std::vector<std::vector<bool>> sorted_members;
+  for (const auto index : by_size) {
+    loops.push_back(std::move(forest.loops[index]));
+    sorted_members.push_back(std::move(members[index]));
+  }
+  forest.loops = std::move(loops);
+
+  for (size_t i = 0; i < forest.loops.size(); ++i) {
+    auto &loop = forest.loops[i];
+    loop.parent = LoopForest::k_no_loop;
+    for (size_t j = i + 1; j < forest.loops.size(); ++j) {
+      if (sorted_members[j][loop.header]) {
+        loop.parent = j;
+        forest.loops[j].children.push_back(i);
+        break;
+      }
+    }
+    for (const auto label : loop.blocks) {
+      if (forest.innermost[label] == LoopForest::k_no_loop) {
+        forest.innermost[label] = i;
+      }
+    }
+  }
+  for (size_t i = forest.loops.size(); i-- > 0;) {
+    auto &loop = forest.loops[i];
+    loop.depth = loop.parent == LoopForest::k_no_loop ? 1 : forest.loops[loop.parent].depth + 1;
+  }
+  return forest;
+}
+
+Label insert_preheader(std::vector<Bytecode::BasicBlock> &blocks, const ControlFlowGraph &cfg,
+                       const Loop &loop) {
+  const auto preheader = static_cast<Label>(blocks.size());
+  blocks.emplace_back();
+  for (const auto predecessor : cfg.predecessors[loop.header]) {
+    if (std::find(loop.blocks.begin(), loop.blocks.end(), predecessor) != loop.blocks.end()) {
+      continue;
+    }
+    for (auto &instr_ptr : blocks[predecessor].instructions) {
+      if (!is_terminator(*instr_ptr)) {
+        continue;
+      }
+      visit_labels(
+          *instr_ptr,
+          [&loop, preheader](Label &target) {
+            if (target == loop.header) {
+              target = preheader;
+            }
+          },
+          [](Label &) {});
+      break;
+    }
+  }
+  blocks[preheader].append<Bytecode::Instruction::Jump>(loop.header);
+  return preheader;
+}
+
+size_t insert_preheaders(std::vector<Bytecode::BasicBlock> &blocks, const ControlFlowGraph &cfg,
+                         const LoopForest &forest) {
+  size_t inserted = 0;
+  for (const auto &loop : forest.loops) {
+    if (loop.preheader == ControlFlowGraph::k_no_label && loop.header != cfg.entry) {
+      insert_preheader(blocks, cfg, loop);
+      ++inserted;
+    }
+  }
+  return inserted;
+}
+
+}  // namespace kai
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "../optimizer.h"
+
+#include <utility>
+#include <vector>
+
+namespace kai {
+
+// Control-flow graph of one function: the blocks reachable from its entry
+// through branch instructions, and their dominator tree. Per-block vectors
+// are indexed by label over the whole program; blocks outside the function
+// have no edges and no dominator.
+struct ControlFlowGraph {
+  static constexpr Bytecode::Label k_no_label = ~Bytecode::Label{0};
+
+  Bytecode::Label entry = 0;
+  // Reachable blocks in reverse postorder, starting with the entry.
+  std::vector<Bytecode::Label> order;
+  // Distinct targets of each block's terminator, and the blocks branching to
+  // each block, in reverse postorder.
+  std::vector<std::vector<Bytecode::Label>> successors;
+  std::vector<std::vector<Bytecode::Label>> predecessors;
+  // Immediate dominator, k_no_label for the entry and unreachable blocks.
+  std::vector<Bytecode::Label> idom;
+  std::vector<std::vector<Bytecode::Label>> dominator_children;
+
+  bool is_reachable(Bytecode::Label label) const;
+  bool dominates(Bytecode::Label dominator, Bytecode::Label label) const;
+
+  // Blocks where the dominance of each block ends: the join points that
+  // need a phi for a register defined in it.
+  std::vector<std::vector<Bytecode::Label>> dominance_frontiers() const;
+
+  // Preorder and postorder numbers on the dominator tree, for dominates().
+  std::vector<size_t> preorder;
+  std::vector<size_t> postorder;
+};
+
+// Builds the graph of the function starting at `entry`. Only each block's
+// first terminator is followed, so instructions after it are ignored.
+ControlFlowGraph build_control_flow_graph(const std::vector<Bytecode::BasicBlock> &blocks,
+                                          Bytecode::Label entry);
+
+// A natural loop: a header that dominates the blocks branching back to it
+// (its latches), and every block that reaches a latch without passing
+// through the header.
+struct Loop {
+  Bytecode::Label header = 0;
+  std::vector<Bytecode::Label> latches;
+  // Blocks of the loop in reverse postorder, starting with the header.
+  std::vector<Bytecode::Label> blocks;
+  // Edges leaving the loop, as (block inside, block outside).
+  std::vector<std::pair<Bytecode::Label, Bytecode::Label>> exits;
+  // The only predecessor of the header outside the loop, when it branches
+  // nowhere else; ControlFlowGraph::k_no_label otherwise.
+  Bytecode::Label preheader = ControlFlowGraph::k_no_label;
+  // Innermost enclosing loop, or LoopForest::k_no_loop.
+  size_t parent = 0;
+  std::vector<size_t> children;
+  // 1 for an outermost loop.
+  size_t depth = 1;
+};
+
+// The loop nesting forest of a function. Back edges to a block that does not
+// dominate their source, which only irreducible control flow has, form no
+// loop.
+struct LoopForest {
+  static constexpr size_t k_no_loop = ~size_t{0};
+
+  // Every loop comes before the loops enclosing it, so a walk in order
+  // visits inner loops first.
+  std::vector<Loop> loops;
+  // Innermost loop containing each block, indexed by label over the whole
+  // program; k_no_loop outside every loop.
+  std::vector<size_t> innermost;
+
+  bool contains(size_t loop, Bytecode::Label label) const;
+};
+
+LoopForest find_loops(const ControlFlowGraph &cfg);
+
+// Gives `loop` a preheader: appends a block that jumps to the header and
+// points the header's predecessors outside the loop at it. Labels of existing
+// blocks do not change, but `cfg` and the forest are stale afterwards.
+// Returns the new block's label.
+Bytecode::Label insert_preheader(std::vector<Bytecode::BasicBlock> &blocks,
+                                 const ControlFlowGraph &cfg, const Loop &loop);
+
+// Gives every loop of `forest`, the loops of `cfg`, a preheader where it has
+// none, except a loop headed at the function's entry: calls land there, so
+// no block can come in front of it. Returns how many blocks it appended;
+// `cfg` and `forest` are stale when it appended any.
+size_t insert_preheaders(std::vector<Bytecode::BasicBlock> &blocks, const ControlFlowGraph &cfg,
+                         const LoopForest &forest);
+
+}  // namespace kai
@@ -1,5 +1,7 @@
 #include "../optimizer.h"
+#include "optimizer_internal.h"
 
+#include <algorithm>
 #include <limits>
 #include <unordered_set>
 
@@ -10,42 +12,21 @@ using Type = Bytecode::Instruction::Type;
 
 namespace {
 
-bool is_terminator_type(Type type) {
-  switch (type) {
-    case Type::Jump:
-    case Type::JumpConditional:
-    case Type::JumpEqualImmediate:
-    case Type::JumpGreaterThanImmediate:
-    case Type::JumpLessThanOrEqual:
-    case Type::Return:
-    case Type::TailCall:
-      return true;
-    default:
-      return false;
-  }
-}
-
 bool is_jump_only_block(const Bytecode::BasicBlock &block) {
   return block.instructions.size() == 1 && block.instructions[0]->type() == Type::Jump;
 }
 
 }  // namespace
 
-void BytecodeOptimizer::cfg_cleanup(std::vector<Bytecode::BasicBlock> &blocks) {
+PassResult BytecodeOptimizer::cfg_cleanup(std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
   // 1) Trim everything after the first terminator in each block.
   for (auto &block : blocks) {
-    for (size_t i = 0; i < block.instructions.size(); ++i) {
-      if (!is_terminator_type(block.instructions[i]->type())) {
-        continue;
-      }
-      block.instructions.erase(block.instructions.begin() + static_cast<std::ptrdiff_t>(i + 1),
-                               block.instructions.end());
-      break;
-    }
+    result.changes += trim_after_terminator(block);
   }
 
   if (blocks.empty()) {
-    return;
+    return result;
   }
 
   // 2) Collapse jump-only trampoline chains by retargeting incoming branches.
@@ -71,32 +52,19 @@ void BytecodeOptimizer::cfg_cleanup(std::vector<Bytecode::BasicBlock> &blocks) {
     }
     return current;
   };
+  const auto retarget = [&](Label &label) {
+    const auto target = resolve_jump_target(label);
+    if (target != label) {
+      label = target;
+      ++result.changes;
+      result.control_flow_changed = true;
+    }
+  };
 
+  const auto ignore = [](Label &) {};
   for (auto &block : blocks) {
     for (auto &instr_ptr : block.instructions) {
-      auto &instr = *instr_ptr;
-      if (instr.type() == Type::Jump) {
-        auto &jump = derived_cast<Bytecode::Instruction::Jump &>(instr);
-        jump.label = resolve_jump_target(jump.label);
-      } else if (instr.type() == Type::JumpConditional) {
-        auto &jump_cond = derived_cast<Bytecode::Instruction::JumpConditional &>(instr);
-        jump_cond.label1 = resolve_jump_target(jump_cond.label1);
-        jump_cond.label2 = resolve_jump_target(jump_cond.label2);
-      } else if (instr.type() == Type::JumpEqualImmediate) {
-        auto &jump_equal_imm =
-            derived_cast<Bytecode::Instruction::JumpEqualImmediate &>(instr);
-        jump_equal_imm.label1 = resolve_jump_target(jump_equal_imm.label1);
-        jump_equal_imm.label2 = resolve_jump_target(jump_equal_imm.label2);
-      } else if (instr.type() == Type::JumpGreaterThanImmediate) {
-        auto &jump_greater_than_imm =
-            derived_cast<Bytecode::Instruction::JumpGreaterThanImmediate &>(instr);
-        jump_greater_than_imm.label1 = resolve_jump_target(jump_greater_than_imm.label1);
-        jump_greater_than_imm.label2 = resolve_jump_target(jump_greater_than_imm.label2);
-      } else if (instr.type() == Type::JumpLessThanOrEqual) {
-        auto &jump_lte = derived_cast<Bytecode::Instruction::JumpLessThanOrEqual &>(instr);
-        jump_lte.label1 = resolve_jump_target(jump_lte.label1);
-        jump_lte.label2 = resolve_jump_target(jump_lte.label2);
-      }
+      visit_labels(*instr_ptr, retarget, ignore);
     }
   }
 
@@ -111,91 +79,22 @@ void BytecodeOptimizer::cfg_cleanup(std::vector<Bytecode::BasicBlock> &blocks) {
     }
 
     keep[label] = true;
-    for (const auto &instr_ptr : blocks[label].instructions) {
-      const auto &instr = *instr_ptr;
-      switch (instr.type()) {
-        case Type::Jump: {
-          const auto target = derived_cast<const Bytecode::Instruction::Jump &>(instr).label;
-          if (target < blocks.size()) {
-            worklist.push_back(target);
-          }
-          break;
-        }
-        case Type::JumpConditional: {
-          const auto &jump_cond =
-              derived_cast<const Bytecode::Instruction::JumpConditional &>(instr);
-          if (jump_cond.label1 < blocks.size()) {
-            worklist.push_back(jump_cond.label1);
-          }
-          if (jump_cond.label2 < blocks.size()) {
-            worklist.push_back(jump_cond.label2);
-          }
-          break;
-        }
-        case Type::JumpEqualImmediate: {
-          const auto &jump_equal_imm =
-              derived_cast<const Bytecode::Instruction::JumpEqualImmediate &>(instr);
-          if (jump_equal_imm.label1 < blocks.size()) {
-            worklist.push_back(jump_equal_imm.label1);
-          }
-          if (jump_equal_imm.label2 < blocks.size()) {
-            worklist.push_back(jump_equal_imm.label2);
-          }
-          break;
-        }
-        case Type::JumpGreaterThanImmediate: {
-          const auto &jump_greater_than_imm =
-              derived_cast<const Bytecode::Instruction::JumpGreaterThanImmediate &>(instr);
-          if (jump_greater_than_imm.label1 < blocks.size()) {
-            worklist.push_back(jump_greater_than_imm.label1);
-          }
-          if (jump_greater_than_imm.label2 < blocks.size()) {
-            worklist.push_back(jump_greater_than_imm.label2);
-          }
-          break;
-        }
-        case Type::JumpLessThanOrEqual: {
-          const auto &jump_lte =
-              derived_cast<const Bytecode::Instruction::JumpLessThanOrEqual &>(instr);
-          if (jump_lte.label1 < blocks.size()) {
-            worklist.push_back(jump_lte.label1);
-          }
-          if (jump_lte.label2 < blocks.size()) {
-            worklist.push_back(jump_lte.label2);
-          }
-          break;
-        }
-        case Type::Call: {
-          const auto target = derived_cast<const Bytecode::Instruction::Call &>(instr).label;
-          if (target < blocks.size()) {
-            worklist.push_back(target);
-          }
-          break;
-        }
-        case Type::TailCall: {
-          const auto target =
-              derived_cast<const Bytecode::Instruction::TailCall &>(instr).label;
-          if (target < blocks.size()) {
-            worklist.push_back(target);
-          }
-          break;
-        }
-        default:
-          break;
+    const auto visit = [&](Label &target) {
+      if (target < blocks.size()) {
+        worklist.push_back(target);
       }
+    };
+    for (auto &instr_ptr : blocks[label].instructions) {
+      visit_labels(*instr_ptr, visit, visit);
     }
   }
 
-  bool removed_any = false;
-  for (size_t i = 0; i < blocks.size(); ++i) {
-    if (!keep[i]) {
-      removed_any = true;
-      break;
-    }
-  }
-  if (!removed_any) {
-    return;
+  const auto removed = static_cast<size_t>(std::count(keep.begin(), keep.end(), false));
+  if (removed == 0) {
+    return result;
   }
+  result.changes += removed;
+  result.control_flow_changed = true;
 
   constexpr auto kInvalidLabel = std::numeric_limits<Label>::max();
   std::vector<Label> old_to_new(blocks.size(), kInvalidLabel);
@@ -218,56 +117,13 @@ void BytecodeOptimizer::cfg_cleanup(std::vector<Bytecode::BasicBlock> &blocks) {
     return mapped == kInvalidLabel ? label : mapped;
   };
 
+  const auto remap = [&remap_label](Label &label) { label = remap_label(label); };
   for (auto &block : blocks) {
     for (auto &instr_ptr : block.instructions) {
-      auto &instr = *instr_ptr;
-      switch (instr.type()) {
-        case Type::Jump: {
-          auto &jump = derived_cast<Bytecode::Instruction::Jump &>(instr);
-          jump.label = remap_label(jump.label);
-          break;
-        }
-        case Type::JumpConditional: {
-          auto &jump_cond = derived_cast<Bytecode::Instruction::JumpConditional &>(instr);
-          jump_cond.label1 = remap_label(jump_cond.label1);
-          jump_cond.label2 = remap_label(jump_cond.label2);
-          break;
-        }
-        case Type::JumpEqualImmediate: {
-          auto &jump_equal_imm =
-              derived_cast<Bytecode::Instruction::JumpEqualImmediate &>(instr);
-          jump_equal_imm.label1 = remap_label(jump_equal_imm.label1);
-          jump_equal_imm.label2 = remap_label(jump_equal_imm.label2);
-          break;
-        }
-        case Type::JumpGreaterThanImmediate: {
-          auto &jump_greater_than_imm =
-              derived_cast<Bytecode::Instruction::JumpGreaterThanImmediate &>(instr);
-          jump_greater_than_imm.label1 = remap_label(jump_greater_than_imm.label1);
-          jump_greater_than_imm.label2 = remap_label(jump_greater_than_imm.label2);
-          break;
-        }
-        case Type::JumpLessThanOrEqual: {
-          auto &jump_lte = derived_cast<Bytecode::Instruction::JumpLessThanOrEqual &>(instr);
-          jump_lte.label1 = remap_label(jump_lte.label1);
-          jump_lte.label2 = remap_label(jump_lte.label2);
-          break;
-        }
-        case Type::Call: {
-          auto &call = derived_cast<Bytecode::Instruction::Call &>(instr);
-          call.label = remap_label(call.label);
-          break;
-        }
-        case Type::TailCall: {
-          auto &tail_call = derived_cast<Bytecode::Instruction::TailCall &>(instr);
-          tail_call.label = remap_label(tail_call.label);
-          break;
-        }
-        default:
-          break;
-      }
+      visit_labels(*instr_ptr, remap, remap);
     }
   }
+  return result;
 }
 
 }  // namespace kai
@@ -8,8 +8,9 @@ namespace kai {
 using Register = Bytecode::Register;
 using Type = Bytecode::Instruction::Type;
 
-void BytecodeOptimizer::simplify_constant_conditions(
+PassResult BytecodeOptimizer::simplify_constant_conditions(
     std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
   for (auto &block : blocks) {
     std::unordered_map<Register, Bytecode::Value> constants;
     for (auto &instr_ptr : block.instructions) {
@@ -37,6 +38,8 @@ void BytecodeOptimizer::simplify_constant_conditions(
             const auto target = it->second != 0 ? jump_conditional.label1
                                                 : jump_conditional.label2;
             instr_ptr = std::make_unique<Bytecode::Instruction::Jump>(target);
+            ++result.changes;
+            result.control_flow_changed = true;
           }
           break;
         }
@@ -48,6 +51,7 @@ void BytecodeOptimizer::simplify_constant_conditions(
       }
     }
   }
+  return result;
 }
 
 }  // namespace kai
@@ -1,8 +1,11 @@
 #include "../optimizer.h"
+#include "optimizer_analyses.h"
 #include "optimizer_internal.h"
 
 #include <algorithm>
-#include <deque>
+#include <cassert>
+#include <optional>
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -89,26 +92,14 @@ Register resolve_register_alias(Register reg, const FactMap &facts) {
   }
 }
 
+// Drops the facts writing `dst` breaks: its own, and every copy of it. A copy
+// of a copy of `dst` still holds the same value, so it stays; dropping more
+// would let a state with more facts end a block with fewer.
 void invalidate(FactMap &facts, Register dst) {
-  std::unordered_set<Register> invalidated = {dst};
-  bool changed = true;
-  while (changed) {
-    changed = false;
-    for (auto it = facts.begin(); it != facts.end();) {
-      bool remove = invalidated.count(it->first) > 0;
-      if (!remove) {
-        const auto &fact = it->second;
-        remove = fact.kind == Fact::Kind::Register &&
-                 invalidated.count(fact.reg) > 0;
-      }
-      if (!remove) {
-        ++it;
-        continue;
-      }
-      changed |= invalidated.insert(it->first).second;
-      it = facts.erase(it);
-    }
-  }
+  std::erase_if(facts, [dst](const auto &entry) {
+    return entry.first == dst ||
+           (entry.second.kind == Fact::Kind::Register && entry.second.reg == dst);
+  });
 }
 
 void set_register_fact(FactMap &facts, Register dst, Register src) {
@@ -145,103 +136,16 @@ void transfer_instruction(const Bytecode::Instruction &instr, FactMap &facts) {
   }
 }
 
-void add_successor(std::vector<size_t> &successors, Label label, size_t block_count) {
-  if (label >= block_count) {
-    return;
-  }
-  const auto succ = static_cast<size_t>(label);
-  if (std::find(successors.begin(), successors.end(), succ) == successors.end()) {
-    successors.push_back(succ);
-  }
-}
-
-std::vector<std::vector<size_t>> build_successors(
-    const std::vector<Bytecode::BasicBlock> &blocks) {
-  std::vector<std::vector<size_t>> successors(blocks.size());
-
-  for (size_t i = 0; i < blocks.size(); ++i) {
-    bool found_terminator = false;
-    for (const auto &instr_ptr : blocks[i].instructions) {
-      const auto &instr = *instr_ptr;
-      switch (instr.type()) {
-        case Type::Jump: {
-          const auto &jump = derived_cast<const Bytecode::Instruction::Jump &>(instr);
-          add_successor(successors[i], jump.label, blocks.size());
-          found_terminator = true;
-          break;
-        }
-        case Type::JumpConditional: {
-          const auto &jump_cond =
-              derived_cast<const Bytecode::Instruction::JumpConditional &>(instr);
-          add_successor(successors[i], jump_cond.label1, blocks.size());
-          add_successor(successors[i], jump_cond.label2, blocks.size());
-          found_terminator = true;
-          break;
-        }
-        case Type::JumpEqualImmediate: {
-          const auto &jump_equal_imm =
-              derived_cast<const Bytecode::Instruction::JumpEqualImmediate &>(instr);
-          add_successor(successors[i], jump_equal_imm.label1, blocks.size());
-          add_successor(successors[i], jump_equal_imm.label2, blocks.size());
-          found_terminator = true;
-          break;
-        }
-        case Type::JumpGreaterThanImmediate: {
-          const auto &jump_greater_than_imm =
-              derived_cast<const Bytecode::Instruction::JumpGreaterThanImmediate &>(instr);
-          add_successor(successors[i], jump_greater_than_imm.label1, blocks.size());
-          add_successor(successors[i], jump_greater_than_imm.label2, blocks.size());
-          found_terminator = true;
-          break;
-        }
-        case Type::JumpLessThanOrEqual: {
-          const auto &jump_lte =
-              derived_cast<const Bytecode::Instruction::JumpLessThanOrEqual &>(instr);
-          add_successor(successors[i], jump_lte.label1, blocks.size());
-          add_successor(successors[i], jump_lte.label2, blocks.size());
-          found_terminator = true;
-          break;
-        }
-        case Type::Return:
-        case Type::TailCall:
-          found_terminator = true;
-          break;
-        default:
-          break;
-      }
-
-      if (found_terminator) {
-        break;
-      }
-    }
-
-    if (!found_terminator && i + 1 < blocks.size()) {
-      successors[i].push_back(i + 1);
-    }
-  }
-
-  return successors;
-}
-
-std::vector<std::vector<size_t>> build_predecessors(
-    const std::vector<std::vector<size_t>> &successors) {
-  std::vector<std::vector<size_t>> predecessors(successors.size());
-
-  for (size_t from = 0; from < successors.size(); ++from) {
-    for (const auto to : successors[from]) {
-      predecessors[to].push_back(from);
-    }
-  }
-
-  return predecessors;
-}
-
-FactMap meet_predecessors(size_t block_index,
-                          const std::vector<std::vector<size_t>> &predecessors,
-                          const std::vector<FactMap> &out_states,
-                          const std::vector<bool> &out_initialized) {
+// Facts holding on entry to `block_index`: none at an entry block, and
+// otherwise those every initialized predecessor agrees on. Predecessors not
+// visited yet stand for Top and drop out of the meet; nullopt when all of
+// them are, so the block has no state to publish yet.
+std::optional<FactMap> meet_predecessors(size_t block_index,
+                                         const std::vector<std::vector<Label>> &predecessors,
+                                         const std::vector<FactMap> &out_states,
+                                         const std::vector<bool> &out_initialized) {
   if (predecessors[block_index].empty()) {
-    return {};
+    return FactMap{};
   }
 
   bool found_any_initialized_pred = false;
@@ -263,19 +167,29 @@ FactMap meet_predecessors(size_t block_index,
   }
 
   if (!found_any_initialized_pred) {
-    return {};
+    return std::nullopt;
   }
 
   return in_state;
 }
 
+// Rewrites the operands of one instruction through `facts` and adds what it
+// changed to `result`.
 void rewrite_instruction(std::unique_ptr<Bytecode::Instruction> &instr_ptr,
                          FactMap &facts,
-                         const FactMap &entry_facts) {
+                         const FactMap &entry_facts,
+                         PassResult &result) {
   auto &instr = *instr_ptr;
 
-  const auto resolve_register = [&facts](Register reg) {
-    return resolve_register_alias(reg, facts);
+  const auto resolve_register = [&facts, &result](Register reg) {
+    const auto resolved = resolve_register_alias(reg, facts);
+    result.changes += resolved != reg;
+    return resolved;
+  };
+  const auto jump_to = [&instr_ptr, &result](Label target) {
+    instr_ptr = std::make_unique<Bytecode::Instruction::Jump>(target);
+    ++result.changes;
+    result.control_flow_changed = true;
   };
 
   switch (instr.type()) {
@@ -291,64 +205,6 @@ void rewrite_instruction(std::unique_ptr<Bytecode::Instruction> &instr_ptr,
       set_constant_fact(facts, load.dst, load.value);
       break;
     }
-    case Type::LessThan: {
-      auto &less_than = derived_cast<Bytecode::Instruction::LessThan &>(instr);
-      less_than.lhs = resolve_register(less_than.lhs);
-      less_than.rhs = resolve_register(less_than.rhs);
-      invalidate(facts, less_than.dst);
-      break;
-    }
-    case Type::LessThanImmediate: {
-      auto &less_than_imm =
-          derived_cast<Bytecode::Instruction::LessThanImmediate &>(instr);
-      less_than_imm.lhs = resolve_register(less_than_imm.lhs);
-      invalidate(facts, less_than_imm.dst);
-      break;
-    }
-    case Type::GreaterThan: {
-      auto &greater_than = derived_cast<Bytecode::Instruction::GreaterThan &>(instr);
-      greater_than.lhs = resolve_register(greater_than.lhs);
-      greater_than.rhs = resolve_register(greater_than.rhs);
-      invalidate(facts, greater_than.dst);
-      break;
-    }
-    case Type::GreaterThanImmediate: {
-      auto &greater_than_imm =
-          derived_cast<Bytecode::Instruction::GreaterThanImmediate &>(instr);
-      greater_than_imm.lhs = resolve_register(greater_than_imm.lhs);
-      invalidate(facts, greater_than_imm.dst);
-      break;
-    }
-    case Type::LessThanOrEqual: {
-      auto &less_than_or_equal =
-          derived_cast<Bytecode::Instruction::LessThanOrEqual &>(instr);
-      less_than_or_equal.lhs = resolve_register(less_than_or_equal.lhs);
-      less_than_or_equal.rhs = resolve_register(less_than_or_equal.rhs);
-      invalidate(facts, less_than_or_equal.dst);
-      break;
-    }
-    case Type::LessThanOrEqualImmediate: {
-      auto &less_than_or_equal_imm =
-          derived_cast<Bytecode::Instruction::LessThanOrEqualImmediate &>(instr);
-      less_than_or_equal_imm.lhs = resolve_register(less_than_or_equal_imm.lhs);
-      invalidate(facts, less_than_or_equal_imm.dst);
-      break;
-    }
-    case Type::GreaterThanOrEqual: {
-      auto &greater_than_or_equal =
-          derived_cast<Bytecode::Instruction::GreaterThanOrEqual &>(instr);
-      greater_than_or_equal.lhs = resolve_register(greater_than_or_equal.lhs);
-      greater_than_or_equal.rhs = resolve_register(greater_than_or_equal.rhs);
-      invalidate(facts, greater_than_or_equal.dst);
-      break;
-    }
-    case Type::GreaterThanOrEqualImmediate: {
-      auto &greater_than_or_equal_imm =
-          derived_cast<Bytecode::Instruction::GreaterThanOrEqualImmediate &>(instr);
-      greater_than_or_equal_imm.lhs = resolve_register(greater_than_or_equal_imm.lhs);
-      invalidate(facts, greater_than_or_equal_imm.dst);
-      break;
-    }
     case Type::Jump:
       break;
     case Type::JumpConditional: {
@@ -356,230 +212,22 @@ void rewrite_instruction(std::unique_ptr<Bytecode::Instruction> &instr_ptr,
       const auto resolved = resolve_value(jump_cond.cond, facts);
       if (resolved.is_constant) {
         const auto target = resolved.value != 0 ? jump_cond.label1 : jump_cond.label2;
-        instr_ptr = std::make_unique<Bytecode::Instruction::Jump>(target);
+        jump_to(target);
       } else {
         jump_cond.cond = resolve_register(jump_cond.cond);
       }
       break;
     }
-    case Type::JumpEqualImmediate: {
-      auto &jump_equal_imm =
-          derived_cast<Bytecode::Instruction::JumpEqualImmediate &>(instr);
-      const auto resolved = resolve_value(jump_equal_imm.src, facts);
-      if (resolved.is_constant) {
-        const auto target = resolved.value == jump_equal_imm.value ? jump_equal_imm.label1
-                                                                    : jump_equal_imm.label2;
-        instr_ptr = std::make_unique<Bytecode::Instruction::Jump>(target);
-      } else {
-        jump_equal_imm.src = resolve_register(jump_equal_imm.src);
-      }
-      break;
-    }
-    case Type::JumpGreaterThanImmediate: {
-      auto &jump_greater_than_imm =
-          derived_cast<Bytecode::Instruction::JumpGreaterThanImmediate &>(instr);
-      const auto resolved = resolve_value(jump_greater_than_imm.lhs, facts);
-      if (resolved.is_constant) {
-        const auto target = resolved.value > jump_greater_than_imm.value
-                                ? jump_greater_than_imm.label1
-                                : jump_greater_than_imm.label2;
-        instr_ptr = std::make_unique<Bytecode::Instruction::Jump>(target);
-      } else {
-        jump_greater_than_imm.lhs = resolve_register(jump_greater_than_imm.lhs);
-      }
-      break;
-    }
-    case Type::JumpLessThanOrEqual: {
-      auto &jump_lte = derived_cast<Bytecode::Instruction::JumpLessThanOrEqual &>(instr);
-      const auto lhs_resolved = resolve_value(jump_lte.lhs, facts);
-      const auto rhs_resolved = resolve_value(jump_lte.rhs, facts);
-      if (lhs_resolved.is_constant && rhs_resolved.is_constant) {
-        const auto target = lhs_resolved.value <= rhs_resolved.value ? jump_lte.label1
-                                                                      : jump_lte.label2;
-        instr_ptr = std::make_unique<Bytecode::Instruction::Jump>(target);
-      } else {
-        if (!lhs_resolved.is_constant) {
-          jump_lte.lhs = resolve_register(jump_lte.lhs);
-        }
-        if (!rhs_resolved.is_constant) {
-          jump_lte.rhs = resolve_register(jump_lte.rhs);
-        }
-      }
-      break;
-    }
-    case Type::Call: {
-      auto &call = derived_cast<Bytecode::Instruction::Call &>(instr);
-      for (auto &arg : call.arg_registers) {
-        arg = resolve_register(arg);
-      }
-      invalidate(facts, call.dst);
-      break;
-    }
-    case Type::TailCall: {
-      auto &tail_call = derived_cast<Bytecode::Instruction::TailCall &>(instr);
-      for (auto &arg : tail_call.arg_registers) {
-        arg = resolve_register(arg);
-      }
-      break;
-    }
     case Type::Return: {
       auto &ret = derived_cast<Bytecode::Instruction::Return &>(instr);
       const auto entry_resolved = resolve_register_alias(ret.reg, entry_facts);
-      const auto current_resolved = resolve_register(ret.reg);
-      if (current_resolved != entry_resolved) {
+      const auto current_resolved = resolve_register_alias(ret.reg, facts);
+      if (current_resolved != entry_resolved && current_resolved != ret.reg) {
         ret.reg = current_resolved;
+        ++result.changes;
       }
       break;
     }
-    case Type::Equal: {
-      auto &equal = derived_cast<Bytecode::Instruction::Equal &>(instr);
-      equal.src1 = resolve_register(equal.src1);
-      equal.src2 = resolve_register(equal.src2);
-      invalidate(facts, equal.dst);
-      break;
-    }
-    case Type::EqualImmediate: {
-      auto &equal_imm = derived_cast<Bytecode::Instruction::EqualImmediate &>(instr);
-      equal_imm.src = resolve_register(equal_imm.src);
-      invalidate(facts, equal_imm.dst);
-      break;
-    }
-    case Type::NotEqual: {
-      auto &not_equal = derived_cast<Bytecode::Instruction::NotEqual &>(instr);
-      not_equal.src1 = resolve_register(not_equal.src1);
-      not_equal.src2 = resolve_register(not_equal.src2);
-      invalidate(facts, not_equal.dst);
-      break;
-    }
-    case Type::NotEqualImmediate: {
-      auto &not_equal_imm =
-          derived_cast<Bytecode::Instruction::NotEqualImmediate &>(instr);
-      not_equal_imm.src = resolve_register(not_equal_imm.src);
-      invalidate(facts, not_equal_imm.dst);
-      break;
-    }
-    case Type::Add: {
-      auto &add = derived_cast<Bytecode::Instruction::Add &>(instr);
-      add.src1 = resolve_register(add.src1);
-      add.src2 = resolve_register(add.src2);
-      invalidate(facts, add.dst);
-      break;
-    }
-    case Type::AddImmediate: {
-      auto &add_imm = derived_cast<Bytecode::Instruction::AddImmediate &>(instr);
-      add_imm.src = resolve_register(add_imm.src);
-      invalidate(facts, add_imm.dst);
-      break;
-    }
-    case Type::Subtract: {
-      auto &subtract = derived_cast<Bytecode::Instruction::Subtract &>(instr);
-      subtract.src1 = resolve_register(subtract.src1);
-      subtract.src2 = resolve_register(subtract.src2);
-      invalidate(facts, subtract.dst);
-      break;
-    }
-    case Type::SubtractImmediate: {
-      auto &subtract_imm =
-          derived_cast<Bytecode::Instruction::SubtractImmediate &>(instr);
-      subtract_imm.src = resolve_register(subtract_imm.src);
-      invalidate(facts, subtract_imm.dst);
-      break;
-    }
-    case Type::Multiply: {
-      auto &multiply = derived_cast<Bytecode::Instruction::Multiply &>(instr);
-      multiply.src1 = resolve_register(multiply.src1);
-      multiply.src2 = resolve_register(multiply.src2);
-      invalidate(facts, multiply.dst);
-      break;
-    }
-    case Type::MultiplyImmediate: {
-      auto &multiply_imm =
-          derived_cast<Bytecode::Instruction::MultiplyImmediate &>(instr);
-      multiply_imm.src = resolve_register(multiply_imm.src);
-      invalidate(facts, multiply_imm.dst);
-      break;
-    }
-    case Type::Divide: {
-      auto &divide = derived_cast<Bytecode::Instruction::Divide &>(instr);
-      divide.src1 = resolve_register(divide.src1);
-      divide.src2 = resolve_register(divide.src2);
-      invalidate(facts, divide.dst);
-      break;
-    }
-    case Type::DivideImmediate: {
-      auto &divide_imm = derived_cast<Bytecode::Instruction::DivideImmediate &>(instr);
-      divide_imm.src = resolve_register(divide_imm.src);
-      invalidate(facts, divide_imm.dst);
-      break;
-    }
-    case Type::Modulo: {
-      auto &modulo = derived_cast<Bytecode::Instruction::Modulo &>(instr);
-      modulo.src1 = resolve_register(modulo.src1);
-      modulo.src2 = resolve_register(modulo.src2);
-      invalidate(facts, modulo.dst);
-      break;
-    }
-    case Type::ModuloImmediate: {
-      auto &modulo_imm = derived_cast<Bytecode::Instruction::ModuloImmediate &>(instr);
-      modulo_imm.src = resolve_register(modulo_imm.src);
-      invalidate(facts, modulo_imm.dst);
-      break;
-    }
-    case Type::ArrayCreate: {
-      auto &array_create = derived_cast<Bytecode::Instruction::ArrayCreate &>(instr);
-      for (auto &element : array_create.elements) {
-        element = resolve_register(element);
-      }
-      invalidate(facts, array_create.dst);
-      break;
-    }
-    case Type::ArrayLiteralCreate: {
-      auto &array_literal_create =
-          derived_cast<Bytecode::Instruction::ArrayLiteralCreate &>(instr);
-      invalidate(facts, array_literal_create.dst);
-      break;
-    }
-    case Type::ArrayLoad: {
-      auto &array_load = derived_cast<Bytecode::Instruction::ArrayLoad &>(instr);
-      array_load.array = resolve_register(array_load.array);
-      array_load.index = resolve_register(array_load.index);
-      invalidate(facts, array_load.dst);
-      break;
-    }
-    case Type::ArrayLoadImmediate: {
-      auto &array_load_imm =
-          derived_cast<Bytecode::Instruction::ArrayLoadImmediate &>(instr);
-      array_load_imm.array = resolve_register(array_load_imm.array);
-      invalidate(facts, array_load_imm.dst);
-      break;
-    }
-    case Type::ArrayStore: {
-      auto &array_store = derived_cast<Bytecode::Instruction::ArrayStore &>(instr);
-      array_store.array = resolve_register(array_store.array);
-      array_store.index = resolve_register(array_store.index);
-      array_store.value = resolve_register(array_store.value);
-      break;
-    }
-    case Type::StructCreate: {
-      auto &struct_create = derived_cast<Bytecode::Instruction::StructCreate &>(instr);
-      for (auto &[name, reg] : struct_create.fields) {
-        reg = resolve_register(reg);
-      }
-      invalidate(facts, struct_create.dst);
-      break;
-    }
-    case Type::StructLiteralCreate: {
-      auto &struct_literal_create =
-          derived_cast<Bytecode::Instruction::StructLiteralCreate &>(instr);
-      invalidate(facts, struct_literal_create.dst);
-      break;
-    }
-    case Type::StructLoad: {
-      auto &struct_load = derived_cast<Bytecode::Instruction::StructLoad &>(instr);
-      struct_load.object = resolve_register(struct_load.object);
-      invalidate(facts, struct_load.dst);
-      break;
-    }
     case Type::AddressOf: {
       auto &address_of = derived_cast<Bytecode::Instruction::AddressOf &>(instr);
       // `AddressOf` must preserve the exact source register identity. Rewriting
@@ -587,81 +235,125 @@ void rewrite_instruction(std::unique_ptr<Bytecode::Instruction> &instr_ptr,
       invalidate(facts, address_of.dst);
       break;
     }
-    case Type::LoadIndirect: {
-      auto &load_indirect = derived_cast<Bytecode::Instruction::LoadIndirect &>(instr);
-      load_indirect.pointer = resolve_register(load_indirect.pointer);
-      invalidate(facts, load_indirect.dst);
-      break;
-    }
-    case Type::Negate: {
-      auto &negate = derived_cast<Bytecode::Instruction::Negate &>(instr);
-      negate.src = resolve_register(negate.src);
-      invalidate(facts, negate.dst);
-      break;
-    }
-    case Type::LogicalNot: {
-      auto &logical_not = derived_cast<Bytecode::Instruction::LogicalNot &>(instr);
-      logical_not.src = resolve_register(logical_not.src);
-      invalidate(facts, logical_not.dst);
+    default:
+      // A compare-and-branch on constants takes one of its targets.
+      if (const auto compare = branch_compare_type(instr.type())) {
+        std::vector<Value> operands;
+        for_each_src_reg(instr, [&facts, &operands](Register reg) {
+          const auto resolved = resolve_value(reg, facts);
+          if (resolved.is_constant) {
+            operands.push_back(resolved.value);
+          }
+        });
+        if (const auto immediate = get_immediate(instr)) {
+          operands.push_back(*immediate);
+        }
+        if (operands.size() == 2) {
+          const auto targets = get_jump_targets(instr);
+          jump_to(evaluate_compare(*compare, operands[0], operands[1]) ? targets[0]
+                                                                       : targets[1]);
+          break;
+        }
+      }
+      // Everything else reads its operands through the facts and clobbers its
+      // destination.
+      visit_registers(
+          instr, [&resolve_register](Register &reg) { reg = resolve_register(reg); },
+          [&facts](Register &reg) { invalidate(facts, reg); });
       break;
-    }
   }
 }
 
+bool is_subset(const FactMap &facts, const FactMap &of) {
+  return std::all_of(facts.begin(), facts.end(), [&of](const auto &entry) {
+    const auto it = of.find(entry.first);
+    return it != of.end() && it->second == entry.second;
+  });
+}
+
 }  // namespace
 
-void BytecodeOptimizer::copy_propagation(std::vector<Bytecode::BasicBlock> &blocks) {
-  const auto successors = build_successors(blocks);
-  const auto predecessors = build_predecessors(successors);
+PassResult BytecodeOptimizer::copy_propagation(std::vector<Bytecode::BasicBlock> &blocks) {
+  auto &analyses = this->analyses(blocks);
+  const auto &graph = analyses.block_graph();
+  const auto &successors = graph.successors;
+  const auto &predecessors = graph.predecessors;
 
   std::vector<FactMap> in_states(blocks.size());
   std::vector<FactMap> out_states(blocks.size());
   std::vector<bool> out_initialized(blocks.size(), false);
 
-  std::deque<size_t> worklist;
-  std::vector<bool> queued(blocks.size(), false);
-  for (size_t i = 0; i < blocks.size(); ++i) {
-    worklist.push_back(i);
-    queued[i] = true;
+  // Blocks in reverse postorder, function by function, then those no
+  // function reaches. The worklist visits the lowest position first, so a
+  // block comes after its forward predecessors and each pass around a loop
+  // only narrows its facts.
+  std::vector<size_t> order;
+  std::vector<size_t> position(blocks.size(), blocks.size());
+  const auto add_to_order = [&order, &position](Label label) {
+    if (position[label] == position.size()) {
+      position[label] = order.size();
+      order.push_back(label);
+    }
+  };
+  for (const auto &function : analyses.functions()) {
+    for (const auto label : analyses.cfg(function.entry).order) {
+      add_to_order(label);
+    }
+  }
+  for (Label label = 0; label < blocks.size(); ++label) {
+    add_to_order(label);
+  }
+
+  std::set<size_t> worklist;
+  for (size_t i = 0; i < order.size(); ++i) {
+    worklist.insert(i);
   }
 
   while (!worklist.empty()) {
-    const auto block_index = worklist.front();
-    worklist.pop_front();
-    queued[block_index] = false;
+    const auto block_index = order[*worklist.begin()];
+    worklist.erase(worklist.begin());
 
-    auto in_state =
+    auto in_state_opt =
         meet_predecessors(block_index, predecessors, out_states, out_initialized);
+    if (!in_state_opt) {
+      continue;
+    }
+    auto in_state = std::move(*in_state_opt);
     auto out_state = in_state;
 
     for (const auto &instr_ptr : blocks[block_index].instructions) {
       transfer_instruction(*instr_ptr, out_state);
     }
 
-    if (in_state == in_states[block_index] && out_state == out_states[block_index]) {
+    // A block's first state always counts, even when its facts are empty,
+    // so that its successors take it into their meet.
+    if (out_initialized[block_index] && in_state == in_states[block_index] &&
+        out_state == out_states[block_index]) {
       continue;
     }
+    // Facts only ever narrow once a block has a state, which bounds the
+    // number of times it can change.
+    assert(!out_initialized[block_index] ||
+           is_subset(in_state, in_states[block_index]));
 
     in_states[block_index] = std::move(in_state);
     out_states[block_index] = std::move(out_state);
     out_initialized[block_index] = true;
 
     for (const auto succ : successors[block_index]) {
-      if (!queued[succ]) {
-        worklist.push_back(succ);
-        queued[succ] = true;
-      }
+      worklist.insert(position[succ]);
     }
   }
 
+  PassResult result;
   for (size_t i = 0; i < blocks.size(); ++i) {
     auto facts = in_states[i];
     const auto entry_facts = facts;
     for (auto &instr_ptr : blocks[i].instructions) {
-      rewrite_instruction(instr_ptr, facts, entry_facts);
+      rewrite_instruction(instr_ptr, facts, entry_facts, result);
     }
 
-    std::erase_if(blocks[i].instructions, [](const auto &instr_ptr) {
+    result.changes += std::erase_if(blocks[i].instructions, [](const auto &instr_ptr) {
       if (instr_ptr->type() != Type::Move) {
         return false;
       }
@@ -669,6 +361,7 @@ void BytecodeOptimizer::copy_propagation(std::vector<Bytecode::BasicBlock> &bloc
       return move.dst == move.src;
     });
   }
+  return result;
 }
 
 }  // namespace kai
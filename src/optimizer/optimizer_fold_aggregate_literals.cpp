@@ -8,8 +8,9 @@ namespace kai {
 using Register = Bytecode::Register;
 using Type = Bytecode::Instruction::Type;
 
-void BytecodeOptimizer::fold_aggregate_literals(
+PassResult BytecodeOptimizer::fold_aggregate_literals(
     std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
   for (auto &block : blocks) {
     std::unordered_map<Register, Bytecode::Value> constant_loads;
     for (auto &instr_ptr : block.instructions) {
@@ -38,6 +39,7 @@ void BytecodeOptimizer::fold_aggregate_literals(
           instr_ptr = std::make_unique<Bytecode::Instruction::ArrayLiteralCreate>(
               array_create.dst, std::move(elements));
           constant_loads.erase(array_create.dst);
+          ++result.changes;
           continue;
         }
       } else if (instr.type() == Type::ArrayLoad) {
@@ -48,6 +50,7 @@ void BytecodeOptimizer::fold_aggregate_literals(
           instr_ptr = std::make_unique<Bytecode::Instruction::ArrayLoadImmediate>(
               array_load.dst, array_load.array, it->second);
           constant_loads.erase(array_load.dst);
+          ++result.changes;
           continue;
         }
       } else if (instr.type() == Type::StructCreate) {
@@ -68,6 +71,7 @@ void BytecodeOptimizer::fold_aggregate_literals(
           instr_ptr = std::make_unique<Bytecode::Instruction::StructLiteralCreate>(
               struct_create.dst, std::move(fields));
           constant_loads.erase(struct_create.dst);
+          ++result.changes;
           continue;
         }
       }
@@ -77,6 +81,7 @@ void BytecodeOptimizer::fold_aggregate_literals(
       }
     }
   }
+  return result;
 }
 
 }  // namespace kai
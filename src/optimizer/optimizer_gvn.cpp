@@ -0,0 +1,224 @@
+#include "../optimizer.h"
+#include "optimizer_internal.h"
+#include "optimizer_ssa.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+using Type = Bytecode::Instruction::Type;
+
+namespace {
+
+// A pure computation, keyed by what determines its result. Loads from the
+// heap also carry the memory version they read.
+struct Expression {
+  Type type;
+  std::vector<Register> operands;
+  std::optional<Bytecode::Value> immediate;
+  std::string field;
+  size_t memory;
+
+  bool operator<(const Expression &other) const {
+    return std::tie(type, operands, immediate, field, memory) <
+           std::tie(other.type, other.operands, other.immediate, other.field, other.memory);
+  }
+};
+
+bool reads_memory(Type type) {
+  return has_opcode_flag(type, k_reads_heap);
+}
+
+// Instructions that may change what a heap load returns. A callee may store
+// anywhere.
+bool writes_memory(Type type) {
+  return has_opcode_flag(type, k_writes_heap | k_calls);
+}
+
+// A Move takes its source's number instead, and loaded constants are left to
+// constant propagation.
+bool is_numbered(Type type) {
+  return (has_opcode_flag(type, k_pure) && type != Type::Move && type != Type::Load) ||
+         reads_memory(type);
+}
+
+// `operands` are the value numbers of the instruction's source registers.
+Expression make_expression(const Bytecode::Instruction &instr, std::vector<Register> operands,
+                           size_t memory) {
+  Expression expression{instr.type(), std::move(operands), get_immediate(instr), {},
+                        reads_memory(instr.type()) ? memory : 0};
+  if (instr.type() == Type::StructLoad) {
+    expression.field = derived_cast<const Bytecode::Instruction::StructLoad &>(instr).field;
+  }
+  // a > b is b < a, and a >= b is b <= a.
+  if (expression.type == Type::GreaterThan) {
+    expression.type = Type::LessThan;
+    std::swap(expression.operands[0], expression.operands[1]);
+  } else if (expression.type == Type::GreaterThanOrEqual) {
+    expression.type = Type::LessThanOrEqual;
+    std::swap(expression.operands[0], expression.operands[1]);
+  } else if (has_opcode_flag(expression.type, k_commutative) &&
+             expression.operands[1] < expression.operands[0]) {
+    std::swap(expression.operands[0], expression.operands[1]);
+  }
+  return expression;
+}
+
+// Memory versions of each block: the one on entry, then one after each
+// store. A block with one version on all its incoming edges keeps it; any
+// other join, including a loop header reached by a back edge, starts a new
+// one. Equal versions therefore mean that no store can run between the two
+// points.
+std::vector<std::vector<size_t>> memory_versions(const std::vector<Bytecode::BasicBlock> &blocks,
+                                                 const ControlFlowGraph &cfg) {
+  std::vector<std::vector<size_t>> versions(blocks.size());
+  size_t next_version = 0;
+  for (const auto label : cfg.order) {
+    const auto &predecessors = cfg.predecessors[label];
+    const auto version_out = [&versions](Label predecessor) {
+      return versions[predecessor].empty() ? std::nullopt
+                                           : std::optional<size_t>(versions[predecessor].back());
+    };
+    const bool inherits =
+        !predecessors.empty() && version_out(predecessors[0]) &&
+        std::all_of(predecessors.begin(), predecessors.end(), [&](Label predecessor) {
+          return version_out(predecessor) == version_out(predecessors[0]);
+        });
+    versions[label].push_back(inherits ? *version_out(predecessors[0]) : next_version++);
+    for (const auto &instr_ptr : blocks[label].instructions) {
+      if (writes_memory(instr_ptr->type())) {
+        versions[label].push_back(next_version++);
+      }
+    }
+  }
+  return versions;
+}
+
+// Removes computations that repeat one on every path to them, walking the
+// dominator tree with a scoped table of available expressions. Returns
+// how many were removed.
+size_t number_values(std::vector<Bytecode::BasicBlock> &blocks, SsaFunction &ssa) {
+  const auto &cfg = ssa.cfg;
+
+  // Registers whose address is taken keep one number for every write, so
+  // neither they nor what is computed from them are values.
+  std::vector<bool> varies(ssa.next_register, false);
+  for (const auto label : cfg.order) {
+    for (const auto &instr_ptr : blocks[label].instructions) {
+      if (const auto dst = get_dst_reg(*instr_ptr); dst && *dst < ssa.first_value) {
+        varies[*dst] = true;
+      }
+    }
+  }
+
+  const auto versions = memory_versions(blocks, cfg);
+  std::vector<Register> leader(ssa.next_register);
+  for (Register reg = 0; reg < ssa.next_register; ++reg) {
+    leader[reg] = reg;
+  }
+  const auto rename = [&leader](Register &reg) { reg = leader[reg]; };
+  // Value number of each register: copies share the number of their source.
+  std::vector<Register> number = leader;
+
+  std::map<Expression, Register> available;
+  std::vector<Expression> scope;
+  struct Visit {
+    Label label;
+    size_t next_child;
+    size_t scope_before;
+  };
+  std::vector<Visit> stack = {{cfg.entry, 0, 0}};
+  bool entering = true;
+  size_t removed = 0;
+  while (!stack.empty()) {
+    auto &visit = stack.back();
+    if (entering) {
+      auto &instrs = blocks[visit.label].instructions;
+      size_t stores = 0;
+      for (auto &instr_ptr : instrs) {
+        visit_registers(*instr_ptr, rename, [](Register &) {});
+        const auto type = instr_ptr->type();
+        if (writes_memory(type)) {
+          ++stores;
+        }
+        const auto dst = get_dst_reg(*instr_ptr);
+        if (!dst || varies[*dst]) {
+          continue;
+        }
+        if (type == Type::Move) {
+          const auto src = derived_cast<const Bytecode::Instruction::Move &>(*instr_ptr).src;
+          if (!varies[src]) {
+            number[*dst] = number[src];
+          }
+          continue;
+        }
+        auto srcs = get_src_regs(*instr_ptr);
+        if (!is_numbered(type) ||
+            std::any_of(srcs.begin(), srcs.end(), [&](Register src) { return varies[src]; })) {
+          continue;
+        }
+        for (auto &src : srcs) {
+          src = number[src];
+        }
+        auto expression =
+            make_expression(*instr_ptr, std::move(srcs), versions[visit.label][stores]);
+        const auto [it, inserted] = available.emplace(expression, *dst);
+        if (inserted) {
+          scope.push_back(std::move(expression));
+          continue;
+        }
+        leader[*dst] = it->second;
+        instr_ptr.reset();
+        ++removed;
+      }
+      instrs.erase(std::remove(instrs.begin(), instrs.end(), nullptr), instrs.end());
+    }
+    const auto &children = cfg.dominator_children[visit.label];
+    if (visit.next_child < children.size()) {
+      const auto child = children[visit.next_child++];
+      stack.push_back({child, 0, scope.size()});
+      entering = true;
+      continue;
+    }
+    while (scope.size() > visit.scope_before) {
+      available.erase(scope.back());
+      scope.pop_back();
+    }
+    stack.pop_back();
+    entering = false;
+  }
+
+  // Phi arguments are read at the end of predecessors that may come later
+  // in the walk, such as loop latches.
+  for (const auto label : cfg.order) {
+    for (auto &phi : ssa.phis[label]) {
+      for (auto &arg : phi.args) {
+        rename(arg);
+      }
+    }
+  }
+  return removed;
+}
+
+}  // namespace
+
+PassResult BytecodeOptimizer::global_value_numbering(
+    std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
+  result.changes = transform_functions_in_ssa(
+      blocks, [](std::vector<Bytecode::BasicBlock> &blocks, SsaFunction &ssa,
+                 const Bytecode::Function &) { return number_values(blocks, ssa); });
+  // Leaving SSA may split edges.
+  result.control_flow_changed = result.changes != 0;
+  return result;
+}
+
+}  // namespace kai
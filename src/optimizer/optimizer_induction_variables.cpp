@@ -0,0 +1,245 @@
+#include "optimizer_induction_variables.h"
+#include "optimizer_internal.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+using Type = Bytecode::Instruction::Type;
+using Value = Bytecode::Value;
+
+namespace {
+
+constexpr Value k_max_value = std::numeric_limits<Value>::max();
+
+// The constant `instr` adds to `src`, when it is an AddImmediate or a
+// SubtractImmediate reading it.
+std::optional<Value> step_from(const Bytecode::Instruction &instr, Register src) {
+  switch (instr.type()) {
+    case Type::AddImmediate: {
+      const auto &add_imm = derived_cast<const Bytecode::Instruction::AddImmediate &>(instr);
+      if (add_imm.src == src) {
+        return add_imm.value;
+      }
+      break;
+    }
+    case Type::SubtractImmediate: {
+      const auto &subtract_imm =
+          derived_cast<const Bytecode::Instruction::SubtractImmediate &>(instr);
+      if (subtract_imm.src == src) {
+        return Value{0} - subtract_imm.value;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return std::nullopt;
+}
+
+// The immediate compare that holds exactly when `compare` does not.
+std::optional<Type> negated_compare(Type compare) {
+  switch (compare) {
+    case Type::LessThanImmediate:
+      return Type::GreaterThanOrEqualImmediate;
+    case Type::GreaterThanOrEqualImmediate:
+      return Type::LessThanImmediate;
+    case Type::LessThanOrEqualImmediate:
+      return Type::GreaterThanImmediate;
+    case Type::GreaterThanImmediate:
+      return Type::LessThanOrEqualImmediate;
+    case Type::EqualImmediate:
+      return Type::NotEqualImmediate;
+    case Type::NotEqualImmediate:
+      return Type::EqualImmediate;
+    default:
+      return std::nullopt;
+  }
+}
+
+size_t terminator_index(const Bytecode::BasicBlock &block) {
+  const auto &instrs = block.instructions;
+  const auto it = std::find_if(instrs.begin(), instrs.end(),
+                               [](const auto &instr) { return is_terminator(*instr); });
+  return static_cast<size_t>(it - instrs.begin());
+}
+
+}  // namespace
+
+std::vector<InductionVariable> find_induction_variables(
+    const std::vector<Bytecode::BasicBlock> &blocks, const ControlFlowGraph &cfg,
+    const LoopForest &forest, size_t loop_index) {
+  const auto &loop = forest.loops[loop_index];
+  std::unordered_map<Register, size_t> def_count;
+  for (const auto label : loop.blocks) {
+    for (const auto &instr_ptr : blocks[label].instructions) {
+      if (const auto dst = get_dst_reg(*instr_ptr)) {
+        ++def_count[*dst];
+      }
+    }
+  }
+
+  std::vector<InductionVariable> variables;
+  for (const auto label : loop.blocks) {
+    const auto &instrs = blocks[label].instructions;
+    const auto end = terminator_index(blocks[label]);
+    for (size_t i = 0; i < end; ++i) {
+      const auto dst = get_dst_reg(*instrs[i]);
+      if (!dst || def_count[*dst] != 1) {
+        continue;
+      }
+      auto step = step_from(*instrs[i], *dst);
+      if (!step && i > 0 && instrs[i]->type() == Type::Move) {
+        const auto &move = derived_cast<const Bytecode::Instruction::Move &>(*instrs[i]);
+        if (get_dst_reg(*instrs[i - 1]) == move.src) {
+          step = step_from(*instrs[i - 1], *dst);
+        }
+      }
+      if (!step || *step == 0) {
+        continue;
+      }
+      InductionVariable variable{*dst, *step, label, i};
+      variable.steps_every_iteration =
+          forest.innermost[label] == loop_index &&
+          std::all_of(loop.latches.begin(), loop.latches.end(),
+                      [&](Label latch) { return cfg.dominates(label, latch); });
+      variables.push_back(variable);
+    }
+  }
+  return variables;
+}
+
+std::optional<Value> entry_value(const std::vector<Bytecode::BasicBlock> &blocks,
+                                 const ControlFlowGraph &cfg, const Loop &loop,
+                                 Register reg) {
+  if (loop.preheader == ControlFlowGraph::k_no_label) {
+    return std::nullopt;
+  }
+  std::vector<bool> visited(blocks.size(), false);
+  for (auto label = loop.preheader; !visited[label];) {
+    visited[label] = true;
+    const auto &instrs = blocks[label].instructions;
+    for (size_t i = terminator_index(blocks[label]); i-- > 0;) {
+      if (get_dst_reg(*instrs[i]) != reg) {
+        continue;
+      }
+      if (instrs[i]->type() != Type::Load) {
+        return std::nullopt;
+      }
+      return derived_cast<const Bytecode::Instruction::Load &>(*instrs[i]).value;
+    }
+    // Calls enter the function at its entry without passing a predecessor.
+    if (label == cfg.entry || cfg.predecessors[label].size() != 1) {
+      return std::nullopt;
+    }
+    label = cfg.predecessors[label][0];
+  }
+  return std::nullopt;
+}
+
+std::optional<TripCount> find_trip_count(const std::vector<Bytecode::BasicBlock> &blocks,
+                                         const ControlFlowGraph &cfg, const Loop &loop,
+                                         const std::vector<InductionVariable> &variables) {
+  const auto &header = blocks[loop.header];
+  if (terminator_index(header) == header.instructions.size()) {
+    return std::nullopt;
+  }
+  const auto &terminator = *header.instructions[terminator_index(header)];
+  const Bytecode::Instruction *test = &terminator;
+  auto compare = branch_compare_type(terminator.type());
+  if (terminator.type() == Type::JumpConditional) {
+    // The last write of the condition before the branch.
+    const auto cond =
+        derived_cast<const Bytecode::Instruction::JumpConditional &>(terminator).cond;
+    for (size_t i = terminator_index(header); i-- > 0;) {
+      if (get_dst_reg(*header.instructions[i]) == cond) {
+        test = header.instructions[i].get();
+        compare = test->type();
+        break;
+      }
+    }
+  }
+  const auto bound = get_immediate(*test);
+  if (!compare || !negated_compare(*compare) || !bound) {
+    return std::nullopt;
+  }
+  const auto reg = get_src_regs(*test)[0];
+  const auto variable = std::find_if(variables.begin(), variables.end(),
+                                     [reg](const auto &other) { return other.reg == reg; });
+  // The header tests the value the variable enters the iteration with.
+  if (variable == variables.end() || !variable->steps_every_iteration ||
+      variable->block == loop.header) {
+    return std::nullopt;
+  }
+  const auto start = entry_value(blocks, cfg, loop, reg);
+  if (!start) {
+    return std::nullopt;
+  }
+
+  const auto targets = get_jump_targets(terminator);
+  const auto inside = [&loop](Label label) {
+    return std::find(loop.blocks.begin(), loop.blocks.end(), label) != loop.blocks.end();
+  };
+  if (inside(targets[0]) == inside(targets[1])) {
+    return std::nullopt;
+  }
+  TripCount trip;
+  trip.variable = static_cast<size_t>(variable - variables.begin());
+  trip.test = test;
+  trip.body = inside(targets[0]) ? targets[0] : targets[1];
+  trip.exit = inside(targets[0]) ? targets[1] : targets[0];
+  // The compare the loop goes on while.
+  const auto continues = inside(targets[0]) ? *compare : *negated_compare(*compare);
+
+  // Steps below 2^63 count up and the others count down. The variable must
+  // leave the loop before it wraps.
+  const bool up = variable->step <= k_max_value / 2;
+  const auto stride = up ? variable->step : Value{0} - variable->step;
+  Value count = 0;
+  switch (continues) {
+    case Type::LessThanImmediate:
+      if (!up || *bound > k_max_value - stride) {
+        return std::nullopt;
+      }
+      count = *start < *bound ? (*bound - *start + stride - 1) / stride : 0;
+      break;
+    case Type::LessThanOrEqualImmediate:
+      if (!up || *bound > k_max_value - stride) {
+        return std::nullopt;
+      }
+      count = *start <= *bound ? (*bound - *start) / stride + 1 : 0;
+      break;
+    case Type::GreaterThanImmediate:
+      if (up || *bound == k_max_value || *bound + 1 < stride) {
+        return std::nullopt;
+      }
+      count = *start > *bound ? (*start - *bound + stride - 1) / stride : 0;
+      break;
+    case Type::GreaterThanOrEqualImmediate:
+      if (up || *bound < stride) {
+        return std::nullopt;
+      }
+      count = *start >= *bound ? (*start - *bound) / stride + 1 : 0;
+      break;
+    case Type::NotEqualImmediate: {
+      const auto distance = up ? *bound - *start : *start - *bound;
+      if ((up ? *start > *bound : *start < *bound) || distance % stride != 0) {
+        return std::nullopt;
+      }
+      count = distance / stride;
+      break;
+    }
+    default:
+      return std::nullopt;
+  }
+  const auto last = up ? *start + count * stride : *start - count * stride;
+  trip.count = count;
+  trip.min = std::min(*start, last);
+  trip.max = std::max(*start, last);
+  return trip;
+}
+
+}  // namespace kai
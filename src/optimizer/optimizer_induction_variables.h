@@ -0,0 +1,64 @@
+#pragma once
+
+#include "optimizer_cfg.h"
+
+#include <optional>
+#include <vector>
+
+namespace kai {
+
+// A basic induction variable: a register whose only definition in a loop
+// adds a constant to it, either directly or through a temporary that the
+// next instruction copies back:
+//   AddImmediate i, i, c        AddImmediate t, i, c
+//                               Move i, t
+// SubtractImmediate steps by the negated constant.
+struct InductionVariable {
+  Bytecode::Register reg = 0;
+  // Added at each step, wrapping.
+  Bytecode::Value step = 0;
+  // The block that steps the register, and the index in it of the
+  // instruction that writes it.
+  Bytecode::Label block = 0;
+  size_t position = 0;
+  // Whether the step runs exactly once on every way around the loop: its
+  // block dominates every latch and belongs to no inner loop.
+  bool steps_every_iteration = false;
+};
+
+// The basic induction variables of `forest.loops[loop]`.
+std::vector<InductionVariable> find_induction_variables(
+    const std::vector<Bytecode::BasicBlock> &blocks, const ControlFlowGraph &cfg,
+    const LoopForest &forest, size_t loop);
+
+// The constant `reg` holds whenever `loop` is entered: the value of a Load
+// into it on the way from the loop's preheader back through blocks with a
+// single predecessor, when nothing else writes it after that.
+std::optional<Bytecode::Value> entry_value(const std::vector<Bytecode::BasicBlock> &blocks,
+                                           const ControlFlowGraph &cfg, const Loop &loop,
+                                           Bytecode::Register reg);
+
+// How often a loop runs, when its header ends by testing an induction
+// variable against an immediate, with a compare-and-branch or with a compare
+// and a JumpConditional on its result. Other exits may end the loop sooner,
+// so the count is a bound on the iterations.
+struct TripCount {
+  // Index of the tested variable in find_induction_variables().
+  size_t variable = 0;
+  // The instruction comparing it, in the header.
+  const Bytecode::Instruction *test = nullptr;
+  Bytecode::Value count = 0;
+  // Smallest and largest values the variable holds in the loop; it never
+  // wraps between them.
+  Bytecode::Value min = 0;
+  Bytecode::Value max = 0;
+  // The header's successors inside and outside the loop.
+  Bytecode::Label body = 0;
+  Bytecode::Label exit = 0;
+};
+
+std::optional<TripCount> find_trip_count(const std::vector<Bytecode::BasicBlock> &blocks,
+                                         const ControlFlowGraph &cfg, const Loop &loop,
+                                         const std::vector<InductionVariable> &variables);
+
+}  // namespace kai
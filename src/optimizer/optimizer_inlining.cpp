@@ -0,0 +1,261 @@
+#include "../optimizer.h"
+#include "optimizer_internal.h"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+using Type = Bytecode::Instruction::Type;
+
+namespace {
+
+// Instructions of `block` up to and including its first terminator; the
+// generator leaves unreachable code after a Return.
+size_t live_instruction_count(const Bytecode::BasicBlock &block) {
+  size_t count = 0;
+  for (const auto &instr_ptr : block.instructions) {
+    ++count;
+    if (is_terminator(*instr_ptr)) {
+      break;
+    }
+  }
+  return count;
+}
+
+// The cost of inlining `callee` is the number of instructions copied into
+// the caller, or nullopt when it cannot be inlined: a TailCall would leave
+// the caller, and a pointer into the callee's frame could outlive the call.
+std::optional<size_t> inline_cost(const std::vector<Bytecode::BasicBlock> &blocks,
+                                  const Bytecode::Function &callee) {
+  if (callee.entry == 0 || callee.blocks.front() != callee.entry) {
+    return std::nullopt;
+  }
+  size_t cost = 0;
+  for (const auto label : callee.blocks) {
+    const auto &block = blocks[label];
+    const auto count = live_instruction_count(block);
+    for (size_t i = 0; i < count; ++i) {
+      const auto type = block.instructions[i]->type();
+      if (type == Type::TailCall || type == Type::AddressOf) {
+        return std::nullopt;
+      }
+    }
+    cost += count;
+  }
+  return cost;
+}
+
+// Registers, other than parameters, that `callee` may read before writing.
+// A called function starts with a zeroed frame; an inlined copy shares the
+// caller's frame and may run repeatedly, so these have to be cleared.
+std::set<Register> read_before_written(const std::vector<Bytecode::BasicBlock> &blocks,
+                                       const Bytecode::Function &callee) {
+  std::unordered_map<Label, std::set<Register>> live_in;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = callee.blocks.rbegin(); it != callee.blocks.rend(); ++it) {
+      const auto &block = blocks[*it];
+      const auto count = live_instruction_count(block);
+      std::set<Register> live;
+      if (count > 0) {
+        for (const auto target : get_jump_targets(*block.instructions[count - 1])) {
+          const auto &successor = live_in[target];
+          live.insert(successor.begin(), successor.end());
+        }
+      }
+      for (size_t i = count; i-- > 0;) {
+        const auto &instr = *block.instructions[i];
+        if (const auto dst = get_dst_reg(instr)) {
+          live.erase(*dst);
+        }
+        for (const auto src : get_src_regs(instr)) {
+          live.insert(src);
+        }
+      }
+      auto &current = live_in[*it];
+      if (live != current) {
+        current = std::move(live);
+        changed = true;
+      }
+    }
+  }
+
+  auto registers = std::move(live_in[callee.entry]);
+  for (const auto param : callee.parameter_registers) {
+    registers.erase(param);
+  }
+  return registers;
+}
+
+// Where scanning for call sites resumes after inlining one.
+struct Resume {
+  Label label;
+  size_t index;
+};
+
+// Replaces the Call at `blocks[label].instructions[index]` with a copy of
+// `callee` in a region of the frame that starts at `caller`'s frame size.
+// A single-block callee is spliced into the calling block. Otherwise the
+// copied blocks are placed right after `label`, and the rest of the calling
+// block moves to a new block after them.
+Resume inline_call(std::vector<Bytecode::BasicBlock> &blocks, Label label, size_t index,
+                   const Bytecode::Function &caller, const Bytecode::Function &callee) {
+  const auto &call = derived_cast<const Bytecode::Instruction::Call &>(
+      *blocks[label].instructions[index]);
+  const auto dst = call.dst;
+  const auto args = call.arg_registers;
+  const auto base = static_cast<Register>(caller.frame_size);
+  const auto size = callee.blocks.size();
+  const auto &entry = blocks[callee.entry];
+  const auto entry_count = live_instruction_count(entry);
+  const bool splice = size == 1 && entry_count > 0 &&
+                      entry.instructions[entry_count - 1]->type() == Type::Return;
+  const Label first = label + 1;
+  const Label continuation = splice ? label : first + size;
+
+  std::unordered_map<Label, Label> copy_of;
+  for (size_t i = 0; i < size; ++i) {
+    copy_of[callee.blocks[i]] = first + i;
+  }
+  const auto shift_call = [first, size, splice](Label &target) {
+    if (!splice && target >= first) {
+      target += size + 1;
+    }
+  };
+
+  // Copy the callee before inserting blocks, which may move it.
+  std::vector<Bytecode::BasicBlock> copies(size);
+  for (size_t i = 0; i < size; ++i) {
+    const auto &block = blocks[callee.blocks[i]];
+    const auto count = live_instruction_count(block);
+    for (size_t j = 0; j < count; ++j) {
+      auto instr = clone_instruction(*block.instructions[j]);
+      const auto rename = [base](Register &reg) { reg += base; };
+      visit_registers(*instr, rename, rename);
+      if (instr->type() == Type::Return) {
+        const auto result = derived_cast<const Bytecode::Instruction::Return &>(*instr).reg;
+        copies[i].append<Bytecode::Instruction::Move>(dst, result);
+        if (!splice) {
+          copies[i].append<Bytecode::Instruction::Jump>(continuation);
+        }
+        continue;
+      }
+      visit_labels(
+          *instr, [&copy_of](Label &target) { target = copy_of.at(target); }, shift_call);
+      copies[i].instructions.push_back(std::move(instr));
+    }
+  }
+
+  const auto cleared = read_before_written(blocks, callee);
+  if (!splice) {
+    insert_blocks(blocks, first, size + 1, /*calls_land_on_new_blocks=*/false);
+  }
+
+  auto &instrs = blocks[label].instructions;
+  std::vector<std::unique_ptr<Bytecode::Instruction>> rest;
+  for (size_t j = index + 1; j < instrs.size(); ++j) {
+    rest.push_back(std::move(instrs[j]));
+  }
+  instrs.erase(instrs.begin() + static_cast<std::ptrdiff_t>(index), instrs.end());
+  for (size_t p = 0; p < callee.parameter_registers.size(); ++p) {
+    blocks[label].append<Bytecode::Instruction::Move>(base + callee.parameter_registers[p],
+                                                      args[p]);
+  }
+  for (const auto reg : cleared) {
+    blocks[label].append<Bytecode::Instruction::Load>(base + reg, 0);
+  }
+
+  if (splice) {
+    for (auto &instr : copies[0].instructions) {
+      instrs.push_back(std::move(instr));
+    }
+  } else {
+    blocks[label].append<Bytecode::Instruction::Jump>(first);
+    for (size_t i = 0; i < size; ++i) {
+      blocks[first + i] = std::move(copies[i]);
+    }
+  }
+  auto &resumed = blocks[continuation].instructions;
+  const auto resume_index = resumed.size();
+  for (auto &instr : rest) {
+    resumed.push_back(std::move(instr));
+  }
+  return {continuation, resume_index};
+}
+
+}  // namespace
+
+void BytecodeOptimizer::set_inline_threshold(size_t threshold) {
+  inline_threshold_ = threshold;
+}
+
+PassResult BytecodeOptimizer::inline_functions(std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
+  if (inline_threshold_ == 0) {
+    return result;
+  }
+
+  // Code copied in one round is only scanned in the next, so each round
+  // inlines one more level of a recursive function.
+  for (size_t round = 0; round < k_max_inline_depth; ++round) {
+    bool inlined = false;
+    // Every inlining shifts labels and grows a frame, so the function table
+    // is rebuilt after each one.
+    auto functions = build_function_table(blocks);
+    Label label = 0;
+    size_t index = 0;
+    while (label < blocks.size()) {
+      if (index >= live_instruction_count(blocks[label])) {
+        ++label;
+        index = 0;
+        continue;
+      }
+      if (blocks[label].instructions[index]->type() != Type::Call) {
+        ++index;
+        continue;
+      }
+
+      const Bytecode::Function *caller = nullptr;
+      const Bytecode::Function *callee = nullptr;
+      const auto target =
+          derived_cast<const Bytecode::Instruction::Call &>(*blocks[label].instructions[index])
+              .label;
+      for (const auto &function : functions) {
+        if (function.entry == target) {
+          callee = &function;
+        }
+        for (const auto block : function.blocks) {
+          if (block == label) {
+            caller = &function;
+          }
+        }
+      }
+      const auto cost = callee ? inline_cost(blocks, *callee) : std::nullopt;
+      if (caller == nullptr || !cost || *cost > inline_threshold_) {
+        ++index;
+        continue;
+      }
+
+      const auto resume = inline_call(blocks, label, index, *caller, *callee);
+      label = resume.label;
+      index = resume.index;
+      functions = build_function_table(blocks);
+      inlined = true;
+      ++result.changes;
+      result.control_flow_changed = true;
+    }
+    if (!inlined) {
+      break;
+    }
+  }
+  return result;
+}
+
+}  // namespace kai
@@ -1,12 +1,143 @@
 #pragma once
 
+#include "../bytecode_operands.h"
 #include "../optimizer.h"
 
+#include <functional>
+#include <memory>
 #include <optional>
+#include <vector>
 
 namespace kai {
 
+class AnalysisCache;
+struct ControlFlowGraph;
+struct LoopForest;
+
 using Register = Bytecode::Register;
 std::optional<Register> get_dst_reg(const Bytecode::Instruction &instr);
 
+// Registers the instruction reads from its own frame. A call's parameter
+// registers belong to the callee's frame and are not included.
+std::vector<Register> get_src_regs(const Bytecode::Instruction &instr);
+
+// Calls `on_use` for each register get_src_regs() would return, without
+// collecting them.
+template <typename OnUse>
+void for_each_src_reg(const Bytecode::Instruction &instr, OnUse &&on_use) {
+  struct Visitor : OperandVisitor {
+    OnUse &on_use;
+    void use(const Register &reg) { on_use(reg); }
+  };
+  visit_operands(instr, Visitor{{}, on_use});
+}
+
+// The value operand of a Load or an immediate opcode. It comes after the
+// instruction's source registers.
+std::optional<Bytecode::Value> get_immediate(const Bytecode::Instruction &instr);
+
+// Calls `on_use` for every register the instruction reads and then `on_def`
+// for the register it writes, both in its own frame, so they can be renamed
+// in place.
+template <typename OnUse, typename OnDef>
+void visit_registers(Bytecode::Instruction &instr, OnUse &&on_use, OnDef &&on_def) {
+  struct Visitor : OperandVisitor {
+    OnUse &on_use;
+    OnDef &on_def;
+    void use(Register &reg) { on_use(reg); }
+    void def(Register &reg) { on_def(reg); }
+  };
+  visit_operands(instr, Visitor{{}, on_use, on_def});
+}
+
+// Calls `on_jump` for every branch target and `on_call` for the target of a
+// Call or TailCall.
+template <typename OnJump, typename OnCall>
+void visit_labels(Bytecode::Instruction &instr, OnJump &&on_jump, OnCall &&on_call) {
+  struct Visitor : OperandVisitor {
+    OnJump &on_jump;
+    OnCall &on_call;
+    void jump(Bytecode::Label &label) { on_jump(label); }
+    void call(Bytecode::Label &label) { on_call(label); }
+  };
+  visit_operands(instr, Visitor{{}, on_jump, on_call});
+}
+
+std::vector<Bytecode::Label> get_jump_targets(const Bytecode::Instruction &instr);
+
+inline bool is_terminator(const Bytecode::Instruction &instr) {
+  return has_opcode_flag(instr.type(), k_terminator);
+}
+
+// Every compare opcode with the branch that makes the compare and jumps on
+// its result in one instruction. Both take the same operands in the same
+// order, the branch targets aside.
+#define KAI_COMPARE_BRANCHES(X)                                   \
+  X(LessThan, JumpLessThan)                                       \
+  X(LessThanImmediate, JumpLessThanImmediate)                     \
+  X(GreaterThan, JumpGreaterThan)                                 \
+  X(GreaterThanImmediate, JumpGreaterThanImmediate)               \
+  X(LessThanOrEqual, JumpLessThanOrEqual)                         \
+  X(LessThanOrEqualImmediate, JumpLessThanOrEqualImmediate)       \
+  X(GreaterThanOrEqual, JumpGreaterThanOrEqual)                   \
+  X(GreaterThanOrEqualImmediate, JumpGreaterThanOrEqualImmediate) \
+  X(Equal, JumpEqual)                                             \
+  X(EqualImmediate, JumpEqualImmediate)                           \
+  X(NotEqual, JumpNotEqual)                                       \
+  X(NotEqualImmediate, JumpNotEqualImmediate)
+
+// The compare a compare-and-branch opcode makes, or nullopt for any other
+// opcode.
+std::optional<Bytecode::Instruction::Type> branch_compare_type(Bytecode::Instruction::Type type);
+
+// Whether `compare` holds for its two operands, the immediate being the
+// second.
+bool evaluate_compare(Bytecode::Instruction::Type compare, Bytecode::Value lhs,
+                      Bytecode::Value rhs);
+
+// The branch to `label1` when `compare` holds and to `label2` otherwise, or
+// null when `compare` is not a compare.
+std::unique_ptr<Bytecode::Instruction> make_compare_branch(const Bytecode::Instruction &compare,
+                                                           Bytecode::Label label1,
+                                                           Bytecode::Label label2);
+
+// Inserts `instr` in front of the block's first terminator, or at its end
+// when it has none.
+void insert_before_terminator(Bytecode::BasicBlock &block,
+                              std::unique_ptr<Bytecode::Instruction> instr);
+
+// Drops the instructions after the block's first terminator, which never run,
+// and returns how many there were.
+size_t trim_after_terminator(Bytecode::BasicBlock &block);
+
+// Inserts `count` empty blocks at `at`. Every label at or after `at` moves up
+// by `count`, so existing branches keep their targets; with
+// `calls_land_on_new_blocks`, calls to `at` land on the first new block
+// instead.
+void insert_blocks(std::vector<Bytecode::BasicBlock> &blocks, Bytecode::Label at,
+                   size_t count, bool calls_land_on_new_blocks);
+
+std::unique_ptr<Bytecode::Instruction> clone_instruction(const Bytecode::Instruction &instr);
+
+// Whether a block of `function` also belongs to another of `functions`. Such
+// a block is entered with registers the other function set, which an
+// analysis of `function` alone knows nothing of.
+bool shares_blocks(const std::vector<Bytecode::Function> &functions,
+                   const Bytecode::Function &function);
+
+// Whether `function` takes the address of one of its registers, which then
+// may change behind any instruction that writes through a pointer.
+bool takes_address(const std::vector<Bytecode::BasicBlock> &blocks,
+                   const Bytecode::Function &function);
+
+// Runs a loop pass on every function whose blocks are its own and whose
+// registers no pointer can step behind the loops' backs. Each function's
+// blocks are first trimmed after their terminators and its loops given
+// preheaders; `transform` then gets the function's graph and loops as they
+// are afterwards. Returns the changes to every function.
+PassResult transform_loops(
+    std::vector<Bytecode::BasicBlock> &blocks, AnalysisCache &analyses,
+    const std::function<PassResult(const Bytecode::Function &, const ControlFlowGraph &,
+                                   const LoopForest &)> &transform);
+
 }  // namespace kai
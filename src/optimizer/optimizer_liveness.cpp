@@ -0,0 +1,96 @@
+#include "optimizer_liveness.h"
+#include "optimizer_internal.h"
+
+#include <algorithm>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+
+namespace {
+
+// Registers read before being written in a block (gen) and written in it
+// (kill), for backward liveness.
+struct BlockEffects {
+  RegisterSet reads;
+  RegisterSet writes;
+};
+
+BlockEffects block_effects(const Bytecode::BasicBlock &block, size_t register_count) {
+  BlockEffects effects{RegisterSet(register_count), RegisterSet(register_count)};
+  for (const auto &instr_ptr : block.instructions) {
+    for_each_src_reg(*instr_ptr, [&effects](Register src) {
+      if (!effects.writes.contains(src)) {
+        effects.reads.insert(src);
+      }
+    });
+    if (const auto dst = get_dst_reg(*instr_ptr)) {
+      effects.writes.insert(*dst);
+    }
+  }
+  return effects;
+}
+
+}  // namespace
+
+std::vector<RegisterSet> live_in_sets(const std::vector<Bytecode::BasicBlock> &blocks,
+                                      const ControlFlowGraph &cfg,
+                                      const std::vector<std::vector<Phi>> &phis,
+                                      size_t register_count) {
+  std::vector<RegisterSet> live_in(blocks.size());
+  std::vector<RegisterSet> phi_defs(blocks.size());
+  std::vector<BlockEffects> effects(blocks.size());
+  for (const auto label : cfg.order) {
+    live_in[label] = RegisterSet(register_count);
+    phi_defs[label] = RegisterSet(register_count);
+    for (const auto &phi : phis[label]) {
+      phi_defs[label].insert(phi.dst);
+    }
+    effects[label] = block_effects(blocks[label], register_count);
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = cfg.order.rbegin(); it != cfg.order.rend(); ++it) {
+      const auto label = *it;
+      RegisterSet live(register_count);
+      for (const auto successor : cfg.successors[label]) {
+        live.insert_all(live_in[successor], &phi_defs[successor]);
+        const auto &predecessors = cfg.predecessors[successor];
+        const auto index = static_cast<size_t>(
+            std::find(predecessors.begin(), predecessors.end(), label) - predecessors.begin());
+        for (const auto &phi : phis[successor]) {
+          live.insert(phi.args[index]);
+        }
+      }
+      RegisterSet in = effects[label].reads;
+      in.insert_all(live, &effects[label].writes);
+      in.insert_all(phi_defs[label]);
+      changed = live_in[label].insert_all(in) || changed;
+    }
+  }
+  return live_in;
+}
+
+RegisterSet live_out_set(Label label, const ControlFlowGraph &cfg,
+                         const std::vector<std::vector<Phi>> &phis,
+                         const std::vector<RegisterSet> &live_in, size_t register_count) {
+  RegisterSet live(register_count);
+  for (const auto successor : cfg.successors[label]) {
+    RegisterSet defs(register_count);
+    for (const auto &phi : phis[successor]) {
+      defs.insert(phi.dst);
+    }
+    live.insert_all(live_in[successor], &defs);
+    const auto &predecessors = cfg.predecessors[successor];
+    const auto index = static_cast<size_t>(
+        std::find(predecessors.begin(), predecessors.end(), label) - predecessors.begin());
+    for (const auto &phi : phis[successor]) {
+      live.insert(phi.args[index]);
+    }
+  }
+  return live;
+}
+
+}  // namespace kai
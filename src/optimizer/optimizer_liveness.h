@@ -0,0 +1,58 @@
+#pragma once
+
+#include "optimizer_ssa.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace kai {
+
+// Fixed-size set of registers, for dataflow over every register of a
+// function at once.
+class RegisterSet {
+ public:
+  explicit RegisterSet(size_t size = 0) : words_((size + 63) / 64, 0) {}
+
+  bool contains(Bytecode::Register reg) const { return (words_[reg / 64] >> (reg % 64)) & 1; }
+  void insert(Bytecode::Register reg) { words_[reg / 64] |= uint64_t{1} << (reg % 64); }
+  void erase(Bytecode::Register reg) { words_[reg / 64] &= ~(uint64_t{1} << (reg % 64)); }
+
+  // Adds `other` minus `excluded`; returns whether this set grew.
+  bool insert_all(const RegisterSet &other, const RegisterSet *excluded = nullptr) {
+    bool grew = false;
+    for (size_t i = 0; i < words_.size(); ++i) {
+      const auto added = other.words_[i] & ~(excluded ? excluded->words_[i] : 0);
+      grew = grew || (added & ~words_[i]) != 0;
+      words_[i] |= added;
+    }
+    return grew;
+  }
+
+  template <typename Visit>
+  void for_each(Visit &&visit) const {
+    for (size_t i = 0; i < words_.size(); ++i) {
+      for (auto word = words_[i]; word != 0; word &= word - 1) {
+        visit(static_cast<Bytecode::Register>(i * 64 + __builtin_ctzll(word)));
+      }
+    }
+  }
+
+ private:
+  std::vector<uint64_t> words_;
+};
+
+// Live registers on entry to each block of `cfg`, over registers below
+// `register_count`. Phi destinations count as live on entry to their block
+// and phi arguments as live on exit from the matching predecessor; code
+// outside SSA form passes no phis.
+std::vector<RegisterSet> live_in_sets(const std::vector<Bytecode::BasicBlock> &blocks,
+                                      const ControlFlowGraph &cfg,
+                                      const std::vector<std::vector<Phi>> &phis,
+                                      size_t register_count);
+
+// Live registers on exit from `label`, derived from the live-in sets.
+RegisterSet live_out_set(Bytecode::Label label, const ControlFlowGraph &cfg,
+                         const std::vector<std::vector<Phi>> &phis,
+                         const std::vector<RegisterSet> &live_in, size_t register_count);
+
+}  // namespace kai
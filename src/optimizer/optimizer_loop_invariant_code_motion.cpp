@@ -1,270 +1,186 @@
 #include "../optimizer.h"
+#include "optimizer_analyses.h"
 #include "optimizer_internal.h"
 
+#include <algorithm>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
 namespace kai {
 
+using Label = Bytecode::Label;
 using Register = Bytecode::Register;
 using Type = Bytecode::Instruction::Type;
 
 namespace {
 
-// Returns source registers for hoistable instruction types.
-// Non-hoistable types (Call, ArrayStore, etc.) are never passed here.
-std::vector<Register> get_src_regs(const Bytecode::Instruction &instr) {
-  switch (instr.type()) {
-    case Type::Load:
-      return {};
-    case Type::Move:
-      return {derived_cast<const Bytecode::Instruction::Move &>(instr).src};
-    case Type::LessThan: {
-      const auto &lt = derived_cast<const Bytecode::Instruction::LessThan &>(instr);
-      return {lt.lhs, lt.rhs};
-    }
-    case Type::LessThanImmediate:
-      return {derived_cast<const Bytecode::Instruction::LessThanImmediate &>(instr).lhs};
-    case Type::GreaterThan: {
-      const auto &gt = derived_cast<const Bytecode::Instruction::GreaterThan &>(instr);
-      return {gt.lhs, gt.rhs};
-    }
-    case Type::GreaterThanImmediate:
-      return {derived_cast<const Bytecode::Instruction::GreaterThanImmediate &>(instr).lhs};
-    case Type::LessThanOrEqual: {
-      const auto &lte =
-          derived_cast<const Bytecode::Instruction::LessThanOrEqual &>(instr);
-      return {lte.lhs, lte.rhs};
-    }
-    case Type::LessThanOrEqualImmediate:
-      return {derived_cast<const Bytecode::Instruction::LessThanOrEqualImmediate &>(instr)
-                  .lhs};
-    case Type::GreaterThanOrEqual: {
-      const auto &gte =
-          derived_cast<const Bytecode::Instruction::GreaterThanOrEqual &>(instr);
-      return {gte.lhs, gte.rhs};
-    }
-    case Type::GreaterThanOrEqualImmediate:
-      return {derived_cast<const Bytecode::Instruction::GreaterThanOrEqualImmediate &>(instr)
-                  .lhs};
-    case Type::Equal: {
-      const auto &e = derived_cast<const Bytecode::Instruction::Equal &>(instr);
-      return {e.src1, e.src2};
-    }
-    case Type::EqualImmediate:
-      return {derived_cast<const Bytecode::Instruction::EqualImmediate &>(instr).src};
-    case Type::NotEqual: {
-      const auto &ne = derived_cast<const Bytecode::Instruction::NotEqual &>(instr);
-      return {ne.src1, ne.src2};
-    }
-    case Type::NotEqualImmediate:
-      return {derived_cast<const Bytecode::Instruction::NotEqualImmediate &>(instr).src};
-    case Type::Add: {
-      const auto &a = derived_cast<const Bytecode::Instruction::Add &>(instr);
-      return {a.src1, a.src2};
-    }
-    case Type::AddImmediate:
-      return {derived_cast<const Bytecode::Instruction::AddImmediate &>(instr).src};
-    case Type::Subtract: {
-      const auto &s = derived_cast<const Bytecode::Instruction::Subtract &>(instr);
-      return {s.src1, s.src2};
-    }
-    case Type::SubtractImmediate:
-      return {derived_cast<const Bytecode::Instruction::SubtractImmediate &>(instr).src};
-    case Type::Multiply: {
-      const auto &m = derived_cast<const Bytecode::Instruction::Multiply &>(instr);
-      return {m.src1, m.src2};
-    }
-    case Type::MultiplyImmediate:
-      return {derived_cast<const Bytecode::Instruction::MultiplyImmediate &>(instr).src};
-    case Type::Divide: {
-      const auto &d = derived_cast<const Bytecode::Instruction::Divide &>(instr);
-      return {d.src1, d.src2};
-    }
-    case Type::DivideImmediate:
-      return {derived_cast<const Bytecode::Instruction::DivideImmediate &>(instr).src};
-    case Type::Modulo: {
-      const auto &mo = derived_cast<const Bytecode::Instruction::Modulo &>(instr);
-      return {mo.src1, mo.src2};
-    }
-    case Type::ModuloImmediate:
-      return {derived_cast<const Bytecode::Instruction::ModuloImmediate &>(instr).src};
-    case Type::Negate:
-      return {derived_cast<const Bytecode::Instruction::Negate &>(instr).src};
-    case Type::LogicalNot:
-      return {derived_cast<const Bytecode::Instruction::LogicalNot &>(instr).src};
-    default:
-      return {};
-  }
-}
-
-bool is_hoistable(const Bytecode::Instruction &instr,
-                  const std::unordered_map<Register, size_t> &def_count) {
-  switch (instr.type()) {
-    case Type::Load:
-    case Type::Move:
-    case Type::Add:
-    case Type::AddImmediate:
-    case Type::Subtract:
-    case Type::SubtractImmediate:
-    case Type::Multiply:
-    case Type::MultiplyImmediate:
-    case Type::Divide:
-    case Type::DivideImmediate:
-    case Type::Modulo:
-    case Type::ModuloImmediate:
-    case Type::LessThan:
-    case Type::LessThanImmediate:
-    case Type::GreaterThan:
-    case Type::GreaterThanImmediate:
-    case Type::LessThanOrEqual:
-    case Type::LessThanOrEqualImmediate:
-    case Type::GreaterThanOrEqual:
-    case Type::GreaterThanOrEqualImmediate:
-    case Type::Equal:
-    case Type::EqualImmediate:
-    case Type::NotEqual:
-    case Type::NotEqualImmediate:
-    case Type::Negate:
-    case Type::LogicalNot:
-      break;
-    default:
-      return false;
-  }
-
-  auto dst_opt = get_dst_reg(instr);
-  if (!dst_opt) {
+// Division by zero is undefined, so a division may only run where it ran
+// before unless its divisor is a known non-zero constant.
+bool may_fault(const Bytecode::Instruction &instr) {
+  if (!has_opcode_flag(instr.type(), k_may_fault)) {
     return false;
   }
-
-  auto it = def_count.find(*dst_opt);
-  if (it == def_count.end() || it->second != 1) {
-    return false;
-  }
-
-  for (Register src : get_src_regs(instr)) {
-    if (def_count.count(src) > 0) {
-      return false;
-    }
-  }
-
-  return true;
+  const auto divisor = get_immediate(instr);
+  return !divisor || *divisor == Bytecode::Value{0};
 }
 
-}  // namespace
+class LoopHoister {
+ public:
+  LoopHoister(std::vector<Bytecode::BasicBlock> &blocks, const Bytecode::Function &function)
+      : blocks_(blocks), function_(function), next_register_(function.frame_size) {}
+
+  // `function_cfg` is the function's graph; instructions after a block's
+  // terminator, which it ignores, are dropped first.
+  PassResult run(const ControlFlowGraph &function_cfg) {
+    PassResult result;
+    for (const auto label : function_.blocks) {
+      result.changes += trim_after_terminator(blocks_[label]);
+    }
+    const ControlFlowGraph *graph = &function_cfg;
+    auto forest = find_loops(*graph);
+    const auto preheaders = insert_preheaders(blocks_, *graph, forest);
+    result.changes += preheaders;
+    result.control_flow_changed = preheaders != 0;
+    ControlFlowGraph rebuilt;
+    if (result.control_flow_changed) {
+      rebuilt = build_control_flow_graph(blocks_, function_.entry);
+      graph = &rebuilt;
+      forest = find_loops(rebuilt);
+    }
+    const auto &cfg = *graph;
 
-void BytecodeOptimizer::loop_invariant_code_motion(
-    std::vector<Bytecode::BasicBlock> &blocks) {
-  // Step 1: Detect back edges → collect (header H, tail S) loop pairs.
-  std::vector<std::pair<size_t, size_t>> loops;
-  for (size_t i = 0; i < blocks.size(); ++i) {
-    const auto &block = blocks[i];
-    if (block.instructions.empty()) continue;
-    const auto &last = *block.instructions.back();
-    if (last.type() == Type::Jump) {
-      const auto &j = derived_cast<const Bytecode::Instruction::Jump &>(last);
-      if (static_cast<size_t>(j.label) <= i) {
-        loops.push_back({static_cast<size_t>(j.label), i});
-      }
-    } else if (last.type() == Type::JumpConditional) {
-      const auto &jc =
-          derived_cast<const Bytecode::Instruction::JumpConditional &>(last);
-      if (static_cast<size_t>(jc.label1) <= i) {
-        loops.push_back({static_cast<size_t>(jc.label1), i});
-      }
-      if (static_cast<size_t>(jc.label2) <= i) {
-        loops.push_back({static_cast<size_t>(jc.label2), i});
-      }
-    } else if (last.type() == Type::JumpEqualImmediate) {
-      const auto &jump_equal_imm =
-          derived_cast<const Bytecode::Instruction::JumpEqualImmediate &>(last);
-      if (static_cast<size_t>(jump_equal_imm.label1) <= i) {
-        loops.push_back({static_cast<size_t>(jump_equal_imm.label1), i});
-      }
-      if (static_cast<size_t>(jump_equal_imm.label2) <= i) {
-        loops.push_back({static_cast<size_t>(jump_equal_imm.label2), i});
-      }
-    } else if (last.type() == Type::JumpGreaterThanImmediate) {
-      const auto &jump_greater_than_imm =
-          derived_cast<const Bytecode::Instruction::JumpGreaterThanImmediate &>(last);
-      if (static_cast<size_t>(jump_greater_than_imm.label1) <= i) {
-        loops.push_back({static_cast<size_t>(jump_greater_than_imm.label1), i});
-      }
-      if (static_cast<size_t>(jump_greater_than_imm.label2) <= i) {
-        loops.push_back({static_cast<size_t>(jump_greater_than_imm.label2), i});
-      }
-    } else if (last.type() == Type::JumpLessThanOrEqual) {
-      const auto &jump_lte =
-          derived_cast<const Bytecode::Instruction::JumpLessThanOrEqual &>(last);
-      if (static_cast<size_t>(jump_lte.label1) <= i) {
-        loops.push_back({static_cast<size_t>(jump_lte.label1), i});
+    for (const auto label : cfg.order) {
+      for (const auto &instr_ptr : blocks_[label].instructions) {
+        if (instr_ptr->type() == Type::AddressOf) {
+          pinned_.push_back(derived_cast<const Bytecode::Instruction::AddressOf &>(*instr_ptr).src);
+        }
       }
-      if (static_cast<size_t>(jump_lte.label2) <= i) {
-        loops.push_back({static_cast<size_t>(jump_lte.label2), i});
+    }
+
+    // Inner loops first, so code hoisted into an inner preheader can leave
+    // the enclosing loop too.
+    for (const auto &loop : forest.loops) {
+      if (loop.preheader != ControlFlowGraph::k_no_label) {
+        result.changes += hoist(cfg, loop);
       }
     }
+    return result;
   }
 
-  // Step 2: Hoist loop-invariant instructions to the pre-header for each loop.
-  for (const auto &[H, S] : loops) {
-    if (H == 0) continue;  // No pre-header exists.
-
-    auto &pre_header = blocks[H - 1];
+ private:
+  // Returns how many instructions moved to the preheader.
+  size_t hoist(const ControlFlowGraph &cfg, const Loop &loop) {
+    const std::vector<std::vector<Phi>> no_phis(blocks_.size());
+    const auto live_in = live_in_sets(blocks_, cfg, no_phis, next_register_);
 
-    // Build def_count: Register → number of definitions in loop blocks H..S.
     std::unordered_map<Register, size_t> def_count;
-    for (size_t b = H; b <= S; ++b) {
-      for (const auto &instr_ptr : blocks[b].instructions) {
-        auto dst_opt = get_dst_reg(*instr_ptr);
-        if (dst_opt) {
-          def_count[*dst_opt]++;
+    for (const auto label : loop.blocks) {
+      for (const auto &instr_ptr : blocks_[label].instructions) {
+        if (const auto dst = get_dst_reg(*instr_ptr)) {
+          ++def_count[*dst];
         }
       }
     }
-
-    // Iteratively hoist: scan H..S, hoist the first hoistable instruction
-    // found, update def_count, then restart from H.
+    const auto is_variant = [&def_count](Register reg) {
+      const auto it = def_count.find(reg);
+      return it != def_count.end() && it->second > 0;
+    };
+    // Whether every way out of the loop passes through `label`.
+    const auto runs_before_exit = [&](Label label) {
+      return !loop.exits.empty() &&
+             std::all_of(loop.exits.begin(), loop.exits.end(),
+                         [&](const auto &exit) { return cfg.dominates(label, exit.first); });
+    };
+    const auto live_after_loop = [&](Register reg) {
+      return std::any_of(loop.exits.begin(), loop.exits.end(),
+                         [&](const auto &exit) { return live_in[exit.second].contains(reg); });
+    };
+
+    size_t moved = 0;
     bool changed = true;
     while (changed) {
       changed = false;
-      for (size_t b = H; b <= S && !changed; ++b) {
-        auto &blk = blocks[b];
-        for (size_t j = 0; j < blk.instructions.size() && !changed; ++j) {
-          if (!is_hoistable(*blk.instructions[j], def_count)) continue;
-
-          // Remove from loop block.
-          auto instr_ptr = std::move(blk.instructions[j]);
-          blk.instructions.erase(blk.instructions.begin() +
-                                  static_cast<std::ptrdiff_t>(j));
-
-          // Update def_count for the hoisted instruction's dst.
-          auto dst_opt = get_dst_reg(*instr_ptr);
-          if (dst_opt) {
-            auto cnt_it = def_count.find(*dst_opt);
-            if (cnt_it != def_count.end()) {
-              if (--cnt_it->second == 0) def_count.erase(cnt_it);
-            }
+      for (const auto label : loop.blocks) {
+        auto &instrs = blocks_[label].instructions;
+        for (size_t i = 0; i < instrs.size(); ++i) {
+          auto &instr = *instrs[i];
+          const auto dst = get_dst_reg(instr);
+          if (!has_opcode_flag(instr.type(), k_pure) || !dst || def_count[*dst] != 1 ||
+              std::count(pinned_.begin(), pinned_.end(), *dst)) {
+            continue;
           }
-
-          // Insert before the terminator of the pre-header.
-          auto insert_it = pre_header.instructions.end();
-          if (!pre_header.instructions.empty()) {
-            const auto last_type = pre_header.instructions.back()->type();
-            if (last_type == Type::Jump || last_type == Type::JumpConditional ||
-                last_type == Type::JumpEqualImmediate ||
-                last_type == Type::JumpGreaterThanImmediate ||
-                last_type == Type::JumpLessThanOrEqual || last_type == Type::Return ||
-                last_type == Type::TailCall) {
-              --insert_it;
-            }
+          const auto srcs = get_src_regs(instr);
+          if (std::any_of(srcs.begin(), srcs.end(), is_variant) ||
+              (may_fault(instr) && !runs_before_exit(label))) {
+            continue;
           }
-          pre_header.instructions.insert(insert_it, std::move(instr_ptr));
 
+          // The loop neither reads the register's earlier value nor, when it
+          // may be left without running this, lets the code after it do so:
+          // the definition itself can move.
+          if (!live_in[loop.header].contains(*dst) &&
+              (runs_before_exit(label) || !live_after_loop(*dst))) {
+            insert_before_terminator(blocks_[loop.preheader], std::move(instrs[i]));
+            instrs.erase(instrs.begin() + static_cast<std::ptrdiff_t>(i));
+            --def_count[*dst];
+            --i;
+            ++moved;
+            changed = true;
+            continue;
+          }
+          // Otherwise compute into a fresh register in the preheader and
+          // copy from it here, which only pays for more than a copy.
+          if (instr.type() == Type::Load || instr.type() == Type::Move) {
+            continue;
+          }
+          const auto temporary = next_register_++;
+          auto hoisted = std::move(instrs[i]);
+          visit_registers(*hoisted, [](Register &) {}, [temporary](Register &reg) {
+            reg = temporary;
+          });
+          instrs[i] = std::make_unique<Bytecode::Instruction::Move>(*dst, temporary);
+          insert_before_terminator(blocks_[loop.preheader], std::move(hoisted));
+          ++moved;
           changed = true;
         }
       }
     }
+    return moved;
+  }
+
+  std::vector<Bytecode::BasicBlock> &blocks_;
+  const Bytecode::Function &function_;
+  Register next_register_;
+  std::vector<Register> pinned_;
+};
+
+}  // namespace
+
+PassResult BytecodeOptimizer::loop_invariant_code_motion(
+    std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
+  auto &analyses = this->analyses(blocks);
+  const auto functions = analyses.functions();
+  std::vector<bool> is_entry(blocks.size(), false);
+  for (const auto &function : functions) {
+    is_entry[function.entry] = true;
+  }
+  for (const auto &function : functions) {
+    // Hoisting reads the liveness of one function, which code shared with
+    // another does not have.
+    if (std::any_of(function.blocks.begin(), function.blocks.end(), [&](Label label) {
+          return label != function.entry && is_entry[label];
+        })) {
+      continue;
+    }
+    // Preheaders appended for one function leave the graphs of the others
+    // a block short, so those are built again.
+    const auto function_result = LoopHoister(blocks, function).run(analyses.cfg(function.entry));
+    analyses.invalidate(function_result);
+    result += function_result;
   }
+  return result;
 }
 
 }  // namespace kai
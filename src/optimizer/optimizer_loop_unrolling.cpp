@@ -0,0 +1,229 @@
+#include "../optimizer.h"
+#include "optimizer_analyses.h"
+#include "optimizer_induction_variables.h"
+#include "optimizer_internal.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+
+namespace {
+
+class LoopUnroller {
+ public:
+  LoopUnroller(std::vector<Bytecode::BasicBlock> &blocks, const Bytecode::Function &function,
+               size_t factor)
+      : blocks_(blocks), function_(function), factor_(factor) {}
+
+  PassResult run(const ControlFlowGraph &function_cfg) {
+    PassResult result;
+    auto cfg = function_cfg;
+
+    // Each loop unrolled changes the graph, so the loops are found again.
+    // An unrolled loop steps its variable in every copy, or is no loop any
+    // more, so it is not unrolled twice.
+    for (bool unrolled = true; unrolled;) {
+      unrolled = false;
+      const auto forest = find_loops(cfg);
+      for (size_t index = 0; index < forest.loops.size() && !unrolled; ++index) {
+        if (const auto copied = unroll(cfg, forest, index)) {
+          result.changes += copied;
+          result.control_flow_changed = true;
+          unrolled = true;
+        }
+      }
+      if (unrolled) {
+        cfg = build_control_flow_graph(blocks_, function_.entry);
+      }
+    }
+    return result;
+  }
+
+ private:
+  // Returns how many instructions the copies of the loop hold, or 0 when it
+  // is left alone.
+  size_t unroll(const ControlFlowGraph &cfg, const LoopForest &forest, size_t index) {
+    const auto &loop = forest.loops[index];
+    if (!loop.children.empty() || loop.preheader == ControlFlowGraph::k_no_label) {
+      return 0;
+    }
+    const auto variables = find_induction_variables(blocks_, cfg, forest, index);
+    const auto trip = find_trip_count(blocks_, cfg, loop, variables);
+    if (!trip || trip->count == 0) {
+      return 0;
+    }
+    size_t size = 0;
+    for (const auto label : loop.blocks) {
+      size += blocks_[label].instructions.size();
+    }
+
+    // A loop running at most `factor_` times unrolls completely. A longer
+    // one is laid out as the most copies up to `factor_` that divide its
+    // trip count, so only the first copy tests whether to go on.
+    size_t copies = 0;
+    const auto budget = BytecodeOptimizer::k_max_unrolled_instructions;
+    if (trip->count <= factor_ && trip->count * size <= budget) {
+      copies = trip->count;
+    } else {
+      for (auto candidate = std::min<size_t>(factor_, trip->count); candidate >= 2; --candidate) {
+        if (trip->count % candidate == 0 && candidate * size <= budget) {
+          copies = candidate;
+          break;
+        }
+      }
+    }
+    if (copies == 0) {
+      return 0;
+    }
+    const bool complete = copies == trip->count;
+
+    // Copy k of the loop, for k from 1, takes the blocks after copy k - 1;
+    // its header only runs what comes before the test, and shares its block
+    // with the copy of the body when nothing else enters the body. A
+    // complete unroll ends in one more copy of the header that leaves the
+    // loop.
+    const auto members = loop.blocks;
+    const auto member_index = [&members](Label label) {
+      return static_cast<size_t>(std::find(members.begin(), members.end(), label) -
+                                 members.begin());
+    };
+    const auto body = member_index(trip->body);
+    const bool merge_body = cfg.predecessors[trip->body].size() == 1;
+    std::vector<size_t> slots(members.size());
+    size_t slot_count = 1;
+    for (size_t member = 1; member < members.size(); ++member) {
+      slots[member] = merge_body && member == body ? 0 : slot_count++;
+    }
+    const auto base = blocks_.size();
+    const auto copy_label = [&](size_t k, size_t member) {
+      return static_cast<Label>(base + (k - 1) * slot_count + slots[member]);
+    };
+    const auto last_header = static_cast<Label>(base + (copies - 1) * slot_count);
+    blocks_.resize(last_header + (complete ? 1 : 0));
+    // Where the back edges of copy k go.
+    const auto next_header = [&](size_t k) {
+      if (k + 1 < copies) {
+        return copy_label(k + 1, 0);
+      }
+      return complete ? last_header : loop.header;
+    };
+    const auto retarget = [&](Bytecode::Instruction &instr, size_t k) {
+      visit_labels(
+          instr,
+          [&](Label &target) {
+            if (target == loop.header) {
+              target = next_header(k);
+            } else if (k > 0 && member_index(target) < members.size()) {
+              target = copy_label(k, member_index(target));
+            }
+          },
+          [](Label &) {});
+    };
+
+    // The copies of the header drop a compare only its JumpConditional reads.
+    auto &header = blocks_[loop.header].instructions;
+    const auto terminator = std::find_if(header.begin(), header.end(),
+                                         [](const auto &instr) { return is_terminator(*instr); });
+    const Bytecode::Instruction *dropped = nullptr;
+    if (trip->test != terminator->get()) {
+      const auto cond = *get_dst_reg(*trip->test);
+      const auto reads_cond = [cond](const auto &instr) {
+        const auto srcs = get_src_regs(*instr);
+        return std::count(srcs.begin(), srcs.end(), cond) != 0;
+      };
+      bool private_cond = true;
+      for (const auto label : cfg.order) {
+        for (const auto &instr_ptr : blocks_[label].instructions) {
+          private_cond = private_cond && (instr_ptr == *terminator || !reads_cond(instr_ptr));
+        }
+      }
+      if (private_cond) {
+        dropped = trip->test;
+      }
+    }
+    const auto copy_header = [&](Bytecode::BasicBlock &copy) {
+      for (auto it = header.begin(); it != terminator; ++it) {
+        if (it->get() != dropped) {
+          copy.instructions.push_back(clone_instruction(**it));
+        }
+      }
+    };
+
+    std::vector<size_t> order{0};
+    if (merge_body) {
+      order.push_back(body);
+    }
+    for (size_t member = 1; member < members.size(); ++member) {
+      if (!merge_body || member != body) {
+        order.push_back(member);
+      }
+    }
+    size_t copied = 0;
+    for (size_t k = 1; k < copies; ++k) {
+      for (const auto member : order) {
+        auto &copy = blocks_[copy_label(k, member)];
+        const auto before = copy.instructions.size();
+        if (member == 0) {
+          copy_header(copy);
+          if (!merge_body) {
+            copy.append<Bytecode::Instruction::Jump>(copy_label(k, body));
+          }
+        } else {
+          for (const auto &instr_ptr : blocks_[members[member]].instructions) {
+            auto instr = clone_instruction(*instr_ptr);
+            retarget(*instr, k);
+            copy.instructions.push_back(std::move(instr));
+          }
+        }
+        copied += copy.instructions.size() - before;
+      }
+    }
+    if (complete) {
+      copy_header(blocks_[last_header]);
+      blocks_[last_header].append<Bytecode::Instruction::Jump>(trip->exit);
+      copied += blocks_[last_header].instructions.size();
+    }
+
+    // The original loop becomes copy 0. A complete unroll knows its first
+    // test passes.
+    for (size_t member = 1; member < members.size(); ++member) {
+      for (auto &instr_ptr : blocks_[members[member]].instructions) {
+        retarget(*instr_ptr, 0);
+      }
+    }
+    if (complete) {
+      *terminator = std::make_unique<Bytecode::Instruction::Jump>(trip->body);
+      if (dropped) {
+        header.erase(std::find_if(header.begin(), header.end(),
+                                  [dropped](const auto &instr) { return instr.get() == dropped; }));
+      }
+    }
+    return std::max<size_t>(copied, 1);
+  }
+
+  std::vector<Bytecode::BasicBlock> &blocks_;
+  const Bytecode::Function &function_;
+  size_t factor_;
+};
+
+}  // namespace
+
+void BytecodeOptimizer::set_unroll_factor(size_t factor) {
+  unroll_factor_ = factor;
+}
+
+PassResult BytecodeOptimizer::unroll_loops(std::vector<Bytecode::BasicBlock> &blocks) {
+  if (unroll_factor_ < 2) {
+    return {};
+  }
+  return transform_loops(blocks, analyses(blocks),
+                         [&](const Bytecode::Function &function, const ControlFlowGraph &cfg,
+                             const LoopForest &) {
+                           return LoopUnroller(blocks, function, unroll_factor_).run(cfg);
+                         });
+}
+
+}  // namespace kai
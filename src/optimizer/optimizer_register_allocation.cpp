@@ -0,0 +1,253 @@
+#include "../optimizer.h"
+#include "optimizer_analyses.h"
+#include "optimizer_internal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+using Type = Bytecode::Instruction::Type;
+
+namespace {
+
+constexpr Register k_unassigned = ~Register{0};
+
+std::vector<Register> *param_registers(Bytecode::Instruction &instr) {
+  if (instr.type() == Type::Call) {
+    return &derived_cast<Bytecode::Instruction::Call &>(instr).param_registers;
+  }
+  if (instr.type() == Type::TailCall) {
+    return &derived_cast<Bytecode::Instruction::TailCall &>(instr).param_registers;
+  }
+  return nullptr;
+}
+
+// Assigns each register of `function` a frame slot, indexed by register;
+// registers the function does not mention stay k_unassigned. Two registers
+// share a slot only when neither is live where the other is written, and a
+// Move's destination takes its source's slot when it can, so the copy
+// disappears.
+//
+// Some registers are read through something other than their uses, so they
+// keep a slot to themselves: one whose address is taken, since LoadIndirect
+// reads it through a pointer, and one read before it is written, since that
+// read must see the zero the call stored.
+std::vector<Register> assign_slots(const std::vector<Bytecode::BasicBlock> &blocks,
+                                   const Bytecode::Function &function,
+                                   AnalysisCache &analyses) {
+  const size_t register_count = function.frame_size;
+  const auto &cfg = analyses.cfg(function.entry);
+  const std::vector<std::vector<Phi>> no_phis(blocks.size());
+  const auto &live_in = analyses.live_in(function);
+
+  std::vector<std::vector<Register>> interferes(register_count);
+  const auto interfere = [&interferes](Register a, Register b) {
+    interferes[a].push_back(b);
+    interferes[b].push_back(a);
+  };
+  RegisterSet exclusive = live_in[cfg.entry];
+  for (const auto param : function.parameter_registers) {
+    exclusive.erase(param);
+  }
+  std::vector<bool> mentioned(register_count, false);
+  const auto mention = [&mentioned](Register reg) { mentioned[reg] = true; };
+  for (const auto label : cfg.order) {
+    auto live = live_out_set(label, cfg, no_phis, live_in, register_count);
+    const auto &instrs = blocks[label].instructions;
+    for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+      const auto &instr = **it;
+      const auto copied = instr.type() == Type::Move
+                              ? std::optional<Register>(
+                                    derived_cast<const Bytecode::Instruction::Move &>(instr).src)
+                              : std::nullopt;
+      if (const auto dst = get_dst_reg(instr)) {
+        live.for_each([&](Register other) {
+          if (other != *dst && other != copied) {
+            interfere(*dst, other);
+          }
+        });
+        live.erase(*dst);
+        mention(*dst);
+      }
+      for (const auto src : get_src_regs(instr)) {
+        live.insert(src);
+        mention(src);
+      }
+      if (instr.type() == Type::AddressOf) {
+        exclusive.insert(derived_cast<const Bytecode::Instruction::AddressOf &>(instr).src);
+      }
+    }
+  }
+  // The call writes every parameter at once.
+  for (const auto param : function.parameter_registers) {
+    mention(param);
+    for (const auto other : function.parameter_registers) {
+      if (other != param) {
+        interfere(param, other);
+      }
+    }
+  }
+
+  std::vector<Register> slot(register_count, k_unassigned);
+  Register first_shared = 0;
+  for (Register reg = 0; reg < register_count; ++reg) {
+    if (mentioned[reg] && exclusive.contains(reg)) {
+      slot[reg] = first_shared++;
+    }
+  }
+
+  std::vector<bool> taken;
+  const auto assign = [&](Register reg, std::optional<Register> preferred) {
+    if (slot[reg] != k_unassigned) {
+      return;
+    }
+    // Some slot up to one past the neighbors is free.
+    taken.assign(first_shared + interferes[reg].size() + 1, false);
+    for (const auto other : interferes[reg]) {
+      if (slot[other] < taken.size()) {
+        taken[slot[other]] = true;
+      }
+    }
+    if (preferred && slot[*preferred] != k_unassigned && slot[*preferred] >= first_shared &&
+        (slot[*preferred] >= taken.size() || !taken[slot[*preferred]])) {
+      slot[reg] = slot[*preferred];
+      return;
+    }
+    Register free = first_shared;
+    while (taken[free]) {
+      ++free;
+    }
+    slot[reg] = free;
+  };
+
+  // Parameters first, then registers in the order they are written.
+  for (const auto param : function.parameter_registers) {
+    assign(param, std::nullopt);
+  }
+  for (const auto label : cfg.order) {
+    for (const auto &instr_ptr : blocks[label].instructions) {
+      if (const auto dst = get_dst_reg(*instr_ptr)) {
+        assign(*dst, instr_ptr->type() == Type::Move
+                         ? std::optional<Register>(
+                               derived_cast<const Bytecode::Instruction::Move &>(*instr_ptr).src)
+                         : std::nullopt);
+      }
+    }
+  }
+  for (Register reg = 0; reg < register_count; ++reg) {
+    if (mentioned[reg]) {
+      assign(reg, std::nullopt);
+    }
+  }
+  return slot;
+}
+
+// Renumbers every register in the program to a dense range, for code where
+// the functions share blocks and so cannot be given frames of their own.
+// Returns how many registers got a new number.
+size_t renumber_densely(std::vector<Bytecode::BasicBlock> &blocks) {
+  std::vector<Register> regs;
+  const auto track = [&regs](Register &reg) { regs.push_back(reg); };
+  for (auto &block : blocks) {
+    for (auto &instr_ptr : block.instructions) {
+      visit_registers(*instr_ptr, track, track);
+      if (auto *params = param_registers(*instr_ptr)) {
+        std::for_each(params->begin(), params->end(), track);
+      }
+    }
+  }
+  std::sort(regs.begin(), regs.end());
+  regs.erase(std::unique(regs.begin(), regs.end()), regs.end());
+
+  std::unordered_map<Register, Register> mapping;
+  mapping.reserve(regs.size());
+  size_t renamed = 0;
+  for (size_t i = 0; i < regs.size(); ++i) {
+    mapping[regs[i]] = static_cast<Register>(i);
+    renamed += regs[i] != i;
+  }
+  const auto remap = [&mapping](Register &reg) { reg = mapping.at(reg); };
+  for (auto &block : blocks) {
+    for (auto &instr_ptr : block.instructions) {
+      visit_registers(*instr_ptr, remap, remap);
+      if (auto *params = param_registers(*instr_ptr)) {
+        std::for_each(params->begin(), params->end(), remap);
+      }
+    }
+  }
+  return renamed;
+}
+
+}  // namespace
+
+PassResult BytecodeOptimizer::allocate_registers(std::vector<Bytecode::BasicBlock> &blocks) {
+  auto &analyses = this->analyses(blocks);
+  PassResult result;
+  for (auto &block : blocks) {
+    result.changes += trim_after_terminator(block);
+  }
+  // Liveness must not see registers only the dropped code read.
+  analyses.invalidate(result);
+  const auto &functions = analyses.functions();
+
+  std::vector<bool> owned(blocks.size(), false);
+  for (const auto &function : functions) {
+    for (const auto label : function.blocks) {
+      if (owned[label]) {
+        result.changes += renumber_densely(blocks);
+        return result;
+      }
+      owned[label] = true;
+    }
+  }
+
+  // Every analysis is read before the first rename.
+  std::unordered_map<Label, std::vector<Register>> slots;
+  for (const auto &function : functions) {
+    slots.emplace(function.entry, assign_slots(blocks, function, analyses));
+  }
+  for (const auto &function : functions) {
+    const auto &slot = slots.at(function.entry);
+    const auto rename = [&slot, &result](Register &reg) {
+      assert(slot[reg] != k_unassigned);
+      result.changes += slot[reg] != reg;
+      reg = slot[reg];
+    };
+    for (const auto label : function.blocks) {
+      auto &instrs = blocks[label].instructions;
+      for (auto &instr_ptr : instrs) {
+        visit_registers(*instr_ptr, rename, rename);
+      }
+      result.changes += std::erase_if(instrs, [](const auto &instr_ptr) {
+        if (instr_ptr->type() != Type::Move) {
+          return false;
+        }
+        const auto &move = derived_cast<const Bytecode::Instruction::Move &>(*instr_ptr);
+        return move.dst == move.src;
+      });
+    }
+  }
+
+  // Parameter registers name slots in the callee's frame.
+  for (auto &block : blocks) {
+    for (auto &instr_ptr : block.instructions) {
+      Label callee = 0;
+      visit_labels(*instr_ptr, [](Label &) {}, [&callee](Label &label) { callee = label; });
+      if (auto *params = param_registers(*instr_ptr)) {
+        const auto &slot = slots.at(callee);
+        for (auto &param : *params) {
+          param = slot[param];
+        }
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace kai
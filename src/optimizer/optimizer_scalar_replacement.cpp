@@ -0,0 +1,312 @@
+#include "../optimizer.h"
+#include "optimizer_analyses.h"
+#include "optimizer_internal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+using Register = Bytecode::Register;
+using Type = Bytecode::Instruction::Type;
+
+namespace {
+
+// An array or struct created in a function, and the registers that take
+// over its elements or fields.
+struct Aggregate {
+  // Field names of a struct; empty for an array.
+  std::vector<std::string> fields;
+  size_t size = 0;
+  std::vector<Register> scalars;
+};
+
+// A register holding an aggregate's handle: the one its creation writes, or
+// a copy of another. `def` is the only instruction writing it.
+struct Handle {
+  Register aggregate = 0;
+  Label block = 0;
+  const Bytecode::Instruction *def = nullptr;
+};
+
+// The element or field index `instr` reads or writes in the aggregate held
+// by `reg`, when that is all it does with the handle.
+std::optional<size_t> access_index(const Bytecode::Instruction &instr, Register reg,
+                                   const Aggregate &aggregate) {
+  const auto field_index = [&aggregate](const std::string &field) -> std::optional<size_t> {
+    const auto it = std::find(aggregate.fields.begin(), aggregate.fields.end(), field);
+    if (it == aggregate.fields.end()) {
+      return std::nullopt;
+    }
+    return static_cast<size_t>(it - aggregate.fields.begin());
+  };
+  switch (instr.type()) {
+    case Type::ArrayLoadImmediate: {
+      const auto &load = derived_cast<const Bytecode::Instruction::ArrayLoadImmediate &>(instr);
+      // An index out of range keeps its error.
+      if (load.array != reg || !aggregate.fields.empty() || load.index >= aggregate.size) {
+        return std::nullopt;
+      }
+      return static_cast<size_t>(load.index);
+    }
+    case Type::StructLoad: {
+      const auto &load = derived_cast<const Bytecode::Instruction::StructLoad &>(instr);
+      if (load.object != reg) {
+        return std::nullopt;
+      }
+      return field_index(load.field);
+    }
+    case Type::StructStore: {
+      const auto &store = derived_cast<const Bytecode::Instruction::StructStore &>(instr);
+      if (store.object != reg || store.value == reg) {
+        return std::nullopt;
+      }
+      return field_index(store.field);
+    }
+    default:
+      return std::nullopt;
+  }
+}
+
+// The aggregate `instr` creates, when it is an array or struct creation.
+std::optional<Aggregate> created_aggregate(const Bytecode::Instruction &instr) {
+  Aggregate aggregate;
+  switch (instr.type()) {
+    case Type::ArrayCreate:
+      aggregate.size =
+          derived_cast<const Bytecode::Instruction::ArrayCreate &>(instr).elements.size();
+      return aggregate;
+    case Type::ArrayLiteralCreate:
+      aggregate.size =
+          derived_cast<const Bytecode::Instruction::ArrayLiteralCreate &>(instr).elements.size();
+      return aggregate;
+    case Type::StructCreate:
+      for (const auto &[field, value] :
+           derived_cast<const Bytecode::Instruction::StructCreate &>(instr).fields) {
+        aggregate.fields.push_back(field);
+      }
+      break;
+    case Type::StructLiteralCreate:
+      for (const auto &[field, value] :
+           derived_cast<const Bytecode::Instruction::StructLiteralCreate &>(instr).fields) {
+        aggregate.fields.push_back(field);
+      }
+      break;
+    default:
+      return std::nullopt;
+  }
+  aggregate.size = aggregate.fields.size();
+  auto sorted = aggregate.fields;
+  std::sort(sorted.begin(), sorted.end());
+  // Which of two same-named fields a load sees is the heap's business.
+  if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+    return std::nullopt;
+  }
+  return aggregate;
+}
+
+class ScalarReplacer {
+ public:
+  ScalarReplacer(std::vector<Bytecode::BasicBlock> &blocks, const Bytecode::Function &function)
+      : blocks_(blocks), next_register_(static_cast<Register>(function.frame_size)) {}
+
+  PassResult run(const ControlFlowGraph &cfg) {
+    PassResult result;
+    find_aggregates(cfg);
+    if (aggregates_.empty()) {
+      return result;
+    }
+    for (auto &[reg, aggregate] : aggregates_) {
+      for (size_t i = 0; i < aggregate.size; ++i) {
+        aggregate.scalars.push_back(next_register_++);
+      }
+    }
+    for (const auto label : cfg.order) {
+      auto &instrs = blocks_[label].instructions;
+      std::vector<std::unique_ptr<Bytecode::Instruction>> rewritten;
+      rewritten.reserve(instrs.size());
+      for (auto &instr_ptr : instrs) {
+        if (const auto dst = get_dst_reg(*instr_ptr); dst && handles_.contains(*dst)) {
+          // Copies of a handle go away with it.
+          if (instr_ptr->type() != Type::Move) {
+            create_scalars(*instr_ptr, aggregates_.at(*dst).scalars, rewritten);
+          }
+          continue;
+        }
+        const auto srcs = get_src_regs(*instr_ptr);
+        const auto handle = std::find_if(srcs.begin(), srcs.end(),
+                                         [&](Register src) { return handles_.contains(src); });
+        if (handle == srcs.end()) {
+          rewritten.push_back(std::move(instr_ptr));
+          continue;
+        }
+        const auto &aggregate = aggregates_.at(handles_.at(*handle).aggregate);
+        const auto scalar = aggregate.scalars[*access_index(*instr_ptr, *handle, aggregate)];
+        if (instr_ptr->type() == Type::StructStore) {
+          const auto &store = derived_cast<const Bytecode::Instruction::StructStore &>(*instr_ptr);
+          rewritten.push_back(std::make_unique<Bytecode::Instruction::Move>(scalar, store.value));
+        } else {
+          rewritten.push_back(
+              std::make_unique<Bytecode::Instruction::Move>(*get_dst_reg(*instr_ptr), scalar));
+        }
+      }
+      instrs = std::move(rewritten);
+    }
+    result.changes = aggregates_.size();
+    return result;
+  }
+
+ private:
+  // Keeps the aggregates whose handle never leaves the function: each
+  // register holding it is written once, ahead of every read of it, and
+  // every read loads or stores one of its elements or fields, or copies the
+  // handle to another such register.
+  void find_aggregates(const ControlFlowGraph &cfg) {
+    std::unordered_map<Register, size_t> def_count;
+    for (const auto label : cfg.order) {
+      for (const auto &instr_ptr : blocks_[label].instructions) {
+        if (const auto dst = get_dst_reg(*instr_ptr)) {
+          ++def_count[*dst];
+        }
+      }
+    }
+    for (const auto label : cfg.order) {
+      for (const auto &instr_ptr : blocks_[label].instructions) {
+        const auto dst = get_dst_reg(*instr_ptr);
+        if (!dst || def_count[*dst] != 1) {
+          continue;
+        }
+        if (auto aggregate = created_aggregate(*instr_ptr)) {
+          aggregates_.emplace(*dst, std::move(*aggregate));
+          handles_.emplace(*dst, Handle{*dst, label, instr_ptr.get()});
+        }
+      }
+    }
+    // Copies of copies are found in later sweeps.
+    for (bool grew = !handles_.empty(); grew;) {
+      grew = false;
+      for (const auto label : cfg.order) {
+        for (const auto &instr_ptr : blocks_[label].instructions) {
+          if (instr_ptr->type() != Type::Move) {
+            continue;
+          }
+          const auto &move = derived_cast<const Bytecode::Instruction::Move &>(*instr_ptr);
+          const auto source = handles_.find(move.src);
+          if (source != handles_.end() && def_count[move.dst] == 1 &&
+              !handles_.contains(move.dst)) {
+            handles_.emplace(move.dst, Handle{source->second.aggregate, label, instr_ptr.get()});
+            grew = true;
+          }
+        }
+      }
+    }
+
+    std::vector<Register> escaped;
+    for (const auto label : cfg.order) {
+      const auto &instrs = blocks_[label].instructions;
+      for (auto it = instrs.begin(); it != instrs.end(); ++it) {
+        const auto srcs = get_src_regs(**it);
+        for (const auto src : srcs) {
+          const auto handle = handles_.find(src);
+          if (handle == handles_.end()) {
+            continue;
+          }
+          const auto &def = handle->second;
+          const bool after_def =
+              label == def.block
+                  ? std::any_of(instrs.begin(), it,
+                                [&](const auto &instr) { return instr.get() == def.def; })
+                  : cfg.dominates(def.block, label);
+          const auto dst = get_dst_reg(**it);
+          const bool copies = (*it)->type() == Type::Move && handles_.contains(*dst);
+          if (!after_def || std::count(srcs.begin(), srcs.end(), src) != 1 ||
+              (!copies && !access_index(**it, src, aggregates_.at(def.aggregate)))) {
+            escaped.push_back(def.aggregate);
+          }
+        }
+      }
+    }
+    for (const auto aggregate : escaped) {
+      aggregates_.erase(aggregate);
+    }
+    std::erase_if(handles_,
+                  [&](const auto &entry) { return !aggregates_.contains(entry.second.aggregate); });
+  }
+
+  // Replaces the creation of an aggregate with copies of its elements or
+  // fields into `scalars`.
+  static void create_scalars(const Bytecode::Instruction &create,
+                             const std::vector<Register> &scalars,
+                             std::vector<std::unique_ptr<Bytecode::Instruction>> &out) {
+    switch (create.type()) {
+      case Type::ArrayCreate: {
+        const auto &elements =
+            derived_cast<const Bytecode::Instruction::ArrayCreate &>(create).elements;
+        for (size_t i = 0; i < elements.size(); ++i) {
+          out.push_back(std::make_unique<Bytecode::Instruction::Move>(scalars[i], elements[i]));
+        }
+        break;
+      }
+      case Type::ArrayLiteralCreate: {
+        const auto &elements =
+            derived_cast<const Bytecode::Instruction::ArrayLiteralCreate &>(create).elements;
+        for (size_t i = 0; i < elements.size(); ++i) {
+          out.push_back(std::make_unique<Bytecode::Instruction::Load>(scalars[i], elements[i]));
+        }
+        break;
+      }
+      case Type::StructCreate: {
+        const auto &fields =
+            derived_cast<const Bytecode::Instruction::StructCreate &>(create).fields;
+        for (size_t i = 0; i < fields.size(); ++i) {
+          out.push_back(
+              std::make_unique<Bytecode::Instruction::Move>(scalars[i], fields[i].second));
+        }
+        break;
+      }
+      case Type::StructLiteralCreate: {
+        const auto &fields =
+            derived_cast<const Bytecode::Instruction::StructLiteralCreate &>(create).fields;
+        for (size_t i = 0; i < fields.size(); ++i) {
+          out.push_back(
+              std::make_unique<Bytecode::Instruction::Load>(scalars[i], fields[i].second));
+        }
+        break;
+      }
+      default:
+        assert(false && "not an aggregate creation");
+    }
+  }
+
+  std::vector<Bytecode::BasicBlock> &blocks_;
+  Register next_register_;
+  // Keyed by the register the creation writes.
+  std::unordered_map<Register, Aggregate> aggregates_;
+  std::unordered_map<Register, Handle> handles_;
+};
+
+}  // namespace
+
+PassResult BytecodeOptimizer::scalar_replacement(std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
+  auto &analyses = this->analyses(blocks);
+  const auto functions = analyses.functions();
+  for (const auto &function : functions) {
+    // A pointer may read or overwrite the handle behind the pass's back.
+    if (shares_blocks(functions, function) || takes_address(blocks, function)) {
+      continue;
+    }
+    const auto function_result = ScalarReplacer(blocks, function).run(analyses.cfg(function.entry));
+    analyses.invalidate(function_result);
+    result += function_result;
+  }
+  return result;
+}
+
+}  // namespace kai
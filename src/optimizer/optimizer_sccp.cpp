@@ -0,0 +1,353 @@
+#include "../optimizer.h"
+#include "optimizer_internal.h"
+#include "optimizer_ssa.h"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+using Type = Bytecode::Instruction::Type;
+using Value = Bytecode::Value;
+
+namespace {
+
+// Lattice of a register's value: not yet known to be reached (Top), always
+// the same constant, or varying (Bottom).
+struct LatticeValue {
+  enum class State { Top, Constant, Bottom };
+
+  State state = State::Top;
+  Value value = 0;
+
+  static LatticeValue constant(Value value) { return {State::Constant, value}; }
+  static LatticeValue bottom() { return {State::Bottom, 0}; }
+
+  bool is_constant() const { return state == State::Constant; }
+};
+
+LatticeValue meet(LatticeValue a, LatticeValue b) {
+  if (a.state == LatticeValue::State::Top) {
+    return b;
+  }
+  if (b.state == LatticeValue::State::Top) {
+    return a;
+  }
+  if (a.is_constant() && b.is_constant() && a.value == b.value) {
+    return a;
+  }
+  return LatticeValue::bottom();
+}
+
+// Whether the instruction's result depends on nothing but its operands, so
+// it can be evaluated on constants.
+bool is_foldable(Type type) {
+  return has_opcode_flag(type, k_pure);
+}
+
+// Computes `type` the way the interpreter does, on unsigned 64-bit values.
+// Unary opcodes ignore `rhs`. Division by zero is left to run.
+std::optional<Value> fold(Type type, Value lhs, Value rhs) {
+  switch (type) {
+    case Type::Move:
+    case Type::Load:
+      return lhs;
+    case Type::LessThan:
+    case Type::LessThanImmediate:
+      return lhs < rhs ? 1 : 0;
+    case Type::GreaterThan:
+    case Type::GreaterThanImmediate:
+      return lhs > rhs ? 1 : 0;
+    case Type::LessThanOrEqual:
+    case Type::LessThanOrEqualImmediate:
+      return lhs <= rhs ? 1 : 0;
+    case Type::GreaterThanOrEqual:
+    case Type::GreaterThanOrEqualImmediate:
+      return lhs >= rhs ? 1 : 0;
+    case Type::Equal:
+    case Type::EqualImmediate:
+      return lhs == rhs ? 1 : 0;
+    case Type::NotEqual:
+    case Type::NotEqualImmediate:
+      return lhs != rhs ? 1 : 0;
+    case Type::Add:
+    case Type::AddImmediate:
+      return lhs + rhs;
+    case Type::Subtract:
+    case Type::SubtractImmediate:
+      return lhs - rhs;
+    case Type::Multiply:
+    case Type::MultiplyImmediate:
+      return lhs * rhs;
+    case Type::Divide:
+    case Type::DivideImmediate:
+      return rhs == 0 ? std::nullopt : std::optional<Value>(lhs / rhs);
+    case Type::Modulo:
+    case Type::ModuloImmediate:
+      return rhs == 0 ? std::nullopt : std::optional<Value>(lhs % rhs);
+    case Type::Negate:
+      return Value{0} - lhs;
+    case Type::LogicalNot:
+      return lhs == 0 ? 1 : 0;
+    default:
+      return std::nullopt;
+  }
+}
+
+// Value of a foldable instruction's result, or of a conditional branch's
+// condition, given the values of its operands.
+LatticeValue evaluate(const Bytecode::Instruction &instr,
+                      const std::vector<LatticeValue> &values) {
+  std::vector<Value> operands;
+  bool unknown = false;
+  for (const auto src : get_src_regs(instr)) {
+    const auto &value = values[src];
+    if (value.state == LatticeValue::State::Bottom) {
+      return LatticeValue::bottom();
+    }
+    unknown = unknown || value.state == LatticeValue::State::Top;
+    operands.push_back(value.value);
+  }
+  if (unknown) {
+    return {};
+  }
+  if (const auto immediate = get_immediate(instr)) {
+    operands.push_back(*immediate);
+  }
+  operands.resize(2, 0);
+  if (instr.type() == Type::JumpConditional) {
+    return LatticeValue::constant(operands[0]);
+  }
+  // A compare-and-branch folds to the value of its compare.
+  const auto folded =
+      fold(branch_compare_type(instr.type()).value_or(instr.type()), operands[0], operands[1]);
+  return folded ? LatticeValue::constant(*folded) : LatticeValue::bottom();
+}
+
+bool is_conditional_branch(Type type) {
+  return type == Type::JumpConditional || branch_compare_type(type).has_value();
+}
+
+// Propagates constants through one function in SSA form. Returns how many
+// blocks, phis, instructions and branches folded.
+size_t propagate_constants(std::vector<Bytecode::BasicBlock> &blocks, SsaFunction &ssa,
+                         const Bytecode::Function &function, bool is_tail_called) {
+  const auto &cfg = ssa.cfg;
+
+  // A register read before it is written holds a parameter or, in a frame
+  // set up by Call, zero. TailCall leaves the caller's values behind, and
+  // registers whose address is taken keep their own number for every write.
+  std::vector<LatticeValue> values(ssa.next_register);
+  for (Register reg = 0; reg < ssa.first_value; ++reg) {
+    values[reg] = is_tail_called ? LatticeValue::bottom() : LatticeValue::constant(0);
+  }
+  for (const auto reg : function.parameter_registers) {
+    values[reg] = LatticeValue::bottom();
+  }
+  std::vector<std::vector<Label>> users(ssa.next_register);
+  const auto add_user = [&users](Register reg, Label label) {
+    if (users[reg].empty() || users[reg].back() != label) {
+      users[reg].push_back(label);
+    }
+  };
+  for (const auto label : cfg.order) {
+    for (const auto &phi : ssa.phis[label]) {
+      for (const auto arg : phi.args) {
+        add_user(arg, label);
+      }
+    }
+    for (const auto &instr_ptr : blocks[label].instructions) {
+      for (const auto src : get_src_regs(*instr_ptr)) {
+        add_user(src, label);
+      }
+      if (const auto dst = get_dst_reg(*instr_ptr); dst && *dst < ssa.first_value) {
+        values[*dst] = LatticeValue::bottom();
+      }
+    }
+  }
+
+  // Wegman and Zadeck: a block is evaluated once an edge into it is known to
+  // execute, and again whenever a value it reads drops.
+  std::vector<bool> executable(blocks.size(), false);
+  std::vector<std::vector<bool>> executable_edges(blocks.size());
+  for (const auto label : cfg.order) {
+    executable_edges[label].assign(cfg.predecessors[label].size(), false);
+  }
+  std::vector<Label> worklist = {cfg.entry};
+  std::vector<bool> queued(blocks.size(), false);
+  queued[cfg.entry] = true;
+  const auto enqueue = [&](Label label) {
+    if (!queued[label]) {
+      queued[label] = true;
+      worklist.push_back(label);
+    }
+  };
+  const auto mark_edge = [&](Label from, Label to) {
+    const auto &predecessors = cfg.predecessors[to];
+    const auto index =
+        std::find(predecessors.begin(), predecessors.end(), from) - predecessors.begin();
+    if (!executable_edges[to][index]) {
+      executable_edges[to][index] = true;
+      enqueue(to);
+    }
+  };
+  const auto lower = [&](Register reg, LatticeValue value) {
+    auto &current = values[reg];
+    const auto lowered = meet(current, value);
+    if (lowered.state == current.state && lowered.value == current.value) {
+      return;
+    }
+    current = lowered;
+    for (const auto user : users[reg]) {
+      if (executable[user]) {
+        enqueue(user);
+      }
+    }
+  };
+
+  while (!worklist.empty()) {
+    const auto label = worklist.back();
+    worklist.pop_back();
+    queued[label] = false;
+    executable[label] = true;
+    for (const auto &phi : ssa.phis[label]) {
+      LatticeValue value;
+      for (size_t i = 0; i < phi.args.size(); ++i) {
+        if (executable_edges[label][i]) {
+          value = meet(value, values[phi.args[i]]);
+        }
+      }
+      lower(phi.dst, value);
+    }
+    for (const auto &instr_ptr : blocks[label].instructions) {
+      const auto &instr = *instr_ptr;
+      if (const auto dst = get_dst_reg(instr)) {
+        lower(*dst, is_foldable(instr.type()) ? evaluate(instr, values) : LatticeValue::bottom());
+      }
+      if (!is_terminator(instr)) {
+        continue;
+      }
+      const auto targets = get_jump_targets(instr);
+      if (is_conditional_branch(instr.type())) {
+        // An unknown condition is taken as varying, so every edge out of a
+        // reached block stays in the graph.
+        const auto condition = evaluate(instr, values);
+        if (condition.is_constant()) {
+          mark_edge(label, condition.value != 0 ? targets[0] : targets[1]);
+          continue;
+        }
+      }
+      for (const auto target : targets) {
+        mark_edge(label, target);
+      }
+    }
+  }
+
+  size_t changes = 0;
+  for (const auto label : cfg.order) {
+    if (!executable[label]) {
+      ++changes;
+      continue;
+    }
+    for (const auto &phi : ssa.phis[label]) {
+      changes += values[phi.dst].is_constant();
+    }
+    for (const auto &instr_ptr : blocks[label].instructions) {
+      const auto dst = get_dst_reg(*instr_ptr);
+      changes += dst && instr_ptr->type() != Type::Load && is_foldable(instr_ptr->type()) &&
+                 values[*dst].is_constant();
+      changes += is_conditional_branch(instr_ptr->type()) &&
+                 evaluate(*instr_ptr, values).is_constant();
+    }
+  }
+  if (changes == 0) {
+    return 0;
+  }
+
+  // Unreached blocks lose their edges and code, constant results become
+  // Loads, and branches on constants become Jumps. Unreached blocks are
+  // left out of the graph, so leaving SSA ignores them.
+  const auto order = cfg.order;
+  for (const auto label : order) {
+    auto &instrs = blocks[label].instructions;
+    if (!executable[label]) {
+      for (const auto successor : std::vector<Label>(cfg.successors[label])) {
+        remove_ssa_edge(ssa, label, successor);
+      }
+      // Every block needs a terminator; this one keeps no registers alive
+      // until cfg_cleanup drops the block.
+      instrs.clear();
+      blocks[label].append<Bytecode::Instruction::Jump>(label);
+      ssa.phis[label].clear();
+      continue;
+    }
+    auto &phis = ssa.phis[label];
+    std::vector<std::unique_ptr<Bytecode::Instruction>> constant_phis;
+    for (auto it = phis.begin(); it != phis.end();) {
+      if (values[it->dst].is_constant()) {
+        constant_phis.push_back(
+            std::make_unique<Bytecode::Instruction::Load>(it->dst, values[it->dst].value));
+        it = phis.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (auto &instr_ptr : instrs) {
+      const auto type = instr_ptr->type();
+      const auto dst = get_dst_reg(*instr_ptr);
+      if (dst && type != Type::Load && is_foldable(type) && values[*dst].is_constant()) {
+        instr_ptr = std::make_unique<Bytecode::Instruction::Load>(*dst, values[*dst].value);
+        continue;
+      }
+      if (!is_conditional_branch(type)) {
+        continue;
+      }
+      const auto condition = evaluate(*instr_ptr, values);
+      if (!condition.is_constant()) {
+        continue;
+      }
+      const auto targets = get_jump_targets(*instr_ptr);
+      const auto taken = condition.value != 0 ? targets[0] : targets[1];
+      if (targets[0] != targets[1]) {
+        remove_ssa_edge(ssa, label, condition.value != 0 ? targets[1] : targets[0]);
+      }
+      instr_ptr = std::make_unique<Bytecode::Instruction::Jump>(taken);
+    }
+    instrs.insert(instrs.begin(), std::make_move_iterator(constant_phis.begin()),
+                  std::make_move_iterator(constant_phis.end()));
+  }
+  ssa.cfg.order.erase(std::remove_if(ssa.cfg.order.begin(), ssa.cfg.order.end(),
+                                     [&executable](Label label) { return !executable[label]; }),
+                      ssa.cfg.order.end());
+  return changes;
+}
+
+}  // namespace
+
+PassResult BytecodeOptimizer::sparse_conditional_constant_propagation(
+    std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
+  result.changes = transform_functions_in_ssa(
+      blocks, [](std::vector<Bytecode::BasicBlock> &blocks, SsaFunction &ssa,
+                 const Bytecode::Function &function) {
+        bool is_tail_called = false;
+        for (const auto &block : blocks) {
+          for (const auto &instr_ptr : block.instructions) {
+            is_tail_called =
+                is_tail_called ||
+                (instr_ptr->type() == Type::TailCall &&
+                 derived_cast<const Bytecode::Instruction::TailCall &>(*instr_ptr).label ==
+                     function.entry);
+          }
+        }
+        return propagate_constants(blocks, ssa, function, is_tail_called);
+      });
+  result.control_flow_changed = result.changes != 0;
+  return result;
+}
+
+}  // namespace kai
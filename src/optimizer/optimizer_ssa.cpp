@@ -0,0 +1,408 @@
+#include "optimizer_ssa.h"
+#include "optimizer_internal.h"
+#include "optimizer_liveness.h"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <utility>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+using Type = Bytecode::Instruction::Type;
+
+std::optional<SsaFunction> construct_ssa(std::vector<Bytecode::BasicBlock> &blocks,
+                                         const Bytecode::Function &function) {
+  auto cfg = build_control_flow_graph(blocks, function.entry);
+  if (!cfg.predecessors[function.entry].empty()) {
+    return std::nullopt;
+  }
+  for (const auto label : cfg.order) {
+    trim_after_terminator(blocks[label]);
+  }
+
+  const auto register_count = function.frame_size;
+  std::vector<bool> pinned(register_count, false);
+  std::vector<std::vector<Label>> def_blocks(register_count);
+  for (const auto label : cfg.order) {
+    for (const auto &instr_ptr : blocks[label].instructions) {
+      if (instr_ptr->type() == Type::AddressOf) {
+        pinned[derived_cast<const Bytecode::Instruction::AddressOf &>(*instr_ptr).src] = true;
+      }
+      if (const auto dst = get_dst_reg(*instr_ptr)) {
+        auto &defs = def_blocks[*dst];
+        if (defs.empty() || defs.back() != label) {
+          defs.push_back(label);
+        }
+      }
+    }
+  }
+
+  // Pruned SSA: a register gets a phi in the iterated dominance frontier of
+  // its definitions only where it is live.
+  const std::vector<std::vector<Phi>> no_phis(blocks.size());
+  const auto live_in = live_in_sets(blocks, cfg, no_phis, register_count);
+  const auto frontiers = cfg.dominance_frontiers();
+  std::vector<std::vector<Phi>> phis(blocks.size());
+  std::vector<std::vector<Register>> phi_registers(blocks.size());
+  std::vector<Register> has_phi(blocks.size(), register_count);
+  std::vector<Register> queued(blocks.size(), register_count);
+  for (Register reg = 0; reg < register_count; ++reg) {
+    if (pinned[reg] || def_blocks[reg].empty()) {
+      continue;
+    }
+    auto worklist = def_blocks[reg];
+    for (const auto label : worklist) {
+      queued[label] = reg;
+    }
+    while (!worklist.empty()) {
+      const auto label = worklist.back();
+      worklist.pop_back();
+      for (const auto join : frontiers[label]) {
+        if (has_phi[join] == reg || !live_in[join].contains(reg)) {
+          continue;
+        }
+        has_phi[join] = reg;
+        phis[join].push_back({reg, std::vector<Register>(cfg.predecessors[join].size(), reg)});
+        phi_registers[join].push_back(reg);
+        if (queued[join] != reg) {
+          queued[join] = reg;
+          worklist.push_back(join);
+        }
+      }
+    }
+  }
+
+  // Rename along the dominator tree. Each register starts out as itself,
+  // holding its value on entry.
+  auto next_register = static_cast<Register>(register_count);
+  std::vector<std::vector<Register>> versions(register_count);
+  const auto current = [&versions](Register reg) {
+    return versions[reg].empty() ? reg : versions[reg].back();
+  };
+  std::vector<Register> defined;
+  const auto define = [&](Register reg) {
+    versions[reg].push_back(next_register);
+    defined.push_back(reg);
+    return next_register++;
+  };
+
+  struct Visit {
+    Label label;
+    size_t next_child;
+    size_t defined_before;
+  };
+  std::vector<Visit> stack = {{cfg.entry, 0, 0}};
+  bool entering = true;
+  while (!stack.empty()) {
+    auto &visit = stack.back();
+    if (entering) {
+      const auto label = visit.label;
+      for (auto &phi : phis[label]) {
+        phi.dst = define(phi.dst);
+      }
+      for (auto &instr_ptr : blocks[label].instructions) {
+        visit_registers(
+            *instr_ptr,
+            [&](Register &reg) {
+              if (reg < register_count && !pinned[reg]) {
+                reg = current(reg);
+              }
+            },
+            [&](Register &reg) {
+              if (!pinned[reg]) {
+                reg = define(reg);
+              }
+            });
+      }
+      for (const auto successor : cfg.successors[label]) {
+        const auto &predecessors = cfg.predecessors[successor];
+        const auto index = static_cast<size_t>(
+            std::find(predecessors.begin(), predecessors.end(), label) - predecessors.begin());
+        for (size_t i = 0; i < phis[successor].size(); ++i) {
+          phis[successor][i].args[index] = current(phi_registers[successor][i]);
+        }
+      }
+    }
+    const auto &children = cfg.dominator_children[visit.label];
+    if (visit.next_child < children.size()) {
+      const auto child = children[visit.next_child++];
+      stack.push_back({child, 0, defined.size()});
+      entering = true;
+      continue;
+    }
+    while (defined.size() > visit.defined_before) {
+      versions[defined.back()].pop_back();
+      defined.pop_back();
+    }
+    stack.pop_back();
+    entering = false;
+  }
+
+  SsaFunction ssa;
+  ssa.cfg = std::move(cfg);
+  ssa.phis = std::move(phis);
+  ssa.next_register = next_register;
+  ssa.first_value = static_cast<Register>(register_count);
+  return ssa;
+}
+
+void remove_ssa_edge(SsaFunction &ssa, Label from, Label to) {
+  auto &predecessors = ssa.cfg.predecessors[to];
+  const auto it = std::find(predecessors.begin(), predecessors.end(), from);
+  assert(it != predecessors.end());
+  const auto index = it - predecessors.begin();
+  predecessors.erase(it);
+  for (auto &phi : ssa.phis[to]) {
+    phi.args.erase(phi.args.begin() + index);
+  }
+  auto &successors = ssa.cfg.successors[from];
+  successors.erase(std::find(successors.begin(), successors.end(), to));
+}
+
+void destruct_ssa(std::vector<Bytecode::BasicBlock> &blocks, SsaFunction &ssa) {
+  const auto &cfg = ssa.cfg;
+  const size_t register_count = ssa.next_register;
+
+  std::vector<bool> in_phi(register_count, false);
+  for (const auto label : cfg.order) {
+    for (const auto &phi : ssa.phis[label]) {
+      in_phi[phi.dst] = true;
+      for (const auto arg : phi.args) {
+        in_phi[arg] = true;
+      }
+    }
+  }
+
+  // Interference between registers that take part in phis: two interfere
+  // when one is live where the other is defined.
+  const auto live_in = live_in_sets(blocks, cfg, ssa.phis, register_count);
+  std::vector<std::vector<Register>> interferes(register_count);
+  const auto interfere_with_live = [&](Register reg, const RegisterSet &live) {
+    if (!in_phi[reg]) {
+      return;
+    }
+    live.for_each([&](Register other) {
+      if (other != reg && in_phi[other]) {
+        interferes[reg].push_back(other);
+        interferes[other].push_back(reg);
+      }
+    });
+  };
+  for (const auto label : cfg.order) {
+    auto live = live_out_set(label, cfg, ssa.phis, live_in, register_count);
+    const auto &instrs = blocks[label].instructions;
+    for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+      if (const auto dst = get_dst_reg(**it)) {
+        interfere_with_live(*dst, live);
+        live.erase(*dst);
+      }
+      for (const auto src : get_src_regs(**it)) {
+        live.insert(src);
+      }
+    }
+    // Phis define their registers together at the top of the block, and the
+    // function's own registers are all defined on entry.
+    for (const auto &phi : ssa.phis[label]) {
+      live.insert(phi.dst);
+    }
+    if (label == cfg.entry) {
+      live.for_each([&](Register reg) { interfere_with_live(reg, live); });
+    } else {
+      for (const auto &phi : ssa.phis[label]) {
+        interfere_with_live(phi.dst, live);
+      }
+    }
+  }
+
+  // Coalesce each phi with its arguments while the merged groups stay free
+  // of interference.
+  std::vector<Register> group(register_count);
+  std::vector<std::vector<Register>> members(register_count);
+  for (Register reg = 0; reg < register_count; ++reg) {
+    group[reg] = reg;
+    if (in_phi[reg]) {
+      members[reg] = {reg};
+    }
+  }
+  const auto groups_interfere = [&](Register a, Register b) {
+    for (const auto member : members[a]) {
+      for (const auto other : interferes[member]) {
+        if (group[other] == b) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+  for (const auto label : cfg.order) {
+    for (const auto &phi : ssa.phis[label]) {
+      for (const auto arg : phi.args) {
+        const auto a = group[phi.dst];
+        const auto b = group[arg];
+        if (a == b || groups_interfere(a, b)) {
+          continue;
+        }
+        for (const auto member : members[b]) {
+          group[member] = a;
+          members[a].push_back(member);
+        }
+        members[b].clear();
+      }
+    }
+  }
+
+  // A group takes its lowest register. That keeps a parameter or a register
+  // read before it is written at its original number, where the caller or
+  // the zeroed frame provides its value; two of those never share a group,
+  // as they are all live on entry.
+  std::vector<Register> renamed(register_count);
+  for (Register reg = 0; reg < register_count; ++reg) {
+    renamed[reg] = reg;
+  }
+  for (Register leader = 0; leader < register_count; ++leader) {
+    if (members[leader].empty()) {
+      continue;
+    }
+    const auto lowest = *std::min_element(members[leader].begin(), members[leader].end());
+    for (const auto member : members[leader]) {
+      renamed[member] = lowest;
+    }
+  }
+  const auto rename = [&renamed](Register &reg) { reg = renamed[reg]; };
+  for (const auto label : cfg.order) {
+    for (auto &instr_ptr : blocks[label].instructions) {
+      visit_registers(*instr_ptr, rename, rename);
+    }
+    for (auto &phi : ssa.phis[label]) {
+      rename(phi.dst);
+      for (auto &arg : phi.args) {
+        rename(arg);
+      }
+    }
+  }
+
+  // The remaining phis become parallel copies on their incoming edges. An
+  // edge from a block that branches elsewhere too gets a block of its own.
+  struct SplitEdge {
+    Label from;
+    Label to;
+    std::vector<std::pair<Register, Register>> moves;
+  };
+  std::vector<SplitEdge> split_edges;
+  const auto temporary = static_cast<Register>(register_count);
+  for (const auto label : cfg.order) {
+    const auto &phis = ssa.phis[label];
+    if (phis.empty()) {
+      continue;
+    }
+    std::vector<Register> dsts;
+    for (const auto &phi : phis) {
+      dsts.push_back(phi.dst);
+    }
+    const auto &predecessors = cfg.predecessors[label];
+    for (size_t i = 0; i < predecessors.size(); ++i) {
+      std::vector<Register> args;
+      for (const auto &phi : phis) {
+        args.push_back(phi.args[i]);
+      }
+      auto moves = schedule_parallel_move(args, dsts, temporary);
+      if (moves.empty()) {
+        continue;
+      }
+      auto &instrs = blocks[predecessors[i]].instructions;
+      if (instrs.back()->type() != Type::Jump) {
+        split_edges.push_back({predecessors[i], label, std::move(moves)});
+        continue;
+      }
+      for (const auto &[dst, src] : moves) {
+        instrs.insert(instrs.end() - 1, std::make_unique<Bytecode::Instruction::Move>(dst, src));
+      }
+    }
+  }
+
+  // Insert the edge blocks right after their source, from the last source
+  // back, so labels still to be visited do not move.
+  std::stable_sort(split_edges.begin(), split_edges.end(),
+                   [](const auto &a, const auto &b) { return a.from > b.from; });
+  for (size_t i = 0; i < split_edges.size(); ++i) {
+    const auto &edge = split_edges[i];
+    const Label at = edge.from + 1;
+    insert_blocks(blocks, at, 1, /*calls_land_on_new_blocks=*/false);
+    for (size_t j = i + 1; j < split_edges.size(); ++j) {
+      if (split_edges[j].to >= at) {
+        ++split_edges[j].to;
+      }
+    }
+    const auto to = edge.to >= at ? edge.to + 1 : edge.to;
+    visit_labels(
+        *blocks[edge.from].instructions.back(),
+        [at, to](Label &target) {
+          if (target == to) {
+            target = at;
+          }
+        },
+        [](Label &) {});
+    for (const auto &[dst, src] : edge.moves) {
+      blocks[at].append<Bytecode::Instruction::Move>(dst, src);
+    }
+    blocks[at].append<Bytecode::Instruction::Jump>(to);
+  }
+
+  ssa.phis.clear();
+}
+
+size_t transform_functions_in_ssa(
+    std::vector<Bytecode::BasicBlock> &blocks,
+    const std::function<size_t(std::vector<Bytecode::BasicBlock> &, SsaFunction &,
+                               const Bytecode::Function &)> &transform) {
+  size_t changes = 0;
+  auto functions = build_function_table(blocks);
+  for (size_t i = 0; i < functions.size(); ++i) {
+    const auto function = functions[i];
+    std::vector<bool> is_entry(blocks.size(), false);
+    for (const auto &other : functions) {
+      is_entry[other.entry] = true;
+    }
+    if (std::any_of(function.blocks.begin(), function.blocks.end(), [&](Label label) {
+          return label != function.entry && is_entry[label];
+        })) {
+      continue;
+    }
+
+    std::vector<std::pair<Label, std::vector<std::unique_ptr<Bytecode::Instruction>>>> original;
+    for (const auto label : function.blocks) {
+      std::vector<std::unique_ptr<Bytecode::Instruction>> instrs;
+      for (const auto &instr_ptr : blocks[label].instructions) {
+        instrs.push_back(clone_instruction(*instr_ptr));
+      }
+      original.emplace_back(label, std::move(instrs));
+    }
+    auto ssa = construct_ssa(blocks, function);
+    if (!ssa) {
+      continue;
+    }
+    const auto function_changes = transform(blocks, *ssa, function);
+    if (function_changes == 0) {
+      for (auto &[label, instrs] : original) {
+        blocks[label].instructions = std::move(instrs);
+      }
+      continue;
+    }
+    changes += function_changes;
+    destruct_ssa(blocks, *ssa);
+
+    // Split edges land after the entry, and code the transform removed may
+    // drop callees from the table, so find this function again.
+    functions = build_function_table(blocks);
+    i = static_cast<size_t>(std::find_if(functions.begin(), functions.end(),
+                                         [&function](const auto &other) {
+                                           return other.entry == function.entry;
+                                         }) -
+                            functions.begin());
+  }
+  return changes;
+}
+
+}  // namespace kai
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "optimizer_cfg.h"
+
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace kai {
+
+// phi(args) at the start of a block: takes args[i] when control arrives from
+// the block's i-th predecessor in the control-flow graph.
+struct Phi {
+  Bytecode::Register dst;
+  std::vector<Bytecode::Register> args;
+};
+
+// One function in static single assignment form. Every register written in
+// the function is replaced by a fresh register per definition, numbered from
+// the function's frame size up, and joins get phis. A register keeps its own
+// number for the value it holds on entry: a parameter, or zero. Registers
+// whose address is taken are left alone, since LoadIndirect reads them
+// through a pointer.
+struct SsaFunction {
+  ControlFlowGraph cfg;
+  // Phis of each block, indexed by label.
+  std::vector<std::vector<Phi>> phis;
+  // First register not used by the function.
+  Bytecode::Register next_register = 0;
+  // Registers below this are the function's original registers.
+  Bytecode::Register first_value = 0;
+};
+
+// Rewrites `function` into SSA form. Returns nullopt, leaving the blocks
+// untouched, when its entry is also a branch target, since a phi there would
+// have no incoming edge for the call.
+std::optional<SsaFunction> construct_ssa(std::vector<Bytecode::BasicBlock> &blocks,
+                                         const Bytecode::Function &function);
+
+// Drops the control-flow edge from `from` to `to` along with the phi
+// arguments it carries. The caller rewrites the branch; the dominator tree is
+// left as it was.
+void remove_ssa_edge(SsaFunction &ssa, Bytecode::Label from, Bytecode::Label to);
+
+// Leaves SSA form: coalesces each phi with the arguments whose live ranges it
+// does not overlap, so they share a register, and turns the rest into copies
+// at the end of the predecessors. Edges from a block with several successors
+// get a new block for their copies, which shifts later labels.
+void destruct_ssa(std::vector<Bytecode::BasicBlock> &blocks, SsaFunction &ssa);
+
+// Runs `transform` on each function in SSA form, then leaves SSA again.
+// `transform` returns how many changes it made to the function. If it made
+// none, the function's code is restored, so it does not pay for the round
+// trip. Functions that construct_ssa rejects are skipped. So are functions
+// whose blocks contain another function's entry, since renaming those blocks
+// would break the other function. Returns the changes of every function.
+size_t transform_functions_in_ssa(
+    std::vector<Bytecode::BasicBlock> &blocks,
+    const std::function<size_t(std::vector<Bytecode::BasicBlock> &, SsaFunction &,
+                               const Bytecode::Function &)> &transform);
+
+}  // namespace kai
@@ -0,0 +1,303 @@
+#include "../optimizer.h"
+#include "optimizer_analyses.h"
+#include "optimizer_induction_variables.h"
+#include "optimizer_internal.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+using Register = Bytecode::Register;
+using Type = Bytecode::Instruction::Type;
+using Value = Bytecode::Value;
+
+namespace {
+
+constexpr Value k_max_value = std::numeric_limits<Value>::max();
+
+// A product of an induction variable and a factor the loop does not change.
+// The loop keeps it up to date by adding to it at each step instead.
+struct Reduction {
+  const Bytecode::Instruction *multiply = nullptr;
+  Label block = 0;
+  Register dst = 0;
+  size_t variable = 0;
+  // The factor when it is a known constant, and otherwise the register
+  // holding it.
+  std::optional<Value> factor;
+  Register factor_reg = 0;
+};
+
+void erase_instruction(Bytecode::BasicBlock &block, const Bytecode::Instruction *instr) {
+  auto &instrs = block.instructions;
+  instrs.erase(std::find_if(instrs.begin(), instrs.end(),
+                            [instr](const auto &other) { return other.get() == instr; }));
+}
+
+void insert_after(Bytecode::BasicBlock &block, const Bytecode::Instruction *anchor,
+                  std::unique_ptr<Bytecode::Instruction> instr) {
+  auto &instrs = block.instructions;
+  const auto it = std::find_if(instrs.begin(), instrs.end(),
+                               [anchor](const auto &other) { return other.get() == anchor; });
+  instrs.insert(it + 1, std::move(instr));
+}
+
+class StrengthReducer {
+ public:
+  StrengthReducer(std::vector<Bytecode::BasicBlock> &blocks, const Bytecode::Function &function)
+      : blocks_(blocks), function_(function), next_register_(function.frame_size) {}
+
+  PassResult run(const ControlFlowGraph &cfg, const LoopForest &forest) {
+    PassResult result;
+    for (size_t index = 0; index < forest.loops.size(); ++index) {
+      if (forest.loops[index].preheader != ControlFlowGraph::k_no_label) {
+        result.changes += reduce(cfg, forest, index);
+      }
+    }
+    return result;
+  }
+
+ private:
+  // Returns how many multiplications and loop tests it rewrote.
+  size_t reduce(const ControlFlowGraph &cfg, const LoopForest &forest, size_t index) {
+    const auto &loop = forest.loops[index];
+    const auto variables = find_induction_variables(blocks_, cfg, forest, index);
+    if (variables.empty()) {
+      return 0;
+    }
+    const std::vector<std::vector<Phi>> no_phis(blocks_.size());
+    const auto live_in = live_in_sets(blocks_, cfg, no_phis, next_register_);
+
+    std::unordered_map<Register, size_t> def_count;
+    for (const auto label : loop.blocks) {
+      for (const auto &instr_ptr : blocks_[label].instructions) {
+        if (const auto dst = get_dst_reg(*instr_ptr)) {
+          ++def_count[*dst];
+        }
+      }
+    }
+    // Whether the next iteration or the code after the loop may read `reg`
+    // as the loop leaves it.
+    const auto escapes = [&](Register reg) {
+      return live_in[loop.header].contains(reg) ||
+             std::any_of(loop.exits.begin(), loop.exits.end(),
+                         [&](const auto &exit) { return live_in[exit.second].contains(reg); });
+    };
+    // Whether `reg` may be read after the instruction at `position` of
+    // `label` before it is written again.
+    const auto live_after = [&](Label label, size_t position, Register reg) {
+      const auto &instrs = blocks_[label].instructions;
+      for (size_t i = position + 1; i < instrs.size(); ++i) {
+        const auto srcs = get_src_regs(*instrs[i]);
+        if (std::count(srcs.begin(), srcs.end(), reg)) {
+          return true;
+        }
+        if (get_dst_reg(*instrs[i]) == reg) {
+          return false;
+        }
+      }
+      return std::any_of(cfg.successors[label].begin(), cfg.successors[label].end(),
+                         [&](Label successor) { return live_in[successor].contains(reg); });
+    };
+
+    // The product keeps the value the multiplication gave it only while the
+    // variable does not step: every read of it must come after the
+    // multiplication in the same iteration, with no step in between.
+    std::vector<Reduction> reductions;
+    for (const auto label : loop.blocks) {
+      for (const auto &instr_ptr : blocks_[label].instructions) {
+        if (is_terminator(*instr_ptr)) {
+          break;
+        }
+        auto reduction = match(*instr_ptr, variables, def_count);
+        if (!reduction || def_count[reduction->dst] != 1 || escapes(reduction->dst)) {
+          continue;
+        }
+        const auto &variable = variables[reduction->variable];
+        if (live_after(variable.block, variable.position, reduction->dst)) {
+          continue;
+        }
+        if (!reduction->factor) {
+          reduction->factor = entry_value(blocks_, cfg, loop, reduction->factor_reg);
+        }
+        if (reduction->factor == Value{0}) {
+          continue;
+        }
+        reduction->block = label;
+        reductions.push_back(*reduction);
+      }
+    }
+    if (reductions.empty()) {
+      return 0;
+    }
+
+    const auto trip = find_trip_count(blocks_, cfg, loop, variables);
+    std::vector<const Bytecode::Instruction *> steps;
+    for (const auto &variable : variables) {
+      steps.push_back(blocks_[variable.block].instructions[variable.position].get());
+    }
+    auto &preheader = blocks_[loop.preheader];
+    for (const auto &reduction : reductions) {
+      const auto &variable = variables[reduction.variable];
+      const auto start = entry_value(blocks_, cfg, loop, variable.reg);
+      const auto dst = reduction.dst;
+      std::unique_ptr<Bytecode::Instruction> update;
+      if (reduction.factor) {
+        const auto factor = *reduction.factor;
+        if (start) {
+          insert_before_terminator(
+              preheader, std::make_unique<Bytecode::Instruction::Load>(dst, *start * factor));
+        } else {
+          insert_before_terminator(preheader,
+                                   std::make_unique<Bytecode::Instruction::MultiplyImmediate>(
+                                       dst, variable.reg, factor));
+        }
+        update = std::make_unique<Bytecode::Instruction::AddImmediate>(dst, dst,
+                                                                       variable.step * factor);
+      } else {
+        const auto factor_reg = reduction.factor_reg;
+        if (start) {
+          insert_before_terminator(preheader,
+                                   std::make_unique<Bytecode::Instruction::MultiplyImmediate>(
+                                       dst, factor_reg, *start));
+        } else {
+          insert_before_terminator(
+              preheader,
+              std::make_unique<Bytecode::Instruction::Multiply>(dst, variable.reg, factor_reg));
+        }
+        auto increment = factor_reg;
+        if (variable.step != 1) {
+          increment = next_register_++;
+          insert_before_terminator(preheader,
+                                   std::make_unique<Bytecode::Instruction::MultiplyImmediate>(
+                                       increment, factor_reg, variable.step));
+        }
+        update = std::make_unique<Bytecode::Instruction::Add>(dst, dst, increment);
+      }
+      insert_after(blocks_[variable.block], steps[reduction.variable], std::move(update));
+      erase_instruction(blocks_[reduction.block], reduction.multiply);
+    }
+    return reductions.size() +
+           (trip && replace_test(cfg, loop, *trip, variables, steps, reductions) ? 1 : 0);
+  }
+
+  // The reduction `instr` allows, when it multiplies a variable by a
+  // register the loop does not write or by an immediate.
+  static std::optional<Reduction> match(const Bytecode::Instruction &instr,
+                                        const std::vector<InductionVariable> &variables,
+                                        const std::unordered_map<Register, size_t> &def_count) {
+    if (instr.type() != Type::Multiply && instr.type() != Type::MultiplyImmediate) {
+      return std::nullopt;
+    }
+    const auto srcs = get_src_regs(instr);
+    for (size_t i = 0; i < srcs.size(); ++i) {
+      const auto variable =
+          std::find_if(variables.begin(), variables.end(),
+                       [&](const auto &other) { return other.reg == srcs[i]; });
+      if (variable == variables.end()) {
+        continue;
+      }
+      Reduction reduction;
+      reduction.multiply = &instr;
+      reduction.dst = *get_dst_reg(instr);
+      reduction.variable = static_cast<size_t>(variable - variables.begin());
+      if (srcs.size() == 1) {
+        reduction.factor = get_immediate(instr);
+        return reduction;
+      }
+      reduction.factor_reg = srcs[1 - i];
+      if (!def_count.contains(reduction.factor_reg)) {
+        return reduction;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Linear-function test replacement: when the loop's test is all that
+  // still reads the tested variable, tests a product of it instead,
+  //   JumpLessThanImmediate i, N, @body, @exit
+  //   -> JumpLessThanImmediate p, N * K, @body, @exit     with p = i * K
+  // and drops the variable's step. A compare feeding a JumpConditional is
+  // rewritten the same way. Scaling keeps the order of the values
+  // the variable takes as long as none of their products wraps.
+  bool replace_test(const ControlFlowGraph &cfg, const Loop &loop, const TripCount &trip,
+                    const std::vector<InductionVariable> &variables,
+                    const std::vector<const Bytecode::Instruction *> &steps,
+                    const std::vector<Reduction> &reductions) {
+    const auto reduction =
+        std::find_if(reductions.begin(), reductions.end(), [&](const auto &candidate) {
+          return candidate.variable == trip.variable && candidate.factor &&
+                 trip.max <= k_max_value / *candidate.factor;
+        });
+    if (trip.count == 0 || reduction == reductions.end()) {
+      return false;
+    }
+    const auto &variable = variables[trip.variable];
+    auto &step_block = blocks_[variable.block];
+    // The step, and the addition into a temporary it copies from.
+    std::vector<const Bytecode::Instruction *> chain{steps[trip.variable]};
+    std::optional<Register> temporary;
+    if (steps[trip.variable]->type() == Type::Move) {
+      const auto step = std::find_if(
+          step_block.instructions.begin(), step_block.instructions.end(),
+          [&](const auto &instr) { return instr.get() == steps[trip.variable]; });
+      chain.push_back((step - 1)->get());
+      temporary = get_dst_reg(*chain.back());
+    }
+    for (const auto label : cfg.order) {
+      for (const auto &instr_ptr : blocks_[label].instructions) {
+        if (instr_ptr.get() == trip.test ||
+            std::find(chain.begin(), chain.end(), instr_ptr.get()) != chain.end()) {
+          continue;
+        }
+        const auto srcs = get_src_regs(*instr_ptr);
+        if (std::count(srcs.begin(), srcs.end(), variable.reg) ||
+            (temporary && std::count(srcs.begin(), srcs.end(), *temporary))) {
+          return false;
+        }
+      }
+    }
+
+    struct Scale : OperandVisitor {
+      Register from;
+      Register to;
+      Value factor;
+      void use(Register &reg) {
+        if (reg == from) {
+          reg = to;
+        }
+      }
+      void immediate(Value &value) { value *= factor; }
+    };
+    auto &test = *std::find_if(
+        blocks_[loop.header].instructions.begin(), blocks_[loop.header].instructions.end(),
+        [&](const auto &instr) { return instr.get() == trip.test; });
+    visit_operands(*test, Scale{{}, variable.reg, reduction->dst, *reduction->factor});
+    for (const auto *instr : chain) {
+      erase_instruction(step_block, instr);
+    }
+    return true;
+  }
+
+  std::vector<Bytecode::BasicBlock> &blocks_;
+  const Bytecode::Function &function_;
+  Register next_register_;
+};
+
+}  // namespace
+
+PassResult BytecodeOptimizer::strength_reduction(std::vector<Bytecode::BasicBlock> &blocks) {
+  return transform_loops(blocks, analyses(blocks),
+                         [&](const Bytecode::Function &function, const ControlFlowGraph &cfg,
+                             const LoopForest &forest) {
+                           return StrengthReducer(blocks, function).run(cfg, forest);
+                         });
+}
+
+}  // namespace kai
@@ -0,0 +1,92 @@
+#include "../optimizer.h"
+#include "optimizer_internal.h"
+
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace kai {
+
+using Register = Bytecode::Register;
+using Type = Bytecode::Instruction::Type;
+
+namespace {
+
+// The superinstruction doing `producer` and then `terminator`, or null when
+// the pair has none.
+std::unique_ptr<Bytecode::Instruction> fuse(
+    const Bytecode::Instruction &producer, const Bytecode::Instruction &terminator,
+    const std::unordered_set<Register> &address_taken) {
+  if (terminator.type() == Type::Jump) {
+    const auto label = derived_cast<const Bytecode::Instruction::Jump &>(terminator).label;
+    switch (producer.type()) {
+      case Type::Move: {
+        const auto &move = derived_cast<const Bytecode::Instruction::Move &>(producer);
+        return std::make_unique<Bytecode::Instruction::MoveJump>(move.dst, move.src, label);
+      }
+      case Type::Load: {
+        const auto &load = derived_cast<const Bytecode::Instruction::Load &>(producer);
+        return std::make_unique<Bytecode::Instruction::LoadJump>(load.dst, load.value, label);
+      }
+      case Type::AddImmediate: {
+        const auto &add_imm =
+            derived_cast<const Bytecode::Instruction::AddImmediate &>(producer);
+        return std::make_unique<Bytecode::Instruction::AddImmediateJump>(
+            add_imm.dst, add_imm.src, add_imm.value, label);
+      }
+      case Type::SubtractImmediate: {
+        // Values wrap, so subtracting K is adding its negation.
+        const auto &subtract_imm =
+            derived_cast<const Bytecode::Instruction::SubtractImmediate &>(producer);
+        return std::make_unique<Bytecode::Instruction::AddImmediateJump>(
+            subtract_imm.dst, subtract_imm.src, Bytecode::Value{0} - subtract_imm.value,
+            label);
+      }
+      default:
+        return nullptr;
+    }
+  }
+  if (terminator.type() == Type::Return && producer.type() == Type::Add) {
+    // The sum is only dropped from the frame when no pointer can read it
+    // there.
+    const auto &add = derived_cast<const Bytecode::Instruction::Add &>(producer);
+    const auto &ret = derived_cast<const Bytecode::Instruction::Return &>(terminator);
+    if (ret.reg == add.dst && !address_taken.contains(add.dst)) {
+      return std::make_unique<Bytecode::Instruction::AddReturn>(add.src1, add.src2);
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+PassResult BytecodeOptimizer::form_superinstructions(std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
+  std::unordered_set<Register> address_taken;
+  for (const auto &block : blocks) {
+    for (const auto &instr : block.instructions) {
+      if (instr->type() == Type::AddressOf) {
+        address_taken.insert(derived_cast<const Bytecode::Instruction::AddressOf &>(*instr).src);
+      }
+    }
+  }
+
+  for (auto &block : blocks) {
+    auto &instrs = block.instructions;
+    const auto terminator = std::find_if(instrs.begin(), instrs.end(),
+                                         [](const auto &instr) { return is_terminator(*instr); });
+    if (terminator == instrs.end() || terminator == instrs.begin()) {
+      continue;
+    }
+    const auto producer = terminator - 1;
+    if (auto fused = fuse(**producer, **terminator, address_taken)) {
+      *producer = std::move(fused);
+      instrs.erase(terminator);
+      ++result.changes;
+    }
+  }
+  return result;
+}
+
+}  // namespace kai
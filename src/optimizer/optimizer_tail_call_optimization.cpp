@@ -1,15 +1,34 @@
 #include "../optimizer.h"
+#include "optimizer_analyses.h"
+#include "optimizer_internal.h"
 
 #include <cstddef>
+#include <vector>
 
 namespace kai {
 
 using Type = Bytecode::Instruction::Type;
 
-void BytecodeOptimizer::tail_call_optimization(
+PassResult BytecodeOptimizer::tail_call_optimization(
     std::vector<Bytecode::BasicBlock> &blocks) {
-  for (auto &block : blocks) {
-    auto &instrs = block.instructions;
+  PassResult result;
+  // A tail call hands the current frame to the callee. If the caller took the
+  // address of one of its registers, a pointer into that frame may reach the
+  // callee and must not be overwritten by the callee's registers.
+  std::vector<bool> frame_reusable(blocks.size(), true);
+  for (const auto &function : analyses(blocks).functions()) {
+    if (takes_address(blocks, function)) {
+      for (const auto label : function.blocks) {
+        frame_reusable[label] = false;
+      }
+    }
+  }
+
+  for (size_t label = 0; label < blocks.size(); ++label) {
+    if (!frame_reusable[label]) {
+      continue;
+    }
+    auto &instrs = blocks[label].instructions;
     size_t i = 0;
     while (i + 1 < instrs.size()) {
       if (instrs[i]->type() != Type::Call || instrs[i + 1]->type() != Type::Return) {
@@ -28,8 +47,10 @@ void BytecodeOptimizer::tail_call_optimization(
       instrs[i] = std::make_unique<Bytecode::Instruction::TailCall>(
           call.label, std::move(call.arg_registers), std::move(call.param_registers));
       instrs.erase(instrs.begin() + static_cast<std::ptrdiff_t>(i + 1));
+      ++result.changes;
     }
   }
+  return result;
 }
 
 }  // namespace kai
@@ -0,0 +1,116 @@
+#include "../optimizer.h"
+#include "optimizer_internal.h"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace kai {
+
+using Label = Bytecode::Label;
+using Type = Bytecode::Instruction::Type;
+
+namespace {
+
+// Arguments of a self tail call at `instrs[i]`: either a TailCall to `entry`
+// or a Call to `entry` whose result is returned right away.
+const Bytecode::Instruction::Call *self_tail_call(
+    const std::vector<std::unique_ptr<Bytecode::Instruction>> &instrs, size_t i,
+    Label entry) {
+  if (instrs[i]->type() != Type::Call || i + 1 >= instrs.size() ||
+      instrs[i + 1]->type() != Type::Return) {
+    return nullptr;
+  }
+  const auto &call = derived_cast<const Bytecode::Instruction::Call &>(*instrs[i]);
+  const auto &ret = derived_cast<const Bytecode::Instruction::Return &>(*instrs[i + 1]);
+  return call.label == entry && ret.reg == call.dst ? &call : nullptr;
+}
+
+bool is_self_tail_call(const std::vector<std::unique_ptr<Bytecode::Instruction>> &instrs,
+                       size_t i, Label entry) {
+  if (instrs[i]->type() == Type::TailCall) {
+    return derived_cast<const Bytecode::Instruction::TailCall &>(*instrs[i]).label == entry;
+  }
+  return self_tail_call(instrs, i, entry) != nullptr;
+}
+
+// Rewrites every self tail call of `function` into parameter moves and a
+// jump back to its entry block, then gives the function a new entry block
+// that only jumps to the old one. Calls land on the new block, which becomes
+// the loop pre-header.
+void convert_to_loop(std::vector<Bytecode::BasicBlock> &blocks,
+                     const Bytecode::Function &function) {
+  const auto entry = function.entry;
+  // Registers are numbered per function, so the slot just past the frame is
+  // free to break argument cycles.
+  const auto temporary = static_cast<Bytecode::Register>(function.frame_size);
+  for (const auto label : function.blocks) {
+    auto &instrs = blocks[label].instructions;
+    for (size_t i = 0; i < instrs.size(); ++i) {
+      if (!is_self_tail_call(instrs, i, entry)) {
+        continue;
+      }
+      std::vector<std::pair<Bytecode::Register, Bytecode::Register>> moves;
+      if (instrs[i]->type() == Type::TailCall) {
+        const auto &tail_call =
+            derived_cast<const Bytecode::Instruction::TailCall &>(*instrs[i]);
+        moves = schedule_parallel_move(tail_call.arg_registers, tail_call.param_registers,
+                                       temporary);
+      } else {
+        const auto &call = *self_tail_call(instrs, i, entry);
+        moves = schedule_parallel_move(call.arg_registers, call.param_registers, temporary);
+      }
+      // Nothing after the tail call can run.
+      instrs.erase(instrs.begin() + static_cast<std::ptrdiff_t>(i), instrs.end());
+      for (const auto &[dst, src] : moves) {
+        instrs.push_back(std::make_unique<Bytecode::Instruction::Move>(dst, src));
+      }
+      instrs.push_back(std::make_unique<Bytecode::Instruction::Jump>(entry));
+      break;
+    }
+  }
+
+  insert_blocks(blocks, entry, 1, /*calls_land_on_new_blocks=*/true);
+  blocks[entry].append<Bytecode::Instruction::Jump>(entry + 1);
+}
+
+// A self-recursive function whose frame can be reused across iterations.
+std::optional<Bytecode::Function> next_tail_recursive_function(
+    const std::vector<Bytecode::BasicBlock> &blocks) {
+  for (const auto &function : build_function_table(blocks)) {
+    if (function.entry == 0) {
+      continue;
+    }
+    bool tail_recursive = false;
+    for (const auto label : function.blocks) {
+      const auto &instrs = blocks[label].instructions;
+      for (size_t i = 0; i < instrs.size(); ++i) {
+        tail_recursive = tail_recursive || is_self_tail_call(instrs, i, function.entry);
+      }
+    }
+    // As in tail_call_optimization: a pointer into the frame may reach the
+    // next iteration, which must not overwrite its pointee.
+    if (tail_recursive && !takes_address(blocks, function)) {
+      return function;
+    }
+  }
+  return std::nullopt;
+}
+
+}  // namespace
+
+PassResult BytecodeOptimizer::tail_recursion_elimination(
+    std::vector<Bytecode::BasicBlock> &blocks) {
+  PassResult result;
+  // Each conversion inserts a block and shifts labels, so the function table
+  // is rebuilt every round. A converted function has no self tail calls left.
+  while (const auto function = next_tail_recursive_function(blocks)) {
+    convert_to_loop(blocks, *function);
+    ++result.changes;
+    result.control_flow_changed = true;
+  }
+  return result;
+}
+
+}  // namespace kai
@@ -1,96 +1,213 @@
+#include "optimizer_analyses.h"
 #include "optimizer_internal.h"
 
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
 namespace kai {
 
+using Label = Bytecode::Label;
 using Type = Bytecode::Instruction::Type;
 
 std::optional<Register> get_dst_reg(const Bytecode::Instruction &instr) {
+  struct Visitor : OperandVisitor {
+    std::optional<Register> dst;
+    void def(const Register &reg) { dst = reg; }
+  } visitor;
+  visit_operands(instr, visitor);
+  return visitor.dst;
+}
+
+std::unique_ptr<Bytecode::Instruction> clone_instruction(const Bytecode::Instruction &instr) {
   switch (instr.type()) {
-    case Type::Move:
-      return derived_cast<const Bytecode::Instruction::Move &>(instr).dst;
-    case Type::Load:
-      return derived_cast<const Bytecode::Instruction::Load &>(instr).dst;
+#define KAI_CLONE_OPCODE(name, flags, operands)             \
+  case Type::name:                                          \
+    return std::make_unique<Bytecode::Instruction::name>(   \
+        derived_cast<const Bytecode::Instruction::name &>(instr));
+    KAI_BYTECODE_OPCODES(KAI_CLONE_OPCODE)
+#undef KAI_CLONE_OPCODE
+  }
+  assert(false);
+  return nullptr;
+}
+
+std::vector<Register> get_src_regs(const Bytecode::Instruction &instr) {
+  struct Visitor : OperandVisitor {
+    std::vector<Register> uses;
+    void use(const Register &reg) { uses.push_back(reg); }
+  } visitor;
+  visit_operands(instr, visitor);
+  return std::move(visitor.uses);
+}
+
+std::optional<Bytecode::Value> get_immediate(const Bytecode::Instruction &instr) {
+  struct Visitor : OperandVisitor {
+    std::optional<Bytecode::Value> value;
+    void immediate(const Bytecode::Value &immediate) { value = immediate; }
+  } visitor;
+  visit_operands(instr, visitor);
+  return visitor.value;
+}
+
+std::vector<Label> get_jump_targets(const Bytecode::Instruction &instr) {
+  struct Visitor : OperandVisitor {
+    std::vector<Label> targets;
+    void jump(const Label &label) { targets.push_back(label); }
+  } visitor;
+  visit_operands(instr, visitor);
+  return std::move(visitor.targets);
+}
+
+std::optional<Type> branch_compare_type(Type type) {
+  switch (type) {
+#define KAI_BRANCH_COMPARE(compare, branch) \
+  case Type::branch:                         \
+    return Type::compare;
+    KAI_COMPARE_BRANCHES(KAI_BRANCH_COMPARE)
+#undef KAI_BRANCH_COMPARE
+    default:
+      return std::nullopt;
+  }
+}
+
+bool evaluate_compare(Type compare, Bytecode::Value lhs, Bytecode::Value rhs) {
+  switch (compare) {
     case Type::LessThan:
-      return derived_cast<const Bytecode::Instruction::LessThan &>(instr).dst;
     case Type::LessThanImmediate:
-      return derived_cast<const Bytecode::Instruction::LessThanImmediate &>(instr).dst;
+      return lhs < rhs;
     case Type::GreaterThan:
-      return derived_cast<const Bytecode::Instruction::GreaterThan &>(instr).dst;
     case Type::GreaterThanImmediate:
-      return derived_cast<const Bytecode::Instruction::GreaterThanImmediate &>(instr).dst;
+      return lhs > rhs;
     case Type::LessThanOrEqual:
-      return derived_cast<const Bytecode::Instruction::LessThanOrEqual &>(instr).dst;
     case Type::LessThanOrEqualImmediate:
-      return derived_cast<const Bytecode::Instruction::LessThanOrEqualImmediate &>(instr)
-          .dst;
+      return lhs <= rhs;
     case Type::GreaterThanOrEqual:
-      return derived_cast<const Bytecode::Instruction::GreaterThanOrEqual &>(instr).dst;
     case Type::GreaterThanOrEqualImmediate:
-      return derived_cast<const Bytecode::Instruction::GreaterThanOrEqualImmediate &>(instr)
-          .dst;
+      return lhs >= rhs;
     case Type::Equal:
-      return derived_cast<const Bytecode::Instruction::Equal &>(instr).dst;
     case Type::EqualImmediate:
-      return derived_cast<const Bytecode::Instruction::EqualImmediate &>(instr).dst;
+      return lhs == rhs;
     case Type::NotEqual:
-      return derived_cast<const Bytecode::Instruction::NotEqual &>(instr).dst;
     case Type::NotEqualImmediate:
-      return derived_cast<const Bytecode::Instruction::NotEqualImmediate &>(instr).dst;
-    case Type::Add:
-      return derived_cast<const Bytecode::Instruction::Add &>(instr).dst;
-    case Type::AddImmediate:
-      return derived_cast<const Bytecode::Instruction::AddImmediate &>(instr).dst;
-    case Type::Subtract:
-      return derived_cast<const Bytecode::Instruction::Subtract &>(instr).dst;
-    case Type::SubtractImmediate:
-      return derived_cast<const Bytecode::Instruction::SubtractImmediate &>(instr).dst;
-    case Type::Multiply:
-      return derived_cast<const Bytecode::Instruction::Multiply &>(instr).dst;
-    case Type::MultiplyImmediate:
-      return derived_cast<const Bytecode::Instruction::MultiplyImmediate &>(instr).dst;
-    case Type::Divide:
-      return derived_cast<const Bytecode::Instruction::Divide &>(instr).dst;
-    case Type::DivideImmediate:
-      return derived_cast<const Bytecode::Instruction::DivideImmediate &>(instr).dst;
-    case Type::Modulo:
-      return derived_cast<const Bytecode::Instruction::Modulo &>(instr).dst;
-    case Type::ModuloImmediate:
-      return derived_cast<const Bytecode::Instruction::ModuloImmediate &>(instr).dst;
-    case Type::Call:
-      return derived_cast<const Bytecode::Instruction::Call &>(instr).dst;
-    case Type::ArrayCreate:
-      return derived_cast<const Bytecode::Instruction::ArrayCreate &>(instr).dst;
-    case Type::ArrayLiteralCreate:
-      return derived_cast<const Bytecode::Instruction::ArrayLiteralCreate &>(instr).dst;
-    case Type::ArrayLoad:
-      return derived_cast<const Bytecode::Instruction::ArrayLoad &>(instr).dst;
-    case Type::ArrayLoadImmediate:
-      return derived_cast<const Bytecode::Instruction::ArrayLoadImmediate &>(instr).dst;
-    case Type::StructCreate:
-      return derived_cast<const Bytecode::Instruction::StructCreate &>(instr).dst;
-    case Type::StructLiteralCreate:
-      return derived_cast<const Bytecode::Instruction::StructLiteralCreate &>(instr).dst;
-    case Type::StructLoad:
-      return derived_cast<const Bytecode::Instruction::StructLoad &>(instr).dst;
-    case Type::AddressOf:
-      return derived_cast<const Bytecode::Instruction::AddressOf &>(instr).dst;
-    case Type::LoadIndirect:
-      return derived_cast<const Bytecode::Instruction::LoadIndirect &>(instr).dst;
-    case Type::Negate:
-      return derived_cast<const Bytecode::Instruction::Negate &>(instr).dst;
-    case Type::LogicalNot:
-      return derived_cast<const Bytecode::Instruction::LogicalNot &>(instr).dst;
-    case Type::Jump:
-    case Type::JumpConditional:
-    case Type::JumpEqualImmediate:
-    case Type::JumpGreaterThanImmediate:
-    case Type::JumpLessThanOrEqual:
-    case Type::TailCall:
-    case Type::Return:
-    case Type::ArrayStore:
-      return std::nullopt;
+      return lhs != rhs;
+    default:
+      assert(false);
+      return false;
+  }
+}
+
+std::unique_ptr<Bytecode::Instruction> make_compare_branch(const Bytecode::Instruction &compare,
+                                                           Label label1, Label label2) {
+  const auto srcs = get_src_regs(compare);
+  const auto immediate = get_immediate(compare);
+  switch (compare.type()) {
+#define KAI_MAKE_COMPARE_BRANCH(compare, branch)                    \
+  case Type::compare:                                               \
+    return std::make_unique<Bytecode::Instruction::branch>(         \
+        srcs[0], immediate ? *immediate : srcs[1], label1, label2);
+    KAI_COMPARE_BRANCHES(KAI_MAKE_COMPARE_BRANCH)
+#undef KAI_MAKE_COMPARE_BRANCH
+    default:
+      return nullptr;
+  }
+}
+
+void insert_before_terminator(Bytecode::BasicBlock &block,
+                              std::unique_ptr<Bytecode::Instruction> instr) {
+  auto &instrs = block.instructions;
+  const auto terminator = std::find_if(instrs.begin(), instrs.end(),
+                                       [](const auto &other) { return is_terminator(*other); });
+  instrs.insert(terminator, std::move(instr));
+}
+
+size_t trim_after_terminator(Bytecode::BasicBlock &block) {
+  for (size_t i = 0; i < block.instructions.size(); ++i) {
+    if (is_terminator(*block.instructions[i])) {
+      const auto trimmed = block.instructions.size() - i - 1;
+      block.instructions.erase(block.instructions.begin() + static_cast<std::ptrdiff_t>(i + 1),
+                               block.instructions.end());
+      return trimmed;
+    }
+  }
+  return 0;
+}
+
+void insert_blocks(std::vector<Bytecode::BasicBlock> &blocks, Label at, size_t count,
+                   bool calls_land_on_new_blocks) {
+  const auto shift = [at, count](Label &label) {
+    if (label >= at) {
+      label += count;
+    }
+  };
+  const auto shift_call = [&](Label &label) {
+    if (!(calls_land_on_new_blocks && label == at)) {
+      shift(label);
+    }
+  };
+  for (auto &block : blocks) {
+    for (auto &instr_ptr : block.instructions) {
+      visit_labels(*instr_ptr, shift, shift_call);
+    }
+  }
+  std::vector<Bytecode::BasicBlock> inserted(count);
+  blocks.insert(blocks.begin() + static_cast<std::ptrdiff_t>(at),
+                std::make_move_iterator(inserted.begin()),
+                std::make_move_iterator(inserted.end()));
+}
+
+bool shares_blocks(const std::vector<Bytecode::Function> &functions,
+                   const Bytecode::Function &function) {
+  for (const auto &other : functions) {
+    if (&other == &function) {
+      continue;
+    }
+    for (const auto label : function.blocks) {
+      if (std::binary_search(other.blocks.begin(), other.blocks.end(), label)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool takes_address(const std::vector<Bytecode::BasicBlock> &blocks,
+                   const Bytecode::Function &function) {
+  return std::any_of(function.blocks.begin(), function.blocks.end(), [&](Label label) {
+    return std::any_of(blocks[label].instructions.begin(), blocks[label].instructions.end(),
+                       [](const auto &instr) { return instr->type() == Type::AddressOf; });
+  });
+}
+
+PassResult transform_loops(
+    std::vector<Bytecode::BasicBlock> &blocks, AnalysisCache &analyses,
+    const std::function<PassResult(const Bytecode::Function &, const ControlFlowGraph &,
+                                   const LoopForest &)> &transform) {
+  PassResult result;
+  const auto functions = analyses.functions();
+  for (const auto &function : functions) {
+    if (shares_blocks(functions, function) || takes_address(blocks, function)) {
+      continue;
+    }
+    PassResult function_result;
+    for (const auto label : function.blocks) {
+      function_result.changes += trim_after_terminator(blocks[label]);
+    }
+    const auto &function_cfg = analyses.cfg(function.entry);
+    const auto forest = find_loops(function_cfg);
+    const auto preheaders = insert_preheaders(blocks, function_cfg, forest);
+    function_result.changes += preheaders;
+    function_result.control_flow_changed = preheaders != 0;
+    if (function_result.control_flow_changed) {
+      const auto cfg = build_control_flow_graph(blocks, function.entry);
+      function_result += transform(function, cfg, find_loops(cfg));
+    } else {
+      function_result += transform(function, function_cfg, forest);
+    }
+    analyses.invalidate(function_result);
+    result += function_result;
   }
-  return std::nullopt;
+  return result;
 }
 
 }  // namespace kai
@@ -238,6 +238,12 @@ std::unique_ptr<Ast> Parser::parse_assignment() {
         std::move(index.array), std::move(index.index), std::move(value));
   }
 
+  if (left->type == Ast::Type::FieldAccess) {
+    auto &field_access = derived_cast<Ast::FieldAccess &>(*left);
+    return std::make_unique<Ast::FieldAssignment>(
+        std::move(field_access.object), std::move(field_access.field), std::move(value));
+  }
+
   // TODO(pointer): support dereference assignment targets (`*p = v`) by
   // lowering l-value dereferences here once pointer stores are implemented.
   error_reporter_.report<InvalidAssignmentTargetError>(equals_token.source_location());
@@ -143,6 +143,7 @@ void TypeChecker::visit_statement(const Ast* node) {
     }
     case T::Assignment:
     case T::IndexAssignment:
+    case T::FieldAssignment:
     case T::Return:
     case T::IfElse:
     case T::While:
@@ -381,6 +382,22 @@ TypeChecker::ExprInfo TypeChecker::visit_expression(const Ast* node) {
       return unknown();
     }
 
+    case T::FieldAssignment: {
+      const auto& assign = derived_cast<const Ast::FieldAssignment&>(*node);
+      const auto object = visit_expression(assign.object.get());
+      const auto value = visit_expression(assign.value.get());
+      if (object.shape->kind != Shape::Kind::Struct_Literal) {
+        reporter_.report<NotAStructError>(no_loc(), describe(object.shape->kind));
+        return value;
+      }
+      // Layouts are fixed at creation, so assignment cannot add a field.
+      auto& struct_shape = derived_cast<Shape::Struct_Literal&>(*object.shape);
+      if (!struct_shape.fields_.contains(assign.field)) {
+        reporter_.report<UndefinedFieldError>(no_loc(), assign.field);
+      }
+      return value;
+    }
+
     case T::FunctionDeclaration: {
       visit_statement(node);
       return unknown();
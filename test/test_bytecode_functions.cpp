@@ -267,3 +267,83 @@ TEST_CASE("test_bytecode_function_entry_starts_with_while_without_trampoline_jum
     kai::BytecodeInterpreter interp;
     REQUIRE(interp.interpret(gen.blocks()) == 1);
 }
+
+TEST_CASE("test_bytecode_function_registers_numbered_per_function") {
+    auto program = [] {
+      auto root = std::make_unique<Ast::Block>();
+      root->append(decl("a", lit(1)));
+      root->append(decl("b", lit(2)));
+      root->append(decl("c", add(var("a"), var("b"))));
+
+      auto sum_body = std::make_unique<Ast::Block>();
+      sum_body->append(ret(add(var("x"), var("y"))));
+      root->append(std::make_unique<Ast::FunctionDeclaration>(
+          "sum", std::vector<std::string>{"x", "y"}, std::move(sum_body)));
+      root->append(ret(call("sum", var("c"), lit(4))));
+      return std::move(*root);
+    }();
+
+    kai::BytecodeGenerator gen;
+    gen.visit_block(program);
+    gen.finalize();
+
+    const auto functions = kai::build_function_table(gen.blocks());
+    REQUIRE(functions.size() == 2);
+    REQUIRE(functions[0].entry == 0);
+    REQUIRE(functions[0].arity == 0);
+
+    const auto &sum = functions[1];
+    REQUIRE(sum.arity == 2);
+    REQUIRE(sum.parameter_registers == std::vector<kai::Bytecode::Register>{0, 1});
+    // Move x, Move y, Add: the callee frame does not include the caller's registers.
+    REQUIRE(sum.frame_size == 5);
+    REQUIRE(sum.max_call_depth == 0);
+    REQUIRE(functions[0].max_call_depth == 1);
+
+    kai::BytecodeInterpreter interp;
+    REQUIRE(interp.interpret(gen.blocks()) == 7);
+}
+
+TEST_CASE("test_bytecode_function_table_call_depth") {
+    // main (@0) calls f (@1), f calls g (@2), g counts down by tail-calling itself.
+    std::vector<kai::Bytecode::BasicBlock> blocks(5);
+    blocks[0].append<kai::Bytecode::Instruction::Load>(0, 3);
+    blocks[0].append<kai::Bytecode::Instruction::Call>(
+        1, 1, std::vector<kai::Bytecode::Register>{0},
+        std::vector<kai::Bytecode::Register>{0});
+    blocks[0].append<kai::Bytecode::Instruction::Return>(1);
+
+    blocks[1].append<kai::Bytecode::Instruction::Call>(
+        1, 2, std::vector<kai::Bytecode::Register>{0},
+        std::vector<kai::Bytecode::Register>{0});
+    blocks[1].append<kai::Bytecode::Instruction::Return>(1);
+
+    blocks[2].append<kai::Bytecode::Instruction::JumpEqualImmediate>(0, 0, 4, 3);
+    blocks[3].append<kai::Bytecode::Instruction::SubtractImmediate>(5, 0, 1);
+    blocks[3].append<kai::Bytecode::Instruction::TailCall>(
+        2, std::vector<kai::Bytecode::Register>{5},
+        std::vector<kai::Bytecode::Register>{0});
+    blocks[4].append<kai::Bytecode::Instruction::Return>(0);
+
+    const auto functions = kai::build_function_table(blocks);
+    REQUIRE(functions.size() == 3);
+    REQUIRE(functions[0].max_call_depth == 2);
+    REQUIRE(functions[1].max_call_depth == 1);
+    REQUIRE(functions[2].entry == 2);
+    REQUIRE(functions[2].blocks == std::vector<kai::Bytecode::Label>{2, 3, 4});
+    REQUIRE(functions[2].frame_size == 6);
+    REQUIRE(functions[2].max_call_depth == 0);
+
+    blocks[3].instructions.back() = std::make_unique<kai::Bytecode::Instruction::Call>(
+        6, 2, std::vector<kai::Bytecode::Register>{5},
+        std::vector<kai::Bytecode::Register>{0});
+    blocks[3].append<kai::Bytecode::Instruction::Return>(6);
+    const auto recursive = kai::build_function_table(blocks);
+    REQUIRE(recursive[2].max_call_depth ==
+            kai::Bytecode::Function::k_unbounded_call_depth);
+    REQUIRE(recursive[0].max_call_depth ==
+            kai::Bytecode::Function::k_unbounded_call_depth);
+
+    kai::BytecodeInterpreter interp;
+    REQUIRE(interp.interpret(blocks) == 0);
+}
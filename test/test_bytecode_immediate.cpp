@@ -99,13 +99,17 @@ TEST_CASE("bytecode_uses_subtract_immediate_for_repeated_n_minus_constants") {
   gen.visit_block(program);
   gen.finalize();
 
-  kai::BytecodeOptimizer opt;
-  opt.optimize(gen.blocks());
-
   REQUIRE(count_type(gen.blocks(), Type::SubtractImmediate) == 2);
   REQUIRE(!has_load_immediate(gen.blocks(), 1));
   REQUIRE(!has_load_immediate(gen.blocks(), 2));
 
+  // n is a constant, so the optimizer folds the whole expression.
+  kai::BytecodeOptimizer opt;
+  opt.optimize(gen.blocks());
+
+  REQUIRE(count_type(gen.blocks(), Type::SubtractImmediate) == 0);
+  REQUIRE(has_load_immediate(gen.blocks(), 13));
+
   kai::BytecodeInterpreter interp;
   REQUIRE(interp.interpret(gen.blocks()) == 13);
 }
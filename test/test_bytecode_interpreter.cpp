@@ -0,0 +1,106 @@
+#include "../src/ast.h"
+#include "../src/bytecode.h"
+#include "catch.hpp"
+#include "../src/optimizer.h"
+#include "../src/parser.h"
+
+using namespace kai;
+
+// A pointer to a local that escapes its frame through an array keeps reading
+// the local's last value after the frame's slots are reused by later calls,
+// and keeps an array held there alive across collections.
+TEST_CASE("test_bytecode_interpreter_pointer_outlives_its_frame") {
+  const char *sources[] = {
+      R"(
+fn f() {
+  let x = 5;
+  let arr = [&x];
+  return arr;
+}
+fn g(a) {
+  let y = 77;
+  return y + a;
+}
+let p = f();
+let z = g(1);
+return *p[0];
+)",
+      R"(
+fn f(n) {
+  let x = n;
+  let arr = [&x];
+  return arr;
+}
+fn g(a) {
+  let y = 77;
+  return y + a;
+}
+let p = f(5);
+let q = f(51);
+let z = g(1);
+return *p[0] + *q[0];
+)",
+      R"(
+fn f() {
+  let xs = [4, 5, 6];
+  let arr = [&xs];
+  return arr;
+}
+let p = f();
+let i = 0;
+let total = 0;
+while (i < 20000) {
+  let tmp = [i, i];
+  total = total + tmp[0] - tmp[1];
+  i++;
+}
+let ys = *p[0];
+return ys[1] + total;
+)",
+  };
+  const Bytecode::Value expected[] = {5, 56, 5};
+
+  for (size_t i = 0; i < 3; ++i) {
+    ErrorReporter reporter;
+    Parser parser(sources[i], reporter);
+    std::unique_ptr<Ast::Block> program = parser.parse_program();
+    REQUIRE(program != nullptr);
+
+    AstInterpreter ast_interpreter;
+    REQUIRE(ast_interpreter.interpret(*program) == expected[i]);
+
+    BytecodeGenerator generator;
+    generator.visit_block(*program);
+    generator.finalize();
+
+    BytecodeInterpreter bytecode_interpreter;
+    REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == expected[i]);
+
+    BytecodeOptimizer optimizer;
+    optimizer.optimize(generator.blocks());
+    REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == expected[i]);
+  }
+}
+
+// While its frame is live, a pointer reads the local as it is now.
+TEST_CASE("test_bytecode_interpreter_pointer_sees_later_writes_in_its_frame") {
+  ErrorReporter reporter;
+  Parser parser(R"(
+fn f() {
+  let x = 5;
+  let p = &x;
+  x = 9;
+  return *p;
+}
+return f();
+)", reporter);
+  std::unique_ptr<Ast::Block> program = parser.parse_program();
+  REQUIRE(program != nullptr);
+
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+
+  BytecodeInterpreter bytecode_interpreter;
+  REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 9);
+}
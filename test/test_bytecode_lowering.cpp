@@ -0,0 +1,106 @@
+#include "catch.hpp"
+#include "test_bytecode_cases.h"
+
+using Type = kai::Bytecode::Instruction::Type;
+
+TEST_CASE("test_bytecode_lowering_lays_out_blocks_contiguously") {
+    // 0: r0 = 5; jump @2
+    // 1: sum(a, b) = a + b
+    // 2: r1 = call @1(r0, r0); return r1
+    std::vector<kai::Bytecode::BasicBlock> blocks(3);
+    blocks[0].append<kai::Bytecode::Instruction::Load>(0, 5);
+    blocks[0].append<kai::Bytecode::Instruction::Jump>(2);
+    blocks[1].append<kai::Bytecode::Instruction::Add>(2, 0, 1);
+    blocks[1].append<kai::Bytecode::Instruction::Return>(2);
+    blocks[2].append<kai::Bytecode::Instruction::Call>(
+        1, 1, std::vector<kai::Bytecode::Register>{0, 0},
+        std::vector<kai::Bytecode::Register>{0, 1});
+    blocks[2].append<kai::Bytecode::Instruction::Return>(1);
+
+    const auto executable = kai::lower_to_executable(blocks);
+    REQUIRE(executable.code.size() == 6);
+    REQUIRE(executable.block_offsets == std::vector<kai::u32>{0, 2, 4});
+    REQUIRE(executable.entry_frame_size == 2);
+
+    const auto &jump = executable.code[1];
+    REQUIRE(jump.type == Type::Jump);
+    REQUIRE(jump.b == 4);
+
+    const auto &call = executable.code[4];
+    REQUIRE(call.type == Type::Call);
+    REQUIRE(call.a == 1);
+    REQUIRE(call.b == 2);
+    REQUIRE(call.d == 2);
+    REQUIRE(call.value == 3);
+    REQUIRE(std::vector<kai::u32>(executable.operands.begin() + call.c,
+                                  executable.operands.begin() + call.c + 2 * call.d) ==
+            std::vector<kai::u32>{0, 0, 0, 1});
+
+    kai::BytecodeInterpreter interp;
+    REQUIRE(interp.interpret(executable) == 10);
+}
+
+TEST_CASE("test_bytecode_lowering_schedules_tail_call_moves") {
+    // 0: return swap_down(3, 4, 7)
+    // 1: swap_down(a, b, n): if n == 0
+    // 2:   return a * 100 + b
+    // 3: return swap_down(b, a, n - 1)
+    using Register = kai::Bytecode::Register;
+    std::vector<kai::Bytecode::BasicBlock> blocks(4);
+    blocks[0].append<kai::Bytecode::Instruction::Load>(0, 3);
+    blocks[0].append<kai::Bytecode::Instruction::Load>(1, 4);
+    blocks[0].append<kai::Bytecode::Instruction::Load>(2, 7);
+    blocks[0].append<kai::Bytecode::Instruction::Call>(
+        3, 1, std::vector<Register>{0, 1, 2}, std::vector<Register>{0, 1, 2});
+    blocks[0].append<kai::Bytecode::Instruction::Return>(3);
+    blocks[1].append<kai::Bytecode::Instruction::EqualImmediate>(3, 2, 0);
+    blocks[1].append<kai::Bytecode::Instruction::JumpConditional>(3, 2, 3);
+    blocks[2].append<kai::Bytecode::Instruction::MultiplyImmediate>(4, 0, 100);
+    blocks[2].append<kai::Bytecode::Instruction::Add>(4, 4, 1);
+    blocks[2].append<kai::Bytecode::Instruction::Return>(4);
+    blocks[3].append<kai::Bytecode::Instruction::SubtractImmediate>(5, 2, 1);
+    blocks[3].append<kai::Bytecode::Instruction::TailCall>(
+        1, std::vector<Register>{1, 0, 5}, std::vector<Register>{0, 1, 2});
+
+    const auto executable = kai::lower_to_executable(blocks);
+    const auto &tail_call = executable.code.back();
+    REQUIRE(tail_call.type == Type::TailCall);
+    REQUIRE(tail_call.d == 3);
+
+    // n is moved first since nothing reads its parameter; the swap of a and
+    // b is a cycle and goes through the temporary.
+    constexpr auto temporary = kai::Bytecode::Executable::k_move_temporary;
+    const auto *moves = executable.operands.data() + tail_call.c + 2 * tail_call.d;
+    REQUIRE(tail_call.a == 4);
+    REQUIRE(std::vector<kai::u32>(moves, moves + 2 * tail_call.a) ==
+            std::vector<kai::u32>{2, 5, temporary, 0, 0, 1, 1, temporary});
+
+    kai::BytecodeInterpreter interp;
+    REQUIRE(interp.interpret(executable) == 403);
+}
+
+TEST_CASE("test_bytecode_lowering_pools_aggregate_operands") {
+    auto program = [] {
+      auto body = std::make_unique<Ast::Block>();
+      body->append(decl("a", lit(4)));
+      std::vector<std::unique_ptr<Ast>> elements;
+      elements.emplace_back(lit(3));
+      elements.emplace_back(var("a"));
+      body->append(decl("xs", std::make_unique<Ast::ArrayLiteral>(std::move(elements))));
+      body->append(decl("point", struct_lit({{"x", 40}, {"y", 2}})));
+      body->append(ret(add(add(idx(var("xs"), lit(1)), field_get(var("point"), "x")),
+                           field_get(var("point"), "y"))));
+      return std::move(*body);
+    }();
+
+    kai::BytecodeGenerator gen;
+    gen.visit_block(program);
+    gen.finalize();
+
+    const auto executable = kai::lower_to_executable(gen.blocks());
+    REQUIRE(executable.strings == std::vector<std::string>{"x", "y"});
+
+    kai::BytecodeInterpreter interp;
+    REQUIRE(interp.interpret(executable) == 46);
+    REQUIRE(interp.interpret(gen.blocks()) == 46);
+}
@@ -0,0 +1,85 @@
+#include "catch.hpp"
+#include "../src/bytecode_operands.h"
+
+#include <string>
+
+using Type = kai::Bytecode::Instruction::Type;
+
+namespace {
+
+// Records every operand as "<role> <number>" in visiting order.
+struct Recorder : kai::OperandVisitor {
+    std::vector<std::string> operands;
+
+    void use(const kai::Bytecode::Register &reg) { record("use", reg); }
+    void def(const kai::Bytecode::Register &reg) { record("def", reg); }
+    void immediate(const kai::Bytecode::Value &value) { record("imm", value); }
+    void jump(const kai::Bytecode::Label &label) { record("jump", label); }
+    void call(const kai::Bytecode::Label &label) { record("call", label); }
+    void parameters(const std::vector<kai::Bytecode::Register> &registers, bool in_own_frame) {
+        for (const auto reg : registers) {
+            record(in_own_frame ? "own param" : "param", reg);
+        }
+    }
+
+    void record(const char *role, kai::u64 number) {
+        operands.push_back(std::string(role) + " " + std::to_string(number));
+    }
+};
+
+std::vector<std::string> operands_of(const kai::Bytecode::Instruction &instr) {
+    Recorder recorder;
+    kai::visit_operands(instr, recorder);
+    return recorder.operands;
+}
+
+}  // namespace
+
+TEST_CASE("test_bytecode_operands_visit_uses_before_the_def") {
+    REQUIRE(operands_of(kai::Bytecode::Instruction::Add(3, 1, 2)) ==
+            std::vector<std::string>{"use 1", "use 2", "def 3"});
+    REQUIRE(operands_of(kai::Bytecode::Instruction::AddImmediate(3, 1, 9)) ==
+            std::vector<std::string>{"use 1", "def 3", "imm 9"});
+    REQUIRE(operands_of(kai::Bytecode::Instruction::ArrayStore(4, 5, 6)) ==
+            std::vector<std::string>{"use 4", "use 5", "use 6"});
+    REQUIRE(operands_of(kai::Bytecode::Instruction::StructCreate(
+                7, {{"x", 1}, {"y", 2}})) ==
+            std::vector<std::string>{"use 1", "use 2", "def 7"});
+    REQUIRE(operands_of(kai::Bytecode::Instruction::JumpEqualImmediate(1, 0, 4, 5)) ==
+            std::vector<std::string>{"use 1", "imm 0", "jump 4", "jump 5"});
+}
+
+TEST_CASE("test_bytecode_operands_tell_tail_call_parameters_apart") {
+    REQUIRE(operands_of(kai::Bytecode::Instruction::Call(0, 3, {1, 2}, {5, 6})) ==
+            std::vector<std::string>{"use 1", "use 2", "def 0", "call 3", "param 5",
+                                     "param 6"});
+    REQUIRE(operands_of(kai::Bytecode::Instruction::TailCall(3, {1}, {5})) ==
+            std::vector<std::string>{"use 1", "call 3", "own param 5"});
+}
+
+TEST_CASE("test_bytecode_operands_rename_registers_in_place") {
+    struct Shift : kai::OperandVisitor {
+        void use(kai::Bytecode::Register &reg) { reg += 10; }
+    };
+    kai::Bytecode::Instruction::Multiply multiply(0, 1, 2);
+    kai::Bytecode::Instruction &instr = multiply;
+    kai::visit_operands(instr, Shift{});
+    REQUIRE(multiply.dst == 0);
+    REQUIRE(multiply.src1 == 11);
+    REQUIRE(multiply.src2 == 12);
+}
+
+TEST_CASE("test_bytecode_operands_flags_describe_effects") {
+    REQUIRE(kai::has_opcode_flag(Type::Add, kai::k_pure));
+    REQUIRE(kai::has_opcode_flag(Type::Add, kai::k_commutative));
+    REQUIRE_FALSE(kai::has_opcode_flag(Type::Subtract, kai::k_commutative));
+    REQUIRE(kai::has_opcode_flag(Type::ModuloImmediate, kai::k_may_fault));
+    REQUIRE(kai::has_opcode_flag(Type::TailCall, kai::k_calls));
+    REQUIRE(kai::has_opcode_flag(Type::TailCall, kai::k_terminator));
+    REQUIRE_FALSE(kai::has_opcode_flag(Type::Call, kai::k_terminator));
+    REQUIRE(kai::has_opcode_flag(Type::StructStore, kai::k_writes_heap));
+    REQUIRE(kai::has_opcode_flag(Type::ArrayLoadImmediate, kai::k_reads_heap));
+    REQUIRE(kai::has_opcode_flag(Type::ArrayLiteralCreate, kai::k_allocates));
+    REQUIRE_FALSE(kai::has_opcode_flag(Type::LoadIndirect, kai::k_pure));
+    static_assert(kai::has_opcode_flag(Type::Return, kai::k_terminator));
+}
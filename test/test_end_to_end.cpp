@@ -7,6 +7,7 @@
 #include "../src/typechecker.h"
 
 #include <algorithm>
+#include <stdexcept>
 
 using namespace kai;
 
@@ -799,6 +800,44 @@ return *p + y;
   REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 104);
 }
 
+TEST_CASE("test_program_end_to_end_pointer_argument_survives_register_stack_growth") {
+  ErrorReporter reporter;
+  Parser parser(R"(
+fn depth(n) {
+  if (n == 0) {
+    return 0;
+  } else {
+    return depth(n - 1) + 1;
+  }
+}
+fn read_after_calls(p) {
+  let d = depth(200);
+  return *p + d;
+}
+let x = 7;
+let p = &x;
+x = 9;
+return read_after_calls(p);
+)", reporter);
+  std::unique_ptr<Ast::Block> program = parser.parse_program();
+  REQUIRE(program != nullptr);
+  REQUIRE(typecheck_program(*program).empty());
+
+  AstInterpreter ast_interpreter;
+  REQUIRE(ast_interpreter.interpret(*program) == 209);
+
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+
+  BytecodeInterpreter bytecode_interpreter;
+  REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 209);
+
+  BytecodeOptimizer optimizer;
+  optimizer.optimize(generator.blocks());
+  REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 209);
+}
+
 TEST_CASE("test_program_end_to_end_pointer_alias_via_assignment_tracks_same_cell") {
   ErrorReporter reporter;
   Parser parser(R"(
@@ -970,3 +1009,182 @@ return point.x + point.y;
   BytecodeInterpreter bytecode_interpreter;
   REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 42);
 }
+
+TEST_CASE("test_program_end_to_end_garbage_collection_keeps_allocation_loop_flat") {
+  ErrorReporter reporter;
+  Parser parser(R"(
+fn same(a, b) {
+  return a == b;
+}
+let keep = [1, 2, 3];
+let x = 5;
+let p = &x;
+let i = 0;
+let total = 0;
+while (i < 20000) {
+  let tmp = [i, i + 1];
+  let point = struct { x: i, y: 1 };
+  total = total + tmp[1] - tmp[0] + point.y + same([0], [0]);
+  let q = &total;
+  i++;
+}
+return total + keep[2] + *p;
+)", reporter);
+  std::unique_ptr<Ast::Block> program = parser.parse_program();
+  REQUIRE(program != nullptr);
+  REQUIRE(typecheck_program(*program).empty());
+
+  AstInterpreter ast_interpreter;
+  REQUIRE(ast_interpreter.interpret(*program) == 40008);
+  REQUIRE(ast_interpreter.heap.stats().collections > 0);
+  REQUIRE(ast_interpreter.heap.stats().allocated_objects > 80000);
+  REQUIRE(ast_interpreter.heap.stats().slots < 4 * Heap::k_min_collection_threshold);
+
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+
+  BytecodeInterpreter bytecode_interpreter;
+  REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 40008);
+  REQUIRE(bytecode_interpreter.heap_stats().collections > 0);
+  REQUIRE(bytecode_interpreter.heap_stats().slots < 4 * Heap::k_min_collection_threshold);
+
+  BytecodeOptimizer optimizer;
+  optimizer.optimize(generator.blocks());
+  REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 40008);
+  REQUIRE(bytecode_interpreter.heap_stats().slots < 4 * Heap::k_min_collection_threshold);
+}
+
+TEST_CASE("test_program_end_to_end_struct_loads_across_layouts") {
+  ErrorReporter reporter;
+  Parser parser(R"(
+fn get_x(point) {
+  return point.x;
+}
+let total = 0;
+let i = 0;
+while (i < 12) {
+  let a = struct { x: 1, y: 2 };
+  let b = struct { y: 20, x: 10 };
+  let c = struct { z: 0, x: 100 };
+  let d = struct { x: 1000 };
+  let e = struct { w: 0, v: 0, x: 10000 };
+  let f = struct { u: 0, x: 100000 };
+  total = total + get_x(a) + get_x(b) + get_x(c) + get_x(d) + get_x(e) + get_x(f);
+  i++;
+}
+return total + struct { y: 5, x: 1 }.y;
+)", reporter);
+  std::unique_ptr<Ast::Block> program = parser.parse_program();
+  REQUIRE(program != nullptr);
+
+  AstInterpreter ast_interpreter;
+  REQUIRE(ast_interpreter.interpret(*program) == 1333337);
+
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+
+  BytecodeInterpreter bytecode_interpreter;
+  REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 1333337);
+
+  BytecodeOptimizer optimizer;
+  optimizer.optimize(generator.blocks());
+  REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 1333337);
+}
+
+TEST_CASE("test_program_end_to_end_field_assignment_updates_struct_in_place") {
+  ErrorReporter reporter;
+  Parser parser(R"(
+let point = struct { x: 0, y: 0 };
+let i = 0;
+while (i < 3000) {
+  point.x = point.x + 2;
+  point.y = point.x - i;
+  i++;
+}
+let alias = point;
+alias.y = 7;
+return point.x + point.y;
+)", reporter);
+  std::unique_ptr<Ast::Block> program = parser.parse_program();
+  REQUIRE(program != nullptr);
+  REQUIRE(typecheck_program(*program).empty());
+
+  AstInterpreter ast_interpreter;
+  REQUIRE(ast_interpreter.interpret(*program) == 6007);
+  REQUIRE(ast_interpreter.heap.stats().allocated_objects == 1);
+
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+
+  BytecodeInterpreter bytecode_interpreter;
+  REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 6007);
+  REQUIRE(bytecode_interpreter.heap_stats().allocated_objects == 1);
+
+  // The struct never leaves the program, so the optimizer keeps its fields
+  // in registers.
+  BytecodeOptimizer optimizer;
+  optimizer.optimize(generator.blocks());
+  REQUIRE(bytecode_interpreter.interpret(generator.blocks()) == 6007);
+  REQUIRE(bytecode_interpreter.heap_stats().allocated_objects == 0);
+}
+
+TEST_CASE("test_program_end_to_end_array_index_out_of_bounds_throws") {
+  ErrorReporter reporter;
+  Parser parser(R"(
+let values = [1, 2, 3];
+let i = 0;
+let total = 0;
+while (i < 4) {
+  total = total + values[i];
+  i++;
+}
+return total;
+)", reporter);
+  std::unique_ptr<Ast::Block> program = parser.parse_program();
+  REQUIRE(program != nullptr);
+  REQUIRE(typecheck_program(*program).empty());
+
+  AstInterpreter ast_interpreter;
+  REQUIRE_THROWS_AS(ast_interpreter.interpret(*program), std::out_of_range);
+
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+
+  BytecodeInterpreter bytecode_interpreter;
+  REQUIRE_THROWS_AS(bytecode_interpreter.interpret(generator.blocks()), std::out_of_range);
+
+  BytecodeOptimizer optimizer;
+  optimizer.optimize(generator.blocks());
+  REQUIRE_THROWS_AS(bytecode_interpreter.interpret(generator.blocks()), std::out_of_range);
+}
+
+TEST_CASE("test_program_end_to_end_store_through_a_non_array_throws") {
+  ErrorReporter reporter;
+  Parser parser(R"(
+fn put(a, i) {
+  a[i] = 7;
+  return 0;
+}
+return put(1000000000, 0);
+)", reporter);
+  std::unique_ptr<Ast::Block> program = parser.parse_program();
+  REQUIRE(program != nullptr);
+
+  AstInterpreter ast_interpreter;
+  REQUIRE_THROWS_AS(ast_interpreter.interpret(*program), std::out_of_range);
+
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+
+  BytecodeInterpreter bytecode_interpreter;
+  REQUIRE_THROWS_AS(bytecode_interpreter.interpret(generator.blocks()), std::out_of_range);
+
+  BytecodeOptimizer optimizer;
+  optimizer.optimize(generator.blocks());
+  REQUIRE_THROWS_AS(bytecode_interpreter.interpret(generator.blocks()), std::out_of_range);
+}
@@ -0,0 +1,80 @@
+#include "catch.hpp"
+#include "../src/heap.h"
+
+#include <stdexcept>
+
+TEST_CASE("test_heap_handles_index_a_dense_slot_table") {
+  kai::Heap heap;
+  const auto array = heap.allocate_array({10, 20, 30});
+  const auto layout = heap.layouts().intern({"x"}).layout;
+  const auto object = heap.allocate_struct(layout, {7});
+  const auto empty = heap.allocate_array({});
+
+  REQUIRE(array == 1);
+  REQUIRE(object == 2);
+  REQUIRE(empty == 3);
+  REQUIRE(heap.size() == 3);
+
+  REQUIRE(heap.load(array, 1) == 20);
+  heap.store(array, 1, 25);
+  REQUIRE(heap.load(array, 1) == 25);
+  REQUIRE(heap.array(array) == std::vector<kai::Heap::Value>{10, 25, 30});
+  REQUIRE(heap.array(empty).empty());
+
+  REQUIRE(heap.struct_layout(object) == layout);
+  REQUIRE(heap.load_field(object, 0) == 7);
+
+  heap.clear();
+  REQUIRE(heap.size() == 0);
+  REQUIRE(heap.allocate_array({1}) == 1);
+}
+
+TEST_CASE("test_heap_rejects_handles_that_name_no_object_of_the_kind") {
+  kai::Heap heap;
+  const auto array = heap.allocate_array({10});
+  const auto layout = heap.layouts().intern({"x"}).layout;
+  const auto object = heap.allocate_struct(layout, {7});
+
+  REQUIRE_THROWS_AS(heap.load(0, 0), std::out_of_range);
+  REQUIRE_THROWS_AS(heap.store(1000000000, 0, 7), std::out_of_range);
+  REQUIRE_THROWS_AS(heap.load_unchecked(object + 1, 0), std::out_of_range);
+  REQUIRE_THROWS_AS(heap.struct_layout(1000000000), std::out_of_range);
+
+  REQUIRE_THROWS_AS(heap.load(object, 0), std::runtime_error);
+  REQUIRE_THROWS_AS(heap.store_unchecked(object, 0, 1), std::runtime_error);
+  REQUIRE_THROWS_AS(heap.load_field(array, 0), std::runtime_error);
+  REQUIRE_THROWS_AS(heap.store_field(array, 0, 1), std::runtime_error);
+  REQUIRE(heap.load(array, 0) == 10);
+  REQUIRE(heap.load_field(object, 0) == 7);
+}
+
+TEST_CASE("test_heap_rejects_element_access_past_the_end") {
+  kai::Heap heap;
+  const auto array = heap.allocate_array({10, 20, 30});
+  const auto empty = heap.allocate_array({});
+
+  REQUIRE_THROWS_AS(heap.load(array, 3), std::out_of_range);
+  REQUIRE_THROWS_AS(heap.store(array, ~kai::Heap::Value{0}, 1), std::out_of_range);
+  REQUIRE_THROWS_AS(heap.load(empty, 0), std::out_of_range);
+  REQUIRE(heap.array(array) == std::vector<kai::Heap::Value>{10, 20, 30});
+
+  heap.store_unchecked(array, 2, 35);
+  REQUIRE(heap.load_unchecked(array, 2) == 35);
+}
+
+TEST_CASE("test_heap_struct_layouts_are_shared_by_field_set") {
+  kai::StructLayouts layouts;
+  const auto point = layouts.intern({"y", "x"});
+  const auto same_point = layouts.intern({"x", "y"});
+  const auto other = layouts.intern({"z", "x", "y"});
+  const auto repeated = layouts.intern({"x", "x"});
+
+  REQUIRE(point.layout == same_point.layout);
+  REQUIRE(point.offsets == std::vector<uint32_t>{1, 0});
+  REQUIRE(same_point.offsets == std::vector<uint32_t>{0, 1});
+  REQUIRE(other.layout != point.layout);
+  REQUIRE(layouts.fields(other.layout) == std::vector<std::string>{"x", "y", "z"});
+  REQUIRE(layouts.offset(other.layout, "z") == 2);
+  REQUIRE(repeated.offsets == std::vector<uint32_t>{0, 0});
+  REQUIRE(layouts.size() == 3);
+}
@@ -0,0 +1,349 @@
+#include "../src/bytecode.h"
+#include "catch.hpp"
+#include "../src/jit.h"
+#include "../src/optimizer.h"
+#include "../src/parser.h"
+
+#include <cstdio>
+
+using namespace kai;
+
+namespace {
+
+struct JitRun {
+  Bytecode::Value interpreted;
+  Bytecode::Value jitted;
+  size_t compiled_functions;
+  size_t osr_transfers;
+};
+
+// Thresholds of 1 tier every function up on its first call and every loop on
+// its first back edge.
+JitRun run_with_and_without_jit(
+    const char *source, bool optimize, u32 call_threshold = 1, u32 back_edge_threshold = 1,
+    size_t inline_threshold = BytecodeOptimizer::k_default_inline_threshold) {
+  ErrorReporter reporter;
+  Parser parser(source, reporter);
+  auto program = parser.parse_program();
+  REQUIRE(program != nullptr);
+  REQUIRE(!reporter.has_errors());
+
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+  if (optimize) {
+    BytecodeOptimizer optimizer;
+    optimizer.set_inline_threshold(inline_threshold);
+    optimizer.optimize(generator.blocks());
+  }
+
+  BytecodeInterpreter interpreter;
+  const auto interpreted = interpreter.interpret(generator.blocks());
+  interpreter.set_jit_enabled(true);
+  interpreter.set_jit_thresholds(call_threshold, back_edge_threshold);
+  const auto jitted = interpreter.interpret(generator.blocks());
+  return {interpreted, jitted, interpreter.jit_compiled_function_count(),
+          interpreter.jit_osr_transfer_count()};
+}
+
+}  // namespace
+
+TEST_CASE("test_jit_matches_interpreter_on_arithmetic_and_calls") {
+  const char *source = R"(
+fn divisor_count_of_square(n) {
+  let m = n;
+  let count = 1;
+  let p = 2;
+  while (p * p <= m) {
+    let exponent = 0;
+    while (m % p == 0) {
+      m = m / p;
+      exponent++;
+    }
+    if (exponent > 0) {
+      count = count * (2 * exponent + 1);
+    }
+    if (p == 2) {
+      p = 3;
+    } else {
+      p = p + 2;
+    }
+  }
+  if (m > 1) {
+    count = count * 3;
+  }
+  return count;
+}
+fn fib(n) {
+  if (n < 2) {
+    return n;
+  }
+  return fib(n - 1) + fib(n - 2);
+}
+let total = 0;
+let i = 1;
+while (i <= 300) {
+  total = total + divisor_count_of_square(i);
+  i++;
+}
+return total * 1000 + fib(15);
+)";
+  for (const bool optimize : {false, true}) {
+    const auto run = run_with_and_without_jit(source, optimize);
+    REQUIRE(run.jitted == run.interpreted);
+    if (Jit::is_supported()) {
+      REQUIRE(run.compiled_functions == 3);
+    }
+  }
+}
+
+TEST_CASE("test_jit_matches_interpreter_on_unsigned_and_wide_values") {
+  // Values are unsigned 64-bit: negative numbers compare above positive ones,
+  // and immediates that do not fit in 32 bits take the wide encodings.
+  const char *source = R"(
+fn mix(a, b) {
+  let big = 5000000000;
+  let result = 0;
+  if (-a > b) {
+    result = result + 1;
+  }
+  if (a * big > big) {
+    result = result + 10;
+  }
+  if (!(a - b)) {
+    result = result + 100;
+  }
+  return result + (a + big) / b + (a * 3000000000) % 7 + (big - a) % b;
+}
+return mix(3, 2) + mix(7, 7) * 1000;
+)";
+  for (const bool optimize : {false, true}) {
+    const auto run = run_with_and_without_jit(source, optimize);
+    REQUIRE(run.jitted == run.interpreted);
+  }
+}
+
+TEST_CASE("test_jit_matches_interpreter_on_every_compare_branch") {
+  // Each loop and `if` condition becomes one of the fused compare-and-branch
+  // opcodes once optimized, with register or immediate operands.
+  const char *source = R"(
+fn shapes(n, m) {
+  let result = 0;
+  let i = 0;
+  while (i < n) {
+    if (i <= m) { result = result + 1; }
+    if (i > m) { result = result + 2; }
+    if (i >= m) { result = result + 4; }
+    if (i == m) { result = result + 8; }
+    if (i != m) { result = result + 16; }
+    if (i <= 3) { result = result + 32; }
+    if (i >= 3) { result = result + 64; }
+    if (i != 3) { result = result + 128; }
+    i++;
+  }
+  let j = n;
+  while (j > 0) {
+    j = j - 1;
+    result = result * 3;
+  }
+  return result;
+}
+return shapes(6, 2) + shapes(9, 9);
+)";
+  for (const bool optimize : {false, true}) {
+    const auto run = run_with_and_without_jit(source, optimize);
+    REQUIRE(run.jitted == run.interpreted);
+  }
+}
+
+TEST_CASE("test_jit_tail_calls_swap_arguments_in_place") {
+  const char *source = R"(
+fn gcd_steps(a, b, steps) {
+  if (b == 0) {
+    return a * 1000 + steps;
+  }
+  return gcd_steps(b, a % b, steps + 1);
+}
+fn swap_down(a, b, n) {
+  if (n == 0) {
+    return a * 100 + b;
+  }
+  return swap_down(b, a, n - 1);
+}
+return gcd_steps(1071, 462, 0) + swap_down(3, 4, 7) + swap_down(3, 4, 8);
+)";
+  for (const bool optimize : {false, true}) {
+    const auto run = run_with_and_without_jit(source, optimize);
+    REQUIRE(run.interpreted == 21003 + 403 + 304);
+    REQUIRE(run.jitted == run.interpreted);
+  }
+}
+
+TEST_CASE("test_jit_recurses_as_deep_as_the_interpreter") {
+  // A million native calls overflow the machine stack of the thread, but fit
+  // the JIT's own. Three million unoptimized frames need more slots than the
+  // register stack has, so native code gives up and the interpreter runs the
+  // call instead.
+  const char *source = R"(
+fn depth(n) {
+  if (n == 0) {
+    return 0;
+  }
+  return depth(n - 1) + 1;
+}
+return depth(%u);
+)";
+  for (const u32 depth : {1000000u, 3000000u}) {
+    char program[256];
+    std::snprintf(program, sizeof(program), source, depth);
+    const auto run = run_with_and_without_jit(program, false);
+    REQUIRE(run.interpreted == depth);
+    REQUIRE(run.jitted == depth);
+    if (Jit::is_supported()) {
+      REQUIRE(run.compiled_functions == 1);
+    }
+  }
+}
+
+TEST_CASE("test_jit_leaves_unsupported_functions_to_the_interpreter") {
+  // `sum` uses arrays and `calls_sum` calls it, so neither is compiled; the
+  // program entry calls both kinds of function.
+  const char *source = R"(
+fn square(x) {
+  return x * x;
+}
+fn sum(xs) {
+  return xs[0] + xs[1];
+}
+fn calls_sum(a) {
+  return sum([a, square(a)]);
+}
+let point = struct { x: 4 };
+return calls_sum(3) + square(point.x);
+)";
+  const auto run = run_with_and_without_jit(source, false);
+  REQUIRE(run.interpreted == 28);
+  REQUIRE(run.jitted == 28);
+  if (Jit::is_supported()) {
+    REQUIRE(run.compiled_functions == 1);
+  }
+}
+
+TEST_CASE("test_jit_short_programs_stay_interpreted") {
+  const char *source = R"(
+fn square(x) {
+  return x * x;
+}
+let total = 0;
+let i = 0;
+while (i < 10) {
+  total = total + square(i);
+  i++;
+}
+return total;
+)";
+  const auto run = run_with_and_without_jit(source, true,
+                                            BytecodeInterpreter::k_default_call_threshold,
+                                            BytecodeInterpreter::k_default_back_edge_threshold);
+  REQUIRE(run.interpreted == 285);
+  REQUIRE(run.jitted == 285);
+  REQUIRE(run.compiled_functions == 0);
+  REQUIRE(run.osr_transfers == 0);
+}
+
+TEST_CASE("test_jit_promotes_functions_by_call_count") {
+  // The loop never gets hot enough for OSR, but `step` is called often.
+  const char *source = R"(
+fn step(x) {
+  return (x * 7 + 3) % 1000;
+}
+let x = 1;
+let i = 0;
+while (i < 50) {
+  x = step(x);
+  i++;
+}
+return x;
+)";
+  const auto run = run_with_and_without_jit(source, false, 10, 1000000);
+  REQUIRE(run.jitted == run.interpreted);
+  if (Jit::is_supported()) {
+    REQUIRE(run.compiled_functions == 1);
+    REQUIRE(run.osr_transfers == 0);
+  }
+}
+
+TEST_CASE("test_jit_transfers_hot_loops_mid_flight") {
+  // The top-level loop and the loop inside `mix` both run long enough to move
+  // into native code part way through. The program entry builds an array and
+  // indexes it at run time, so only `mix` can be compiled and its result
+  // returns to the interpreter.
+  // Inlining is off so that `mix` stays a function of its own.
+  const char *source = R"(
+fn mix(n) {
+  let i = 0;
+  let s = 0;
+  while (i < n) {
+    s = s + i * i % 7;
+    i++;
+  }
+  return s;
+}
+let pair = [mix(5000), 2];
+let total = pair[mix(1)];
+let j = 0;
+while (j < 5000) {
+  total = total + j % 3;
+  j++;
+}
+return total + pair[1];
+)";
+  for (const bool optimize : {false, true}) {
+    const auto run = run_with_and_without_jit(
+        source, optimize, BytecodeInterpreter::k_default_call_threshold,
+        BytecodeInterpreter::k_default_back_edge_threshold, 0);
+    REQUIRE(run.jitted == run.interpreted);
+    if (Jit::is_supported()) {
+      REQUIRE(run.compiled_functions == 1);
+      REQUIRE(run.osr_transfers == 1);
+    }
+  }
+}
+
+TEST_CASE("test_jit_transfers_top_level_loop_mid_flight") {
+  const char *source = R"(
+fn collatz_steps(n) {
+  let steps = 0;
+  while (n != 1) {
+    if (n % 2 == 0) {
+      n = n / 2;
+    } else {
+      n = 3 * n + 1;
+    }
+    steps++;
+  }
+  return steps;
+}
+let longest = 0;
+let i = 1;
+while (i < 3000) {
+  let steps = collatz_steps(i);
+  if (steps > longest) {
+    longest = steps;
+  }
+  i++;
+}
+return longest;
+)";
+  for (const bool optimize : {false, true}) {
+    const auto run = run_with_and_without_jit(
+        source, optimize, BytecodeInterpreter::k_default_call_threshold,
+        BytecodeInterpreter::k_default_back_edge_threshold);
+    REQUIRE(run.jitted == run.interpreted);
+    if (Jit::is_supported()) {
+      // Both functions are compiled; the program entry finishes natively.
+      REQUIRE(run.compiled_functions == 2);
+      REQUIRE(run.osr_transfers >= 1);
+    }
+  }
+}
@@ -47,22 +47,33 @@ TEST_CASE("const_cond_jump_conditional_false_simplifies_to_jump_false_label") {
 }
 
 TEST_CASE("const_cond_no_simplify_when_condition_overwritten") {
-  std::vector<Bytecode::BasicBlock> blocks(3);
-  blocks[0].append<Bytecode::Instruction::Load>(0, 1);
-  blocks[0].append<Bytecode::Instruction::AddImmediate>(0, 0, 1);
-  blocks[0].append<Bytecode::Instruction::JumpConditional>(0, 1, 2);
+  // The condition is loaded as a constant, then overwritten with a value
+  // derived from the parameter, so no pass may fold the branch.
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 3);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      1, 1, std::vector<Bytecode::Register>{0}, std::vector<Bytecode::Register>{10});
+  blocks[0].append<Bytecode::Instruction::Return>(1);
 
-  blocks[1].append<Bytecode::Instruction::Load>(1, 11);
-  blocks[1].append<Bytecode::Instruction::Return>(1);
+  blocks[1].append<Bytecode::Instruction::Load>(0, 1);
+  blocks[1].append<Bytecode::Instruction::Add>(0, 0, 10);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(0, 2, 3);
 
-  blocks[2].append<Bytecode::Instruction::Load>(2, 22);
-  blocks[2].append<Bytecode::Instruction::Return>(2);
+  blocks[2].append<Bytecode::Instruction::Load>(1, 11);
+  blocks[2].append<Bytecode::Instruction::Return>(1);
+
+  blocks[3].append<Bytecode::Instruction::Load>(2, 22);
+  blocks[3].append<Bytecode::Instruction::Return>(2);
 
   BytecodeOptimizer opt;
+  opt.set_inline_threshold(0);
   opt.optimize(blocks);
 
-  REQUIRE(blocks[0].instructions.size() == 3);
-  REQUIRE(blocks[0].instructions[2]->type() == Type::JumpConditional);
+  REQUIRE(blocks[1].instructions.back()->type() == Type::JumpConditional);
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::Jump));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 11);
 }
 
 TEST_CASE("const_cond_while_true_has_no_jump_conditional") {
@@ -88,49 +99,67 @@ TEST_CASE("const_cond_while_true_has_no_jump_conditional") {
 // ============================================================
 
 TEST_CASE("peephole_folds_divide_move_non_immediate") {
-  std::vector<Bytecode::BasicBlock> blocks(2);
+  // Both operands arrive as parameters, so the divide is not folded.
+  std::vector<Bytecode::BasicBlock> blocks(3);
   blocks[0].append<Bytecode::Instruction::Load>(0, 84);
   blocks[0].append<Bytecode::Instruction::Load>(1, 7);
-  blocks[0].append<Bytecode::Instruction::Divide>(2, 0, 1);
-  blocks[0].append<Bytecode::Instruction::Move>(0, 2);
-  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      2, 1, std::vector<Bytecode::Register>{0, 1}, std::vector<Bytecode::Register>{0, 1});
+  blocks[0].append<Bytecode::Instruction::Return>(2);
 
-  blocks[1].append<Bytecode::Instruction::Return>(0);
+  blocks[1].append<Bytecode::Instruction::Divide>(2, 0, 1);
+  blocks[1].append<Bytecode::Instruction::Move>(0, 2);
+  blocks[1].append<Bytecode::Instruction::Jump>(2);
+
+  blocks[2].append<Bytecode::Instruction::Return>(0);
 
   BytecodeOptimizer opt;
+  opt.set_inline_threshold(0);
   opt.optimize(blocks);
 
-  REQUIRE(blocks[0].instructions.size() == 4);
-  REQUIRE(blocks[0].instructions[2]->type() == Type::Divide);
+  REQUIRE(blocks[1].instructions.size() == 2);
+  REQUIRE(blocks[1].instructions[0]->type() == Type::Divide);
   const auto &div =
-      static_cast<const Bytecode::Instruction::Divide &>(*blocks[0].instructions[2]);
+      static_cast<const Bytecode::Instruction::Divide &>(*blocks[1].instructions[0]);
   REQUIRE(div.dst == 0);
   REQUIRE(div.src1 == 0);
   REQUIRE(div.src2 == 1);
   REQUIRE_FALSE(has_instruction_type(blocks, Type::Move));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 12);
 }
 
 TEST_CASE("peephole_folds_multiply_move_non_immediate") {
-  std::vector<Bytecode::BasicBlock> blocks(2);
+  // Both operands arrive as parameters, so the multiply is not folded.
+  std::vector<Bytecode::BasicBlock> blocks(3);
   blocks[0].append<Bytecode::Instruction::Load>(0, 6);
   blocks[0].append<Bytecode::Instruction::Load>(1, 7);
-  blocks[0].append<Bytecode::Instruction::Multiply>(2, 0, 1);
-  blocks[0].append<Bytecode::Instruction::Move>(0, 2);
-  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      2, 1, std::vector<Bytecode::Register>{0, 1}, std::vector<Bytecode::Register>{0, 1});
+  blocks[0].append<Bytecode::Instruction::Return>(2);
 
-  blocks[1].append<Bytecode::Instruction::Return>(0);
+  blocks[1].append<Bytecode::Instruction::Multiply>(2, 0, 1);
+  blocks[1].append<Bytecode::Instruction::Move>(0, 2);
+  blocks[1].append<Bytecode::Instruction::Jump>(2);
+
+  blocks[2].append<Bytecode::Instruction::Return>(0);
 
   BytecodeOptimizer opt;
+  opt.set_inline_threshold(0);
   opt.optimize(blocks);
 
-  REQUIRE(blocks[0].instructions.size() == 4);
-  REQUIRE(blocks[0].instructions[2]->type() == Type::Multiply);
+  REQUIRE(blocks[1].instructions.size() == 2);
+  REQUIRE(blocks[1].instructions[0]->type() == Type::Multiply);
   const auto &mul =
-      static_cast<const Bytecode::Instruction::Multiply &>(*blocks[0].instructions[2]);
+      static_cast<const Bytecode::Instruction::Multiply &>(*blocks[1].instructions[0]);
   REQUIRE(mul.dst == 0);
   REQUIRE(mul.src1 == 0);
   REQUIRE(mul.src2 == 1);
   REQUIRE_FALSE(has_instruction_type(blocks, Type::Move));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 42);
 }
 
 TEST_CASE("peephole_non_immediate_fold_preserves_interpreter_result") {
@@ -151,10 +180,13 @@ TEST_CASE("peephole_non_immediate_fold_preserves_interpreter_result") {
 }
 
 TEST_CASE("peephole_non_immediate_not_applied_when_temp_has_multiple_uses") {
+  // The operands arrive as parameters, so the product is not a constant.
   std::vector<Bytecode::BasicBlock> blocks(4);
   blocks[0].append<Bytecode::Instruction::Load>(0, 6);
   blocks[0].append<Bytecode::Instruction::Load>(1, 7);
-  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      4, 1, std::vector<Bytecode::Register>{0, 1}, std::vector<Bytecode::Register>{0, 1});
+  blocks[0].append<Bytecode::Instruction::Return>(4);
 
   blocks[1].append<Bytecode::Instruction::Multiply>(2, 0, 1);      // r2 = r0 * r1
   blocks[1].append<Bytecode::Instruction::Move>(3, 2);             // use #1
@@ -164,15 +196,19 @@ TEST_CASE("peephole_non_immediate_not_applied_when_temp_has_multiple_uses") {
   blocks[3].append<Bytecode::Instruction::Return>(3);
 
   BytecodeOptimizer opt;
+  opt.set_inline_threshold(0);
   opt.optimize(blocks);
 
-  bool multiply_dst_is_temp = false;
-  for (const auto &instr_ptr : blocks[1].instructions) {
-    if (instr_ptr->type() == Type::Multiply) {
-      const auto &mul =
-          static_cast<const Bytecode::Instruction::Multiply &>(*instr_ptr);
-      if (mul.dst == 2) multiply_dst_is_temp = true;
-    }
-  }
-  REQUIRE(multiply_dst_is_temp);
+  // The Move cannot be folded into the Multiply, which still feeds the
+  // branch as well as the return.
+  REQUIRE(blocks[1].instructions.size() == 2);
+  REQUIRE(blocks[1].instructions[0]->type() == Type::Multiply);
+  const auto &mul =
+      static_cast<const Bytecode::Instruction::Multiply &>(*blocks[1].instructions[0]);
+  const auto &branch =
+      static_cast<const Bytecode::Instruction::JumpConditional &>(*blocks[1].instructions[1]);
+  REQUIRE(branch.cond == mul.dst);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 42);
 }
@@ -0,0 +1,187 @@
+#include "test_optimizer_helpers.h"
+
+#include <stdexcept>
+
+// ============================================================
+// Bounds-check elimination
+// ============================================================
+
+// i < 4 keeps every index of a four-element array in bounds.
+TEST_CASE("bounds_check_elimination_drops_checks_a_loop_bound_proves") {
+  // block 0: a=[5,3,8,1]; i=0; s=0; Jump @1
+  // block 1: JumpLessThanImmediate i<4 @2,@3
+  // block 2: t=a[i]; s=s+t; a[i]=t+1; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::ArrayLiteralCreate>(
+      0, std::vector<Bytecode::Value>{5, 3, 8, 1});  // r0 = [5, 3, 8, 1] (a)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Load>(2, 0);  // r2 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 4, 2, 3);  // i < 4
+
+  blocks[2].append<Bytecode::Instruction::ArrayLoad>(3, 0, 1);     // t = a[i]
+  blocks[2].append<Bytecode::Instruction::Add>(2, 2, 3);           // s = s + t
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(3, 3, 1);  // t = t + 1
+  blocks[2].append<Bytecode::Instruction::ArrayStore>(0, 1, 3);    // a[i] = t
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(2);
+
+  BytecodeOptimizer opt;
+  const auto result = opt.eliminate_bounds_checks(blocks);
+
+  REQUIRE(result.changes == 2);
+  REQUIRE_FALSE(result.control_flow_changed);
+  REQUIRE(blocks[2].instructions[0]->type() == Type::ArrayLoadUnchecked);
+  REQUIRE(blocks[2].instructions[3]->type() == Type::ArrayStoreUnchecked);
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::ArrayLoad));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::ArrayStore));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 17);
+}
+
+// i < 5 lets the last iteration index past the end, which must still throw.
+TEST_CASE("bounds_check_elimination_keeps_checks_a_loop_may_fail") {
+  // block 0: a=[5,3,8,1]; i=0; s=0; Jump @1
+  // block 1: JumpLessThanImmediate i<5 @2,@3
+  // block 2: t=a[i]; s=s+t; a[i]=t+1; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::ArrayLiteralCreate>(
+      0, std::vector<Bytecode::Value>{5, 3, 8, 1});  // r0 = [5, 3, 8, 1] (a)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Load>(2, 0);  // r2 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 5, 2, 3);  // i < 5
+
+  blocks[2].append<Bytecode::Instruction::ArrayLoad>(3, 0, 1);     // t = a[i]
+  blocks[2].append<Bytecode::Instruction::Add>(2, 2, 3);           // s = s + t
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(3, 3, 1);  // t = t + 1
+  blocks[2].append<Bytecode::Instruction::ArrayStore>(0, 1, 3);    // a[i] = t
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(2);
+
+  BytecodeOptimizer opt;
+  REQUIRE_FALSE(opt.eliminate_bounds_checks(blocks));
+  REQUIRE(has_instruction_type(blocks, Type::ArrayLoad));
+  REQUIRE(has_instruction_type(blocks, Type::ArrayStore));
+
+  BytecodeInterpreter interp;
+  REQUIRE_THROWS_AS(interp.interpret(blocks), std::out_of_range);
+}
+
+// An in-bounds index proves nothing when the handle may not be an array:
+// here it is an integer that names no object at all.
+TEST_CASE("bounds_check_elimination_keeps_checks_on_a_handle_not_known_to_be_an_array") {
+  // block 0: a=1000000000; i=0; s=0; Jump @1
+  // block 1: JumpLessThanImmediate i<4 @2,@3
+  // block 2: t=a[i]; s=s+t; a[i]=t+1; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 1000000000);  // r0 = 1000000000 (a)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);           // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Load>(2, 0);           // r2 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 4, 2, 3);  // i < 4
+
+  blocks[2].append<Bytecode::Instruction::ArrayLoad>(3, 0, 1);     // t = a[i]
+  blocks[2].append<Bytecode::Instruction::Add>(2, 2, 3);           // s = s + t
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(3, 3, 1);  // t = t + 1
+  blocks[2].append<Bytecode::Instruction::ArrayStore>(0, 1, 3);    // a[i] = t
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(2);
+
+  BytecodeOptimizer opt;
+  REQUIRE_FALSE(opt.eliminate_bounds_checks(blocks));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::ArrayLoadUnchecked));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::ArrayStoreUnchecked));
+
+  BytecodeInterpreter interp;
+  REQUIRE_THROWS_AS(interp.interpret(blocks), std::out_of_range);
+}
+
+TEST_CASE("bounds_check_elimination_follows_a_counter_down_to_zero") {
+  // 0: a = [1, 2, 3]; i = 3; s = 0          1: if (i > 0) @2 else @3
+  // 2: i -= 1; t = a[i]; s += t; @1         3: return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::ArrayLiteralCreate>(
+      0, std::vector<Bytecode::Value>{1, 2, 3});
+  blocks[0].append<Bytecode::Instruction::Load>(1, 3);
+  blocks[0].append<Bytecode::Instruction::Load>(2, 0);
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::JumpGreaterThanImmediate>(1, 0, 2, 3);
+  blocks[2].append<Bytecode::Instruction::SubtractImmediate>(1, 1, 1);
+  blocks[2].append<Bytecode::Instruction::ArrayLoad>(3, 0, 1);
+  blocks[2].append<Bytecode::Instruction::Add>(2, 2, 3);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+  blocks[3].append<Bytecode::Instruction::Return>(2);
+
+  BytecodeOptimizer opt;
+  REQUIRE(opt.eliminate_bounds_checks(blocks).changes == 1);
+  REQUIRE(blocks[2].instructions[1]->type() == Type::ArrayLoadUnchecked);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 6);
+}
+
+TEST_CASE("bounds_check_elimination_knows_nothing_of_an_unknown_index") {
+  // The index is read from the array itself, so it may be anything.
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  blocks[0].append<Bytecode::Instruction::ArrayLiteralCreate>(
+      0, std::vector<Bytecode::Value>{2, 0, 1});
+  blocks[0].append<Bytecode::Instruction::ArrayLoadImmediate>(1, 0, 0);
+  blocks[0].append<Bytecode::Instruction::ArrayLoad>(2, 0, 1);
+  blocks[0].append<Bytecode::Instruction::Return>(2);
+
+  BytecodeOptimizer opt;
+  REQUIRE_FALSE(opt.eliminate_bounds_checks(blocks));
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 1);
+}
+
+TEST_CASE("bounds_check_elimination_runs_in_the_pipeline") {
+  // block 0: a=[5,3,8,1]; i=0; s=0; Jump @1
+  // block 1: JumpLessThanImmediate i<4 @2,@3
+  // block 2: t=a[i]; s=s+t; a[i]=t+1; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::ArrayLiteralCreate>(
+      0, std::vector<Bytecode::Value>{5, 3, 8, 1});  // r0 = [5, 3, 8, 1] (a)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Load>(2, 0);  // r2 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 4, 2, 3);  // i < 4
+
+  blocks[2].append<Bytecode::Instruction::ArrayLoad>(3, 0, 1);     // t = a[i]
+  blocks[2].append<Bytecode::Instruction::Add>(2, 2, 3);           // s = s + t
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(3, 3, 1);  // t = t + 1
+  blocks[2].append<Bytecode::Instruction::ArrayStore>(0, 1, 3);    // a[i] = t
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(2);
+
+  BytecodeOptimizer opt;
+  opt.set_inline_threshold(0);
+  opt.optimize(blocks);
+
+  REQUIRE(has_instruction_type(blocks, Type::ArrayLoadUnchecked));
+  REQUIRE(has_instruction_type(blocks, Type::ArrayStoreUnchecked));
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 17);
+}
@@ -86,3 +86,85 @@ TEST_CASE("jump_conditional_is_preserved_for_non_compare_boolean_conditions") {
   BytecodeInterpreter interp;
   REQUIRE(interp.interpret(blocks) == 42);
 }
+
+TEST_CASE("compare_branch_fusion_covers_every_compare") {
+  using Append = void (*)(Bytecode::BasicBlock &);
+  const std::vector<std::pair<Append, Type>> compares = {
+      {[](auto &b) { b.template append<Bytecode::Instruction::LessThan>(2, 0, 1); },
+       Type::JumpLessThan},
+      {[](auto &b) { b.template append<Bytecode::Instruction::LessThanImmediate>(2, 0, 5); },
+       Type::JumpLessThanImmediate},
+      {[](auto &b) { b.template append<Bytecode::Instruction::GreaterThan>(2, 0, 1); },
+       Type::JumpGreaterThan},
+      {[](auto &b) { b.template append<Bytecode::Instruction::GreaterThanImmediate>(2, 0, 5); },
+       Type::JumpGreaterThanImmediate},
+      {[](auto &b) { b.template append<Bytecode::Instruction::LessThanOrEqual>(2, 0, 1); },
+       Type::JumpLessThanOrEqual},
+      {[](auto &b) {
+         b.template append<Bytecode::Instruction::LessThanOrEqualImmediate>(2, 0, 5);
+       },
+       Type::JumpLessThanOrEqualImmediate},
+      {[](auto &b) { b.template append<Bytecode::Instruction::GreaterThanOrEqual>(2, 0, 1); },
+       Type::JumpGreaterThanOrEqual},
+      {[](auto &b) {
+         b.template append<Bytecode::Instruction::GreaterThanOrEqualImmediate>(2, 0, 5);
+       },
+       Type::JumpGreaterThanOrEqualImmediate},
+      {[](auto &b) { b.template append<Bytecode::Instruction::Equal>(2, 0, 1); },
+       Type::JumpEqual},
+      {[](auto &b) { b.template append<Bytecode::Instruction::EqualImmediate>(2, 0, 5); },
+       Type::JumpEqualImmediate},
+      {[](auto &b) { b.template append<Bytecode::Instruction::NotEqual>(2, 0, 1); },
+       Type::JumpNotEqual},
+      {[](auto &b) { b.template append<Bytecode::Instruction::NotEqualImmediate>(2, 0, 5); },
+       Type::JumpNotEqualImmediate},
+  };
+
+  // r0 is compared with 5, in r1 or as the immediate, from below, equal and
+  // above; @1 returns 1 and @2 returns 2.
+  for (const auto &[append_compare, fused] : compares) {
+    for (const Bytecode::Value lhs : {3, 5, 7}) {
+      std::vector<Bytecode::BasicBlock> blocks(3);
+      blocks[0].append<Bytecode::Instruction::Load>(0, lhs);
+      blocks[0].append<Bytecode::Instruction::Load>(1, 5);
+      append_compare(blocks[0]);
+      blocks[0].append<Bytecode::Instruction::JumpConditional>(2, 1, 2);
+      blocks[1].append<Bytecode::Instruction::Load>(3, 1);
+      blocks[1].append<Bytecode::Instruction::Return>(3);
+      blocks[2].append<Bytecode::Instruction::Load>(3, 2);
+      blocks[2].append<Bytecode::Instruction::Return>(3);
+
+      BytecodeInterpreter interp;
+      const auto expected = interp.interpret(blocks);
+      BytecodeOptimizer opt;
+      REQUIRE(opt.fuse_compare_branches(blocks).changes == 1);
+      REQUIRE(blocks[0].instructions.back()->type() == fused);
+      REQUIRE(interp.interpret(blocks) == expected);
+    }
+  }
+}
+
+TEST_CASE("copy_propagation_folds_compare_branches_on_constants") {
+  // 0: r0 = 4; r1 = 9; if (r0 != r1) @1 else @2
+  // 1: if (r0 >= 4) @3 else @2
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 4);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 9);
+  blocks[0].append<Bytecode::Instruction::JumpNotEqual>(0, 1, 1, 2);
+  blocks[1].append<Bytecode::Instruction::JumpGreaterThanOrEqualImmediate>(0, 4, 3, 2);
+  blocks[2].append<Bytecode::Instruction::Return>(1);
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  const auto result = opt.copy_propagation(blocks);
+  REQUIRE(result.control_flow_changed);
+  const auto &first = derived_cast<const Bytecode::Instruction::Jump &>(
+      *blocks[0].instructions.back());
+  REQUIRE(first.label == 1);
+  const auto &second = derived_cast<const Bytecode::Instruction::Jump &>(
+      *blocks[1].instructions.back());
+  REQUIRE(second.label == 3);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 4);
+}
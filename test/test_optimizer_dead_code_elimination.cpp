@@ -135,6 +135,25 @@ TEST_CASE("dce_array_store_never_removed") {
   REQUIRE(has_array_store);
 }
 
+TEST_CASE("dce_struct_store_never_removed") {
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  blocks[0].append<Bytecode::Instruction::StructLiteralCreate>(
+      0, std::vector<std::pair<std::string, Bytecode::Value>>{{"x", 1}});
+  blocks[0].append<Bytecode::Instruction::Load>(1, 99);
+  blocks[0].append<Bytecode::Instruction::StructStore>(0, "x", 1);
+  blocks[0].append<Bytecode::Instruction::Load>(2, 0);
+  blocks[0].append<Bytecode::Instruction::Return>(2);
+
+  BytecodeOptimizer opt;
+  opt.dead_code_elimination(blocks);
+
+  bool has_struct_store = false;
+  for (const auto &instr : blocks[0].instructions) {
+    if (instr->type() == Type::StructStore) has_struct_store = true;
+  }
+  REQUIRE(has_struct_store);
+}
+
 // An instruction in block 0 whose dst is read in block 1 must not be removed —
 // DCE liveness is computed globally across all blocks.
 TEST_CASE("dce_cross_block_liveness_respected") {
@@ -33,42 +33,48 @@ TEST_CASE("optimize_pipeline_eliminates_unreachable_branch_after_constant_condit
 }
 
 TEST_CASE("optimize_pipeline_fuses_alias_compare_branch_and_compacts_registers") {
-  std::vector<Bytecode::BasicBlock> blocks(3);
+  // The compared value arrives as a parameter, so it is not a constant.
+  std::vector<Bytecode::BasicBlock> blocks(4);
 
-  blocks[0].append<Bytecode::Instruction::Load>(10, 9);
-  blocks[0].append<Bytecode::Instruction::Move>(20, 10);                 // alias
-  blocks[0].append<Bytecode::Instruction::GreaterThanImmediate>(30, 20, 5);
-  blocks[0].append<Bytecode::Instruction::JumpConditional>(30, 1, 2);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 9);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      1, 1, std::vector<Bytecode::Register>{0}, std::vector<Bytecode::Register>{10});
+  blocks[0].append<Bytecode::Instruction::Return>(1);
 
-  blocks[1].append<Bytecode::Instruction::Load>(40, 1);
-  blocks[1].append<Bytecode::Instruction::Return>(40);
+  blocks[1].append<Bytecode::Instruction::Move>(20, 10);                 // alias
+  blocks[1].append<Bytecode::Instruction::GreaterThanImmediate>(30, 20, 5);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(30, 2, 3);
 
-  blocks[2].append<Bytecode::Instruction::Load>(50, 0);
-  blocks[2].append<Bytecode::Instruction::Return>(50);
+  blocks[2].append<Bytecode::Instruction::Load>(40, 1);
+  blocks[2].append<Bytecode::Instruction::Return>(40);
+
+  blocks[3].append<Bytecode::Instruction::Load>(50, 0);
+  blocks[3].append<Bytecode::Instruction::Return>(50);
 
   BytecodeOptimizer opt;
+  opt.set_inline_threshold(0);
   opt.optimize(blocks);
 
-  REQUIRE(blocks[0].instructions.size() == 2);
-  REQUIRE(blocks[0].instructions[0]->type() == Type::Load);
-  REQUIRE(blocks[0].instructions[1]->type() == Type::JumpGreaterThanImmediate);
+  REQUIRE(blocks[1].instructions.size() == 1);
+  REQUIRE(blocks[1].instructions[0]->type() == Type::JumpGreaterThanImmediate);
   REQUIRE_FALSE(has_instruction_type(blocks, Type::Move));
   REQUIRE_FALSE(has_instruction_type(blocks, Type::GreaterThanImmediate));
   REQUIRE_FALSE(has_instruction_type(blocks, Type::JumpConditional));
 
-  const auto &load =
-      static_cast<const Bytecode::Instruction::Load &>(*blocks[0].instructions[0]);
+  const auto &call =
+      static_cast<const Bytecode::Instruction::TailCall &>(*blocks[0].instructions[1]);
   const auto &jump = static_cast<const Bytecode::Instruction::JumpGreaterThanImmediate &>(
-      *blocks[0].instructions[1]);
-  REQUIRE(load.dst == 0);  // compacted from r10
-  REQUIRE(jump.lhs == 0);  // compacted and propagated from alias
+      *blocks[1].instructions[0]);
+  // The callee's frame is allocated on its own, so r10 lands in its slot 0.
+  REQUIRE(call.param_registers == std::vector<Bytecode::Register>{0});
+  REQUIRE(jump.lhs == 0);  // allocated and propagated from alias
   REQUIRE(jump.value == 5);
 
   BytecodeInterpreter interp;
   REQUIRE(interp.interpret(blocks) == 1);
 }
 
-TEST_CASE("optimize_pipeline_materializes_array_literals_and_removes_setup_registers") {
+TEST_CASE("optimize_pipeline_keeps_a_local_array_in_registers") {
   std::vector<Bytecode::BasicBlock> blocks(1);
 
   blocks[0].append<Bytecode::Instruction::Load>(10, 3);
@@ -82,30 +88,17 @@ TEST_CASE("optimize_pipeline_materializes_array_literals_and_removes_setup_regis
   BytecodeOptimizer opt;
   opt.optimize(blocks);
 
-  REQUIRE(blocks[0].instructions.size() == 3);
-  REQUIRE(blocks[0].instructions[0]->type() == Type::ArrayLiteralCreate);
-  REQUIRE(blocks[0].instructions[1]->type() == Type::ArrayLoadImmediate);
-  REQUIRE(blocks[0].instructions[2]->type() == Type::Return);
-  REQUIRE_FALSE(has_instruction_type(blocks, Type::Load));
+  // The array becomes a literal, its load gets an immediate index, and then
+  // the array, which nothing else reads, is replaced by its elements.
   REQUIRE_FALSE(has_instruction_type(blocks, Type::ArrayCreate));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::ArrayLiteralCreate));
   REQUIRE_FALSE(has_instruction_type(blocks, Type::ArrayLoad));
-
-  const auto &array_lit =
-      static_cast<const Bytecode::Instruction::ArrayLiteralCreate &>(
-          *blocks[0].instructions[0]);
-  const auto &array_load =
-      static_cast<const Bytecode::Instruction::ArrayLoadImmediate &>(
-          *blocks[0].instructions[1]);
-  const auto &ret =
-      static_cast<const Bytecode::Instruction::Return &>(*blocks[0].instructions[2]);
-
-  REQUIRE(array_lit.dst == 0);      // compacted from r20
-  REQUIRE(array_load.array == 0);   // reads compacted literal register
-  REQUIRE(array_load.index == 1);   // folded immediate index
-  REQUIRE(ret.reg == array_load.dst);
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::ArrayLoadImmediate));
+  REQUIRE(blocks[0].instructions.size() == 2);
 
   BytecodeInterpreter interp;
   REQUIRE(interp.interpret(blocks) == 4);
+  REQUIRE(interp.heap_stats().allocated_objects == 0);
 }
 
 TEST_CASE("optimize_pipeline_emits_tailcall_and_removes_unreachable_blocks") {
@@ -124,6 +117,7 @@ TEST_CASE("optimize_pipeline_emits_tailcall_and_removes_unreachable_blocks") {
   blocks[2].append<Bytecode::Instruction::Return>(40);
 
   BytecodeOptimizer opt;
+  opt.set_inline_threshold(0);  // keep the call for tail-call optimization
   opt.optimize(blocks);
 
   REQUIRE(blocks.size() == 2);
@@ -136,7 +130,8 @@ TEST_CASE("optimize_pipeline_emits_tailcall_and_removes_unreachable_blocks") {
       *blocks[0].instructions[1]);
   REQUIRE(tail_call.label == 1);
   REQUIRE(tail_call.arg_registers == std::vector<Bytecode::Register>{0});
-  REQUIRE(tail_call.param_registers == std::vector<Bytecode::Register>{1});
+  // The argument and the parameter share slot 0, so the tail call moves nothing.
+  REQUIRE(tail_call.param_registers == std::vector<Bytecode::Register>{0});
 
   BytecodeInterpreter interp;
   REQUIRE(interp.interpret(blocks) == 8);
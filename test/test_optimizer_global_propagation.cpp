@@ -198,3 +198,28 @@ TEST_CASE("global_copy_propagation_handles_euler_style_cross_block_aliases") {
   BytecodeInterpreter interp;
   REQUIRE(interp.interpret(blocks) == 5);
 }
+
+// The loop body comes before the header, its only predecessor. Visited first,
+// it has no facts yet and must not publish an empty state, or the header's
+// meet would drop the facts coming from the entry.
+TEST_CASE("global_propagation_reaches_block_before_its_only_predecessor") {
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 5);
+  blocks[0].append<Bytecode::Instruction::Move>(1, 0);
+  blocks[0].append<Bytecode::Instruction::Jump>(2);
+
+  blocks[1].append<Bytecode::Instruction::AddImmediate>(4, 1, 1);
+  blocks[1].append<Bytecode::Instruction::Jump>(2);
+
+  blocks[2].append<Bytecode::Instruction::JumpConditional>(9, 1, 3);
+
+  blocks[3].append<Bytecode::Instruction::Return>(4);
+
+  BytecodeOptimizer opt;
+  opt.copy_propagation(blocks);
+
+  REQUIRE(blocks[1].instructions[0]->type() == Type::AddImmediate);
+  const auto &add_imm =
+      static_cast<const Bytecode::Instruction::AddImmediate &>(*blocks[1].instructions[0]);
+  REQUIRE(add_imm.src == 0);
+}
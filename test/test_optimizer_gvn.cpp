@@ -0,0 +1,186 @@
+#include "test_optimizer_helpers.h"
+#include "../src/parser.h"
+
+// ============================================================
+// Pass -0.2: Global Value Numbering
+// ============================================================
+
+TEST_CASE("gvn_reuses_computation_from_dominating_block") {
+  // 0: a = 6; b = 7; p = a * b; if (p > 40)
+  // 1:   return b * a + 1
+  // 2: return p
+  std::vector<Bytecode::BasicBlock> blocks(3);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 6);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 7);
+  blocks[0].append<Bytecode::Instruction::Multiply>(2, 0, 1);
+  blocks[0].append<Bytecode::Instruction::GreaterThanImmediate>(3, 2, 40);
+  blocks[0].append<Bytecode::Instruction::JumpConditional>(3, 1, 2);
+  blocks[1].append<Bytecode::Instruction::Multiply>(4, 1, 0);
+  blocks[1].append<Bytecode::Instruction::AddImmediate>(5, 4, 1);
+  blocks[1].append<Bytecode::Instruction::Return>(5);
+  blocks[2].append<Bytecode::Instruction::Return>(2);
+
+  BytecodeOptimizer opt;
+  opt.global_value_numbering(blocks);
+
+  REQUIRE(count_instructions(blocks, Type::Multiply) == 1);
+  const auto &product =
+      static_cast<const Bytecode::Instruction::Multiply &>(*blocks[0].instructions[2]);
+  const auto &add = static_cast<const Bytecode::Instruction::AddImmediate &>(*blocks[1].instructions[0]);
+  REQUIRE(add.src == product.dst);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 43);
+}
+
+TEST_CASE("gvn_keeps_computations_of_sibling_branches") {
+  // 0: if (c)
+  // 1:   x = a + b
+  // 2: else y = a + b
+  // 3: return a + b
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 2);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 3);
+  blocks[0].append<Bytecode::Instruction::JumpConditional>(0, 1, 2);
+  blocks[1].append<Bytecode::Instruction::Add>(2, 0, 1);
+  blocks[1].append<Bytecode::Instruction::Jump>(3);
+  blocks[2].append<Bytecode::Instruction::Add>(3, 0, 1);
+  blocks[2].append<Bytecode::Instruction::Jump>(3);
+  blocks[3].append<Bytecode::Instruction::Add>(4, 1, 0);
+  blocks[3].append<Bytecode::Instruction::Return>(4);
+
+  BytecodeOptimizer opt;
+  opt.global_value_numbering(blocks);
+
+  // Neither branch runs on every path to the join.
+  REQUIRE(count_instructions(blocks, Type::Add) == 3);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 5);
+}
+
+TEST_CASE("gvn_matches_mirrored_compares") {
+  // 0: lt = a < b; if (lt)
+  // 1:   return b > a
+  // 2: return 7
+  std::vector<Bytecode::BasicBlock> blocks(3);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 2);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 3);
+  blocks[0].append<Bytecode::Instruction::LessThan>(2, 0, 1);
+  blocks[0].append<Bytecode::Instruction::JumpConditional>(2, 1, 2);
+  blocks[1].append<Bytecode::Instruction::GreaterThan>(3, 1, 0);
+  blocks[1].append<Bytecode::Instruction::GreaterThanOrEqual>(4, 1, 0);
+  blocks[1].append<Bytecode::Instruction::Add>(5, 3, 4);
+  blocks[1].append<Bytecode::Instruction::Return>(5);
+  blocks[2].append<Bytecode::Instruction::Load>(6, 7);
+  blocks[2].append<Bytecode::Instruction::Return>(6);
+
+  BytecodeOptimizer opt;
+  opt.global_value_numbering(blocks);
+
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::GreaterThan));
+  // b >= a is not a < b.
+  REQUIRE(has_instruction_type(blocks, Type::GreaterThanOrEqual));
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 2);
+}
+
+TEST_CASE("gvn_array_and_struct_stores_invalidate_loads") {
+  // 0: arr = [1, 2]; s = {x: 3, y: 4}
+  //    a = arr[1]; b = arr[1]; x = s.x; y = s.y
+  //    arr[1] = 10; s.x = 20
+  //    c = arr[1]; d = s.x; e = s.y
+  //    return a + b + x + y + c + d + e
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  auto &block = blocks[0];
+  block.append<Bytecode::Instruction::ArrayLiteralCreate>(0, std::vector<Bytecode::Value>{1, 2});
+  block.append<Bytecode::Instruction::StructLiteralCreate>(
+      1, std::vector<std::pair<std::string, Bytecode::Value>>{{"x", 3}, {"y", 4}});
+  block.append<Bytecode::Instruction::ArrayLoadImmediate>(2, 0, 1);
+  block.append<Bytecode::Instruction::ArrayLoadImmediate>(3, 0, 1);
+  block.append<Bytecode::Instruction::StructLoad>(4, 1, "x");
+  block.append<Bytecode::Instruction::StructLoad>(5, 1, "y");
+  block.append<Bytecode::Instruction::Load>(6, 1);
+  block.append<Bytecode::Instruction::Load>(7, 10);
+  block.append<Bytecode::Instruction::ArrayStore>(0, 6, 7);
+  block.append<Bytecode::Instruction::Load>(8, 20);
+  block.append<Bytecode::Instruction::StructStore>(1, "x", 8);
+  block.append<Bytecode::Instruction::ArrayLoadImmediate>(9, 0, 1);
+  block.append<Bytecode::Instruction::StructLoad>(10, 1, "x");
+  block.append<Bytecode::Instruction::StructLoad>(11, 1, "y");
+  block.append<Bytecode::Instruction::Add>(12, 2, 3);
+  block.append<Bytecode::Instruction::Add>(12, 12, 4);
+  block.append<Bytecode::Instruction::Add>(12, 12, 5);
+  block.append<Bytecode::Instruction::Add>(12, 12, 9);
+  block.append<Bytecode::Instruction::Add>(12, 12, 10);
+  block.append<Bytecode::Instruction::Add>(12, 12, 11);
+  block.append<Bytecode::Instruction::Return>(12);
+
+  BytecodeOptimizer opt;
+  opt.global_value_numbering(blocks);
+
+  // One load before the stores and one after.
+  REQUIRE(count_instructions(blocks, Type::ArrayLoadImmediate) == 2);
+  REQUIRE(count_instructions(blocks, Type::StructLoad) == 4);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 2 + 2 + 3 + 4 + 10 + 20 + 4);
+}
+
+TEST_CASE("gvn_stores_in_a_loop_invalidate_loads_before_it") {
+  // 0: arr = [0]; i = 0; first = arr[0]
+  // 1: while (i < 5) {
+  // 2:   arr[0] = arr[0] + i; i = i + 1 }
+  // 3: return first * 100 + arr[0]
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::ArrayLiteralCreate>(0, std::vector<Bytecode::Value>{0});
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);
+  blocks[0].append<Bytecode::Instruction::ArrayLoadImmediate>(2, 0, 0);
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(3, 1, 5);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(3, 2, 3);
+  blocks[2].append<Bytecode::Instruction::ArrayLoadImmediate>(4, 0, 0);
+  blocks[2].append<Bytecode::Instruction::Add>(4, 4, 1);
+  blocks[2].append<Bytecode::Instruction::Load>(5, 0);
+  blocks[2].append<Bytecode::Instruction::ArrayStore>(0, 5, 4);
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+  blocks[3].append<Bytecode::Instruction::ArrayLoadImmediate>(6, 0, 0);
+  blocks[3].append<Bytecode::Instruction::MultiplyImmediate>(7, 2, 100);
+  blocks[3].append<Bytecode::Instruction::Add>(7, 7, 6);
+  blocks[3].append<Bytecode::Instruction::Return>(7);
+
+  BytecodeOptimizer opt;
+  opt.global_value_numbering(blocks);
+
+  REQUIRE(count_instructions(blocks, Type::ArrayLoadImmediate) == 3);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 10);
+}
+
+TEST_CASE("gvn_shares_repeated_squares_in_source_programs") {
+  const char *source = R"(
+fn f(p, m) {
+  let total = 0;
+  if (p * p <= m) {
+    total = p * p + m;
+  } else {
+    total = m - p * p;
+  }
+  return total + p * p;
+}
+return f(3, 20) * 1000 + f(5, 20);
+)";
+  ErrorReporter reporter;
+  Parser parser(source, reporter);
+  auto program = parser.parse_program();
+  REQUIRE(program != nullptr);
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+
+  BytecodeOptimizer opt;
+  opt.set_inline_threshold(0);
+  opt.optimize(generator.blocks());
+
+  REQUIRE(count_instructions(generator.blocks(), Type::Multiply) == 1);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(generator.blocks()) == 38 * 1000 + 20);
+}
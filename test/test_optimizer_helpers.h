@@ -24,3 +24,13 @@ inline bool has_instruction_type(const std::vector<Bytecode::BasicBlock> &blocks
   }
   return false;
 }
+
+inline size_t count_instructions(const std::vector<Bytecode::BasicBlock> &blocks, Type type) {
+  size_t count = 0;
+  for (const auto &block : blocks) {
+    for (const auto &instr : block.instructions) {
+      count += instr->type() == type;
+    }
+  }
+  return count;
+}
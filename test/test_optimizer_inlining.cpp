@@ -0,0 +1,195 @@
+#include "test_optimizer_helpers.h"
+#include "../src/parser.h"
+
+// ============================================================
+// Pass -2: Function Inlining
+// ============================================================
+
+TEST_CASE("inline_splices_single_block_callee_into_caller") {
+  // 0: return add_one(7)
+  // 1: add_one(x): return x + 1
+  std::vector<Bytecode::BasicBlock> blocks(2);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 7);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      1, 1, std::vector<Bytecode::Register>{0}, std::vector<Bytecode::Register>{0});
+  blocks[0].append<Bytecode::Instruction::Return>(1);
+  blocks[1].append<Bytecode::Instruction::AddImmediate>(1, 0, 1);
+  blocks[1].append<Bytecode::Instruction::Return>(1);
+
+  BytecodeOptimizer opt;
+  REQUIRE(opt.inline_functions(blocks));
+
+  // The callee's registers are placed after the caller's two.
+  REQUIRE(blocks.size() == 2);
+  const auto &instrs = blocks[0].instructions;
+  REQUIRE(instrs.size() == 5);
+  const auto &arg = static_cast<const Bytecode::Instruction::Move &>(*instrs[1]);
+  REQUIRE(arg.dst == 2);
+  REQUIRE(arg.src == 0);
+  const auto &add = static_cast<const Bytecode::Instruction::AddImmediate &>(*instrs[2]);
+  REQUIRE(add.dst == 3);
+  REQUIRE(add.src == 2);
+  const auto &result = static_cast<const Bytecode::Instruction::Move &>(*instrs[3]);
+  REQUIRE(result.dst == 1);
+  REQUIRE(result.src == 3);
+  REQUIRE(instrs[4]->type() == Type::Return);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 8);
+}
+
+TEST_CASE("inline_clears_registers_read_before_written") {
+  // 0: return tick() + tick()
+  // 1: tick(): r0 starts at zero in every call, so each call returns 1.
+  std::vector<Bytecode::BasicBlock> blocks(2);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      0, 1, std::vector<Bytecode::Register>{}, std::vector<Bytecode::Register>{});
+  blocks[0].append<Bytecode::Instruction::Call>(
+      1, 1, std::vector<Bytecode::Register>{}, std::vector<Bytecode::Register>{});
+  blocks[0].append<Bytecode::Instruction::Add>(2, 0, 1);
+  blocks[0].append<Bytecode::Instruction::Return>(2);
+  blocks[1].append<Bytecode::Instruction::AddImmediate>(0, 0, 1);
+  blocks[1].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  REQUIRE(opt.inline_functions(blocks));
+
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::Call));
+  REQUIRE(count_instructions(blocks, Type::Load) == 2);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 2);
+}
+
+TEST_CASE("inline_unrolls_recursion_a_bounded_number_of_levels") {
+  // 0: return count_down(10)
+  // 1: count_down(n): if n == 0
+  // 2:   return n
+  // 3: return count_down(n - 1) + 1
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 10);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      1, 1, std::vector<Bytecode::Register>{0}, std::vector<Bytecode::Register>{0});
+  blocks[0].append<Bytecode::Instruction::Return>(1);
+  blocks[1].append<Bytecode::Instruction::EqualImmediate>(1, 0, 0);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(1, 2, 3);
+  blocks[2].append<Bytecode::Instruction::Return>(0);
+  blocks[3].append<Bytecode::Instruction::SubtractImmediate>(2, 0, 1);
+  blocks[3].append<Bytecode::Instruction::Call>(
+      3, 1, std::vector<Bytecode::Register>{2}, std::vector<Bytecode::Register>{0});
+  blocks[3].append<Bytecode::Instruction::AddImmediate>(4, 3, 1);
+  blocks[3].append<Bytecode::Instruction::Return>(4);
+
+  BytecodeOptimizer opt;
+  REQUIRE(opt.inline_functions(blocks));
+
+  // Each round copies count_down into its callers once more, and the
+  // innermost copies still call it.
+  REQUIRE(has_instruction_type(blocks, Type::Call));
+  REQUIRE(blocks.size() == 28);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 10);
+
+  opt.optimize(blocks);
+  REQUIRE(interp.interpret(blocks) == 10);
+}
+
+TEST_CASE("inline_respects_threshold") {
+  // 0: return count_down(10)
+  // 1: count_down(n): if n == 0
+  // 2:   return n
+  // 3: return count_down(n - 1) + 1
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 10);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      1, 1, std::vector<Bytecode::Register>{0}, std::vector<Bytecode::Register>{0});
+  blocks[0].append<Bytecode::Instruction::Return>(1);
+  blocks[1].append<Bytecode::Instruction::EqualImmediate>(1, 0, 0);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(1, 2, 3);
+  blocks[2].append<Bytecode::Instruction::Return>(0);
+  blocks[3].append<Bytecode::Instruction::SubtractImmediate>(2, 0, 1);
+  blocks[3].append<Bytecode::Instruction::Call>(
+      3, 1, std::vector<Bytecode::Register>{2}, std::vector<Bytecode::Register>{0});
+  blocks[3].append<Bytecode::Instruction::AddImmediate>(4, 3, 1);
+  blocks[3].append<Bytecode::Instruction::Return>(4);
+
+  BytecodeOptimizer opt;
+  opt.set_inline_threshold(5);  // count_down has 7 instructions
+  REQUIRE_FALSE(opt.inline_functions(blocks));
+  opt.set_inline_threshold(0);
+  REQUIRE_FALSE(opt.inline_functions(blocks));
+
+  REQUIRE(blocks.size() == 4);
+  REQUIRE(count_instructions(blocks, Type::Call) == 2);
+}
+
+TEST_CASE("inline_skips_callees_that_take_register_addresses") {
+  // 0: return count_down(10)
+  // 1: count_down(n): if n == 0
+  // 2:   return n
+  // 3: p = &n; return count_down(n - 1) + 1
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 10);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      1, 1, std::vector<Bytecode::Register>{0}, std::vector<Bytecode::Register>{0});
+  blocks[0].append<Bytecode::Instruction::Return>(1);
+  blocks[1].append<Bytecode::Instruction::EqualImmediate>(1, 0, 0);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(1, 2, 3);
+  blocks[2].append<Bytecode::Instruction::Return>(0);
+  blocks[3].append<Bytecode::Instruction::AddressOf>(5, 0);
+  blocks[3].append<Bytecode::Instruction::SubtractImmediate>(2, 0, 1);
+  blocks[3].append<Bytecode::Instruction::Call>(
+      3, 1, std::vector<Bytecode::Register>{2}, std::vector<Bytecode::Register>{0});
+  blocks[3].append<Bytecode::Instruction::AddImmediate>(4, 3, 1);
+  blocks[3].append<Bytecode::Instruction::Return>(4);
+
+  BytecodeOptimizer opt;
+  REQUIRE_FALSE(opt.inline_functions(blocks));
+  REQUIRE(blocks.size() == 4);
+}
+
+TEST_CASE("inline_preserves_program_results") {
+  const char *source = R"(
+fn square(x) {
+  return x * x;
+}
+fn clamp(x, hi) {
+  if (x > hi) {
+    return hi;
+  }
+  return x;
+}
+fn fib(n) {
+  if (n < 2) {
+    return n;
+  }
+  return fib(n - 1) + fib(n - 2);
+}
+let total = 0;
+let i = 0;
+while (i < 20) {
+  total = total + clamp(square(i), 100);
+  i++;
+}
+return total * 1000 + fib(12);
+)";
+  for (const size_t threshold : {size_t{0}, BytecodeOptimizer::k_default_inline_threshold,
+                                 size_t{1000}}) {
+    ErrorReporter reporter;
+    Parser parser(source, reporter);
+    auto program = parser.parse_program();
+    REQUIRE(program != nullptr);
+    BytecodeGenerator generator;
+    generator.visit_block(*program);
+    generator.finalize();
+
+    BytecodeOptimizer opt;
+    opt.set_inline_threshold(threshold);
+    opt.optimize(generator.blocks());
+    if (threshold != 0) {
+      // Unrolling fib a few levels still ends in calls.
+      REQUIRE(count_instructions(generator.blocks(), Type::Call) > 0);
+    }
+    BytecodeInterpreter interp;
+    REQUIRE(interp.interpret(generator.blocks()) == 1285 * 1000 + 144);
+  }
+}
@@ -266,3 +266,129 @@ TEST_CASE("licm_does_not_hoist_array_store") {
   REQUIRE(has_array_store);
 }
 
+
+// The header sits after the loop body, so only dominance shows the loop.
+TEST_CASE("licm_hoists_from_loops_laid_out_out_of_order") {
+  // 0: k = 4; i = 0; sum = 0; Jump @3
+  // 1: body: t = k * 3; sum = sum + t; i = i + 1; Jump @3
+  // 2: return sum
+  // 3: header: if (i < 5) @1 else @2
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 4);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);
+  blocks[0].append<Bytecode::Instruction::Load>(2, 0);
+  blocks[0].append<Bytecode::Instruction::Jump>(3);
+  blocks[1].append<Bytecode::Instruction::MultiplyImmediate>(3, 0, 3);
+  blocks[1].append<Bytecode::Instruction::Add>(2, 2, 3);
+  blocks[1].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);
+  blocks[1].append<Bytecode::Instruction::Jump>(3);
+  blocks[2].append<Bytecode::Instruction::Return>(2);
+  blocks[3].append<Bytecode::Instruction::LessThanImmediate>(4, 1, 5);
+  blocks[3].append<Bytecode::Instruction::JumpConditional>(4, 1, 2);
+
+  BytecodeOptimizer opt;
+  opt.loop_invariant_code_motion(blocks);
+
+  REQUIRE(blocks.size() == 4);
+  REQUIRE(blocks[0].instructions[3]->type() == Type::MultiplyImmediate);
+  REQUIRE(blocks[1].instructions.size() == 3);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 60);
+}
+
+// x keeps its earlier value when the loop does not run, so the product goes
+// to a fresh register and the loop copies it.
+TEST_CASE("licm_keeps_values_read_after_a_loop_that_may_not_run") {
+  for (const Bytecode::Value n : {0, 3}) {
+    // 0: a = 6; x = 5; i = 0; Jump @1
+    // 1: if (i < n) @2 else @3
+    // 2: x = a * 7; i = i + 1; Jump @1
+    // 3: return x
+    std::vector<Bytecode::BasicBlock> blocks(4);
+    blocks[0].append<Bytecode::Instruction::Load>(0, 6);
+    blocks[0].append<Bytecode::Instruction::Load>(1, 5);
+    blocks[0].append<Bytecode::Instruction::Load>(2, 0);
+    blocks[0].append<Bytecode::Instruction::Jump>(1);
+    blocks[1].append<Bytecode::Instruction::LessThanImmediate>(3, 2, n);
+    blocks[1].append<Bytecode::Instruction::JumpConditional>(3, 2, 3);
+    blocks[2].append<Bytecode::Instruction::MultiplyImmediate>(1, 0, 7);
+    blocks[2].append<Bytecode::Instruction::AddImmediate>(2, 2, 1);
+    blocks[2].append<Bytecode::Instruction::Jump>(1);
+    blocks[3].append<Bytecode::Instruction::Return>(1);
+
+    BytecodeOptimizer opt;
+    opt.loop_invariant_code_motion(blocks);
+
+    REQUIRE(blocks[0].instructions[3]->type() == Type::MultiplyImmediate);
+    REQUIRE(blocks[2].instructions[0]->type() == Type::Move);
+    BytecodeInterpreter interp;
+    REQUIRE(interp.interpret(blocks) == (n ? 42 : 5));
+  }
+}
+
+// The division only runs when its divisor is non-zero; hoisting it would
+// divide by zero before the loop.
+TEST_CASE("licm_does_not_hoist_division_past_its_guard") {
+  // 0: d = 0; i = 0; q = 0; Jump @1
+  // 1: if (i < 3) @2 else @5
+  // 2: if (d != 0) @3 else @4
+  // 3: q = 100 / d; Jump @4
+  // 4: i = i + 1; Jump @1
+  // 5: return q + i
+  std::vector<Bytecode::BasicBlock> blocks(6);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);
+  blocks[0].append<Bytecode::Instruction::Load>(2, 0);
+  blocks[0].append<Bytecode::Instruction::Load>(6, 100);
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(3, 1, 3);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(3, 2, 5);
+  blocks[2].append<Bytecode::Instruction::NotEqualImmediate>(4, 0, 0);
+  blocks[2].append<Bytecode::Instruction::JumpConditional>(4, 3, 4);
+  blocks[3].append<Bytecode::Instruction::Divide>(2, 6, 0);
+  blocks[3].append<Bytecode::Instruction::Jump>(4);
+  blocks[4].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);
+  blocks[4].append<Bytecode::Instruction::Jump>(1);
+  blocks[5].append<Bytecode::Instruction::Add>(5, 2, 1);
+  blocks[5].append<Bytecode::Instruction::Return>(5);
+
+  BytecodeOptimizer opt;
+  opt.loop_invariant_code_motion(blocks);
+
+  REQUIRE(blocks[3].instructions[0]->type() == Type::Divide);
+  // The guard itself is invariant and leaves.
+  REQUIRE(blocks[0].instructions[4]->type() == Type::NotEqualImmediate);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 3);
+}
+
+TEST_CASE("licm_adds_a_preheader_for_loops_entered_from_several_blocks") {
+  // 0: k = 3; if (k) @1 else @2
+  // 1: i = 1; Jump @3       2: i = 2; Jump @3
+  // 3: while (i < 50) {
+  // 4:   t = k + 1; i = i * t }
+  // 5: return i
+  std::vector<Bytecode::BasicBlock> blocks(6);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 3);
+  blocks[0].append<Bytecode::Instruction::JumpConditional>(0, 1, 2);
+  blocks[1].append<Bytecode::Instruction::Load>(1, 1);
+  blocks[1].append<Bytecode::Instruction::Jump>(3);
+  blocks[2].append<Bytecode::Instruction::Load>(1, 2);
+  blocks[2].append<Bytecode::Instruction::Jump>(3);
+  blocks[3].append<Bytecode::Instruction::LessThanImmediate>(2, 1, 50);
+  blocks[3].append<Bytecode::Instruction::JumpConditional>(2, 4, 5);
+  blocks[4].append<Bytecode::Instruction::AddImmediate>(3, 0, 1);
+  blocks[4].append<Bytecode::Instruction::Multiply>(1, 1, 3);
+  blocks[4].append<Bytecode::Instruction::Jump>(3);
+  blocks[5].append<Bytecode::Instruction::Return>(1);
+
+  BytecodeOptimizer opt;
+  opt.loop_invariant_code_motion(blocks);
+
+  REQUIRE(blocks.size() == 7);
+  REQUIRE(blocks[6].instructions.size() == 2);
+  REQUIRE(blocks[6].instructions[0]->type() == Type::AddImmediate);
+  REQUIRE(blocks[4].instructions.size() == 2);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 64);
+}
@@ -0,0 +1,164 @@
+#include "test_optimizer_helpers.h"
+
+// ============================================================
+// Loop unrolling
+// ============================================================
+
+// A loop of 12 iterations is copied by the largest factor dividing them.
+TEST_CASE("unroll_loops_copies_the_body_by_a_divisor_of_the_trip_count") {
+  // block 0: s=0; i=0; Jump @1
+  // block 1: JumpLessThanImmediate i<12 @2,@3
+  // block 2: s=s+i; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 12, 2, 3);  // i < 12
+
+  blocks[2].append<Bytecode::Instruction::Add>(0, 0, 1);           // s = s + i
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  const auto result = opt.unroll_loops(blocks);
+
+  REQUIRE(result.control_flow_changed);
+  // Three more copies of the body, each going straight on to the next; only
+  // the original header still tests.
+  REQUIRE(blocks.size() == 7);
+  REQUIRE(count_instructions(blocks, Type::JumpLessThanImmediate) == 1);
+  REQUIRE(count_instructions(blocks, Type::AddImmediate) == 4);
+  const auto &last = static_cast<const Bytecode::Instruction::Jump &>(
+      *blocks[6].instructions.back());
+  REQUIRE(last.label == 1);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 66);
+}
+
+// A loop of no more iterations than the factor loses its test entirely.
+TEST_CASE("unroll_loops_unrolls_a_short_loop_completely") {
+  // block 0: s=0; i=0; Jump @1
+  // block 1: JumpLessThanImmediate i<3 @2,@3
+  // block 2: s=s+i; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 3, 2, 3);  // i < 3
+
+  blocks[2].append<Bytecode::Instruction::Add>(0, 0, 1);           // s = s + i
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  REQUIRE(opt.unroll_loops(blocks));
+
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::JumpLessThanImmediate));
+  REQUIRE(count_instructions(blocks, Type::AddImmediate) == 3);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 3);
+}
+
+// A test not yet fused into one branch goes away with its compare.
+TEST_CASE("unroll_loops_drops_the_compare_of_an_unfused_test") {
+  // block 0: s=0; i=0; Jump @1
+  // block 1: r2=i<3; JumpConditional r2 @2,@3
+  // block 2: s=s+i; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(2, 1, 3);  // r2 = i < 3
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(2, 2, 3);
+
+  blocks[2].append<Bytecode::Instruction::Add>(0, 0, 1);           // s = s + i
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  REQUIRE(opt.unroll_loops(blocks));
+
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::LessThanImmediate));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::JumpConditional));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 3);
+}
+
+// Seven iterations: more than the factor, and no factor divides them.
+TEST_CASE("unroll_loops_leaves_loops_without_a_fitting_factor") {
+  // block 0: s=0; i=0; Jump @1
+  // block 1: JumpLessThanImmediate i<7 @2,@3
+  // block 2: s=s+i; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 7, 2, 3);  // i < 7
+
+  blocks[2].append<Bytecode::Instruction::Add>(0, 0, 1);           // s = s + i
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  REQUIRE_FALSE(opt.unroll_loops(blocks));
+  REQUIRE(blocks.size() == 4);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 21);
+}
+
+// A factor below 2 turns unrolling off; another factor bounds the copies.
+TEST_CASE("unroll_loops_follows_the_unroll_factor") {
+  // block 0: s=0; i=0; Jump @1
+  // block 1: JumpLessThanImmediate i<12 @2,@3
+  // block 2: s=s+i; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 12, 2, 3);  // i < 12
+
+  blocks[2].append<Bytecode::Instruction::Add>(0, 0, 1);           // s = s + i
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  opt.set_unroll_factor(1);
+  REQUIRE_FALSE(opt.unroll_loops(blocks));
+  REQUIRE(blocks.size() == 4);
+
+  opt.set_unroll_factor(3);
+  REQUIRE(opt.unroll_loops(blocks));
+  REQUIRE(count_instructions(blocks, Type::AddImmediate) == 3);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 66);
+}
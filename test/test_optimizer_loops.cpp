@@ -0,0 +1,241 @@
+#include "test_optimizer_helpers.h"
+#include "../src/optimizer/optimizer_cfg.h"
+#include "../src/optimizer/optimizer_induction_variables.h"
+
+// ============================================================
+// Loop nesting forest
+// ============================================================
+
+TEST_CASE("loops_form_a_nesting_forest_with_inner_loops_first") {
+  // block 0: i=0; Jump @1
+  // block 1: r2=i<3; JumpConditional r2 @2,@6      (outer loop header)
+  // block 2: j=0; Jump @3
+  // block 3: r3=j<4; JumpConditional r3 @4,@5      (inner loop header)
+  // block 4: j=j+1; Jump @3
+  // block 5: i=i+1; Jump @1
+  // block 6: Return i
+  std::vector<Bytecode::BasicBlock> blocks(7);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(2, 0, 3);  // r2 = i < 3
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(2, 2, 6);
+
+  blocks[2].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (j)
+  blocks[2].append<Bytecode::Instruction::Jump>(3);
+
+  blocks[3].append<Bytecode::Instruction::LessThanImmediate>(3, 1, 4);  // r3 = j < 4
+  blocks[3].append<Bytecode::Instruction::JumpConditional>(3, 4, 5);
+
+  blocks[4].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // j = j + 1
+  blocks[4].append<Bytecode::Instruction::Jump>(3);
+
+  blocks[5].append<Bytecode::Instruction::AddImmediate>(0, 0, 1);  // i = i + 1
+  blocks[5].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[6].append<Bytecode::Instruction::Return>(0);
+
+  const auto cfg = build_control_flow_graph(blocks, 0);
+  const auto forest = find_loops(cfg);
+
+  REQUIRE(forest.loops.size() == 2);
+  const auto &inner = forest.loops[0];
+  const auto &outer = forest.loops[1];
+  REQUIRE(inner.header == 3);
+  REQUIRE(inner.latches == std::vector<Bytecode::Label>{4});
+  REQUIRE(inner.blocks == std::vector<Bytecode::Label>{3, 4});
+  REQUIRE(inner.preheader == 2);
+  REQUIRE(inner.parent == 1);
+  REQUIRE(inner.depth == 2);
+  REQUIRE(inner.exits.size() == 1);
+  REQUIRE(inner.exits[0] == std::pair<Bytecode::Label, Bytecode::Label>{3, 5});
+
+  REQUIRE(outer.header == 1);
+  REQUIRE(outer.blocks.size() == 5);
+  REQUIRE(outer.preheader == 0);
+  REQUIRE(outer.parent == LoopForest::k_no_loop);
+  REQUIRE(outer.children == std::vector<size_t>{0});
+  REQUIRE(outer.depth == 1);
+
+  REQUIRE(forest.innermost[4] == 0);
+  REQUIRE(forest.innermost[5] == 1);
+  REQUIRE(forest.innermost[6] == LoopForest::k_no_loop);
+  REQUIRE(forest.contains(1, 4));
+  REQUIRE_FALSE(forest.contains(0, 5));
+}
+
+TEST_CASE("loops_follow_dominance_rather_than_block_order") {
+  // 0: Jump @3 (the header comes after its body)
+  // 1: body: i = i + 1; Jump @3
+  // 2: return i
+  // 3: header: if (i < 5) @1 else @2
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);
+  blocks[0].append<Bytecode::Instruction::Jump>(3);
+  blocks[1].append<Bytecode::Instruction::AddImmediate>(0, 0, 1);
+  blocks[1].append<Bytecode::Instruction::Jump>(3);
+  blocks[2].append<Bytecode::Instruction::Return>(0);
+  blocks[3].append<Bytecode::Instruction::LessThanImmediate>(1, 0, 5);
+  blocks[3].append<Bytecode::Instruction::JumpConditional>(1, 1, 2);
+
+  const auto forest = find_loops(build_control_flow_graph(blocks, 0));
+  REQUIRE(forest.loops.size() == 1);
+  REQUIRE(forest.loops[0].header == 3);
+  REQUIRE(forest.loops[0].latches == std::vector<Bytecode::Label>{1});
+  REQUIRE(forest.loops[0].exits.size() == 1);
+  REQUIRE(forest.loops[0].exits[0].second == 2);
+}
+
+TEST_CASE("loops_ignore_backward_jumps_that_close_no_cycle") {
+  // 0: Jump @2;  1: return;  2: Jump @1
+  std::vector<Bytecode::BasicBlock> blocks(3);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 7);
+  blocks[0].append<Bytecode::Instruction::Jump>(2);
+  blocks[1].append<Bytecode::Instruction::Return>(0);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  const auto forest = find_loops(build_control_flow_graph(blocks, 0));
+  REQUIRE(forest.loops.empty());
+}
+
+TEST_CASE("loops_get_a_preheader_when_entered_from_several_blocks") {
+  // 0: if (c) @1 else @2
+  // 1: i = 1; Jump @3       2: i = 2; Jump @3
+  // 3: while (i < 10) {
+  // 4:   i = i * 2 }
+  // 5: return i
+  std::vector<Bytecode::BasicBlock> blocks(6);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 1);
+  blocks[0].append<Bytecode::Instruction::JumpConditional>(0, 1, 2);
+  blocks[1].append<Bytecode::Instruction::Load>(1, 1);
+  blocks[1].append<Bytecode::Instruction::Jump>(3);
+  blocks[2].append<Bytecode::Instruction::Load>(1, 2);
+  blocks[2].append<Bytecode::Instruction::Jump>(3);
+  blocks[3].append<Bytecode::Instruction::LessThanImmediate>(2, 1, 10);
+  blocks[3].append<Bytecode::Instruction::JumpConditional>(2, 4, 5);
+  blocks[4].append<Bytecode::Instruction::MultiplyImmediate>(1, 1, 2);
+  blocks[4].append<Bytecode::Instruction::Jump>(3);
+  blocks[5].append<Bytecode::Instruction::Return>(1);
+
+  const auto cfg = build_control_flow_graph(blocks, 0);
+  const auto forest = find_loops(cfg);
+  REQUIRE(forest.loops.size() == 1);
+  REQUIRE(forest.loops[0].preheader == ControlFlowGraph::k_no_label);
+
+  const auto preheader = insert_preheader(blocks, cfg, forest.loops[0]);
+  REQUIRE(preheader == 6);
+  const auto rebuilt = build_control_flow_graph(blocks, 0);
+  REQUIRE(rebuilt.predecessors[3] == std::vector<Bytecode::Label>{6, 4});
+  REQUIRE(find_loops(rebuilt).loops[0].preheader == 6);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 16);
+}
+
+// ============================================================
+// Induction variables and trip counts
+// ============================================================
+
+TEST_CASE("loops_find_induction_variables_and_trip_counts") {
+  // block 0: i=0; Jump @1
+  // block 1: r2=i<3; JumpConditional r2 @2,@6      (outer loop header)
+  // block 2: j=0; Jump @3
+  // block 3: r3=j<4; JumpConditional r3 @4,@5      (inner loop header)
+  // block 4: j=j+1; Jump @3
+  // block 5: i=i+1; Jump @1
+  // block 6: Return i
+  std::vector<Bytecode::BasicBlock> blocks(7);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(2, 0, 3);  // r2 = i < 3
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(2, 2, 6);
+
+  blocks[2].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (j)
+  blocks[2].append<Bytecode::Instruction::Jump>(3);
+
+  blocks[3].append<Bytecode::Instruction::LessThanImmediate>(3, 1, 4);  // r3 = j < 4
+  blocks[3].append<Bytecode::Instruction::JumpConditional>(3, 4, 5);
+
+  blocks[4].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // j = j + 1
+  blocks[4].append<Bytecode::Instruction::Jump>(3);
+
+  blocks[5].append<Bytecode::Instruction::AddImmediate>(0, 0, 1);  // i = i + 1
+  blocks[5].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[6].append<Bytecode::Instruction::Return>(0);
+
+  const auto cfg = build_control_flow_graph(blocks, 0);
+  const auto forest = find_loops(cfg);
+
+  const auto inner = find_induction_variables(blocks, cfg, forest, 0);
+  REQUIRE(inner.size() == 1);
+  REQUIRE(inner[0].reg == 1);
+  REQUIRE(inner[0].step == 1);
+  REQUIRE(inner[0].block == 4);
+  REQUIRE(inner[0].steps_every_iteration);
+  const auto inner_trip = find_trip_count(blocks, cfg, forest.loops[0], inner);
+  REQUIRE(inner_trip);
+  REQUIRE(inner_trip->count == 4);
+  REQUIRE(inner_trip->min == 0);
+  REQUIRE(inner_trip->max == 4);
+  REQUIRE(inner_trip->body == 4);
+  REQUIRE(inner_trip->exit == 5);
+  REQUIRE(inner_trip->test == blocks[3].instructions[0].get());
+
+  // The inner loop's variable is reset on every way into it, so it is no
+  // variable of the outer loop.
+  const auto outer = find_induction_variables(blocks, cfg, forest, 1);
+  REQUIRE(outer.size() == 1);
+  REQUIRE(outer[0].reg == 0);
+  const auto outer_trip = find_trip_count(blocks, cfg, forest.loops[1], outer);
+  REQUIRE(outer_trip);
+  REQUIRE(outer_trip->count == 3);
+}
+
+TEST_CASE("loops_count_down_through_a_copied_step") {
+  // 0: i = 20        1: JumpGreaterThanImmediate i, 5, @2, @3
+  // 2: t = i - 3; i = t; Jump @1
+  // 3: return i
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 20);
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::JumpGreaterThanImmediate>(0, 5, 2, 3);
+  blocks[2].append<Bytecode::Instruction::SubtractImmediate>(1, 0, 3);
+  blocks[2].append<Bytecode::Instruction::Move>(0, 1);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  const auto cfg = build_control_flow_graph(blocks, 0);
+  const auto forest = find_loops(cfg);
+  const auto variables = find_induction_variables(blocks, cfg, forest, 0);
+  REQUIRE(variables.size() == 1);
+  REQUIRE(variables[0].step == Bytecode::Value{0} - 3);
+  REQUIRE(variables[0].position == 1);
+  // 20, 17, 14, 11, 8 pass the test and 5 leaves.
+  const auto trip = find_trip_count(blocks, cfg, forest.loops[0], variables);
+  REQUIRE(trip);
+  REQUIRE(trip->count == 5);
+  REQUIRE(trip->min == 5);
+  REQUIRE(trip->max == 20);
+}
+
+TEST_CASE("loops_have_no_trip_count_when_the_variable_may_wrap") {
+  // 0: i = 0        1: JumpNotEqualImmediate i, 10, @2, @3
+  // 2: i = i + 4; Jump @1        (steps over 10)
+  // 3: return i
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::JumpNotEqualImmediate>(0, 10, 2, 3);
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(0, 0, 4);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  const auto cfg = build_control_flow_graph(blocks, 0);
+  const auto forest = find_loops(cfg);
+  const auto variables = find_induction_variables(blocks, cfg, forest, 0);
+  REQUIRE(variables.size() == 1);
+  REQUIRE_FALSE(find_trip_count(blocks, cfg, forest.loops[0], variables));
+}
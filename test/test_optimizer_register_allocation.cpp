@@ -0,0 +1,200 @@
+#include "test_optimizer_helpers.h"
+#include "../src/parser.h"
+
+// ============================================================
+// Pass 5: Register Allocation
+// ============================================================
+
+namespace {
+
+size_t frame_size_of(const std::vector<Bytecode::BasicBlock> &blocks, Bytecode::Label entry) {
+  for (const auto &function : build_function_table(blocks)) {
+    if (function.entry == entry) {
+      return function.frame_size;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+TEST_CASE("register_allocation_reuses_slots_of_dead_registers") {
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 40);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 2);
+  // Intentional gap: no instruction references r2.
+  blocks[0].append<Bytecode::Instruction::Add>(3, 0, 1);
+  blocks[0].append<Bytecode::Instruction::Return>(3);
+
+  BytecodeOptimizer opt;
+  opt.allocate_registers(blocks);
+
+  REQUIRE(blocks[0].instructions.size() == 4);
+  REQUIRE(blocks[0].instructions[0]->type() == Type::Load);
+  REQUIRE(blocks[0].instructions[1]->type() == Type::Load);
+  REQUIRE(blocks[0].instructions[2]->type() == Type::Add);
+  REQUIRE(blocks[0].instructions[3]->type() == Type::Return);
+
+  const auto &add =
+      static_cast<const Bytecode::Instruction::Add &>(*blocks[0].instructions[2]);
+  const auto &ret =
+      static_cast<const Bytecode::Instruction::Return &>(*blocks[0].instructions[3]);
+
+  // The operands die at the Add, so the sum takes the first one's slot.
+  REQUIRE(add.dst == 0);
+  REQUIRE(add.src1 == 0);
+  REQUIRE(add.src2 == 1);
+  REQUIRE(ret.reg == 0);
+  REQUIRE(frame_size_of(blocks, 0) == 2);
+}
+
+TEST_CASE("register_allocation_renumbers_call_parameter_slots_consistently") {
+  std::vector<Bytecode::BasicBlock> blocks(2);
+
+  // Entry: call block 1 with arg r0 and parameter slot r8, then use call result.
+  blocks[0].append<Bytecode::Instruction::Load>(0, 7);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      10, 1, std::vector<Bytecode::Register>{0}, std::vector<Bytecode::Register>{8});
+  blocks[0].append<Bytecode::Instruction::AddImmediate>(11, 10, 0);
+  blocks[0].append<Bytecode::Instruction::Return>(11);
+
+  // Callee body uses the same parameter register slot.
+  blocks[1].append<Bytecode::Instruction::AddImmediate>(9, 8, 1);
+  blocks[1].append<Bytecode::Instruction::Return>(9);
+
+  BytecodeOptimizer opt;
+  opt.allocate_registers(blocks);
+
+  REQUIRE(blocks[0].instructions[1]->type() == Type::Call);
+  REQUIRE(blocks[1].instructions[0]->type() == Type::AddImmediate);
+
+  const auto &call =
+      static_cast<const Bytecode::Instruction::Call &>(*blocks[0].instructions[1]);
+  const auto &entry_add_imm = static_cast<const Bytecode::Instruction::AddImmediate &>(
+      *blocks[0].instructions[2]);
+  const auto &add_imm = static_cast<const Bytecode::Instruction::AddImmediate &>(
+      *blocks[1].instructions[0]);
+  const auto &callee_ret =
+      static_cast<const Bytecode::Instruction::Return &>(*blocks[1].instructions[1]);
+  const auto &entry_ret =
+      static_cast<const Bytecode::Instruction::Return &>(*blocks[0].instructions[3]);
+
+  // Allocation must preserve call/callee wiring consistently.
+  REQUIRE(call.arg_registers == std::vector<Bytecode::Register>{0});
+  REQUIRE(call.param_registers.size() == 1);
+  REQUIRE(entry_add_imm.src == call.dst);
+  REQUIRE(add_imm.src == call.param_registers[0]);
+  REQUIRE(entry_ret.reg == entry_add_imm.dst);
+  REQUIRE(callee_ret.reg == add_imm.dst);
+  // Each function gets a frame of its own, one slot wide.
+  REQUIRE(frame_size_of(blocks, 0) == 1);
+  REQUIRE(frame_size_of(blocks, 1) == 1);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 8);
+}
+
+TEST_CASE("register_allocation_packs_a_chain_of_temporaries_into_one_slot") {
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 1);
+  for (Bytecode::Register reg = 1; reg < 10; ++reg) {
+    blocks[0].append<Bytecode::Instruction::MultiplyImmediate>(reg, reg - 1, 2);
+  }
+  blocks[0].append<Bytecode::Instruction::Return>(9);
+
+  BytecodeOptimizer opt;
+  opt.allocate_registers(blocks);
+
+  REQUIRE(frame_size_of(blocks, 0) == 1);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 512);
+}
+
+TEST_CASE("register_allocation_coalesces_moves_into_one_slot") {
+  // 0: i = 0; sum = 0
+  // 1: while (i < 10) {
+  // 2:   t = sum + i; sum = t; n = i + 1; i = n }
+  // 3: return sum
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(2, 0, 10);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(2, 2, 3);
+  blocks[2].append<Bytecode::Instruction::Add>(3, 1, 0);
+  blocks[2].append<Bytecode::Instruction::Move>(1, 3);
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(4, 0, 1);
+  blocks[2].append<Bytecode::Instruction::Move>(0, 4);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+  blocks[3].append<Bytecode::Instruction::Return>(1);
+
+  BytecodeOptimizer opt;
+  opt.allocate_registers(blocks);
+
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::Move));
+  // i, sum and the branch condition.
+  REQUIRE(frame_size_of(blocks, 0) == 3);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 45);
+}
+
+TEST_CASE("register_allocation_keeps_address_taken_registers_in_their_own_slot") {
+  // x = 7; p = &x; y = 1; return *p + y
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  blocks[0].append<Bytecode::Instruction::Load>(3, 7);
+  blocks[0].append<Bytecode::Instruction::AddressOf>(4, 3);
+  blocks[0].append<Bytecode::Instruction::Load>(5, 1);
+  blocks[0].append<Bytecode::Instruction::LoadIndirect>(6, 4);
+  blocks[0].append<Bytecode::Instruction::Add>(7, 6, 5);
+  blocks[0].append<Bytecode::Instruction::Return>(7);
+
+  BytecodeOptimizer opt;
+  opt.allocate_registers(blocks);
+
+  // x has no use after its address is taken, but the pointer still reads it.
+  const auto &address_of =
+      static_cast<const Bytecode::Instruction::AddressOf &>(*blocks[0].instructions[1]);
+  const auto &y = static_cast<const Bytecode::Instruction::Load &>(*blocks[0].instructions[2]);
+  REQUIRE(y.dst != address_of.src);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 8);
+}
+
+TEST_CASE("register_allocation_shrinks_frames_of_generated_code") {
+  const char *source = R"(
+fn weigh(n) {
+  if (n < 2) {
+    return n;
+  }
+  let a = n * 3 + 1;
+  let b = a * a - n;
+  let c = (b + a) % 7;
+  return weigh(n - 1) + c;
+}
+return weigh(12);
+)";
+  ErrorReporter reporter;
+  Parser parser(source, reporter);
+  auto program = parser.parse_program();
+  REQUIRE(program != nullptr);
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+
+  auto &blocks = generator.blocks();
+  BytecodeInterpreter interp;
+  const auto expected = interp.interpret(blocks);
+  const auto functions = build_function_table(blocks);
+  REQUIRE(functions.size() == 2);
+  const auto entry = functions[1].entry;
+  const auto frame_before = functions[1].frame_size;
+
+  BytecodeOptimizer opt;
+  opt.allocate_registers(blocks);
+
+  // The generator takes a fresh register for every temporary; only a few
+  // are live at once.
+  REQUIRE(frame_size_of(blocks, entry) * 2 < frame_before);
+  BytecodeInterpreter after;
+  REQUIRE(after.interpret(blocks) == expected);
+}
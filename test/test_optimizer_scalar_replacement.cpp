@@ -0,0 +1,142 @@
+#include "test_optimizer_helpers.h"
+
+#include <stdexcept>
+
+// ============================================================
+// Scalar replacement of aggregates
+// ============================================================
+
+TEST_CASE("scalar_replacement_keeps_struct_fields_in_registers") {
+  // p = {x: 3, y: 4}; q = p; q.x = p.x + 10; return q.x * p.y
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  blocks[0].append<Bytecode::Instruction::StructLiteralCreate>(
+      0, std::vector<std::pair<std::string, Bytecode::Value>>{{"x", 3}, {"y", 4}});
+  blocks[0].append<Bytecode::Instruction::Move>(1, 0);
+  blocks[0].append<Bytecode::Instruction::StructLoad>(2, 0, "x");
+  blocks[0].append<Bytecode::Instruction::AddImmediate>(3, 2, 10);
+  blocks[0].append<Bytecode::Instruction::StructStore>(1, "x", 3);
+  blocks[0].append<Bytecode::Instruction::StructLoad>(4, 1, "x");
+  blocks[0].append<Bytecode::Instruction::StructLoad>(5, 0, "y");
+  blocks[0].append<Bytecode::Instruction::Multiply>(6, 4, 5);
+  blocks[0].append<Bytecode::Instruction::Return>(6);
+
+  BytecodeOptimizer opt;
+  const auto result = opt.scalar_replacement(blocks);
+  REQUIRE(result.changes == 1);
+  REQUIRE_FALSE(result.control_flow_changed);
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::StructLiteralCreate));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::StructLoad));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::StructStore));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 52);
+  REQUIRE(interp.heap_stats().allocated_objects == 0);
+}
+
+TEST_CASE("scalar_replacement_copies_array_elements_from_registers") {
+  // 0: a = 5; b = 6; arr = [a, b]; a = 0; @1
+  // 1: return arr[0] + arr[1]
+  std::vector<Bytecode::BasicBlock> blocks(2);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 5);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 6);
+  blocks[0].append<Bytecode::Instruction::ArrayCreate>(2, std::vector<Bytecode::Register>{0, 1});
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::ArrayLoadImmediate>(3, 2, 0);
+  blocks[1].append<Bytecode::Instruction::ArrayLoadImmediate>(4, 2, 1);
+  blocks[1].append<Bytecode::Instruction::Add>(5, 3, 4);
+  blocks[1].append<Bytecode::Instruction::Return>(5);
+
+  BytecodeOptimizer opt;
+  REQUIRE(opt.scalar_replacement(blocks));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::ArrayCreate));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::ArrayLoadImmediate));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 11);
+}
+
+TEST_CASE("scalar_replacement_keeps_aggregates_whose_handle_escapes") {
+  // The handle is returned.
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  blocks[0].append<Bytecode::Instruction::ArrayLiteralCreate>(
+      0, std::vector<Bytecode::Value>{1, 2});
+  blocks[0].append<Bytecode::Instruction::ArrayLoadImmediate>(1, 0, 1);
+  blocks[0].append<Bytecode::Instruction::Move>(2, 0);
+  blocks[0].append<Bytecode::Instruction::Return>(2);
+
+  BytecodeOptimizer opt;
+  REQUIRE_FALSE(opt.scalar_replacement(blocks));
+  REQUIRE(has_instruction_type(blocks, Type::ArrayLiteralCreate));
+  REQUIRE(has_instruction_type(blocks, Type::ArrayLoadImmediate));
+}
+
+TEST_CASE("scalar_replacement_keeps_an_out_of_range_load_failing") {
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  blocks[0].append<Bytecode::Instruction::ArrayLiteralCreate>(
+      0, std::vector<Bytecode::Value>{1, 2});
+  blocks[0].append<Bytecode::Instruction::ArrayLoadImmediate>(1, 0, 2);
+  blocks[0].append<Bytecode::Instruction::Return>(1);
+
+  BytecodeOptimizer opt;
+  REQUIRE_FALSE(opt.scalar_replacement(blocks));
+
+  BytecodeInterpreter interp;
+  REQUIRE_THROWS_AS(interp.interpret(blocks), std::out_of_range);
+}
+
+TEST_CASE("scalar_replacement_keeps_a_handle_register_written_twice") {
+  // 0: p = {x: 1}; @1
+  // 1: s = p.x; if (s < 5) @2 else @3
+  // 2: q = {x: s + 1}; p = q; @1
+  // 3: return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::StructLiteralCreate>(
+      0, std::vector<std::pair<std::string, Bytecode::Value>>{{"x", 1}});
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::StructLoad>(1, 0, "x");
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 5, 2, 3);
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(2, 1, 1);
+  blocks[2].append<Bytecode::Instruction::StructCreate>(
+      3, std::vector<std::pair<std::string, Bytecode::Register>>{{"x", 2}});
+  blocks[2].append<Bytecode::Instruction::Move>(0, 3);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+  blocks[3].append<Bytecode::Instruction::Return>(1);
+
+  BytecodeOptimizer opt;
+  REQUIRE_FALSE(opt.scalar_replacement(blocks));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 5);
+}
+
+TEST_CASE("scalar_replacement_replaces_a_struct_rebuilt_every_iteration") {
+  // 0: s = 0; i = 0; @1
+  // 1: if (i < 10) @2 else @3
+  // 2: p = {x: i, y: 2}; s += p.x * p.y; i += 1; @1
+  // 3: return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);
+  blocks[0].append<Bytecode::Instruction::Load>(2, 2);
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 10, 2, 3);
+  blocks[2].append<Bytecode::Instruction::StructCreate>(
+      3, std::vector<std::pair<std::string, Bytecode::Register>>{{"x", 1}, {"y", 2}});
+  blocks[2].append<Bytecode::Instruction::StructLoad>(4, 3, "x");
+  blocks[2].append<Bytecode::Instruction::StructLoad>(5, 3, "y");
+  blocks[2].append<Bytecode::Instruction::Multiply>(6, 4, 5);
+  blocks[2].append<Bytecode::Instruction::Add>(0, 0, 6);
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  opt.optimize(blocks);
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::StructCreate));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::StructLoad));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 90);
+  REQUIRE(interp.heap_stats().allocated_objects == 0);
+}
@@ -0,0 +1,233 @@
+#include "test_optimizer_helpers.h"
+#include "../src/parser.h"
+
+// ============================================================
+// Pass -0.25: Sparse Conditional Constant Propagation
+// ============================================================
+
+namespace {
+
+const Bytecode::Instruction::Load *load_of(const Bytecode::Instruction &instr) {
+  return instr.type() == Type::Load ? &static_cast<const Bytecode::Instruction::Load &>(instr)
+                                    : nullptr;
+}
+
+}  // namespace
+
+TEST_CASE("sccp_folds_arithmetic_and_compare_chains") {
+  // 0: a = 6 * 7 - 2; if (a < 100)
+  // 1:   return a
+  // 2: return 0
+  std::vector<Bytecode::BasicBlock> blocks(3);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 6);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 7);
+  blocks[0].append<Bytecode::Instruction::Multiply>(2, 0, 1);
+  blocks[0].append<Bytecode::Instruction::SubtractImmediate>(3, 2, 2);
+  blocks[0].append<Bytecode::Instruction::LessThanImmediate>(4, 3, 100);
+  blocks[0].append<Bytecode::Instruction::JumpConditional>(4, 1, 2);
+  blocks[1].append<Bytecode::Instruction::Return>(3);
+  blocks[2].append<Bytecode::Instruction::Load>(5, 0);
+  blocks[2].append<Bytecode::Instruction::Return>(5);
+
+  BytecodeOptimizer opt;
+  opt.sparse_conditional_constant_propagation(blocks);
+
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::Multiply));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::SubtractImmediate));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::LessThanImmediate));
+  REQUIRE(blocks[0].instructions.back()->type() == Type::Jump);
+  REQUIRE(static_cast<const Bytecode::Instruction::Jump &>(*blocks[0].instructions.back()).label ==
+          1);
+  // The branch that is never taken loses its code.
+  REQUIRE(blocks[2].instructions.size() == 1);
+  REQUIRE(blocks[2].instructions[0]->type() == Type::Jump);
+
+  const auto &ret = static_cast<const Bytecode::Instruction::Return &>(*blocks[1].instructions[0]);
+  bool returns_constant = false;
+  for (const auto &instr : blocks[0].instructions) {
+    const auto *load = load_of(*instr);
+    returns_constant = returns_constant || (load && load->dst == ret.reg && load->value == 40);
+  }
+  REQUIRE(returns_constant);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 40);
+}
+
+TEST_CASE("sccp_ignores_definitions_on_branches_never_taken") {
+  // 0: x = 1; if (x == 1)
+  // 1:   y = 2
+  // 2: else y = 3
+  // 3: return y + 1
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 1);
+  blocks[0].append<Bytecode::Instruction::EqualImmediate>(1, 0, 1);
+  blocks[0].append<Bytecode::Instruction::JumpConditional>(1, 1, 2);
+  blocks[1].append<Bytecode::Instruction::Load>(2, 2);
+  blocks[1].append<Bytecode::Instruction::Jump>(3);
+  blocks[2].append<Bytecode::Instruction::Load>(2, 3);
+  blocks[2].append<Bytecode::Instruction::Jump>(3);
+  blocks[3].append<Bytecode::Instruction::AddImmediate>(3, 2, 1);
+  blocks[3].append<Bytecode::Instruction::Return>(3);
+
+  BytecodeOptimizer opt;
+  opt.sparse_conditional_constant_propagation(blocks);
+
+  // y only arrives from block 1, so its phi and y + 1 are constants.
+  REQUIRE(blocks[2].instructions.size() == 1);
+  const auto *y = load_of(*blocks[3].instructions[0]);
+  const auto *sum = load_of(*blocks[3].instructions[1]);
+  REQUIRE(y != nullptr);
+  REQUIRE(y->value == 2);
+  REQUIRE(sum != nullptr);
+  REQUIRE(sum->value == 3);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 3);
+}
+
+TEST_CASE("sccp_meets_equal_constants_and_prunes_the_branch_they_decide") {
+  // 0: return configure(5)
+  // 1: configure(n): if (n > 3)
+  // 2:   flag = 1
+  // 3: else flag = 1
+  // 4: if (flag)
+  // 5:   return n + 10
+  // 6: return 99
+  std::vector<Bytecode::BasicBlock> blocks(7);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 5);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      1, 1, std::vector<Bytecode::Register>{0}, std::vector<Bytecode::Register>{0});
+  blocks[0].append<Bytecode::Instruction::Return>(1);
+  blocks[1].append<Bytecode::Instruction::JumpGreaterThanImmediate>(0, 3, 2, 3);
+  blocks[2].append<Bytecode::Instruction::Load>(1, 1);
+  blocks[2].append<Bytecode::Instruction::Jump>(4);
+  blocks[3].append<Bytecode::Instruction::Load>(1, 1);
+  blocks[3].append<Bytecode::Instruction::Jump>(4);
+  blocks[4].append<Bytecode::Instruction::JumpConditional>(1, 5, 6);
+  blocks[5].append<Bytecode::Instruction::AddImmediate>(2, 0, 10);
+  blocks[5].append<Bytecode::Instruction::Return>(2);
+  blocks[6].append<Bytecode::Instruction::Load>(2, 99);
+  blocks[6].append<Bytecode::Instruction::Return>(2);
+
+  BytecodeOptimizer opt;
+  opt.sparse_conditional_constant_propagation(blocks);
+
+  // The parameter is unknown, so its branch stays.
+  REQUIRE(blocks.size() == 7);
+  REQUIRE(blocks[1].instructions.back()->type() == Type::JumpGreaterThanImmediate);
+  REQUIRE(blocks[4].instructions.back()->type() == Type::Jump);
+  REQUIRE(blocks[6].instructions.size() == 1);
+  REQUIRE(has_instruction_type(blocks, Type::AddImmediate));
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 15);
+}
+
+TEST_CASE("sccp_leaves_division_by_zero_in_place") {
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 5);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);
+  blocks[0].append<Bytecode::Instruction::Divide>(2, 0, 1);
+  blocks[0].append<Bytecode::Instruction::ModuloImmediate>(3, 0, 0);
+  blocks[0].append<Bytecode::Instruction::DivideImmediate>(4, 0, 2);
+  blocks[0].append<Bytecode::Instruction::Add>(5, 2, 3);
+  blocks[0].append<Bytecode::Instruction::Add>(5, 5, 4);
+  blocks[0].append<Bytecode::Instruction::Return>(5);
+
+  BytecodeOptimizer opt;
+  opt.sparse_conditional_constant_propagation(blocks);
+
+  REQUIRE(has_instruction_type(blocks, Type::Divide));
+  REQUIRE(has_instruction_type(blocks, Type::ModuloImmediate));
+  // 5 / 2 is still folded.
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::DivideImmediate));
+}
+
+TEST_CASE("sccp_keeps_loop_counters_and_folds_invariants") {
+  // 0: k = 3; i = 0; sum = 0
+  // 1: while (i < 10) {
+  // 2:   sum = sum + k * 2; i = i + 1 }
+  // 3: return sum + i
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 3);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);
+  blocks[0].append<Bytecode::Instruction::Load>(2, 0);
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(3, 1, 10);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(3, 2, 3);
+  blocks[2].append<Bytecode::Instruction::MultiplyImmediate>(4, 0, 2);
+  blocks[2].append<Bytecode::Instruction::Add>(2, 2, 4);
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+  blocks[3].append<Bytecode::Instruction::Add>(5, 2, 1);
+  blocks[3].append<Bytecode::Instruction::Return>(5);
+
+  BytecodeOptimizer opt;
+  opt.sparse_conditional_constant_propagation(blocks);
+
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::MultiplyImmediate));
+  REQUIRE(has_instruction_type(blocks, Type::AddImmediate));
+  REQUIRE(blocks[1].instructions.back()->type() == Type::JumpConditional);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 70);
+}
+
+TEST_CASE("sccp_leaves_functions_without_constants_untouched") {
+  // 0: return twice(4)
+  // 1: twice(p): return p + p
+  std::vector<Bytecode::BasicBlock> blocks(2);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 4);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      1, 1, std::vector<Bytecode::Register>{0}, std::vector<Bytecode::Register>{0});
+  blocks[0].append<Bytecode::Instruction::Return>(1);
+  blocks[1].append<Bytecode::Instruction::Add>(1, 0, 0);
+  blocks[1].append<Bytecode::Instruction::Return>(1);
+
+  BytecodeOptimizer opt;
+  opt.sparse_conditional_constant_propagation(blocks);
+
+  REQUIRE(total_instr_count(blocks) == 5);
+  const auto &add = static_cast<const Bytecode::Instruction::Add &>(*blocks[1].instructions[0]);
+  REQUIRE(add.dst == 1);
+  REQUIRE(add.src1 == 0);
+  const auto &call = static_cast<const Bytecode::Instruction::Call &>(*blocks[0].instructions[1]);
+  REQUIRE(call.dst == 1);
+}
+
+TEST_CASE("sccp_collapses_configuration_driven_code") {
+  const char *source = R"(
+let verbose = 0;
+let scale = 4;
+let offset = scale * 10 + 2;
+let limit = 0;
+if (verbose) {
+  limit = 1000;
+} else {
+  limit = offset - scale;
+}
+let result = 0;
+if (limit > 30) {
+  result = limit * 2;
+} else {
+  result = limit / 2;
+}
+return result;
+)";
+  ErrorReporter reporter;
+  Parser parser(source, reporter);
+  auto program = parser.parse_program();
+  REQUIRE(program != nullptr);
+  BytecodeGenerator generator;
+  generator.visit_block(*program);
+  generator.finalize();
+
+  BytecodeOptimizer opt;
+  opt.optimize(generator.blocks());
+
+  const auto &blocks = generator.blocks();
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::JumpConditional));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::JumpGreaterThanImmediate));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::Multiply));
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::MultiplyImmediate));
+  REQUIRE(total_instr_count(blocks) <= 3);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(generator.blocks()) == 76);
+}
@@ -0,0 +1,222 @@
+#include "test_optimizer_helpers.h"
+#include "../src/optimizer/optimizer_internal.h"
+#include "../src/optimizer/optimizer_ssa.h"
+
+#include <unordered_map>
+
+// ============================================================
+// SSA construction and destruction
+// ============================================================
+
+TEST_CASE("ssa_places_phi_at_diamond_join") {
+  // 0: x = 5; if (c)
+  // 1:   x = 7
+  // 2: else x = x + 1
+  // 3: return x
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 5);
+  blocks[0].append<Bytecode::Instruction::JumpConditional>(0, 1, 2);
+  blocks[1].append<Bytecode::Instruction::Load>(1, 7);
+  blocks[1].append<Bytecode::Instruction::Jump>(3);
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);
+  blocks[2].append<Bytecode::Instruction::Jump>(3);
+  blocks[3].append<Bytecode::Instruction::Return>(1);
+
+  const auto functions = build_function_table(blocks);
+  auto ssa = construct_ssa(blocks, functions.front());
+  REQUIRE(ssa.has_value());
+
+  REQUIRE(ssa->cfg.idom[3] == 0);
+  REQUIRE(ssa->cfg.dominance_frontiers()[1] == std::vector<Bytecode::Label>{3});
+  REQUIRE(ssa->phis[3].size() == 1);
+  const auto &phi = ssa->phis[3][0];
+  const auto &ret = static_cast<const Bytecode::Instruction::Return &>(*blocks[3].instructions[0]);
+  REQUIRE(ret.reg == phi.dst);
+  REQUIRE(phi.args[0] != phi.args[1]);
+  REQUIRE(phi.args[0] >= ssa->first_value);
+  // c is never written, so it keeps its own register and gets no phi.
+  const auto &branch =
+      static_cast<const Bytecode::Instruction::JumpConditional &>(*blocks[0].instructions[1]);
+  REQUIRE(branch.cond == 0);
+
+  destruct_ssa(blocks, *ssa);
+  REQUIRE(count_instructions(blocks, Type::Move) == 0);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 6);
+}
+
+TEST_CASE("ssa_loop_phis_coalesce_without_copies") {
+  // 0: i = 0; sum = 0
+  // 1: while (i < 10) {
+  // 2:   sum = sum + i; i = i + 1 }
+  // 3: return sum
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(2, 0, 10);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(2, 2, 3);
+  blocks[2].append<Bytecode::Instruction::Add>(1, 1, 0);
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(0, 0, 1);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+  blocks[3].append<Bytecode::Instruction::Return>(1);
+
+  const auto functions = build_function_table(blocks);
+  auto ssa = construct_ssa(blocks, functions.front());
+  REQUIRE(ssa.has_value());
+
+  REQUIRE(ssa->cfg.idom[2] == 1);
+  REQUIRE(ssa->cfg.idom[3] == 1);
+  REQUIRE(ssa->cfg.dominates(1, 2));
+  REQUIRE_FALSE(ssa->cfg.dominates(2, 3));
+  // i and sum are live around the loop; the compare result is not.
+  REQUIRE(ssa->phis[1].size() == 2);
+  REQUIRE(ssa->cfg.predecessors[1] == std::vector<Bytecode::Label>{0, 2});
+
+  destruct_ssa(blocks, *ssa);
+  REQUIRE(count_instructions(blocks, Type::Move) == 0);
+  REQUIRE(blocks.size() == 4);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 45);
+}
+
+TEST_CASE("ssa_destruct_breaks_swap_cycles_with_temporary") {
+  // 0: a = 3; b = 4; n = 5
+  // 1: while (n != 0) {
+  // 2:   t = a; a = b; b = t; n = n - 1 }
+  // 3: return a * 100 + b
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 3);  // a
+  blocks[0].append<Bytecode::Instruction::Load>(1, 4);  // b
+  blocks[0].append<Bytecode::Instruction::Load>(2, 5);  // n
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+  blocks[1].append<Bytecode::Instruction::EqualImmediate>(4, 2, 0);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(4, 3, 2);
+  blocks[2].append<Bytecode::Instruction::Move>(5, 0);  // t = a
+  blocks[2].append<Bytecode::Instruction::Move>(0, 1);  // a = b
+  blocks[2].append<Bytecode::Instruction::Move>(1, 5);  // b = t
+  blocks[2].append<Bytecode::Instruction::SubtractImmediate>(2, 2, 1);
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+  blocks[3].append<Bytecode::Instruction::MultiplyImmediate>(6, 0, 100);
+  blocks[3].append<Bytecode::Instruction::Add>(6, 6, 1);
+  blocks[3].append<Bytecode::Instruction::Return>(6);
+
+  const auto functions = build_function_table(blocks);
+  auto ssa = construct_ssa(blocks, functions.front());
+  REQUIRE(ssa.has_value());
+
+  // Fold the copies into the loop's phis, as an SSA copy propagation would.
+  // a and b then swap through the phis alone, and each phi's argument is
+  // live at the same time as the phi.
+  std::unordered_map<Register, Register> source;
+  for (const auto &instr : blocks[2].instructions) {
+    if (instr->type() == Type::Move) {
+      const auto &move = static_cast<const Bytecode::Instruction::Move &>(*instr);
+      const auto it = source.find(move.src);
+      source[move.dst] = it != source.end() ? it->second : move.src;
+    }
+  }
+  for (auto &phi : ssa->phis[1]) {
+    for (auto &arg : phi.args) {
+      if (const auto it = source.find(arg); it != source.end()) {
+        arg = it->second;
+      }
+    }
+  }
+
+  REQUIRE(ssa->phis[1].size() == 3);
+  const auto temporary = ssa->next_register;
+  destruct_ssa(blocks, *ssa);
+
+  bool uses_temporary = false;
+  for (const auto &instr : blocks[2].instructions) {
+    if (instr->type() == Type::Move) {
+      uses_temporary = uses_temporary ||
+                       static_cast<const Bytecode::Instruction::Move &>(*instr).dst == temporary;
+    }
+  }
+  REQUIRE(uses_temporary);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 403);
+}
+
+TEST_CASE("ssa_destruct_splits_critical_edges") {
+  // 0: x = 5; old = x; if (c)
+  // 1:   x = 7
+  // 2: return x + old
+  for (const Bytecode::Value c : {0, 1}) {
+    std::vector<Bytecode::BasicBlock> blocks(3);
+    blocks[0].append<Bytecode::Instruction::Load>(0, c);
+    blocks[0].append<Bytecode::Instruction::Load>(1, 5);
+    blocks[0].append<Bytecode::Instruction::Move>(3, 1);
+    blocks[0].append<Bytecode::Instruction::JumpConditional>(0, 1, 2);
+    blocks[1].append<Bytecode::Instruction::Load>(1, 7);
+    blocks[1].append<Bytecode::Instruction::Jump>(2);
+    blocks[2].append<Bytecode::Instruction::Add>(2, 1, 3);
+    blocks[2].append<Bytecode::Instruction::Return>(2);
+
+    const auto functions = build_function_table(blocks);
+    auto ssa = construct_ssa(blocks, functions.front());
+    REQUIRE(ssa.has_value());
+    // Read old x straight from x, as an SSA copy propagation would.
+    const auto &copy =
+        static_cast<const Bytecode::Instruction::Move &>(*blocks[0].instructions[2]);
+    static_cast<Bytecode::Instruction::Add &>(*blocks[2].instructions[0]).src2 = copy.src;
+    destruct_ssa(blocks, *ssa);
+
+    // The old x is still needed at the join, so the edge from the branch
+    // gets its own block for the copy into the phi.
+    REQUIRE(blocks.size() == 4);
+    const auto &branch =
+        static_cast<const Bytecode::Instruction::JumpConditional &>(*blocks[0].instructions.back());
+    REQUIRE(branch.label1 == 2);
+    REQUIRE(branch.label2 == 1);
+    REQUIRE(blocks[1].instructions.back()->type() == Type::Jump);
+    REQUIRE(blocks[1].instructions[0]->type() == Type::Move);
+    BytecodeInterpreter interp;
+    REQUIRE(interp.interpret(blocks) == (c ? 12 : 10));
+  }
+}
+
+TEST_CASE("ssa_keeps_parameters_and_address_taken_registers") {
+  // 0: return twice_plus(4)
+  // 1: twice_plus(p): q = p + p; r = &q; p = *r + 1; return p
+  std::vector<Bytecode::BasicBlock> blocks(2);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 4);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      1, 1, std::vector<Bytecode::Register>{0}, std::vector<Bytecode::Register>{0});
+  blocks[0].append<Bytecode::Instruction::Return>(1);
+  blocks[1].append<Bytecode::Instruction::Add>(1, 0, 0);
+  blocks[1].append<Bytecode::Instruction::AddressOf>(2, 1);
+  blocks[1].append<Bytecode::Instruction::LoadIndirect>(3, 2);
+  blocks[1].append<Bytecode::Instruction::AddImmediate>(0, 3, 1);
+  blocks[1].append<Bytecode::Instruction::Return>(0);
+
+  const auto functions = build_function_table(blocks);
+  auto ssa = construct_ssa(blocks, functions[1]);
+  REQUIRE(ssa.has_value());
+
+  const auto &add = static_cast<const Bytecode::Instruction::Add &>(*blocks[1].instructions[0]);
+  REQUIRE(add.src1 == 0);
+  REQUIRE(add.dst == 1);
+  const auto &redefined =
+      static_cast<const Bytecode::Instruction::AddImmediate &>(*blocks[1].instructions[3]);
+  REQUIRE(redefined.dst >= ssa->first_value);
+
+  destruct_ssa(blocks, *ssa);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 9);
+}
+
+TEST_CASE("ssa_skips_functions_whose_entry_is_a_loop_header") {
+  std::vector<Bytecode::BasicBlock> blocks(2);
+  blocks[0].append<Bytecode::Instruction::AddImmediate>(0, 0, 1);
+  blocks[0].append<Bytecode::Instruction::LessThanImmediate>(1, 0, 3);
+  blocks[0].append<Bytecode::Instruction::JumpConditional>(1, 0, 1);
+  blocks[1].append<Bytecode::Instruction::Return>(0);
+
+  const auto functions = build_function_table(blocks);
+  REQUIRE_FALSE(construct_ssa(blocks, functions.front()).has_value());
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 3);
+}
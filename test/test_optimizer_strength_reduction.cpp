@@ -0,0 +1,175 @@
+#include "test_optimizer_helpers.h"
+
+// ============================================================
+// Strength reduction and linear-function test replacement
+// ============================================================
+
+// A product of the loop variable and a constant is stepped along with it,
+// and the loop tests the product instead.
+TEST_CASE("strength_reduction_steps_a_product_and_tests_it_instead") {
+  // block 0: s=0; i=0; Jump @1
+  // block 1: JumpLessThanImmediate i<10 @2,@3
+  // block 2: p=i*3; s=s+p; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 10, 2, 3);  // i < 10
+
+  blocks[2].append<Bytecode::Instruction::MultiplyImmediate>(2, 1, 3);  // p = i * 3
+  blocks[2].append<Bytecode::Instruction::Add>(0, 0, 2);                // s = s + p
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);       // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  const auto result = opt.strength_reduction(blocks);
+
+  // The reduction and the replaced test; block 0 already is the preheader.
+  REQUIRE(result.changes == 2);
+  REQUIRE_FALSE(result.control_flow_changed);
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::MultiplyImmediate));
+  const auto &test =
+      static_cast<const Bytecode::Instruction::JumpLessThanImmediate &>(*blocks[1].instructions[0]);
+  REQUIRE(test.lhs == 2);
+  REQUIRE(test.value == 30);
+  const auto &step = static_cast<const Bytecode::Instruction::AddImmediate &>(
+      *blocks[2].instructions[1]);
+  REQUIRE(step.dst == 2);
+  REQUIRE(step.value == 3);
+  REQUIRE(blocks[2].instructions.size() == 3);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 135);
+}
+
+// A factor the loop does not change but whose value is unknown is added at
+// each step instead of multiplied.
+TEST_CASE("strength_reduction_adds_an_unknown_invariant_factor") {
+  // block 0: r4=4; k=r4; s=0; i=0; Jump @1
+  // block 1: JumpLessThanImmediate i<10 @2,@3
+  // block 2: p=i*k; s=s+p; i=i+1; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(4, 4);  // r4 = 4
+  blocks[0].append<Bytecode::Instruction::Move>(3, 4);  // r3 = r4 (k, not a known constant)
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 10, 2, 3);  // i < 10
+
+  blocks[2].append<Bytecode::Instruction::Multiply>(2, 1, 3);      // p = i * k
+  blocks[2].append<Bytecode::Instruction::Add>(0, 0, 2);           // s = s + p
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);  // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  REQUIRE(opt.strength_reduction(blocks));
+
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::Multiply));
+  REQUIRE(has_instruction_type(blocks, Type::Add));
+  // Without a known factor the test keeps the variable.
+  REQUIRE(blocks[1].instructions[0]->type() == Type::JumpLessThanImmediate);
+  REQUIRE(static_cast<const Bytecode::Instruction::JumpLessThanImmediate &>(
+              *blocks[1].instructions[0])
+              .lhs == 1);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 180);
+}
+
+// A product read after the variable steps would need the old value, so it
+// stays a multiply.
+TEST_CASE("strength_reduction_keeps_a_product_read_after_the_step") {
+  // block 0: s=0; i=0; Jump @1
+  // block 1: JumpLessThanImmediate i<10 @2,@3
+  // block 2: p=i*3; i=i+1; s=s+p; Jump @1
+  // block 3: Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 10, 2, 3);  // i < 10
+
+  blocks[2].append<Bytecode::Instruction::MultiplyImmediate>(2, 1, 3);  // p = i * 3
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);       // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Add>(0, 0, 2);                // s = s + p
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  opt.strength_reduction(blocks);
+  REQUIRE(has_instruction_type(blocks, Type::MultiplyImmediate));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 135);
+}
+
+// The product is still stepped, but a variable read after the loop keeps
+// the test on the variable.
+TEST_CASE("strength_reduction_keeps_the_test_when_the_variable_is_read_after_the_loop") {
+  // block 0: s=0; i=0; Jump @1
+  // block 1: JumpLessThanImmediate i<10 @2,@3
+  // block 2: p=i*3; s=s+p; i=i+1; Jump @1
+  // block 3: s=s+i; Return s
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);  // r0 = 0 (s)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);  // r1 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::JumpLessThanImmediate>(1, 10, 2, 3);  // i < 10
+
+  blocks[2].append<Bytecode::Instruction::MultiplyImmediate>(2, 1, 3);  // p = i * 3
+  blocks[2].append<Bytecode::Instruction::Add>(0, 0, 2);                // s = s + p
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(1, 1, 1);       // i = i + 1
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Add>(0, 0, 1);  // s = s + i -- reads i after the loop
+  blocks[3].append<Bytecode::Instruction::Return>(0);
+
+  BytecodeOptimizer opt;
+  REQUIRE(opt.strength_reduction(blocks).changes == 1);
+  REQUIRE_FALSE(has_instruction_type(blocks, Type::MultiplyImmediate));
+  REQUIRE(static_cast<const Bytecode::Instruction::JumpLessThanImmediate &>(
+              *blocks[1].instructions[0])
+              .value == 10);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 145);
+}
+
+TEST_CASE("strength_reduction_runs_in_the_full_pipeline") {
+  // s = 0; i = 0; while (i < 50) { s = s + i * 7; i++ } return s
+  auto body = std::make_unique<Ast::Block>();
+  body->append(decl("s", lit(0)));
+  body->append(decl("i", lit(0)));
+  auto while_body = std::make_unique<Ast::Block>();
+  while_body->append(assign("s", add(var("s"), mul(var("i"), lit(7)))));
+  while_body->append(inc("i"));
+  body->append(while_loop(lt(var("i"), lit(50)), std::move(while_body)));
+  body->append(ret(var("s")));
+
+  BytecodeGenerator gen;
+  gen.visit_block(*body);
+  gen.finalize();
+
+  BytecodeOptimizer opt;
+  opt.optimize(gen.blocks());
+  REQUIRE_FALSE(has_instruction_type(gen.blocks(), Type::Multiply));
+  REQUIRE_FALSE(has_instruction_type(gen.blocks(), Type::MultiplyImmediate));
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(gen.blocks()) == 8575);
+}
@@ -0,0 +1,147 @@
+#include "test_optimizer_helpers.h"
+
+#include <sstream>
+
+// ============================================================
+// Superinstruction formation
+// ============================================================
+
+TEST_CASE("superinstructions_fuse_a_block_end_with_its_terminator") {
+  // block 0: i=0; s=10; Jump @1
+  // block 1: r2=i<5; JumpConditional r2 @2,@3
+  // block 2: i=i+1; s=s-2; Jump @1
+  // block 3: r3=i+s; Return r3
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);   // r0 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 10);  // r1 = 10 (s)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(2, 0, 5);  // r2 = i < 5
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(2, 2, 3);
+
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(0, 0, 1);       // i = i + 1
+  blocks[2].append<Bytecode::Instruction::SubtractImmediate>(1, 1, 2);  // s = s - 2
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Add>(3, 0, 1);  // r3 = i + s
+  blocks[3].append<Bytecode::Instruction::Return>(3);
+
+  BytecodeOptimizer opt;
+  const auto result = opt.form_superinstructions(blocks);
+
+  REQUIRE(result.changes == 3);
+  REQUIRE_FALSE(result.control_flow_changed);
+  REQUIRE(blocks[0].instructions.back()->type() == Type::LoadJump);
+  REQUIRE(blocks[1].instructions.size() == 2);
+  REQUIRE(blocks[2].instructions.size() == 2);
+  REQUIRE(blocks[3].instructions.size() == 1);
+
+  // The subtraction becomes an addition of the negated value.
+  const auto &step = derived_cast<const Bytecode::Instruction::AddImmediateJump &>(
+      *blocks[2].instructions.back());
+  REQUIRE(step.dst == 1);
+  REQUIRE(step.value == Bytecode::Value{0} - 2);
+  REQUIRE(step.label == 1);
+  REQUIRE(blocks[3].instructions[0]->type() == Type::AddReturn);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 5);
+}
+
+TEST_CASE("superinstructions_keep_a_sum_the_return_does_not_read") {
+  std::vector<Bytecode::BasicBlock> blocks(1);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 3);
+  blocks[0].append<Bytecode::Instruction::Add>(1, 0, 0);
+  blocks[0].append<Bytecode::Instruction::Return>(0);
+  BytecodeOptimizer opt;
+  REQUIRE_FALSE(opt.form_superinstructions(blocks));
+
+  // Nor one a pointer may read from the frame.
+  std::vector<Bytecode::BasicBlock> pointed(1);
+  pointed[0].append<Bytecode::Instruction::Load>(0, 3);
+  pointed[0].append<Bytecode::Instruction::AddressOf>(2, 1);
+  pointed[0].append<Bytecode::Instruction::Add>(1, 0, 0);
+  pointed[0].append<Bytecode::Instruction::Return>(1);
+  REQUIRE_FALSE(opt.form_superinstructions(pointed));
+}
+
+TEST_CASE("superinstructions_run_after_register_allocation") {
+  // block 0: i=0; s=10; Jump @1
+  // block 1: r2=i<5; JumpConditional r2 @2,@3
+  // block 2: i=i+1; s=s-2; Jump @1
+  // block 3: r3=i+s; Return r3
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);   // r0 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 10);  // r1 = 10 (s)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(2, 0, 5);  // r2 = i < 5
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(2, 2, 3);
+
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(0, 0, 1);       // i = i + 1
+  blocks[2].append<Bytecode::Instruction::SubtractImmediate>(1, 1, 2);  // s = s - 2
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Add>(3, 0, 1);  // r3 = i + s
+  blocks[3].append<Bytecode::Instruction::Return>(3);
+
+  BytecodeOptimizer opt;
+  opt.set_inline_threshold(0);
+  opt.optimize(blocks);
+
+  REQUIRE(opt.stats().back().name == "form_superinstructions");
+  REQUIRE(has_instruction_type(blocks, Type::AddImmediateJump));
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 5);
+}
+
+TEST_CASE("opcode_profile_counts_adjacent_pairs_and_fused_operations") {
+  const auto pair = [](Type first, Type second) {
+    return static_cast<size_t>(first) * k_opcode_count + static_cast<size_t>(second);
+  };
+
+  // block 0: i=0; s=10; Jump @1
+  // block 1: r2=i<5; JumpConditional r2 @2,@3
+  // block 2: i=i+1; s=s-2; Jump @1
+  // block 3: r3=i+s; Return r3
+  std::vector<Bytecode::BasicBlock> blocks(4);
+
+  blocks[0].append<Bytecode::Instruction::Load>(0, 0);   // r0 = 0 (i)
+  blocks[0].append<Bytecode::Instruction::Load>(1, 10);  // r1 = 10 (s)
+  blocks[0].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[1].append<Bytecode::Instruction::LessThanImmediate>(2, 0, 5);  // r2 = i < 5
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(2, 2, 3);
+
+  blocks[2].append<Bytecode::Instruction::AddImmediate>(0, 0, 1);       // i = i + 1
+  blocks[2].append<Bytecode::Instruction::SubtractImmediate>(1, 1, 2);  // s = s - 2
+  blocks[2].append<Bytecode::Instruction::Jump>(1);
+
+  blocks[3].append<Bytecode::Instruction::Add>(3, 0, 1);  // r3 = i + s
+  blocks[3].append<Bytecode::Instruction::Return>(3);
+
+  BytecodeInterpreter interp;
+  interp.set_opcode_profiling(true);
+  REQUIRE(interp.interpret(blocks) == 5);
+  const auto plain = interp.opcode_profile();
+  // 3 entry, 6 * 2 header, 5 * 3 body and 2 exit instructions.
+  REQUIRE(plain.dispatches == 32);
+  REQUIRE(plain.operations == plain.dispatches);
+  REQUIRE(plain.pairs[pair(Type::SubtractImmediate, Type::Jump)] == 5);
+  REQUIRE(plain.pairs[pair(Type::Add, Type::Return)] == 1);
+
+  BytecodeOptimizer opt;
+  opt.form_superinstructions(blocks);
+  REQUIRE(interp.interpret(blocks) == 5);
+  const auto fused = interp.opcode_profile();
+  REQUIRE(fused.operations == plain.operations);
+  REQUIRE(fused.dispatches == plain.dispatches - 7);
+  REQUIRE(fused.pairs[pair(Type::SubtractImmediate, Type::Jump)] == 0);
+
+  std::ostringstream out;
+  fused.dump(out);
+  REQUIRE(out.str().find("hottest pairs:") != std::string::npos);
+  REQUIRE(out.str().find("AddImmediate AddImmediateJump") != std::string::npos);
+}
@@ -0,0 +1,158 @@
+#include "test_optimizer_helpers.h"
+
+// ============================================================
+// Pass -0.5: Tail-Recursion Elimination
+// ============================================================
+
+TEST_CASE("tre_rewrites_self_tail_call_into_loop") {
+  // 0: return swap_down(3, 4, 7)
+  // 1: swap_down(a, b, n): if n == 0
+  // 2:   return a * 100 + b
+  // 3: return swap_down(b, a, n - 1)
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 3);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 4);
+  blocks[0].append<Bytecode::Instruction::Load>(2, 7);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      3, 1, std::vector<Bytecode::Register>{0, 1, 2}, std::vector<Bytecode::Register>{0, 1, 2});
+  blocks[0].append<Bytecode::Instruction::Return>(3);
+  blocks[1].append<Bytecode::Instruction::EqualImmediate>(3, 2, 0);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(3, 2, 3);
+  blocks[2].append<Bytecode::Instruction::MultiplyImmediate>(4, 0, 100);
+  blocks[2].append<Bytecode::Instruction::Add>(4, 4, 1);
+  blocks[2].append<Bytecode::Instruction::Return>(4);
+  blocks[3].append<Bytecode::Instruction::SubtractImmediate>(5, 2, 1);
+  blocks[3].append<Bytecode::Instruction::Call>(
+      6, 1, std::vector<Bytecode::Register>{1, 0, 5}, std::vector<Bytecode::Register>{0, 1, 2});
+  blocks[3].append<Bytecode::Instruction::Return>(6);
+
+  BytecodeOptimizer opt;
+  opt.tail_recursion_elimination(blocks);
+
+  // Calls still enter through a new jump-only block in front of the old
+  // entry, and the self call became moves plus a back edge.
+  REQUIRE(blocks.size() == 5);
+  const auto &call = static_cast<const Bytecode::Instruction::Call &>(*blocks[0].instructions[3]);
+  REQUIRE(call.label == 1);
+  REQUIRE(blocks[1].instructions.size() == 1);
+  REQUIRE(static_cast<const Bytecode::Instruction::Jump &>(*blocks[1].instructions[0]).label == 2);
+  const auto &branch =
+      static_cast<const Bytecode::Instruction::JumpConditional &>(*blocks[2].instructions[1]);
+  REQUIRE(branch.label1 == 3);
+  REQUIRE(branch.label2 == 4);
+
+  // n moves first; swapping a and b goes through register 7, just past the
+  // function's frame.
+  const auto &body = blocks[4].instructions;
+  REQUIRE(body.size() == 6);
+  const std::vector<std::pair<Bytecode::Register, Bytecode::Register>> expected = {
+      {2, 5}, {7, 0}, {0, 1}, {1, 7}};
+  for (size_t i = 0; i < expected.size(); ++i) {
+    REQUIRE(body[i + 1]->type() == Type::Move);
+    const auto &move = static_cast<const Bytecode::Instruction::Move &>(*body[i + 1]);
+    REQUIRE(move.dst == expected[i].first);
+    REQUIRE(move.src == expected[i].second);
+  }
+  REQUIRE(static_cast<const Bytecode::Instruction::Jump &>(*body[5]).label == 2);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 403);
+}
+
+TEST_CASE("tre_rewrites_tail_call_instructions_too") {
+  // 0: return swap_down(3, 4, 7)
+  // 1: swap_down(a, b, n): if n == 0
+  // 2:   return a * 100 + b
+  // 3: return swap_down(b, a, n - 1)
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 3);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 4);
+  blocks[0].append<Bytecode::Instruction::Load>(2, 7);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      3, 1, std::vector<Bytecode::Register>{0, 1, 2}, std::vector<Bytecode::Register>{0, 1, 2});
+  blocks[0].append<Bytecode::Instruction::Return>(3);
+  blocks[1].append<Bytecode::Instruction::EqualImmediate>(3, 2, 0);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(3, 2, 3);
+  blocks[2].append<Bytecode::Instruction::MultiplyImmediate>(4, 0, 100);
+  blocks[2].append<Bytecode::Instruction::Add>(4, 4, 1);
+  blocks[2].append<Bytecode::Instruction::Return>(4);
+  blocks[3].append<Bytecode::Instruction::SubtractImmediate>(5, 2, 1);
+  blocks[3].append<Bytecode::Instruction::Call>(
+      6, 1, std::vector<Bytecode::Register>{1, 0, 5}, std::vector<Bytecode::Register>{0, 1, 2});
+  blocks[3].append<Bytecode::Instruction::Return>(6);
+
+  BytecodeOptimizer opt;
+  opt.tail_call_optimization(blocks);
+  REQUIRE(has_instruction_type(blocks, Type::TailCall));
+  opt.tail_recursion_elimination(blocks);
+
+  // Only the program entry's call to swap_down is still a tail call.
+  REQUIRE(blocks[0].instructions.back()->type() == Type::TailCall);
+  REQUIRE(blocks[4].instructions.back()->type() == Type::Jump);
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 403);
+}
+
+TEST_CASE("tre_skips_functions_that_take_register_addresses") {
+  // 0: return swap_down(3, 4, 7)
+  // 1: swap_down(a, b, n): if n == 0
+  // 2:   return a * 100 + b
+  // 3: p = &a; return swap_down(b, a, n - 1)
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 3);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 4);
+  blocks[0].append<Bytecode::Instruction::Load>(2, 7);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      3, 1, std::vector<Bytecode::Register>{0, 1, 2}, std::vector<Bytecode::Register>{0, 1, 2});
+  blocks[0].append<Bytecode::Instruction::Return>(3);
+  blocks[1].append<Bytecode::Instruction::EqualImmediate>(3, 2, 0);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(3, 2, 3);
+  blocks[2].append<Bytecode::Instruction::MultiplyImmediate>(4, 0, 100);
+  blocks[2].append<Bytecode::Instruction::Add>(4, 4, 1);
+  blocks[2].append<Bytecode::Instruction::Return>(4);
+  blocks[3].append<Bytecode::Instruction::AddressOf>(7, 0);
+  blocks[3].append<Bytecode::Instruction::SubtractImmediate>(5, 2, 1);
+  blocks[3].append<Bytecode::Instruction::Call>(
+      6, 1, std::vector<Bytecode::Register>{1, 0, 5}, std::vector<Bytecode::Register>{0, 1, 2});
+  blocks[3].append<Bytecode::Instruction::Return>(6);
+
+  BytecodeOptimizer opt;
+  opt.tail_recursion_elimination(blocks);
+
+  REQUIRE(blocks.size() == 4);
+  REQUIRE(blocks[3].instructions[2]->type() == Type::Call);
+}
+
+TEST_CASE("tre_exposes_recursion_to_loop_invariant_code_motion") {
+  // 0: return scale_sum(10, 0, 5)
+  // 1: scale_sum(n, acc, k): if n == 0
+  // 2:   return acc
+  // 3: return scale_sum(n - 1, acc + k * 3, k)
+  std::vector<Bytecode::BasicBlock> blocks(4);
+  blocks[0].append<Bytecode::Instruction::Load>(0, 10);
+  blocks[0].append<Bytecode::Instruction::Load>(1, 0);
+  blocks[0].append<Bytecode::Instruction::Load>(2, 5);
+  blocks[0].append<Bytecode::Instruction::Call>(
+      3, 1, std::vector<Bytecode::Register>{0, 1, 2}, std::vector<Bytecode::Register>{0, 1, 2});
+  blocks[0].append<Bytecode::Instruction::Return>(3);
+  blocks[1].append<Bytecode::Instruction::EqualImmediate>(3, 0, 0);
+  blocks[1].append<Bytecode::Instruction::JumpConditional>(3, 2, 3);
+  blocks[2].append<Bytecode::Instruction::Return>(1);
+  blocks[3].append<Bytecode::Instruction::MultiplyImmediate>(4, 2, 3);
+  blocks[3].append<Bytecode::Instruction::Add>(5, 1, 4);
+  blocks[3].append<Bytecode::Instruction::SubtractImmediate>(6, 0, 1);
+  blocks[3].append<Bytecode::Instruction::TailCall>(
+      1, std::vector<Bytecode::Register>{6, 5, 2}, std::vector<Bytecode::Register>{0, 1, 2});
+
+  BytecodeOptimizer opt;
+  opt.tail_recursion_elimination(blocks);
+  opt.loop_invariant_code_motion(blocks);
+
+  // k is passed through unchanged, so k * 3 moves to the pre-header.
+  REQUIRE(blocks[1].instructions.size() == 2);
+  REQUIRE(blocks[1].instructions[0]->type() == Type::MultiplyImmediate);
+  REQUIRE(blocks[1].instructions[1]->type() == Type::Jump);
+
+  BytecodeInterpreter interp;
+  REQUIRE(interp.interpret(blocks) == 150);
+}
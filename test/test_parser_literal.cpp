@@ -444,6 +444,22 @@ TEST_CASE("test_parser_parses_struct_literal_field_access_expression") {
   REQUIRE(struct_literal.fields[1].second->type == Ast::Type::Literal);
 }
 
+TEST_CASE("test_parser_parses_field_assignment_statement") {
+  ErrorReporter reporter;
+  Parser parser("point.x = point.x + 1;", reporter);
+  std::unique_ptr<Ast::Block> program = parser.parse_program();
+
+  REQUIRE(program != nullptr);
+  REQUIRE(!reporter.has_errors());
+  REQUIRE(program->children.size() == 1);
+  REQUIRE(program->children[0]->type == Ast::Type::FieldAssignment);
+
+  const auto &assignment = derived_cast<const Ast::FieldAssignment &>(*program->children[0]);
+  REQUIRE(assignment.field == "x");
+  REQUIRE(assignment.object->type == Ast::Type::Variable);
+  REQUIRE(assignment.value->type == Ast::Type::Add);
+}
+
 TEST_CASE("test_parser_reports_missing_colon_in_struct_literal_field") {
   ErrorReporter reporter;
   Parser parser("struct { x 1 }", reporter);
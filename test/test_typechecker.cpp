@@ -65,6 +65,15 @@ point.y;
   REQUIRE(errors == std::vector<kai::Error::Type>{kai::Error::Type::UndefinedField});
 }
 
+TEST_CASE("type_checker_reports_undefined_field_assignment") {
+  const auto errors = typecheck_source(R"(
+let point = struct { x: 1 };
+point.x = 2;
+point.y = 3;
+)");
+  REQUIRE(errors == std::vector<kai::Error::Type>{kai::Error::Type::UndefinedField});
+}
+
 TEST_CASE("type_checker_reports_type_mismatch_assigning_non_struct_to_struct") {
   const auto errors = typecheck_source(R"(
 let point = struct { x: 1 };